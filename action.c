@@ -332,6 +332,7 @@ rsRetVal actionDestruct(action_t * const pThis)
 
 	pthread_mutex_destroy(&pThis->mutAction);
 	pthread_mutex_destroy(&pThis->mutWrkrDataTable);
+	histogramExit(&pThis->histProc);
 	d_free(pThis->pszName);
 	d_free(pThis->ppTpl);
 	d_free(pThis->peParamPassing);
@@ -388,6 +389,7 @@ rsRetVal actionConstruct(action_t **ppThis)
 	pthread_mutex_init(&pThis->mutAction, NULL);
 	pthread_mutex_init(&pThis->mutWrkrDataTable, NULL);
 	INIT_ATOMIC_HELPER_MUT(pThis->mutCAS);
+	histogramInit(&pThis->histProc);
 
 	/* indicate we have a new action */
 	++iActionNbr;
@@ -398,6 +400,15 @@ finalize_it:
 }
 
 
+/* called before the action stats are read */
+static void
+actionStatsPreRead(statsobj_t __attribute__((unused)) *stats, void *ctx)
+{
+	action_t *pThis = (action_t*) ctx;
+	histogramUpdateCounters(&pThis->histProc);
+}
+
+
 /* action construction finalizer
  */
 rsRetVal
@@ -460,6 +471,9 @@ actionConstructFinalize(action_t *__restrict__ const pThis, struct nvlst *lst)
 	CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("resumed"),
 		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pThis->ctrResume));
 
+	CHKiRet(histogramAddCounters(&pThis->histProc, &statsobj, pThis->statsobj, "proctime"));
+	CHKiRet(statsobj.SetPreReadNotifier(pThis->statsobj, actionStatsPreRead, pThis));
+
 	CHKiRet(statsobj.ConstructFinalize(pThis->statsobj));
 
 	/* create our queue */
@@ -650,6 +664,17 @@ static void actionCommitted(action_t * const pThis, wti_t * const pWti)
 }
 
 
+/* tell the queue whose worker runs the action that the action ran into
+ * trouble. This is the action queue, or the main/ruleset queue if the action
+ * has none. Dummy workers (direct mode) do not belong to a queue.
+ */
+static inline void
+actionDeqBatchBackoff(wti_t * const pWti)
+{
+	if(pWti->pWtp != NULL)
+		qqueueDeqBatchBackoff((qqueue_t*) pWti->pWtp->pUsr);
+}
+
 /* set action to "rtry" state.
  * rgerhards, 2007-08-02
  */
@@ -657,6 +682,7 @@ static void actionRetry(action_t * const pThis, wti_t * const pWti)
 {
 	actionSetState(pThis, pWti, ACT_STATE_RTRY);
 	incActionResumeInRow(pWti, pThis);
+	actionDeqBatchBackoff(pWti);
 }
 
 /* Suspend action, this involves changing the action state as well
@@ -694,6 +720,7 @@ actionSuspend(action_t * const pThis, wti_t * const pWti)
 	suspendDuration = pThis->iResumeInterval * (getActionNbrResRtry(pWti, pThis) / 10 + 1);
 	pThis->ttResumeRtry = ttNow + suspendDuration;
 	actionSetState(pThis, pWti, ACT_STATE_SUSP);
+	actionDeqBatchBackoff(pWti);
 	pThis->ctrSuspendDuration += suspendDuration;
 	if(getActionNbrResRtry(pWti, pThis) == 0) {
 		STATSCOUNTER_INC(pThis->ctrSuspend, pThis->mutCtrSuspend);
@@ -1266,6 +1293,43 @@ actionWriteErrorFile(action_t *__restrict__ const pThis, wti_t *__restrict__ con
 }
 
 
+/* remember a traced message that is part of the current transaction, so
+ * that the commit can be recorded in its trace.
+ */
+static void
+actionTraceAddPending(action_t *__restrict__ const pThis, wti_t *__restrict__ const pWti, msg_t *pMsg)
+{
+	actWrkrInfo_t *const wrkrInfo = &pWti->actWrkrInfo[pThis->iActionNbr];
+
+	if(wrkrInfo->nTracedMsgs < TRACE_MAX_PENDING)
+		wrkrInfo->tracedMsgs[wrkrInfo->nTracedMsgs++] = MsgAddRef(pMsg);
+}
+
+
+/* record the commit in the traces of the messages in this transaction
+ * (if ttStart is not 0) and release them.
+ */
+static void
+actionTraceCommit(action_t *__restrict__ const pThis, wti_t *__restrict__ const pWti, long long ttStart)
+{
+	actWrkrInfo_t *const wrkrInfo = &pWti->actWrkrInfo[pThis->iActionNbr];
+	long long ttEnd;
+	int i;
+
+	ttEnd = currentMonotonicUsecs();
+	for(i = 0 ; i < wrkrInfo->nTracedMsgs ; ++i) {
+		if(ttStart != 0) {
+			traceAddEvt(wrkrInfo->tracedMsgs[i]->pTrace, TRACE_COMMIT_BEGIN,
+				pThis->pszName, -1, ttStart);
+			traceAddEvt(wrkrInfo->tracedMsgs[i]->pTrace, TRACE_COMMIT_END,
+				pThis->pszName, -1, ttEnd);
+		}
+		msgDestruct(&wrkrInfo->tracedMsgs[i]);
+	}
+	wrkrInfo->nTracedMsgs = 0;
+}
+
+
 /* Note: we currently need to return an iRet, as this is used in 
  * direct mode. TODO: However, it may be worth further investigating this,
  * as it looks like there is no ultimate consumer of this code.
@@ -1275,6 +1339,8 @@ static rsRetVal
 actionCommit(action_t *__restrict__ const pThis, wti_t *__restrict__ const pWti)
 {
 	sbool bDone;
+	sbool bCommitted = 0;
+	long long ttStart = 0;
 	DEFiRet;
 
 	if(!pThis->isTransactional ||
@@ -1297,11 +1363,14 @@ actionCommit(action_t *__restrict__ const pThis, wti_t *__restrict__ const pWti)
 		any of these partial implementations).
 		rgerhards, 2013-11-04
 	 */
+	ttStart = currentMonotonicUsecs();
 	bDone = 0;
 	do {
 		iRet = actionTryCommit(pThis, pWti);
 		DBGPRINTF("actionCommit, action %d, in retry loop, iRet %d\n",
 			pThis->iActionNbr, iRet);
+		if(iRet == RS_RET_OK)
+			bCommitted = 1;
 		if(iRet == RS_RET_FORCE_TERM) {
 			ABORT_FINALIZE(RS_RET_FORCE_TERM);
 		} else if(iRet == RS_RET_SUSPENDED) {
@@ -1323,7 +1392,15 @@ actionCommit(action_t *__restrict__ const pThis, wti_t *__restrict__ const pWti)
 			bDone = 1;
 		}
 	} while(!bDone);
+	histogramRecord(&pThis->histProc, currentMonotonicUsecs() - ttStart);
 finalize_it:
+	if(ttStart != 0 && !bCommitted && pThis->pMod->mod.om.abortTransaction != NULL
+	   && pWti->actWrkrInfo[pThis->iActionNbr].actWrkrData != NULL) {
+		/* we give up on this batch, the next commit brings new messages */
+		pThis->pMod->mod.om.abortTransaction(pWti->actWrkrInfo[pThis->iActionNbr].actWrkrData);
+	}
+	if(pWti->actWrkrInfo[pThis->iActionNbr].nTracedMsgs > 0)
+		actionTraceCommit(pThis, pWti, ttStart);
 	pWti->actWrkrInfo[pThis->iActionNbr].p.tx.currIParam = 0; /* reset to beginning */
 	RETiRet;
 }
@@ -1358,8 +1435,10 @@ processMsgMain(action_t *__restrict__ const pAction,
 	msg_t *__restrict__ const pMsg,
 	struct syslogTime *ttNow)
 {
+	long long ttStart;
 	DEFiRet;
 
+	TRACE_EVT(pMsg, TRACE_ACTION_BEGIN, pAction->pszName);
 	CHKiRet(prepareDoActionParams(pAction, pWti, pMsg, ttNow));
 
 	if(pAction->isTransactional) {
@@ -1367,12 +1446,20 @@ processMsgMain(action_t *__restrict__ const pAction,
 		DBGPRINTF("action '%s': is transactional - executing in commit phase\n", pAction->pszName);
 		actionPrepare(pAction, pWti);
 		iRet = getReturnCode(pAction, pWti);
+		if(pMsg->pTrace != NULL) {
+			/* for transactions, the message is only buffered here */
+			traceAddEvt(pMsg->pTrace, TRACE_ACTION_END, pAction->pszName, -1, 0);
+			actionTraceAddPending(pAction, pWti, pMsg);
+		}
 		FINALIZE;
 	}
 
+	ttStart = currentMonotonicUsecs();
 	iRet = actionProcessMessage(pAction,
 				    pWti->actWrkrInfo[pAction->iActionNbr].p.nontx.actParams,
 				    pWti);
+	histogramRecord(&pAction->histProc, currentMonotonicUsecs() - ttStart);
+	TRACE_EVT(pMsg, TRACE_ACTION_END, pAction->pszName);
 	if(pAction->bNeedReleaseBatch)
 		releaseDoActionParams(pAction, pWti);
 finalize_it:
@@ -85,6 +85,7 @@ struct action_s {
 	STATSCOUNTER_DEF(ctrSuspend, mutCtrSuspend)
 	STATSCOUNTER_DEF(ctrSuspendDuration, mutCtrSuspendDuration)
 	STATSCOUNTER_DEF(ctrResume, mutCtrResume)
+	histogram_t histProc;	/* time spent in the output module, per call */
 };
 
 
@@ -1382,6 +1382,191 @@ varFreeMembers(const struct var *r)
 }
 
 
+/* A string view borrows the storage of a message property instead of
+ * copying it into a new es_str_t. This saves a malloc and memcpy for
+ * the very common case where a property is just inspected (compared,
+ * searched, matched). Views are only available for properties which are
+ * not JSON-based; everything else needs the regular evaluation.
+ * The string is always NUL-terminated.
+ */
+struct strview {
+	uchar *str;
+	rs_size_t len;
+	unsigned short bMustFree; /* str was generated for us, free() when done */
+};
+
+/* obtain a view of the expression if it is a plain message property.
+ * Returns 1 if so, 0 otherwise.
+ */
+static int
+evalVarView(struct cnfexpr *__restrict__ const expr, void *__restrict__ const usrptr,
+	struct strview *__restrict__ const v)
+{
+	struct cnfvar *var;
+
+	if(expr->nodetype != 'V')
+		return 0;
+	var = (struct cnfvar*) expr;
+	if(var->prop.id == PROP_CEE        ||
+	   var->prop.id == PROP_LOCAL_VAR  ||
+	   var->prop.id == PROP_GLOBAL_VAR   )
+		return 0;
+	v->bMustFree = 0;
+	v->str = (uchar*) MsgGetProp((msg_t*)usrptr, NULL, &var->prop, &v->len, &v->bMustFree, NULL);
+	DBGPRINTF("rainerscript: (view) var %d: '%s'\n", var->prop.id, v->str);
+	return 1;
+}
+
+static inline void
+strviewFree(struct strview *__restrict__ const v)
+{
+	if(v->bMustFree)
+		free(v->str);
+}
+
+/* check if the view contains the needle, semantics like es_str(Case)Contains() */
+static int
+strviewContains(const struct strview *__restrict__ const v, es_str_t *__restrict__ const needle,
+	const int bCaseInsensitive)
+{
+	const uchar *const n = es_getBufAddr(needle);
+	const rs_size_t lenN = es_strlen(needle);
+	rs_size_t i, j;
+
+	if(v->len < lenN)
+		return 0;
+	for(i = 0 ; i <= v->len - lenN ; ++i) {
+		if(bCaseInsensitive) {
+			for(j = 0 ; j < lenN && tolower(v->str[i+j]) == tolower(n[j]) ; ++j)
+				/* just scan */;
+		} else {
+			for(j = 0 ; j < lenN && v->str[i+j] == n[j] ; ++j)
+				/* just scan */;
+		}
+		if(j == lenN)
+			return 1;
+	}
+	return 0;
+}
+
+static int
+strviewStartsWith(const struct strview *__restrict__ const v, es_str_t *__restrict__ const prefix,
+	const int bCaseInsensitive)
+{
+	const uchar *const p = es_getBufAddr(prefix);
+	const rs_size_t lenP = es_strlen(prefix);
+	rs_size_t i;
+
+	if(v->len < lenP)
+		return 0;
+	if(!bCaseInsensitive)
+		return memcmp(v->str, p, lenP) == 0;
+	for(i = 0 ; i < lenP ; ++i) {
+		if(tolower(v->str[i]) != tolower(p[i]))
+			return 0;
+	}
+	return 1;
+}
+
+/* compare a view against a single string, for the operations supported by
+ * evalStrOpOnView(). Returns the boolean result.
+ */
+static int
+strviewCmp(const struct strview *__restrict__ const v, es_str_t *__restrict__ const estr,
+	const unsigned cmpop)
+{
+	switch(cmpop) {
+	case CMP_EQ:
+		return es_strbufcmp(estr, v->str, v->len) == 0;
+	case CMP_NE:
+		return es_strbufcmp(estr, v->str, v->len) != 0;
+	case CMP_STARTSWITH:
+		return strviewStartsWith(v, estr, 0);
+	case CMP_STARTSWITHI:
+		return strviewStartsWith(v, estr, 1);
+	case CMP_CONTAINS:
+		return strviewContains(v, estr, 0);
+	case CMP_CONTAINSI:
+		return strviewContains(v, estr, 1);
+	default:
+		return 0;
+	}
+}
+
+/* array version of strviewCmp(), semantics like evalStrArrayCmp(). The
+ * array is sorted by es_strcmp(), so we can do a binary search for (in)equality.
+ */
+static int
+strviewArrayCmp(const struct strview *__restrict__ const v, const struct cnfarray *__restrict__ const ar,
+	const unsigned cmpop)
+{
+	int lo, hi, mid, c;
+	int i;
+	int r = 0;
+
+	if(cmpop == CMP_EQ || cmpop == CMP_NE) {
+		lo = 0;
+		hi = ar->nmemb - 1;
+		while(lo <= hi) {
+			mid = lo + (hi - lo) / 2;
+			c = es_strbufcmp(ar->arr[mid], v->str, v->len);
+			if(c == 0) {
+				r = 1;
+				break;
+			} else if(c < 0) {
+				lo = mid + 1;
+			} else {
+				hi = mid - 1;
+			}
+		}
+		if(cmpop == CMP_NE)
+			r = !r;
+	} else {
+		for(i = 0 ; (r == 0) && (i < ar->nmemb) ; ++i) {
+			r = strviewCmp(v, ar->arr[i], cmpop);
+		}
+	}
+	return r;
+}
+
+/* evaluate a string comparison whose left-hand side is a plain message
+ * property via a view. Returns 1 if this was possible, 0 if the caller must
+ * use the regular path. For (in)equality, we can only do this if the
+ * right-hand side is a constant, because otherwise a numerical comparison
+ * may be required.
+ */
+static int
+evalStrOpOnView(const struct cnfexpr *__restrict__ const expr, struct var *__restrict__ const ret,
+	void *__restrict__ const usrptr)
+{
+	struct strview v;
+	struct var r;
+	es_str_t *estr_r;
+	int bMustFree;
+
+	if((expr->nodetype == CMP_EQ || expr->nodetype == CMP_NE)
+	   && expr->r->nodetype != 'S' && expr->r->nodetype != 'A')
+		return 0;
+	if(!evalVarView(expr->l, usrptr, &v))
+		return 0;
+
+	ret->datatype = 'N';
+	if(expr->r->nodetype == 'A') {
+		ret->d.n = strviewArrayCmp(&v, (struct cnfarray*) expr->r, expr->nodetype);
+	} else if(expr->r->nodetype == 'S') {
+		ret->d.n = strviewCmp(&v, ((struct cnfstringval*)expr->r)->estr, expr->nodetype);
+	} else {
+		cnfexprEval(expr->r, &r, usrptr);
+		estr_r = var2String(&r, &bMustFree);
+		ret->d.n = strviewCmp(&v, estr_r, expr->nodetype);
+		if(bMustFree) es_deleteStr(estr_r);
+		varFreeMembers(&r);
+	}
+	strviewFree(&v);
+	return 1;
+}
+
+
 static rsRetVal
 doExtractFieldByChar(uchar *str, uchar delim, const int matchnbr, uchar **resstr)
 {
@@ -1722,6 +1907,7 @@ doFuncCall(struct cnffunc *__restrict__ const func, struct var *__restrict__ con
 	uchar *resStr;
 	int retval;
 	struct var r[CNFFUNC_MAX_ARGS];
+	struct strview view;
 	int delim;
 	int matchnbr;
 	struct funcData_prifilt *pPrifilt;
@@ -1827,9 +2013,17 @@ doFuncCall(struct cnffunc *__restrict__ const func, struct var *__restrict__ con
 		DBGPRINTF("JSONorString: cnum node type %c result %d\n", func->expr[0]->nodetype, (int) ret->d.n);
 		break;
 	case CNFFUNC_RE_MATCH:
-		cnfexprEval(func->expr[0], &r[0], usrptr);
-		str = (char*) var2CString(&r[0], &bMustFree);
-		retval = regexp.regexec(func->funcdata, str, 0, NULL, 0);
+		if(evalVarView(func->expr[0], usrptr, &view)) {
+			retval = regexp.regexec(func->funcdata, (char*) view.str, 0, NULL, 0);
+			strviewFree(&view);
+			r[0].datatype = 'N'; /* nothing to free */
+			bMustFree = 0;
+			str = NULL;
+		} else {
+			cnfexprEval(func->expr[0], &r[0], usrptr);
+			str = (char*) var2CString(&r[0], &bMustFree);
+			retval = regexp.regexec(func->funcdata, str, 0, NULL, 0);
+		}
 		if(retval == 0)
 			ret->d.n = 1;
 		else {
@@ -1849,10 +2043,17 @@ doFuncCall(struct cnffunc *__restrict__ const func, struct var *__restrict__ con
 		doFunc_exec_template(func, ret, (msg_t*) usrptr);
 		break;
 	case CNFFUNC_FIELD:
-		cnfexprEval(func->expr[0], &r[0], usrptr);
+		if(evalVarView(func->expr[0], usrptr, &view)) {
+			/* we "own" the view string for the rest of this call */
+			r[0].datatype = 'N';
+			str = (char*) view.str;
+			bMustFree = view.bMustFree;
+		} else {
+			cnfexprEval(func->expr[0], &r[0], usrptr);
+			str = (char*) var2CString(&r[0], &bMustFree);
+		}
 		cnfexprEval(func->expr[1], &r[1], usrptr);
 		cnfexprEval(func->expr[2], &r[2], usrptr);
-		str = (char*) var2CString(&r[0], &bMustFree);
 		matchnbr = var2Number(&r[2], NULL);
 		if(r[1].datatype == 'S') {
 			char *delimstr;
@@ -2093,6 +2294,8 @@ cnfexprEval(const struct cnfexpr *__restrict__ const expr, struct var *__restric
 	 * places flagged with "CMP" need to be changed.
 	 */
 	case CMP_EQ:
+		if(evalStrOpOnView(expr, ret, usrptr))
+			break;
 		/* this is optimized in regard to right param as a PoC for all compOps
 		 * So this is a NOT yet the copy template!
 		 */
@@ -2161,6 +2364,8 @@ cnfexprEval(const struct cnfexpr *__restrict__ const expr, struct var *__restric
 		varFreeMembers(&l);
 		break;
 	case CMP_NE:
+		if(evalStrOpOnView(expr, ret, usrptr))
+			break;
 		cnfexprEval(expr->l, &l, usrptr);
 		cnfexprEval(expr->r, &r, usrptr);
 		ret->datatype = 'N';
@@ -2407,6 +2612,8 @@ cnfexprEval(const struct cnfexpr *__restrict__ const expr, struct var *__restric
 		FREE_BOTH_RET;
 		break;
 	case CMP_STARTSWITH:
+		if(evalStrOpOnView(expr, ret, usrptr))
+			break;
 		PREP_TWO_STRINGS;
 		ret->datatype = 'N';
 		if(expr->r->nodetype == 'A') {
@@ -2418,6 +2625,8 @@ cnfexprEval(const struct cnfexpr *__restrict__ const expr, struct var *__restric
 		FREE_TWO_STRINGS;
 		break;
 	case CMP_STARTSWITHI:
+		if(evalStrOpOnView(expr, ret, usrptr))
+			break;
 		PREP_TWO_STRINGS;
 		ret->datatype = 'N';
 		if(expr->r->nodetype == 'A') {
@@ -2429,6 +2638,8 @@ cnfexprEval(const struct cnfexpr *__restrict__ const expr, struct var *__restric
 		FREE_TWO_STRINGS;
 		break;
 	case CMP_CONTAINS:
+		if(evalStrOpOnView(expr, ret, usrptr))
+			break;
 		PREP_TWO_STRINGS;
 		ret->datatype = 'N';
 		if(expr->r->nodetype == 'A') {
@@ -2440,6 +2651,8 @@ cnfexprEval(const struct cnfexpr *__restrict__ const expr, struct var *__restric
 		FREE_TWO_STRINGS;
 		break;
 	case CMP_CONTAINSI:
+		if(evalStrOpOnView(expr, ret, usrptr))
+			break;
 		PREP_TWO_STRINGS;
 		ret->datatype = 'N';
 		if(expr->r->nodetype == 'A') {
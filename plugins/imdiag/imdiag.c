@@ -5,7 +5,7 @@
  *
  * File begun on 2008-07-25 by RGerhards
  *
- * Copyright 2008-2014 Adiscon GmbH.
+ * Copyright 2008-2026 Adiscon GmbH.
  *
  * This file is part of rsyslog.
  *
@@ -38,9 +38,15 @@
 #include <sys/socket.h>
 #include <pthread.h>
 #include <semaphore.h>
+#include <time.h>
+#include <dlfcn.h>
 #if HAVE_FCNTL_H
 #include <fcntl.h>
 #endif
+#ifdef HAVE_LINUX_PERF_EVENT_H
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
 #include "rsyslog.h"
 #include "dirty.h"
 #include "cfsysline.h"
@@ -51,6 +57,7 @@
 #include "errmsg.h"
 #include "tcpsrv.h"
 #include "srUtils.h"
+#include "template.h"
 #include "msg.h"
 #include "datetime.h"
 #include "ratelimit.h"
@@ -58,6 +65,11 @@
 #include "lookup.h"
 #include "net.h" /* for permittedPeers, may be removed when this is removed */
 #include "statsobj.h"
+#include "rsconf.h"
+#include "ruleset.h"
+#include "parser.h"
+#include "stream.h"
+#include "rainerscript.h"
 
 MODULE_TYPE_INPUT
 MODULE_TYPE_NOKEEP
@@ -72,6 +84,9 @@ DEFobjCurrIf(errmsg)
 DEFobjCurrIf(datetime)
 DEFobjCurrIf(prop)
 DEFobjCurrIf(statsobj)
+DEFobjCurrIf(ruleset)
+DEFobjCurrIf(parser)
+DEFobjCurrIf(strm)
 
 /* Module static data */
 static tcpsrv_t *pOurTcpsrv = NULL;  /* our TCP server(listener) TODO: change for multiple instances */
@@ -443,6 +458,399 @@ finalize_it:
 	RETiRet;
 }
 
+/* ------------------------------ core benchmark ------------------------------ */
+/* The "benchmark" command runs core processing stages in isolation and
+ * measures them. Messages are processed directly inside this thread, so
+ * neither sockets nor queues add noise. Everything is looked up in the
+ * running config, so the testbench config controls what is measured.
+ * Command format:
+ * benchmark <stage> <number-of-messages> [<name>]
+ * stages are:
+ *   parse-rfc3164, parse-rfc5424 - ParseMsg() on the respective corpus
+ *   template <name>   - tplToString() with the given template
+ *   expr <ruleset>    - cnfexprEval() of the condition of the first
+ *                       statement (which must be an "if") of a ruleset
+ *   lookup <table>    - lookupKey(), key is the message's hostname (or
+ *                       its index for numeric tables)
+ *   serialize         - MsgSerialize(), as done for disk queues
+ * The result is returned as a single JSON object. Cycles and instructions
+ * are taken from the CPU performance counters where available. The number
+ * of memory allocations is only available if rsyslogd runs with the
+ * testbench's liballoccount preloaded. Values that could not be obtained
+ * are reported as null.
+ */
+#define BENCH_CORPUS_SIZE 1000
+#define BENCH_CORPUS_RFC3164 0
+#define BENCH_CORPUS_RFC5424 1
+#define BENCH_CORPUS_MIXED 2 /* alternating, used for stages after the parser */
+
+typedef struct benchCtrs_s {
+	int fdCycles;	/* perf counter file descriptors, -1 if not available */
+	int fdInstr;
+	unsigned long long (*allocCountGet)(void); /* from liballoccount, if preloaded */
+	struct timespec tsStart;
+	uint64_t cyclesStart, instrStart;
+	unsigned long long allocsStart;
+	/* results */
+	long long ns;
+	long long cycles;
+	long long instr;
+	long long allocs;
+} benchCtrs_t;
+
+static int
+benchOpenPerfCtr(const int config)
+{
+#ifdef HAVE_LINUX_PERF_EVENT_H
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = config;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	/* this thread only, on any CPU */
+	return (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+	return -1;
+#endif
+}
+
+static uint64_t
+benchReadPerfCtr(const int fd)
+{
+	uint64_t val = 0;
+	if(fd != -1 && read(fd, &val, sizeof(val)) != sizeof(val))
+		val = 0;
+	return val;
+}
+
+static void
+benchCtrsInit(benchCtrs_t *const pCtrs)
+{
+	memset(pCtrs, 0, sizeof(benchCtrs_t));
+#ifdef HAVE_LINUX_PERF_EVENT_H
+	pCtrs->fdCycles = benchOpenPerfCtr(PERF_COUNT_HW_CPU_CYCLES);
+	pCtrs->fdInstr = benchOpenPerfCtr(PERF_COUNT_HW_INSTRUCTIONS);
+#else
+	pCtrs->fdCycles = -1;
+	pCtrs->fdInstr = -1;
+#endif
+	pCtrs->allocCountGet = (unsigned long long (*)(void)) dlsym(RTLD_DEFAULT, "allocCountGet");
+	DBGPRINTF("imdiag: benchmark perf counters %savailable, allocation counter %savailable\n",
+		pCtrs->fdCycles == -1 ? "not " : "", pCtrs->allocCountGet == NULL ? "not " : "");
+}
+
+static void
+benchCtrsExit(benchCtrs_t *const pCtrs)
+{
+	if(pCtrs->fdCycles != -1)
+		close(pCtrs->fdCycles);
+	if(pCtrs->fdInstr != -1)
+		close(pCtrs->fdInstr);
+}
+
+static void
+benchStart(benchCtrs_t *const pCtrs)
+{
+	if(pCtrs->allocCountGet != NULL)
+		pCtrs->allocsStart = pCtrs->allocCountGet();
+	pCtrs->cyclesStart = benchReadPerfCtr(pCtrs->fdCycles);
+	pCtrs->instrStart = benchReadPerfCtr(pCtrs->fdInstr);
+	clock_gettime(CLOCK_MONOTONIC, &pCtrs->tsStart);
+}
+
+static void
+benchStop(benchCtrs_t *const pCtrs)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	pCtrs->instr += benchReadPerfCtr(pCtrs->fdInstr) - pCtrs->instrStart;
+	pCtrs->cycles += benchReadPerfCtr(pCtrs->fdCycles) - pCtrs->cyclesStart;
+	if(pCtrs->allocCountGet != NULL)
+		pCtrs->allocs += pCtrs->allocCountGet() - pCtrs->allocsStart;
+	pCtrs->ns += (ts.tv_sec - pCtrs->tsStart.tv_sec) * 1000000000LL
+		   + (ts.tv_nsec - pCtrs->tsStart.tv_nsec);
+}
+
+/* format a per-message value, or null if not available */
+static char *
+benchFmtVal(char *const buf, const size_t lenBuf, const int bAvail,
+	const long long val, const int nMsgs)
+{
+	if(bAvail)
+		snprintf(buf, lenBuf, "%.2f", (double) val / nMsgs);
+	else
+		strcpy(buf, "null");
+	return buf;
+}
+
+/* generate raw message i of the canned corpus. The corpora are always the
+ * same, so results of different runs can be compared.
+ */
+static int
+benchGenRawMsg(uchar *const buf, const size_t lenBuf, const int bRFC5424, const int i)
+{
+	static const char *const months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+					     "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+	const unsigned r = (unsigned) i * 2654435761u; /* cheap deterministic scrambling */
+
+	if(bRFC5424) {
+		return snprintf((char*) buf, lenBuf, "<%u>1 2016-%2.2u-%2.2uT%2.2u:%2.2u:%2.2u.%6.6u+01:00 "
+			"host%u app%u %u ID%u [tcpflood@32473 iut=\"%u\" eventSource=\"Application\" "
+			"eventID=\"%u\"] msgnum:%8.8d: Accepted publickey for user%u from "
+			"10.%u.%u.%u port %u ssh2",
+			r % 192, 1 + r % 12, 1 + r % 28, r % 24, (r >> 5) % 60, (r >> 11) % 60,
+			r % 1000000, i % 50, r % 7, 1000 + r % 30000, r % 90, r % 4,
+			1000 + r % 9000, i, r % 500, r % 256, (r >> 8) % 256, (r >> 16) % 256,
+			1024 + r % 60000);
+	} else {
+		return snprintf((char*) buf, lenBuf, "<%u>%s %2u %2.2u:%2.2u:%2.2u host%u sshd[%u]: "
+			"msgnum:%8.8d: Accepted publickey for user%u from 10.%u.%u.%u port %u ssh2",
+			r % 192, months[r % 12], 1 + r % 28, r % 24, (r >> 5) % 60, (r >> 11) % 60,
+			i % 50, 1000 + r % 30000, i, r % 500, r % 256, (r >> 8) % 256,
+			(r >> 16) % 256, 1024 + r % 60000);
+	}
+}
+
+/* create the (unparsed) message objects for the corpus */
+static rsRetVal
+benchGenMsgs(msg_t **ppMsgs, const int corpus)
+{
+	uchar szMsg[1024];
+	struct syslogTime stTime;
+	time_t ttGenTime;
+	int lenMsg;
+	int i;
+	DEFiRet;
+
+	datetime.getCurrTime(&stTime, &ttGenTime, TIME_IN_LOCALTIME);
+	for(i = 0 ; i < BENCH_CORPUS_SIZE ; ++i) {
+		lenMsg = benchGenRawMsg(szMsg, sizeof(szMsg),
+			(corpus == BENCH_CORPUS_MIXED) ? i % 2 : corpus, i);
+		CHKiRet(msgConstructWithTime(&ppMsgs[i], &stTime, ttGenTime));
+		MsgSetRawMsg(ppMsgs[i], (char*) szMsg, lenMsg);
+		MsgSetInputName(ppMsgs[i], pInputName);
+		MsgSetFlowControlType(ppMsgs[i], eFLOWCTL_NO_DELAY);
+		ppMsgs[i]->msgFlags  = NEEDS_PARSING | PARSE_HOSTNAME;
+		MsgSetRcvFrom(ppMsgs[i], pRcvDummy);
+		CHKiRet(MsgSetRcvFromIP(ppMsgs[i], pRcvIPDummy));
+	}
+
+finalize_it:
+	RETiRet;
+}
+
+static void
+benchDestructMsgs(msg_t **ppMsgs)
+{
+	int i;
+	for(i = 0 ; i < BENCH_CORPUS_SIZE ; ++i) {
+		if(ppMsgs[i] != NULL)
+			msgDestruct(&ppMsgs[i]);
+	}
+}
+
+/* parsing needs fresh messages, so the corpus is re-created for each
+ * round. Only the parsing itself is measured.
+ */
+static rsRetVal
+benchParse(benchCtrs_t *const pCtrs, msg_t **ppMsgs, const int corpus, const int nMsgs)
+{
+	int nDone;
+	int nRound;
+	int i;
+	DEFiRet;
+
+	for(nDone = 0 ; nDone < nMsgs ; nDone += nRound) {
+		nRound = (nMsgs - nDone < BENCH_CORPUS_SIZE) ? nMsgs - nDone : BENCH_CORPUS_SIZE;
+		CHKiRet(benchGenMsgs(ppMsgs, corpus));
+		benchStart(pCtrs);
+		for(i = 0 ; i < nRound ; ++i)
+			parser.ParseMsg(ppMsgs[i]);
+		benchStop(pCtrs);
+		benchDestructMsgs(ppMsgs);
+	}
+
+finalize_it:
+	RETiRet;
+}
+
+static rsRetVal
+benchTemplate(benchCtrs_t *const pCtrs, msg_t **ppMsgs, uchar *const pszName, const int nMsgs)
+{
+	struct template *pTpl;
+	actWrkrIParams_t iparam;
+	int i;
+	DEFiRet;
+
+	memset(&iparam, 0, sizeof(iparam));
+	if((pTpl = tplFind(runConf, (char*) pszName, ustrlen(pszName))) == NULL)
+		ABORT_FINALIZE(RS_RET_NOT_FOUND);
+	benchStart(pCtrs);
+	for(i = 0 ; i < nMsgs ; ++i)
+		CHKiRet(tplToString(pTpl, ppMsgs[i % BENCH_CORPUS_SIZE], &iparam, NULL));
+	benchStop(pCtrs);
+
+finalize_it:
+	free(iparam.param);
+	RETiRet;
+}
+
+static rsRetVal
+benchExpr(benchCtrs_t *const pCtrs, msg_t **ppMsgs, uchar *const pszName, const int nMsgs)
+{
+	ruleset_t *pRuleset;
+	struct cnfexpr *expr;
+	int nTrue = 0;
+	int i;
+	DEFiRet;
+
+	CHKiRet(ruleset.GetRuleset(runConf, &pRuleset, pszName));
+	if(pRuleset->root == NULL || pRuleset->root->nodetype != S_IF)
+		ABORT_FINALIZE(RS_RET_NOT_FOUND);
+	expr = pRuleset->root->d.s_if.expr;
+	benchStart(pCtrs);
+	for(i = 0 ; i < nMsgs ; ++i)
+		nTrue += cnfexprEvalBool(expr, ppMsgs[i % BENCH_CORPUS_SIZE]);
+	benchStop(pCtrs);
+	DBGPRINTF("imdiag: benchmark expression was true for %d of %d messages\n", nTrue, nMsgs);
+
+finalize_it:
+	RETiRet;
+}
+
+static rsRetVal
+benchLookup(benchCtrs_t *const pCtrs, msg_t **ppMsgs, uchar *const pszName, const int nMsgs)
+{
+	lookup_ref_t *pTable;
+	lookup_key_t key;
+	uchar *keys[BENCH_CORPUS_SIZE];
+	es_str_t *val;
+	int bStrKey;
+	int i;
+	DEFiRet;
+
+	if((pTable = lookupFindTable(pszName)) == NULL)
+		ABORT_FINALIZE(RS_RET_NOT_FOUND);
+	bStrKey = (pTable->self->key_type == LOOKUP_KEY_TYPE_STRING);
+	/* make sure we do not measure key extraction */
+	for(i = 0 ; i < BENCH_CORPUS_SIZE ; ++i)
+		keys[i] = (uchar*) getHOSTNAME(ppMsgs[i]);
+	benchStart(pCtrs);
+	for(i = 0 ; i < nMsgs ; ++i) {
+		if(bStrKey)
+			key.k_str = keys[i % BENCH_CORPUS_SIZE];
+		else
+			key.k_uint = i % BENCH_CORPUS_SIZE;
+		val = lookupKey(pTable, key);
+		if(val != NULL)
+			es_deleteStr(val);
+	}
+	benchStop(pCtrs);
+
+finalize_it:
+	RETiRet;
+}
+
+/* serialized messages are written to /dev/null. We do not flush after each
+ * message (as the disk queue does), as we are interested in the serializer,
+ * not the file system.
+ */
+static rsRetVal
+benchSerialize(benchCtrs_t *const pCtrs, msg_t **ppMsgs, const int nMsgs)
+{
+	strm_t *pStrm = NULL;
+	int i;
+	DEFiRet;
+
+	CHKiRet(strm.Construct(&pStrm));
+	CHKiRet(strm.SettOperationsMode(pStrm, STREAMMODE_WRITE));
+	CHKiRet(strm.SetsType(pStrm, STREAMTYPE_FILE_SINGLE));
+	CHKiRet(strm.SetFName(pStrm, UCHAR_CONSTANT("/dev/null"), sizeof("/dev/null") - 1));
+	CHKiRet(strm.ConstructFinalize(pStrm));
+	benchStart(pCtrs);
+	for(i = 0 ; i < nMsgs ; ++i)
+		CHKiRet((objSerialize(ppMsgs[i % BENCH_CORPUS_SIZE]))(ppMsgs[i % BENCH_CORPUS_SIZE], pStrm));
+	benchStop(pCtrs);
+	CHKiRet(strm.Flush(pStrm));
+
+finalize_it:
+	if(pStrm != NULL)
+		strm.Destruct(&pStrm);
+	RETiRet;
+}
+
+/* This function runs a core benchmark. See comment at top of this section
+ * for details.
+ */
+static rsRetVal
+runBenchmark(uchar *pszCmd, tcps_sess_t *pSess)
+{
+	uchar stage[128];
+	uchar wordBuf[128];
+	uchar name[256];
+	msg_t *pMsgs[BENCH_CORPUS_SIZE];
+	benchCtrs_t ctrs;
+	char bufCycles[64], bufInstr[64], bufAllocs[64];
+	int nMsgs;
+	int i;
+	DEFiRet;
+
+	memset(pMsgs, 0, sizeof(pMsgs));
+	benchCtrsInit(&ctrs);
+	getFirstWord(&pszCmd, stage, sizeof(stage), TO_LOWERCASE);
+	getFirstWord(&pszCmd, wordBuf, sizeof(wordBuf), NO_MODIFY);
+	getFirstWord(&pszCmd, name, sizeof(name), NO_MODIFY);
+	nMsgs = atoi((char*) wordBuf);
+	if(nMsgs < 1)
+		ABORT_FINALIZE(RS_RET_INVALID_PARAMS);
+
+	if(!ustrcmp(stage, UCHAR_CONSTANT("parse-rfc3164"))) {
+		CHKiRet(benchParse(&ctrs, pMsgs, BENCH_CORPUS_RFC3164, nMsgs));
+	} else if(!ustrcmp(stage, UCHAR_CONSTANT("parse-rfc5424"))) {
+		CHKiRet(benchParse(&ctrs, pMsgs, BENCH_CORPUS_RFC5424, nMsgs));
+	} else {
+		/* all other stages work on the parsed mixed corpus */
+		CHKiRet(benchGenMsgs(pMsgs, BENCH_CORPUS_MIXED));
+		for(i = 0 ; i < BENCH_CORPUS_SIZE ; ++i)
+			parser.ParseMsg(pMsgs[i]);
+		if(!ustrcmp(stage, UCHAR_CONSTANT("template"))) {
+			CHKiRet(benchTemplate(&ctrs, pMsgs, name, nMsgs));
+		} else if(!ustrcmp(stage, UCHAR_CONSTANT("expr"))) {
+			CHKiRet(benchExpr(&ctrs, pMsgs, name, nMsgs));
+		} else if(!ustrcmp(stage, UCHAR_CONSTANT("lookup"))) {
+			CHKiRet(benchLookup(&ctrs, pMsgs, name, nMsgs));
+		} else if(!ustrcmp(stage, UCHAR_CONSTANT("serialize"))) {
+			CHKiRet(benchSerialize(&ctrs, pMsgs, nMsgs));
+		} else {
+			ABORT_FINALIZE(RS_RET_INVALID_PARAMS);
+		}
+	}
+
+finalize_it:
+	if(iRet == RS_RET_OK) {
+		sendResponse(pSess, "{ \"stage\": \"%s\", \"name\": \"%s\", \"msgs\": %d, "
+			"\"ns_per_msg\": %.2f, \"cycles_per_msg\": %s, \"instr_per_msg\": %s, "
+			"\"allocs_per_msg\": %s }\n",
+			stage, name, nMsgs, (double) ctrs.ns / nMsgs,
+			benchFmtVal(bufCycles, sizeof(bufCycles), ctrs.fdCycles != -1, ctrs.cycles, nMsgs),
+			benchFmtVal(bufInstr, sizeof(bufInstr), ctrs.fdInstr != -1, ctrs.instr, nMsgs),
+			benchFmtVal(bufAllocs, sizeof(bufAllocs), ctrs.allocCountGet != NULL, ctrs.allocs, nMsgs));
+	} else {
+		errmsg.LogError(0, iRet, "imdiag: benchmark '%s' could not be run", stage);
+		sendResponse(pSess, "imdiag::error benchmark '%s' failed with error %d\n", stage, iRet);
+		iRet = RS_RET_OK; /* we have reported it, the session is still fine */
+	}
+	benchDestructMsgs(pMsgs);
+	benchCtrsExit(&ctrs);
+	RETiRet;
+}
+
+/* ---------------------------- end core benchmark ---------------------------- */
+
 /* Function to handle received messages. This is our core function!
  * rgerhards, 2009-05-24
  */
@@ -482,6 +890,8 @@ OnMsgReceived(tcps_sess_t *pSess, uchar *pRcv, int iLenMsg)
 		CHKiRet(blockStatsReporting(pSess));
 	} else if(!ustrcmp(cmdBuf, UCHAR_CONSTANT("awaitstatsreport"))) {
 		CHKiRet(awaitStatsReport(pszMsg, pSess));
+	} else if(!ustrcmp(cmdBuf, UCHAR_CONSTANT("benchmark"))) {
+		CHKiRet(runBenchmark(pszMsg, pSess));
 	} else {
 		dbgprintf("imdiag unkown command '%s'\n", cmdBuf);
 		CHKiRet(sendResponse(pSess, "unkown command '%s'\n", cmdBuf));
@@ -645,6 +1055,9 @@ CODESTARTmodExit
 	objRelease(datetime, CORE_COMPONENT);
 	objRelease(prop, CORE_COMPONENT);
 	objRelease(statsobj, CORE_COMPONENT);
+	objRelease(ruleset, CORE_COMPONENT);
+	objRelease(parser, CORE_COMPONENT);
+	objRelease(strm, CORE_COMPONENT);
 ENDmodExit
 
 
@@ -691,6 +1104,9 @@ CODEmodInit_QueryRegCFSLineHdlr
 	CHKiRet(objUse(datetime, CORE_COMPONENT));
 	CHKiRet(objUse(prop, CORE_COMPONENT));
 	CHKiRet(objUse(statsobj, CORE_COMPONENT));
+	CHKiRet(objUse(ruleset, CORE_COMPONENT));
+	CHKiRet(objUse(parser, CORE_COMPONENT));
+	CHKiRet(objUse(strm, CORE_COMPONENT));
 
 	/* register config file handlers */
 	CHKiRet(omsdRegCFSLineHdlr(UCHAR_CONSTANT("imdiagserverrun"), 0, eCmdHdlrGetWord,
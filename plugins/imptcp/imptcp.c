@@ -53,7 +53,6 @@
 #include <sys/queue.h>
 #include <netinet/tcp.h>
 #include <stdint.h>
-#include <zlib.h>
 #if HAVE_FCNTL_H
 #include <fcntl.h>
 #endif
@@ -68,6 +67,7 @@
 #include "errmsg.h"
 #include "srUtils.h"
 #include "datetime.h"
+#include "strmcomp.h"
 #include "ruleset.h"
 #include "msg.h"
 #include "statsobj.h"
@@ -129,6 +129,7 @@ struct instanceConf_s {
 	int bSPFramingFix;
 	int iAddtlFrameDelim;
 	uint8_t compressionMode;
+	uchar *pszStrmCompDict;		/* zstd dictionary file for stream decompression */
 	uchar *pszBindPort;		/* port to bind to */
 	uchar *pszBindAddr;		/* IP to bind socket to */
 	uchar *pszBindPath;     /* Path to bind socket to */
@@ -178,6 +179,7 @@ static struct cnfparamdescr inppdescr[] = {
 	{ "framingfix.cisco.asa", eCmdHdlrBinary, 0 },
 	{ "notifyonconnectionclose", eCmdHdlrBinary, 0 },
 	{ "compression.mode", eCmdHdlrGetWord, 0 },
+	{ "compression.stream.dictionary", eCmdHdlrString, 0 },
 	{ "keepalive", eCmdHdlrBinary, 0 },
 	{ "keepalive.probes", eCmdHdlrInt, 0 },
 	{ "keepalive.time", eCmdHdlrInt, 0 },
@@ -216,6 +218,8 @@ struct ptcpsrv_s {
 	int iKeepAliveProbes;
 	int iKeepAliveTime;
 	uint8_t compressionMode;
+	uchar *strmCompDict;		/* zstd dictionary (or NULL) */
+	size_t lenStrmCompDict;
 	uchar *pszInputName;
 	uchar *dfltTZ;
 	prop_t *pInputName;		/* InputName in (fast to process) property format */
@@ -239,8 +243,7 @@ struct ptcpsess_s {
 	ptcpsess_t *prev, *next;
 	int sock;
 	epolld_t *epd;
-	sbool bzInitDone; /* did we do an init of zstrm already? */
-	z_stream zstrm;	/* zip stream to use for tcp compression */
+	strmcomp_t *pComp;	/* stream decompressor, created on first use */
 	uint8_t compressionMode;
 //--- from tcps_sess.h
 	int iMsg;		 /* index of next char to store in msg */
@@ -360,6 +363,7 @@ destructSrv(ptcpsrv_t *pSrv)
 		free(pSrv->path);
 	if(pSrv->lstnIP != NULL)
 		free(pSrv->lstnIP);
+	free(pSrv->strmCompDict);
 	free(pSrv);
 }
 
@@ -1010,54 +1014,48 @@ finalize_it:
 	RETiRet;
 }
 
+/* context for submitting decompressed data */
+struct decompCtx_s {
+	ptcpsess_t *pSess;
+	struct syslogTime *stTime;
+	time_t ttGenTime;
+};
+
+/* output function for the stream decompressor */
+static rsRetVal
+submitDecompressed(void *usrptr, uchar *buf, size_t len)
+{
+	struct decompCtx_s *ctx = (struct decompCtx_s*) usrptr;
+	ctx->pSess->pLstn->rcvdDecompressed += len;
+	return DataRcvdUncompressed(ctx->pSess, (char*)buf, len, ctx->stTime, ctx->ttGenTime);
+}
+
+/* the codec is detected from the start of the stream, so we accept
+ * whatever codec the sender has been configured for.
+ */
 static rsRetVal
 DataRcvdCompressed(ptcpsess_t *pThis, char *buf, size_t len)
 {
 	struct syslogTime stTime;
-	time_t ttGenTime;
-	int zRet;	/* zlib return state */
-	unsigned outavail;
-	uchar zipBuf[64*1024]; // TODO: alloc on heap, and much larger (512KiB? batch size!)
+	struct decompCtx_s ctx;
+	ptcpsrv_t *pSrv = pThis->pLstn->pSrv;
 	DEFiRet;
-	// TODO: can we do stats counters? Even if they are not 100% correct under all cases,
-	// by simply updating the input and output sizes?
-	uint64_t outtotal;
-
-	datetime.getCurrTime(&stTime, &ttGenTime, TIME_IN_LOCALTIME);
-	outtotal = 0;
-
-	if(!pThis->bzInitDone) {
-		/* allocate deflate state */
-		pThis->zstrm.zalloc = Z_NULL;
-		pThis->zstrm.zfree = Z_NULL;
-		pThis->zstrm.opaque = Z_NULL;
-		zRet = inflateInit(&pThis->zstrm);
-		if(zRet != Z_OK) {
-			DBGPRINTF("imptcp: error %d returned from zlib/inflateInit()\n", zRet);
-			ABORT_FINALIZE(RS_RET_ZLIB_ERR);
-		}
-		pThis->bzInitDone = RSTRUE;
-	}
-
-	pThis->zstrm.next_in = (Bytef*) buf;
-	pThis->zstrm.avail_in = len;
-	/* run inflate() on buffer until everything has been uncompressed */
-	do {
-		DBGPRINTF("imptcp: in inflate() loop, avail_in %d, total_in %ld\n", pThis->zstrm.avail_in, pThis->zstrm.total_in);
-		pThis->zstrm.avail_out = sizeof(zipBuf);
-		pThis->zstrm.next_out = zipBuf;
-		zRet = inflate(&pThis->zstrm, Z_SYNC_FLUSH);    /* no bad return value */
-		//zRet = inflate(&pThis->zstrm, Z_NO_FLUSH);    /* no bad return value */
-		DBGPRINTF("after inflate, ret %d, avail_out %d\n", zRet, pThis->zstrm.avail_out);
-		outavail = sizeof(zipBuf) - pThis->zstrm.avail_out;
-		if(outavail != 0) {
-			outtotal += outavail;
-			pThis->pLstn->rcvdDecompressed += outavail;
-			CHKiRet(DataRcvdUncompressed(pThis, (char*)zipBuf, outavail, &stTime, ttGenTime));
-		}
-	} while (pThis->zstrm.avail_out == 0);
 
-	dbgprintf("end of DataRcvCompress, sizes: in %lld, out %llu\n", (long long) len, (long long unsigned) outtotal);
+	if(pThis->pComp == NULL) {
+		CHKiRet(strmcompConstruct(&pThis->pComp, STRMCOMP_AUTO, 1, 0,
+			pSrv->strmCompDict, pSrv->lenStrmCompDict));
+	}
+
+	ctx.pSess = pThis;
+	ctx.stTime = &stTime;
+	datetime.getCurrTime(&stTime, &ctx.ttGenTime, TIME_IN_LOCALTIME);
+	iRet = strmcompProcess(pThis->pComp, (uchar*) buf, len, STRMCOMP_NOFLUSH,
+		submitDecompressed, &ctx);
+	if(iRet != RS_RET_OK) {
+		DBGPRINTF("imptcp: error %d decompressing %s stream\n", iRet,
+			strmcompCodecName(strmcompGetCodec(pThis->pComp)));
+	}
+
 finalize_it:
 	RETiRet;
 }
@@ -1236,7 +1234,7 @@ addSess(ptcplstn_t *pLstn, int sock, prop_t *peerName, prop_t *peerIP)
 	pSess->bSPFramingFix = pLstn->bSPFramingFix;
 	pSess->inputState = eAtStrtFram;
 	pSess->iMsg = 0;
-	pSess->bzInitDone = 0;
+	pSess->pComp = NULL;
 	pSess->bAtStrtOfFram = 1;
 	pSess->peerName = peerName;
 	pSess->peerIP = peerIP;
@@ -1266,42 +1264,24 @@ finalize_it:
 }
 
 
-/* finish zlib buffer, to be called before closing the session.
+/* finish decompression, to be called before closing the session.
  */
 static rsRetVal
 doZipFinish(ptcpsess_t *pSess)
 {
-	int zRet;	/* zlib return state */
-	DEFiRet;
-	unsigned outavail;
 	struct syslogTime stTime;
-	uchar zipBuf[32*1024]; // TODO: use "global" one from pSess
+	struct decompCtx_s ctx;
+	DEFiRet;
 
-	if(!pSess->bzInitDone)
+	if(pSess->pComp == NULL)
 		goto done;
 
-	pSess->zstrm.avail_in = 0;
-	/* run inflate() on buffer until everything has been compressed */
-	do {
-		DBGPRINTF("doZipFinish: in inflate() loop, avail_in %d, total_in %ld\n", pSess->zstrm.avail_in, pSess->zstrm.total_in);
-		pSess->zstrm.avail_out = sizeof(zipBuf);
-		pSess->zstrm.next_out = zipBuf;
-		zRet = inflate(&pSess->zstrm, Z_FINISH);    /* no bad return value */
-		DBGPRINTF("after inflate, ret %d, avail_out %d\n", zRet, pSess->zstrm.avail_out);
-		outavail = sizeof(zipBuf) - pSess->zstrm.avail_out;
-		if(outavail != 0) {
-			pSess->pLstn->rcvdDecompressed += outavail;
-			CHKiRet(DataRcvdUncompressed(pSess, (char*)zipBuf, outavail, &stTime, 0)); // TODO: query time!
-		}
-	} while (pSess->zstrm.avail_out == 0);
-
-finalize_it:
-	zRet = inflateEnd(&pSess->zstrm);
-	if(zRet != Z_OK) {
-		DBGPRINTF("imptcp: error %d returned from zlib/inflateEnd()\n", zRet);
-	}
+	ctx.pSess = pSess;
+	ctx.stTime = &stTime;
+	datetime.getCurrTime(&stTime, &ctx.ttGenTime, TIME_IN_LOCALTIME);
+	iRet = strmcompProcess(pSess->pComp, NULL, 0, STRMCOMP_FINISH, submitDecompressed, &ctx);
+	strmcompDestruct(&pSess->pComp);
 
-	pSess->bzInitDone = 0;
 done:	RETiRet;
 }
 
@@ -1373,6 +1353,7 @@ createInstance(instanceConf_t **pinst)
 	inst->ratelimitBurst = 10000; /* arbitrary high limit */
 	inst->ratelimitInterval = 0; /* off */
 	inst->compressionMode = COMPRESS_SINGLE_MSG;
+	inst->pszStrmCompDict = NULL;
 
 	/* node created, let's add to config */
 	if(loadModConf->tail == NULL) {
@@ -1454,6 +1435,21 @@ addListner(modConfData_t __attribute__((unused)) *modConf, instanceConf_t *inst)
 	pSrv->iKeepAliveTime = inst->iKeepAliveTime;
 	pSrv->bEmitMsgOnClose = inst->bEmitMsgOnClose;
 	pSrv->compressionMode = inst->compressionMode;
+	if(inst->pszStrmCompDict != NULL) {
+		if(!strmcompCodecAvailable(STRMCOMP_ZSTD)) {
+			errmsg.LogError(0, RS_RET_CODEC_NOT_AVAILABLE, "imptcp: "
+				"compression.stream.dictionary requires zstd support, which is "
+				"not available in this build of rsyslog");
+			ABORT_FINALIZE(RS_RET_CODEC_NOT_AVAILABLE);
+		}
+		iRet = strmcompLoadDict((char*) inst->pszStrmCompDict, &pSrv->strmCompDict,
+			&pSrv->lenStrmCompDict);
+		if(iRet != RS_RET_OK) {
+			errmsg.LogError(0, iRet, "imptcp: could not load compression "
+				"dictionary '%s'", inst->pszStrmCompDict);
+			FINALIZE;
+		}
+	}
 	pSrv->dfltTZ = inst->dfltTZ;
 	if (inst->pszBindPort != NULL) {
 		CHKmalloc(pSrv->port = ustrdup(inst->pszBindPort));
@@ -1884,6 +1880,8 @@ CODESTARTnewInpInst
 				ABORT_FINALIZE(RS_RET_PARAM_ERROR);
 			}
 			free(cstr);
+		} else if(!strcmp(inppblk.descr[i].name, "compression.stream.dictionary")) {
+			inst->pszStrmCompDict = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
 		} else if(!strcmp(inppblk.descr[i].name, "keepalive")) {
 			inst->bKeepAlive = (int) pvals[i].val.d.n;
 		} else if(!strcmp(inppblk.descr[i].name, "keepalive.probes")) {
@@ -2065,6 +2063,7 @@ CODESTARTfreeCnf
 		free(inst->pszBindRuleset);
 		free(inst->pszInputName);
 		free(inst->dfltTZ);
+		free(inst->pszStrmCompDict);
 		del = inst;
 		inst = inst->next;
 		free(del);
@@ -30,6 +30,9 @@
 #include <errno.h>
 #include <unistd.h>
 #include <stdint.h>
+#ifdef __SSE2__
+#	include <emmintrin.h>
+#endif
 #include "conf.h"
 #include "syslogd-types.h"
 #include "srUtils.h"
@@ -69,8 +72,20 @@ typedef struct _instanceData {
 	struct {
 		int8_t bits;
 	} ipv4;
+	struct {
+		sbool enable;
+		int16_t bits;
+	} ipv6;
 } instanceData;
 
+/* a parsed IPv6 address, with text positions for simple mode */
+typedef struct {
+	uint16_t grp[8];
+	int grpBeg[8], grpEnd[8];	/* -1 if the group is part of "::" */
+	sbool bEmbeddedV4;		/* last 32 bits in dotted-quad notation? */
+	int octBeg[4], octEnd[4];	/* positions of the embedded IPv4 octets */
+} ipv6addr_t;
+
 typedef struct wrkrInstanceData {
 	instanceData *pData;
 } wrkrInstanceData_t;
@@ -88,6 +103,8 @@ static struct cnfparamdescr actpdescr[] = {
 	{ "mode", eCmdHdlrGetWord, 0 },
 	{ "replacementchar", eCmdHdlrGetChar, 0 },
 	{ "ipv4.bits", eCmdHdlrInt, 0 },
+	{ "ipv6.enable", eCmdHdlrBinary, 0 },
+	{ "ipv6.bits", eCmdHdlrInt, 0 },
 };
 static struct cnfparamblk actpblk =
 	{ CNFPARAMBLK_VERSION,
@@ -149,6 +166,8 @@ setInstParamDefaults(instanceData *pData)
 	pData->mode = REWRITE_MODE;
 	pData->replChar = 'x';
 	pData->ipv4.bits = 16;
+	pData->ipv6.enable = 0;
+	pData->ipv6.bits = 96;
 }
 
 BEGINnewActInst
@@ -187,6 +206,10 @@ CODESTARTnewActInst
 			pData->replChar = es_getBufAddr(pvals[i].val.d.estr)[0];
 		} else if(!strcmp(actpblk.descr[i].name, "ipv4.bits")) {
 			pData->ipv4.bits = (int8_t) pvals[i].val.d.n;
+		} else if(!strcmp(actpblk.descr[i].name, "ipv6.enable")) {
+			pData->ipv6.enable = (sbool) pvals[i].val.d.n;
+		} else if(!strcmp(actpblk.descr[i].name, "ipv6.bits")) {
+			pData->ipv6.bits = (int16_t) pvals[i].val.d.n;
 		} else {
 			dbgprintf("mmanon: program error, non-handled "
 			  "param '%s'\n", actpblk.descr[i].name);
@@ -213,6 +236,18 @@ CODESTARTnewActInst
 				"mmanon: invalid number of ipv4 bits "
 				"in simple mode, corrected to %d",
 				pData->ipv4.bits);
+		if(pData->ipv6.bits < 16 || pData->ipv6.bits > 128 || pData->ipv6.bits % 16 != 0) {
+			if(pData->ipv6.bits < 16)
+				pData->ipv6.bits = 16;
+			else if(pData->ipv6.bits > 128)
+				pData->ipv6.bits = 128;
+			else
+				pData->ipv6.bits = (pData->ipv6.bits / 16 + 1) * 16;
+			errmsg.LogError(0, RS_RET_INVLD_ANON_BITS,
+				"mmanon: invalid number of ipv6 bits "
+				"in simple mode, corrected to %d",
+				pData->ipv6.bits);
+		}
 	} else { /* REWRITE_MODE */
 		if(pData->ipv4.bits < 1 || pData->ipv4.bits > 32) {
 			pData->ipv4.bits = 32;
@@ -221,6 +256,13 @@ CODESTARTnewActInst
 				"in rewrite mode, corrected to %d",
 				pData->ipv4.bits);
 		}
+		if(pData->ipv6.bits < 1 || pData->ipv6.bits > 128) {
+			pData->ipv6.bits = 128;
+			errmsg.LogError(0, RS_RET_INVLD_ANON_BITS,
+				"mmanon: invalid number of ipv6 bits "
+				"in rewrite mode, corrected to %d",
+				pData->ipv6.bits);
+		}
 		if(pData->replChar != 'x') {
 			errmsg.LogError(0, RS_RET_REPLCHAR_IGNORED,
 				"mmanon: replacementChar parameter is ignored "
@@ -243,121 +285,405 @@ CODESTARTtryResume
 ENDtryResume
 
 
-static int
-getnum(uchar *msg, int lenMsg, int *idx)
+/* character classes used by the address scanner */
+static inline int
+isDigit(const uchar c)
 {
-	int num = 0;
-	int i = *idx;
+	return c >= '0' && c <= '9';
+}
 
-	while(i < lenMsg && msg[i] >= '0' && msg[i] <= '9') {
-		num = num * 10 + msg[i] - '0';
-		++i;
-	}
+static inline int
+hexVal(const uchar c)
+{
+	if(c >= '0' && c <= '9')
+		return c - '0';
+	if(c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if(c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
 
-	*idx = i;
-	return num;
+static inline int
+isAlnum(const uchar c)
+{
+	return isDigit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
 }
 
 
-/* write an IP address octet to the output position */
+/* find the next character that can be part of an address, that is
+ * a dot or (if IPv6 is enabled) a colon, starting at idx. Every address
+ * contains one of them and they are much rarer than digits, so this
+ * is what we use to skip over the bulk of the message. The actual
+ * address start is found by looking back from there.
+ */
 static int
-writeOctet(uchar *msg, int idx, int *nxtidx, uint8_t octet)
+findAnchor(const uchar *msg, const int lenMsg, int idx, const int bColon)
 {
-	if(octet > 99) {
-		msg[idx++] = '0' + octet / 100;
-		octet = octet % 100;
+#ifdef __SSE2__
+	const __m128i dot = _mm_set1_epi8('.');
+	const __m128i colon = _mm_set1_epi8(bColon ? ':' : '.');
+	__m128i in;
+	int mask;
+
+	for( ; idx + 16 <= lenMsg ; idx += 16) {
+		in = _mm_loadu_si128((const __m128i*) (msg + idx));
+		mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(in, dot),
+						      _mm_cmpeq_epi8(in, colon)));
+		if(mask != 0)
+			return idx + __builtin_ctz(mask);
 	}
-	if(octet > 9) {
-		msg[idx++] = '0' + octet / 10;
-		octet = octet % 10;
+#endif
+	for( ; idx < lenMsg ; ++idx) {
+		if(msg[idx] == '.' || (bColon && msg[idx] == ':'))
+			return idx;
 	}
-	msg[idx++] =  '0' + octet;
+	return lenMsg;
+}
 
-	if(nxtidx != NULL) {
-		if(idx + 1 != *nxtidx) {
-			/* we got shorter, fix it! */
-			msg[idx] = '.';
-			*nxtidx = idx + 1;
+
+/* parse a dotted-quad IPv4 address starting at idx. Returns the index
+ * right after the address or -1 if there is none. The octet text
+ * positions are stored for later rewriting.
+ */
+static int
+parseIPv4(const uchar *msg, const int lenMsg, int idx, uint32_t *pAddr, int *octBeg, int *octEnd)
+{
+	uint32_t addr = 0;
+	int num;
+	int k;
+
+	for(k = 0 ; k < 4 ; ++k) {
+		if(k > 0) {
+			if(idx >= lenMsg || msg[idx] != '.')
+				return -1;
+			++idx;
+		}
+		octBeg[k] = idx;
+		num = 0;
+		while(idx < lenMsg && isDigit(msg[idx])) {
+			if(num <= 255) /* prevent overflow on long digit runs */
+				num = num * 10 + msg[idx] - '0';
+			++idx;
 		}
+		if(idx == octBeg[k] || num > 255)
+			return -1;
+		octEnd[k] = idx;
+		addr = (addr << 8) | num;
 	}
+	*pAddr = addr;
 	return idx;
 }
 
-/* currently works for IPv4 only! */
-static void
-anonip(instanceData *pData, uchar *msg, int *pLenMsg, int *idx)
+
+/* parse an IPv6 address starting at idx, in any of the RFC 4291 text
+ * forms, including embedded IPv4. Returns the index right after the
+ * address or -1 if there is none. "::" is expanded, the groups
+ * represented by it have empty text positions.
+ */
+static int
+parseIPv6(const uchar *msg, const int lenMsg, int idx, ipv6addr_t *addr)
 {
-	int i = *idx;
-	int octet;
-	uint32_t ipv4addr;
-	int ipstart[4];
-	int j;
-	int endpos;
-	int lenMsg = *pLenMsg;
+	uint16_t grp[8];
+	int grpBeg[8], grpEnd[8];
+	int nGrps = 0;
+	int dblColonAt = -1;	/* group index where "::" is located */
+	uint32_t v4;
+	int val, digit;
+	int nZero;
+	int j, k;
+
+	addr->bEmbeddedV4 = 0;
+	if(idx + 1 < lenMsg && msg[idx] == ':' && msg[idx+1] == ':') {
+		dblColonAt = 0;
+		idx += 2;
+	}
+	while(nGrps < 8 && idx < lenMsg && hexVal(msg[idx]) != -1) {
+		for(j = idx, val = 0 ; j < lenMsg && j - idx < 4 && (digit = hexVal(msg[j])) != -1 ; ++j)
+			val = (val << 4) | digit;
+		if(j + 1 < lenMsg && msg[j] == '.' && isDigit(msg[j+1])) {
+			/* embedded IPv4, this must be the last 32 bits */
+			if(nGrps > 6)
+				return -1;
+			if((j = parseIPv4(msg, lenMsg, idx, &v4, addr->octBeg, addr->octEnd)) == -1)
+				return -1;
+			grp[nGrps] = v4 >> 16;
+			grp[nGrps+1] = v4 & 0xffff;
+			grpBeg[nGrps] = grpEnd[nGrps] = grpBeg[nGrps+1] = grpEnd[nGrps+1] = -1;
+			nGrps += 2;
+			idx = j;
+			addr->bEmbeddedV4 = 1;
+			break;
+		}
+		if(j < lenMsg && hexVal(msg[j]) != -1)
+			return -1; /* more than 4 digits */
+		grp[nGrps] = val;
+		grpBeg[nGrps] = idx;
+		grpEnd[nGrps] = j;
+		++nGrps;
+		idx = j;
+		if(idx + 1 < lenMsg && msg[idx] == ':') {
+			if(msg[idx+1] == ':') {
+				if(dblColonAt != -1)
+					return -1;
+				dblColonAt = nGrps;
+				idx += 2;
+			} else if(hexVal(msg[idx+1]) != -1) {
+				++idx;
+			}
+		}
+	}
+	if((dblColonAt == -1) ? (nGrps != 8) : (nGrps > 7))
+		return -1;
+	/* an address must not be directly followed by something that could
+	 * be part of it, else it is most probably something else (like
+	 * a time or a MAC address)
+	 */
+	if(idx < lenMsg && (isAlnum(msg[idx]) || msg[idx] == ':'))
+		return -1;
+
+	nZero = 8 - nGrps;
+	for(k = 0, j = 0 ; k < 8 ; ++k) {
+		if(dblColonAt != -1 && k >= dblColonAt && k < dblColonAt + nZero) {
+			addr->grp[k] = 0;
+			addr->grpBeg[k] = addr->grpEnd[k] = -1;
+		} else {
+			addr->grp[k] = grp[j];
+			addr->grpBeg[k] = grpBeg[j];
+			addr->grpEnd[k] = grpEnd[j];
+			++j;
+		}
+	}
+	return idx;
+}
+
+
+/* write an unsigned number in decimal or (lower case) hex */
+static int
+writeNum(uchar *out, unsigned num, const unsigned base)
+{
+	uchar digits[8];
+	int n = 0;
+	int p = 0;
+
+	do {
+		digits[n++] = "0123456789abcdef"[num % base];
+		num /= base;
+	} while(num > 0);
+	while(n > 0)
+		out[p++] = digits[--n];
+	return p;
+}
+
+
+/* write nGrps IPv6 groups, using "::" for the longest run of at least
+ * minRun zero groups. RFC 5952 canonical form is minRun 2.
+ */
+static int
+writeIPv6Grps(uchar *out, const uint16_t *grp, const int nGrps, const int minRun, int *pbEndsDblColon)
+{
+	int runBeg = -1;
+	int runLen = 0;
+	int p = 0;
+	int j, k;
+
+	for(k = 0 ; k < nGrps ; k = j + 1) {
+		for(j = k ; j < nGrps && grp[j] == 0 ; ++j)
+			/* just count */;
+		if(j - k > runLen && j - k >= minRun) {
+			runBeg = k;
+			runLen = j - k;
+		}
+	}
+	for(k = 0 ; k < nGrps ; ++k) {
+		if(k == runBeg) {
+			out[p++] = ':';
+			out[p++] = ':';
+			k += runLen - 1;
+			continue;
+		}
+		if(k > 0 && k != runBeg + runLen)
+			out[p++] = ':';
+		p += writeNum(out + p, grp[k], 16);
+	}
+	*pbEndsDblColon = (runBeg != -1 && runBeg + runLen == nGrps);
+	return p;
+}
 
-	while(i < lenMsg && (msg[i] <= '0' || msg[i] > '9')) {
-		++i; /* skip to first number */
+static int
+writeIPv6(uchar *out, const ipv6addr_t *addr, const int minRun)
+{
+	int bEndsDblColon;
+	int p;
+	int k;
+
+	if(!addr->bEmbeddedV4)
+		return writeIPv6Grps(out, addr->grp, 8, minRun, &bEndsDblColon);
+	p = writeIPv6Grps(out, addr->grp, 6, minRun, &bEndsDblColon);
+	if(!bEndsDblColon)
+		out[p++] = ':';
+	for(k = 0 ; k < 4 ; ++k) {
+		if(k > 0)
+			out[p++] = '.';
+		p += writeNum(out + p, (addr->grp[6 + k/2] >> ((k % 2) ? 0 : 8)) & 0xff, 10);
 	}
-	if(i >= lenMsg)
-		goto done;
-	
-	/* got digit, let's see if ip */
-	ipstart[0] = i;
-	octet = getnum(msg, lenMsg, &i);
-	if(octet > 255 || msg[i] != '.') goto done;
-	ipv4addr = octet << 24;
-	++i;
-	ipstart[1] = i;
-	octet = getnum(msg, lenMsg, &i);
-	if(octet > 255 || msg[i] != '.') goto done;
-	ipv4addr |= octet << 16;
-	++i;
-	ipstart[2] = i;
-	octet = getnum(msg, lenMsg, &i);
-	if(octet > 255 || msg[i] != '.') goto done;
-	ipv4addr |= octet << 8;
-	++i;
-	ipstart[3] = i;
-	octet = getnum(msg, lenMsg, &i);
-	if(octet > 255) goto done;
-	ipv4addr |= octet;
-
-	/* OK, we now found an ip address */
+	return p;
+}
+
+
+/* replace the characters of an address part in simple mode */
+static inline void
+replChars(uchar *msg, const int beg, const int end, const int offs, const char replChar)
+{
+	int i;
+
+	for(i = beg ; i < end ; ++i)
+		msg[i + offs] = replChar;
+}
+
+
+/* anonymize the IPv4 address at msg[strt..end) and write the result to
+ * msg + outIdx (outIdx <= strt, the result is never longer than the
+ * original). Returns the length written.
+ */
+static int
+anonIPv4(instanceData *pData, uchar *msg, const int outIdx, const int strt, const int end,
+	uint32_t ipv4addr, const int *octBeg, const int *octEnd)
+{
+	const int offs = outIdx - strt;
+	int p = outIdx;
+	int k;
+
 	if(pData->mode == SIMPLE_MODE) {
-		if(pData->ipv4.bits == 8)
-			j = ipstart[3];
-		else if(pData->ipv4.bits == 16)
-			j = ipstart[2];
-		else if(pData->ipv4.bits == 24)
-			j = ipstart[1];
-		else /* due to our checks, this *must* be 32 */
-			j = ipstart[0];
-		while(j < i) {
-			if(msg[j] != '.')
-				msg[j] = pData->replChar;
-			++j;
+		memmove(msg + outIdx, msg + strt, end - strt);
+		for(k = 4 - pData->ipv4.bits / 8 ; k < 4 ; ++k)
+			replChars(msg, octBeg[k], octEnd[k], offs, pData->replChar);
+		return end - strt;
+	}
+
+	/* REWRITE_MODE: octets not touched by the mask are kept as they are */
+	ipv4addr &= ipv4masks[pData->ipv4.bits];
+	for(k = 0 ; k < 4 ; ++k) {
+		if(k > 0)
+			msg[p++] = '.';
+		if(pData->ipv4.bits > 24 - 8 * k) {
+			p += writeNum(msg + p, (ipv4addr >> (24 - 8 * k)) & 0xff, 10);
+		} else {
+			memmove(msg + p, msg + octBeg[k], octEnd[k] - octBeg[k]);
+			p += octEnd[k] - octBeg[k];
 		}
-	} else { /* REWRITE_MODE */
-		ipv4addr &= ipv4masks[pData->ipv4.bits];
-		if(pData->ipv4.bits > 24)
-			writeOctet(msg, ipstart[0], &(ipstart[1]), ipv4addr >> 24);
-		if(pData->ipv4.bits > 16)
-			writeOctet(msg, ipstart[1], &(ipstart[2]), (ipv4addr >> 16) & 0xff);
-		if(pData->ipv4.bits > 8)
-			writeOctet(msg, ipstart[2], &(ipstart[3]), (ipv4addr >> 8) & 0xff);
-		endpos = writeOctet(msg, ipstart[3], NULL, ipv4addr & 0xff);
-		/* if we had truncation, we need to shrink the msg */
-		dbgprintf("existing i %d, endpos %d\n", i, endpos);
-		if(i - endpos > 0) {
-			*pLenMsg = lenMsg - (i - endpos);
-			memmove(msg+endpos, msg+i, lenMsg - i + 1);
-			/* correct index for next search! */
-			i -= (i - endpos);
+	}
+	return p - outIdx;
+}
+
+/* same as anonIPv4(), but for IPv6 */
+static int
+anonIPv6(instanceData *pData, uchar *msg, const int outIdx, const int strt, const int end,
+	ipv6addr_t *addr)
+{
+	uchar buf[64]; /* longest IPv6 text is 45 chars */
+	int bits;
+	int len;
+	int k;
+
+	if(pData->mode == SIMPLE_MODE) {
+		const int offs = outIdx - strt;
+		memmove(msg + outIdx, msg + strt, end - strt);
+		for(k = 8 - pData->ipv6.bits / 16 ; k < 8 ; ++k) {
+			if(addr->bEmbeddedV4 && k >= 6) {
+				replChars(msg, addr->octBeg[2*(k-6)], addr->octEnd[2*(k-6)], offs,
+					pData->replChar);
+				replChars(msg, addr->octBeg[2*(k-6)+1], addr->octEnd[2*(k-6)+1], offs,
+					pData->replChar);
+			} else if(addr->grpBeg[k] != -1) {
+				replChars(msg, addr->grpBeg[k], addr->grpEnd[k], offs, pData->replChar);
+			}
 		}
+		return end - strt;
 	}
 
-done:	*idx = i;
-	return;
+	/* REWRITE_MODE */
+	for(k = 7, bits = pData->ipv6.bits ; k >= 0 && bits > 0 ; --k, bits -= 16)
+		addr->grp[k] &= (bits >= 16) ? 0 : (uint16_t) (0xffff << bits);
+	len = writeIPv6(buf, addr, 2);
+	if(len > end - strt) {
+		/* the original used "::" for a single zero group, so do we */
+		len = writeIPv6(buf, addr, 1);
+		if(len > end - strt) { /* cannot happen, but be on the safe side */
+			buf[0] = buf[1] = ':';
+			len = 2;
+		}
+	}
+	memcpy(msg + outIdx, buf, len);
+	return len;
+}
+
+
+/* anonymize all addresses inside the message. This is done in a single
+ * pass, with the output written into the message buffer itself: as an
+ * anonymized address is never longer than the original one, output never
+ * overtakes input. Text between addresses is only moved if an earlier
+ * address got shorter. Returns the new message length.
+ */
+static int
+anonMsg(instanceData *pData, uchar *msg, const int lenMsg)
+{
+	ipv6addr_t ipv6addr;
+	uint32_t ipv4addr;
+	int octBeg[4], octEnd[4];
+	int rdIdx = 0;	/* everything before this is already in the output */
+	int wrIdx = 0;	/* end of output */
+	int idx = 0;	/* where to continue searching */
+	int anchor;
+	int strt, end;
+	int bIPv4;
+
+	while(idx < lenMsg) {
+		anchor = findAnchor(msg, lenMsg, idx, pData->ipv6.enable);
+		if(anchor >= lenMsg)
+			break;
+		strt = anchor;
+		bIPv4 = (msg[anchor] == '.');
+		if(bIPv4) {
+			while(strt > rdIdx && isDigit(msg[strt-1]))
+				--strt;
+			end = (strt == anchor) ? -1
+				: parseIPv4(msg, lenMsg, strt, &ipv4addr, octBeg, octEnd);
+		} else {
+			while(strt > rdIdx && anchor - strt < 4 && hexVal(msg[strt-1]) != -1)
+				--strt;
+			/* must not be preceded by something that could be part of it;
+			 * a previous address directly in front also counts as such.
+			 */
+			if(strt > 0 && (strt == rdIdx || isAlnum(msg[strt-1]) || msg[strt-1] == ':'))
+				end = -1;
+			else
+				end = parseIPv6(msg, lenMsg, strt, &ipv6addr);
+		}
+		if(end == -1) {
+			idx = anchor + 1;
+			continue;
+		}
+
+		/* found an address, first move the text before it into place */
+		if(wrIdx != rdIdx)
+			memmove(msg + wrIdx, msg + rdIdx, strt - rdIdx);
+		wrIdx += strt - rdIdx;
+		if(bIPv4)
+			wrIdx += anonIPv4(pData, msg, wrIdx, strt, end, ipv4addr, octBeg, octEnd);
+		else
+			wrIdx += anonIPv6(pData, msg, wrIdx, strt, end, &ipv6addr);
+		rdIdx = idx = end;
+	}
+
+	if(wrIdx != rdIdx) {
+		memmove(msg + wrIdx, msg + rdIdx, lenMsg - rdIdx);
+		wrIdx += lenMsg - rdIdx;
+		msg[wrIdx] = '\0';
+	} else {
+		wrIdx = lenMsg;
+	}
+	return wrIdx;
 }
 
 
@@ -366,13 +692,10 @@ BEGINdoAction_NoStrings
 	msg_t *pMsg = ppMsg[0];
 	uchar *msg;
 	int lenMsg;
-	int i;
 CODESTARTdoAction
 	lenMsg = getMSGLen(pMsg);
 	msg = getMSG(pMsg);
-	for(i = 0 ; i < lenMsg ; ++i) {
-		anonip(pWrkrData->pData, msg, &lenMsg, &i);
-	}
+	lenMsg = anonMsg(pWrkrData->pData, msg, lenMsg);
 	if(lenMsg != getMSGLen(pMsg))
 		setMSGLen(pMsg, lenMsg);
 ENDdoAction
@@ -43,6 +43,7 @@
 #include "errmsg.h"
 #include "cfsysline.h"
 #include "dirty.h"
+#include "lazyjson.h"
 
 MODULE_TYPE_OUTPUT
 MODULE_TYPE_NOKEEP
@@ -59,6 +60,7 @@ DEF_OMOD_STATIC_DATA
 
 typedef struct _instanceData {
 	sbool bUseRawMsg;     /**< use %rawmsg% instead of %msg% */
+	sbool bLazy;	/**< keep JSON text and parse only referenced values */
 	char *cookie;
 	uchar *container;
 	int lenCookie;
@@ -81,7 +83,8 @@ static modConfData_t *runModConf = NULL;/* modConf ptr to use for the current ex
 static struct cnfparamdescr actpdescr[] = {
 	{ "cookie", eCmdHdlrString, 0 },
 	{ "container", eCmdHdlrString, 0 },
-	{ "userawmsg", eCmdHdlrBinary, 0 }
+	{ "userawmsg", eCmdHdlrBinary, 0 },
+	{ "lazy", eCmdHdlrBinary, 0 }
 };
 static struct cnfparamblk actpblk =
 	{ CNFPARAMBLK_VERSION,
@@ -168,11 +171,28 @@ static rsRetVal
 processJSON(wrkrInstanceData_t *pWrkrData, msg_t *pMsg, char *buf, size_t lenBuf)
 {
 	struct json_object *json;
+	lazyjson_t *doc;
 	const char *errMsg;
+	rsRetVal localRet;
 	DEFiRet;
 
 	assert(pWrkrData->tokener != NULL);
 	DBGPRINTF("mmjsonparse: toParse: '%s'\n", buf);
+
+	/* in lazy mode, only the structure is indexed now. The lazy scanner
+	 * accepts strictly valid JSON objects only, everything else goes
+	 * through json-c as usual, so results do not depend on the mode.
+	 */
+	if(pWrkrData->pData->bLazy) {
+		localRet = lazyjsonConstruct(&doc, buf, lenBuf);
+		if(localRet == RS_RET_OK) {
+			CHKiRet(msgSetLazyJSON(pMsg, doc));
+			FINALIZE;
+		} else if(localRet != RS_RET_JSON_PARSE_ERR) {
+			ABORT_FINALIZE(localRet);
+		}
+	}
+
 	json_tokener_reset(pWrkrData->tokener);
 
 	json = json_tokener_parse_ex(pWrkrData->tokener, buf, lenBuf);
@@ -257,6 +277,7 @@ static inline void
 setInstParamDefaults(instanceData *pData)
 {
 	pData->bUseRawMsg = 0;
+	pData->bLazy = 0;
 }
 
 BEGINnewActInst
@@ -285,6 +306,8 @@ CODESTARTnewActInst
 			pData->container = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
         } else if(!strcmp(actpblk.descr[i].name, "userawmsg")) {
             pData->bUseRawMsg = (int) pvals[i].val.d.n;
+		} else if(!strcmp(actpblk.descr[i].name, "lazy")) {
+			pData->bLazy = (sbool) pvals[i].val.d.n;
 		} else {
 			dbgprintf("mmjsonparse: program error, non-handled param '%s'\n", actpblk.descr[i].name);
 		}
@@ -292,6 +315,11 @@ CODESTARTnewActInst
 
 	if(pData->container == NULL)
 		CHKmalloc(pData->container = (uchar*) strdup("!"));
+	if(pData->bLazy && strcmp((char*)pData->container, "!")) {
+		errmsg.LogError(0, RS_RET_OK, "mmjsonparse: lazy mode is only supported "
+			"for container \"!\", disabling it");
+		pData->bLazy = 0;
+	}
 	pData->lenCookie = strlen(pData->cookie);
 CODE_STD_FINALIZERnewActInst
 	cnfparamvalsDestruct(pvals, &actpblk);
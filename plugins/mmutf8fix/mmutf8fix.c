@@ -41,6 +41,7 @@
 #include "template.h"
 #include "module-template.h"
 #include "errmsg.h"
+#include "utf8fix.h"
 
 MODULE_TYPE_OUTPUT
 MODULE_TYPE_NOKEEP
@@ -193,103 +194,6 @@ CODESTARTtryResume
 ENDtryResume
 
 
-static inline void
-doCC(instanceData *pData, uchar *msg, int lenMsg)
-{
-	int i;
-
-	for(i = 0 ; i < lenMsg ; ++i) {
-		if(msg[i] < 32 || msg[i] > 126) {
-			msg[i] = pData->replChar;
-		}
-	}
-}
-
-/* fix an invalid multibyte sequence */
-static inline void
-fixInvldMBSeq(instanceData *pData, uchar *msg, int lenMsg, int strtIdx, int *endIdx, int8_t seqLen)
-{
-	int i;
-
-	/* startIdx and seqLen always set if bytesLeft is set,
-	   which is required before this function is called */
-	*endIdx = strtIdx + seqLen;
-	if(*endIdx > lenMsg)
-		*endIdx = lenMsg;
-	for(i = strtIdx ; i < *endIdx ; ++i)
-		msg[i] = pData->replChar;
-}
-
-static inline void
-doUTF8(instanceData *pData, uchar *msg, int lenMsg)
-{
-	uchar c;
-	int8_t seqLen = 0, bytesLeft = 0;
-	uint32_t codepoint;
-	int strtIdx = 0, endIdx = 0;
-	int i;
-
-	for(i = 0 ; i < lenMsg ; ++i) {
-		c = msg[i];
-		if(bytesLeft) {
-			if((c & 0xc0) != 0x80) {
-				/* sequence invalid, invalidate all bytes
-				   startIdx is always set if bytesLeft is set */
-				fixInvldMBSeq(pData, msg, lenMsg, strtIdx, &endIdx,
-				              seqLen);
-				i = endIdx - 1;
-				bytesLeft = 0;
-			} else {
-				codepoint = (codepoint << 6) | (c & 0x3f);
-				--bytesLeft;
-				if(bytesLeft == 0) {
-					/* too-large codepoint? */
-					if(codepoint > 0x10FFFF) {
-						/* sequence invalid, invalidate all bytes
-						   startIdx is always set if bytesLeft is set */
-						fixInvldMBSeq(pData, msg, lenMsg,
-							      strtIdx, &endIdx,
-							      seqLen);
-					}
-				}
-			}
-		} else {
-			if((c & 0x80) == 0) {
-				/* 1-byte sequence, US-ASCII */
-				; /* nothing to do, all well */
-			} else if((c & 0xe0) == 0xc0) {
-				/* 2-byte sequence */
-				/* 0xc0 and 0xc1 are illegal */
-				if(c == 0xc0 || c == 0xc1) {
-					msg[i] = pData->replChar;
-				} else {
-					strtIdx = i;
-					seqLen = bytesLeft = 1;
-					codepoint = c & 0x1f;
-				}
-			} else if((c & 0xf0) == 0xe0) {
-				/* 3-byte sequence */
-				strtIdx = i;
-				seqLen = bytesLeft = 2;
-				codepoint = c & 0x0f;
-			} else if((c & 0xf8) == 0xf0) {
-				/* 4-byte sequence */
-				strtIdx = i;
-				seqLen = bytesLeft = 3;
-				codepoint = c & 0x07;
-			} else {   /* invalid (5&6 byte forbidden by RFC3629) */
-				msg[i] = pData->replChar;
-			}
-			if(i+bytesLeft >= lenMsg) {
-				int dummy = lenMsg;
-				/* invalid, as rest of message cannot contain full char */
-				fixInvldMBSeq(pData, msg, lenMsg, strtIdx, &dummy, seqLen);
-				i = lenMsg - 1;
-			}
-		}
-	}
-}
-
 BEGINdoAction_NoStrings
 	msg_t **ppMsg = (msg_t **) pMsgData;
 	msg_t *pMsg = ppMsg[0];
@@ -299,9 +203,9 @@ CODESTARTdoAction
 	lenMsg = getMSGLen(pMsg);
 	msg = getMSG(pMsg);
 	if(pWrkrData->pData->mode == MODE_CC) {
-		doCC(pWrkrData->pData, msg, lenMsg);
+		utf8fixCC(msg, lenMsg, pWrkrData->pData->replChar);
 	} else {
-		doUTF8(pWrkrData->pData, msg, lenMsg);
+		utf8fixUTF8(msg, lenMsg, pWrkrData->pData->replChar);
 	}
 ENDdoAction
 
@@ -340,4 +244,6 @@ CODESTARTmodInit
 CODEmodInit_QueryRegCFSLineHdlr
 	DBGPRINTF("mmutf8fix: module compiled with rsyslog version %s.\n", VERSION);
 	CHKiRet(objUse(errmsg, CORE_COMPONENT));
+	utf8fixInit(0);
+	DBGPRINTF("mmutf8fix: using %s fast path\n", utf8fixImplName());
 ENDmodInit
@@ -0,0 +1,490 @@
+/* utf8fix.c
+ * The actual checking and repair routines of mmutf8fix. They live in
+ * their own file so that the testbench can benchmark them.
+ *
+ * Almost all messages are pure ASCII or valid UTF-8, so we first run a
+ * fast check which determines how much of the message is known to be
+ * fine. Only from the first problematic block on, the scalar code
+ * (which defines what "fixing" means) is used. As soon as the scalar
+ * code has processed that block and is at a character boundary again,
+ * the fast check resumes. On x86, the fast check is vectorized (AVX2 or
+ * SSSE3, selected at runtime). The UTF-8 check is the lookup-table
+ * algorithm from Keiser/Lemire, "Validating UTF-8 In Less Than One
+ * Instruction Per Byte" (2020). It is stricter than our scalar code
+ * (it also rejects overlong forms and surrogates), which is fine: it
+ * only needs to never accept anything the scalar code would modify.
+ * Other platforms use a word-at-a-time ASCII check.
+ *
+ * Copyright 2013-2026 Adiscon GmbH.
+ *
+ * This file is part of rsyslog.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "config.h"
+#include <stdint.h>
+#include <string.h>
+#include "rsyslog.h"
+#include "utf8fix.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#	define UTF8FIX_X86 1
+#	include <immintrin.h>
+#endif
+
+/* number of bytes the scalar code processes at least before we
+ * try the fast path again.
+ */
+#define SCALAR_CHUNK 64
+
+/* fast path checks, they return the number of bytes at the start of
+ * the buffer that need no processing. For UTF-8, this is always a
+ * character boundary.
+ */
+typedef int (*cleanPrefix_t)(const uchar *buf, const int len);
+
+
+/* ---------- scalar code, this defines the actual semantics ---------- */
+
+/* fix an invalid multibyte sequence */
+static inline void
+fixInvldMBSeq(uchar replChar, uchar *msg, int lenMsg, int strtIdx, int *endIdx, int8_t seqLen)
+{
+	int i;
+
+	/* startIdx and seqLen always set if bytesLeft is set,
+	   which is required before this function is called */
+	*endIdx = strtIdx + seqLen;
+	if(*endIdx > lenMsg)
+		*endIdx = lenMsg;
+	for(i = strtIdx ; i < *endIdx ; ++i)
+		msg[i] = replChar;
+}
+
+/* process the message from index i, which must be at a character boundary,
+ * up to the first character boundary at or after stopIdx. Returns the
+ * index where processing stopped.
+ */
+static int
+doUTF8Scalar(uchar replChar, uchar *msg, int lenMsg, int i, const int stopIdx)
+{
+	uchar c;
+	int8_t seqLen = 0, bytesLeft = 0;
+	uint32_t codepoint = 0;
+	int strtIdx = 0, endIdx = 0;
+
+	for( ; i < lenMsg ; ++i) {
+		if(bytesLeft == 0 && i >= stopIdx)
+			break;
+		c = msg[i];
+		if(bytesLeft) {
+			if((c & 0xc0) != 0x80) {
+				/* sequence invalid, invalidate all bytes
+				   startIdx is always set if bytesLeft is set */
+				fixInvldMBSeq(replChar, msg, lenMsg, strtIdx, &endIdx,
+				              seqLen);
+				i = endIdx - 1;
+				bytesLeft = 0;
+			} else {
+				codepoint = (codepoint << 6) | (c & 0x3f);
+				--bytesLeft;
+				if(bytesLeft == 0) {
+					/* too-large codepoint? */
+					if(codepoint > 0x10FFFF) {
+						/* sequence invalid, invalidate all bytes
+						   startIdx is always set if bytesLeft is set */
+						fixInvldMBSeq(replChar, msg, lenMsg,
+							      strtIdx, &endIdx,
+							      seqLen);
+					}
+				}
+			}
+		} else {
+			if((c & 0x80) == 0) {
+				/* 1-byte sequence, US-ASCII */
+				; /* nothing to do, all well */
+			} else if((c & 0xe0) == 0xc0) {
+				/* 2-byte sequence */
+				/* 0xc0 and 0xc1 are illegal */
+				if(c == 0xc0 || c == 0xc1) {
+					msg[i] = replChar;
+				} else {
+					strtIdx = i;
+					seqLen = bytesLeft = 1;
+					codepoint = c & 0x1f;
+				}
+			} else if((c & 0xf0) == 0xe0) {
+				/* 3-byte sequence */
+				strtIdx = i;
+				seqLen = bytesLeft = 2;
+				codepoint = c & 0x0f;
+			} else if((c & 0xf8) == 0xf0) {
+				/* 4-byte sequence */
+				strtIdx = i;
+				seqLen = bytesLeft = 3;
+				codepoint = c & 0x07;
+			} else {   /* invalid (5&6 byte forbidden by RFC3629) */
+				msg[i] = replChar;
+			}
+			if(i+bytesLeft >= lenMsg) {
+				int dummy = lenMsg;
+				/* invalid, as rest of message cannot contain full char */
+				fixInvldMBSeq(replChar, msg, lenMsg, strtIdx, &dummy, seqLen);
+				i = lenMsg - 1;
+			}
+		}
+	}
+	return i;
+}
+
+
+/* ---------- portable fast path ---------- */
+
+/* skip pure ASCII, one machine word at a time */
+static int
+utf8CleanPrefixWord(const uchar *buf, const int len)
+{
+	const uint64_t hibits = 0x8080808080808080ULL;
+	uint64_t w;
+	int i;
+
+	for(i = 0 ; i + 8 <= len ; i += 8) {
+		memcpy(&w, buf + i, sizeof(w));
+		if(w & hibits)
+			return i;
+	}
+	while(i < len && buf[i] < 0x80)
+		++i;
+	return i;
+}
+
+
+/* ---------- x86 vectorized fast path ---------- */
+#ifdef UTF8FIX_X86
+
+/* error classes of the Keiser/Lemire algorithm. An error is flagged if a
+ * class is set in all three lookups for the previous byte's high and low
+ * nibble and the current byte's high nibble.
+ */
+#define TOO_SHORT	(1<<0) /* 11______ 0_______ or 11______ 11______ */
+#define TOO_LONG	(1<<1) /* 0_______ 10______ */
+#define OVERLONG_3	(1<<2) /* 11100000 100_____ */
+#define TOO_LARGE	(1<<3) /* 11110100 1001____ or 11110100 101_____ */
+#define SURROGATE	(1<<4) /* 11101101 101_____ */
+#define OVERLONG_2	(1<<5) /* 1100000_ 10______ */
+#define TOO_LARGE_1000	(1<<6) /* 11110101+ 1000____ */
+#define OVERLONG_4	(1<<6) /* 11110000 1000____ */
+#define TWO_CONTS	(1<<7) /* 10______ 10______ */
+#define CARRY		(TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+static const uchar tblByte1High[16] = {
+	/* 0_______ ________ ASCII */
+	TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+	TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+	/* 10______ ________ continuation */
+	TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+	/* 1100____ ________ two byte lead */
+	TOO_SHORT | OVERLONG_2,
+	/* 1101____ ________ two byte lead */
+	TOO_SHORT,
+	/* 1110____ ________ three byte lead */
+	TOO_SHORT | OVERLONG_3 | SURROGATE,
+	/* 1111____ ________ four+ byte lead */
+	TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+};
+static const uchar tblByte1Low[16] = {
+	/* ____0000 ________ */
+	CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+	/* ____0001 ________ */
+	CARRY | OVERLONG_2,
+	/* ____001_ ________ */
+	CARRY,
+	CARRY,
+	/* ____0100 ________ */
+	CARRY | TOO_LARGE,
+	/* ____0101 ________ */
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	/* ____011_ ________ */
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	/* ____1___ ________ */
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	/* ____1101 ________ */
+	CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000
+};
+static const uchar tblByte2High[16] = {
+	/* ________ 0_______ ASCII */
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+	/* ________ 1000____ */
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+	/* ________ 1001____ */
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+	/* ________ 101_____ */
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+	/* ________ 11______ */
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+};
+
+/* the block with the error may belong to a sequence that started in the
+ * previous block, so we report back the last character boundary before
+ * the previous block. Everything up to there is known to be valid.
+ */
+static inline int
+utf8ErrBoundary(const uchar *buf, int prevBlk)
+{
+	while(prevBlk > 0 && (buf[prevBlk] & 0xc0) == 0x80)
+		--prevBlk;
+	return prevBlk;
+}
+
+__attribute__((target("ssse3")))
+static int
+utf8CleanPrefixSSSE3(const uchar *buf, const int len)
+{
+	const __m128i t1h = _mm_loadu_si128((const __m128i*) tblByte1High);
+	const __m128i t1l = _mm_loadu_si128((const __m128i*) tblByte1Low);
+	const __m128i t2h = _mm_loadu_si128((const __m128i*) tblByte2High);
+	const __m128i nibble = _mm_set1_epi8(0x0f);
+	const __m128i zero = _mm_setzero_si128();
+	/* a lead byte in the last three positions needs more bytes than the block has */
+	const __m128i maxIncompl = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, (char) 0xef, (char) 0xdf, (char) 0xbf);
+	__m128i prev = zero;
+	__m128i prevIncompl = zero;
+	__m128i in, prev1, sc, must23, err;
+	uchar tail[16];
+	int off;
+	int prevBlk = 0;
+
+	for(off = 0 ; off < len ; off += 16) {
+		if(len - off >= 16) {
+			in = _mm_loadu_si128((const __m128i*) (buf + off));
+		} else {
+			/* zero padding makes an unterminated sequence an error */
+			memset(tail, 0, sizeof(tail));
+			memcpy(tail, buf + off, len - off);
+			in = _mm_loadu_si128((const __m128i*) tail);
+		}
+		if(_mm_movemask_epi8(in) == 0) {
+			err = prevIncompl; /* ASCII only, nothing may be left open */
+		} else {
+			prev1 = _mm_alignr_epi8(in, prev, 15);
+			sc = _mm_and_si128(
+				_mm_and_si128(
+				  _mm_shuffle_epi8(t1h, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+				  _mm_shuffle_epi8(t1l, _mm_and_si128(prev1, nibble))),
+				_mm_shuffle_epi8(t2h, _mm_and_si128(_mm_srli_epi16(in, 4), nibble)));
+			/* third and fourth bytes of 3- and 4-byte sequences must be continuations */
+			must23 = _mm_or_si128(
+				_mm_subs_epu8(_mm_alignr_epi8(in, prev, 14), _mm_set1_epi8((char) (0xe0-0x80))),
+				_mm_subs_epu8(_mm_alignr_epi8(in, prev, 13), _mm_set1_epi8((char) (0xf0-0x80))));
+			err = _mm_xor_si128(_mm_and_si128(must23, _mm_set1_epi8((char) 0x80)), sc);
+		}
+		if(_mm_movemask_epi8(_mm_cmpeq_epi8(err, zero)) != 0xffff)
+			return (off == 0) ? 0 : utf8ErrBoundary(buf, prevBlk);
+		prevIncompl = _mm_subs_epu8(in, maxIncompl);
+		prev = in;
+		prevBlk = off;
+	}
+	if(_mm_movemask_epi8(_mm_cmpeq_epi8(prevIncompl, zero)) != 0xffff)
+		return utf8ErrBoundary(buf, prevBlk);
+	return len;
+}
+
+/* AVX2 needs to carry bytes across the two 128 bit lanes */
+#define AVX2_PREV(in, prev, n) \
+	_mm256_alignr_epi8(in, _mm256_permute2x128_si256(prev, in, 0x21), 16 - (n))
+
+__attribute__((target("avx2")))
+static int
+utf8CleanPrefixAVX2(const uchar *buf, const int len)
+{
+	const __m256i t1h = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) tblByte1High));
+	const __m256i t1l = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) tblByte1Low));
+	const __m256i t2h = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) tblByte2High));
+	const __m256i nibble = _mm256_set1_epi8(0x0f);
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i maxIncompl = _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, (char) 0xef, (char) 0xdf, (char) 0xbf);
+	__m256i prev = zero;
+	__m256i prevIncompl = zero;
+	__m256i in, prev1, sc, must23, err;
+	uchar tail[32];
+	int off;
+	int prevBlk = 0;
+
+	for(off = 0 ; off < len ; off += 32) {
+		if(len - off >= 32) {
+			in = _mm256_loadu_si256((const __m256i*) (buf + off));
+		} else {
+			memset(tail, 0, sizeof(tail));
+			memcpy(tail, buf + off, len - off);
+			in = _mm256_loadu_si256((const __m256i*) tail);
+		}
+		if(_mm256_movemask_epi8(in) == 0) {
+			err = prevIncompl;
+		} else {
+			prev1 = AVX2_PREV(in, prev, 1);
+			sc = _mm256_and_si256(
+				_mm256_and_si256(
+				  _mm256_shuffle_epi8(t1h, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+				  _mm256_shuffle_epi8(t1l, _mm256_and_si256(prev1, nibble))),
+				_mm256_shuffle_epi8(t2h, _mm256_and_si256(_mm256_srli_epi16(in, 4), nibble)));
+			must23 = _mm256_or_si256(
+				_mm256_subs_epu8(AVX2_PREV(in, prev, 2), _mm256_set1_epi8((char) (0xe0-0x80))),
+				_mm256_subs_epu8(AVX2_PREV(in, prev, 3), _mm256_set1_epi8((char) (0xf0-0x80))));
+			err = _mm256_xor_si256(_mm256_and_si256(must23, _mm256_set1_epi8((char) 0x80)), sc);
+		}
+		if(!_mm256_testz_si256(err, err))
+			return (off == 0) ? 0 : utf8ErrBoundary(buf, prevBlk);
+		prevIncompl = _mm256_subs_epu8(in, maxIncompl);
+		prev = in;
+		prevBlk = off;
+	}
+	if(!_mm256_testz_si256(prevIncompl, prevIncompl))
+		return utf8ErrBoundary(buf, prevBlk);
+	return len;
+}
+
+/* control character mode: everything outside 32..126 needs fixing. With
+ * signed compares, bytes >= 0x80 are negative and thus fail the lower bound.
+ */
+__attribute__((target("sse2")))
+static int
+ccCleanPrefixSSE2(const uchar *buf, const int len)
+{
+	const __m128i lo = _mm_set1_epi8(31);
+	const __m128i hi = _mm_set1_epi8(127);
+	__m128i in;
+	int off;
+
+	for(off = 0 ; off + 16 <= len ; off += 16) {
+		in = _mm_loadu_si128((const __m128i*) (buf + off));
+		if(_mm_movemask_epi8(_mm_and_si128(_mm_cmpgt_epi8(in, lo),
+						   _mm_cmpgt_epi8(hi, in))) != 0xffff)
+			return off;
+	}
+	while(off < len && buf[off] >= 32 && buf[off] <= 126)
+		++off;
+	return off;
+}
+
+__attribute__((target("avx2")))
+static int
+ccCleanPrefixAVX2(const uchar *buf, const int len)
+{
+	const __m256i lo = _mm256_set1_epi8(31);
+	const __m256i hi = _mm256_set1_epi8(127);
+	__m256i in;
+	int off;
+
+	for(off = 0 ; off + 32 <= len ; off += 32) {
+		in = _mm256_loadu_si256((const __m256i*) (buf + off));
+		if(_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpgt_epi8(in, lo),
+							 _mm256_cmpgt_epi8(hi, in))) != -1)
+			return off;
+	}
+	while(off < len && buf[off] >= 32 && buf[off] <= 126)
+		++off;
+	return off;
+}
+#endif /* #ifdef UTF8FIX_X86 */
+
+
+/* ---------- interface ---------- */
+
+static cleanPrefix_t utf8CleanPrefix = utf8CleanPrefixWord;
+static cleanPrefix_t ccCleanPrefix = NULL;
+static const char *implName = "word";
+
+/* select the fast path implementation. Must be called before any of the
+ * fix functions is used. bNoSIMD forces the portable code (for testing
+ * and benchmarking).
+ */
+void
+utf8fixInit(int bNoSIMD)
+{
+	utf8CleanPrefix = utf8CleanPrefixWord;
+	ccCleanPrefix = NULL;
+	implName = "word";
+#ifdef UTF8FIX_X86
+	if(bNoSIMD)
+		return;
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2")) {
+		utf8CleanPrefix = utf8CleanPrefixAVX2;
+		ccCleanPrefix = ccCleanPrefixAVX2;
+		implName = "avx2";
+	} else if(__builtin_cpu_supports("ssse3")) {
+		utf8CleanPrefix = utf8CleanPrefixSSSE3;
+		ccCleanPrefix = ccCleanPrefixSSE2;
+		implName = "ssse3";
+	} else if(__builtin_cpu_supports("sse2")) {
+		ccCleanPrefix = ccCleanPrefixSSE2;
+		implName = "sse2";
+	}
+#else
+	(void) bNoSIMD;
+#endif
+}
+
+const char *
+utf8fixImplName(void)
+{
+	return implName;
+}
+
+void
+utf8fixCC(uchar *msg, int lenMsg, uchar replChar)
+{
+	int i = 0;
+	int end;
+
+	while(i < lenMsg) {
+		if(ccCleanPrefix != NULL) {
+			i += ccCleanPrefix(msg + i, lenMsg - i);
+			if(i >= lenMsg)
+				break;
+		}
+		end = (ccCleanPrefix == NULL || lenMsg - i < SCALAR_CHUNK) ? lenMsg : i + SCALAR_CHUNK;
+		for( ; i < end ; ++i) {
+			if(msg[i] < 32 || msg[i] > 126) {
+				msg[i] = replChar;
+			}
+		}
+	}
+}
+
+void
+utf8fixUTF8(uchar *msg, int lenMsg, uchar replChar)
+{
+	int i = 0;
+
+	while(i < lenMsg) {
+		i += utf8CleanPrefix(msg + i, lenMsg - i);
+		if(i >= lenMsg)
+			break;
+		i = doUTF8Scalar(replChar, msg, lenMsg, i, i + SCALAR_CHUNK);
+	}
+}
@@ -0,0 +1,30 @@
+/* Definitions for the mmutf8fix validation and repair routines.
+ *
+ * Copyright 2026 Adiscon GmbH.
+ *
+ * This file is part of rsyslog.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef INCLUDED_UTF8FIX_H
+#define INCLUDED_UTF8FIX_H
+
+/* prototypes */
+void utf8fixInit(int bNoSIMD);
+const char *utf8fixImplName(void);
+void utf8fixCC(uchar *msg, int lenMsg, uchar replChar);
+void utf8fixUTF8(uchar *msg, int lenMsg, uchar replChar);
+
+#endif /* #ifndef INCLUDED_UTF8FIX_H */
@@ -96,11 +96,31 @@ typedef struct _instanceData {
 	sbool dynParent;
 	sbool dynBulkId;
 	sbool bulkmode;
+	size_t maxbytes;	/* submit bulk request when this size is reached, 0 - only at end of batch */
+	int inflightRequests;	/* max number of concurrent bulk requests per worker */
 	sbool asyncRepl;
         sbool useHttps;
         sbool allowUnsignedCerts;
 } instanceData;
 
+/* per-message state of a bulk mode transaction */
+#define ES_MSG_DONE 0x01	/* committed by this try of the transaction */
+#define ES_MSG_DONE_PREV 0x02	/* committed by the previous, failed, try */
+
+/* a bulk request, possibly still in flight. Each one has its own curl
+ * handle, so that multiple requests can be active at the same time.
+ */
+typedef struct esBulkReq_s {
+	CURL	*curlHandle;
+	sbool	bBusy;		/* request is in flight */
+	char	*body;		/* request data, owned by us */
+	int	nmemb;		/* number of messages in request */
+	int	*msgIdx;	/* index of each message in the transaction */
+	int	maxMsgIdx;	/* size of msgIdx */
+	char	*reply;
+	int	replyLen;
+} esBulkReq_t;
+
 typedef struct wrkrInstanceData {
 	instanceData *pData;
 	int replyLen;
@@ -111,9 +131,24 @@ typedef struct wrkrInstanceData {
 	struct {
 		es_str_t *data;
 		int nmemb;	/* number of messages in batch (for statistics counting) */
+		int *msgIdx;	/* index of each message in the transaction */
+		int maxMsgIdx;	/* size of msgIdx */
 		uchar *currTpl1;
 		uchar *currTpl2;
 	} batch;
+	CURLM	*curlMulti;	/* bulk mode: drives our concurrent requests */
+	esBulkReq_t *bulkReqs;	/* bulk mode: pData->inflightRequests slots */
+	int	nInFlight;
+	rsRetVal iRetBulk;	/* first error of a completed bulk request, not yet reported */
+	struct {	/* what the current transaction committed, see doAction() */
+		int	iMsg;		/* index of the next message */
+		sbool	bFailed;	/* a request failed, do not submit any more */
+		sbool	bCommitted;	/* a request committed since the last doAction() */
+		sbool	bRetry;		/* the previous transaction failed, this is its retry */
+		int	nMsgsPrev;	/* number of messages of the failed transaction */
+		uchar	*msgState;	/* ES_MSG_* flags, indexed by message index */
+		int	maxMsgState;	/* size of msgState */
+	} tx;
 } wrkrInstanceData_t;
 
 /* tables for interfacing with the v6 config system */
@@ -130,6 +165,8 @@ static struct cnfparamdescr actpdescr[] = {
 	{ "dynsearchtype", eCmdHdlrBinary, 0 },
 	{ "dynparent", eCmdHdlrBinary, 0 },
 	{ "bulkmode", eCmdHdlrBinary, 0 },
+	{ "maxbytes", eCmdHdlrSize, 0 },
+	{ "inflightrequests", eCmdHdlrPositiveInt, 0 },
 	{ "asyncrepl", eCmdHdlrBinary, 0 },
         { "usehttps", eCmdHdlrBinary, 0 },
 	{ "timeout", eCmdHdlrGetWord, 0 },
@@ -148,6 +185,8 @@ static struct cnfparamblk actpblk =
 	};
 
 static rsRetVal curlSetup(wrkrInstanceData_t *pWrkrData, instanceData *pData);
+static rsRetVal bulkSetup(wrkrInstanceData_t *pWrkrData, instanceData *pData);
+static void bulkWait(wrkrInstanceData_t *pWrkrData, int maxInFlight);
 
 BEGINcreateInstance
 CODESTARTcreateInstance
@@ -168,6 +207,8 @@ CODESTARTcreateWrkrInstance
 		}
 	}
 	CHKiRet(curlSetup(pWrkrData, pWrkrData->pData));
+	if(pData->bulkmode)
+		CHKiRet(bulkSetup(pWrkrData, pWrkrData->pData));
 finalize_it:
 ENDcreateWrkrInstance
 
@@ -195,7 +236,22 @@ CODESTARTfreeInstance
 ENDfreeInstance
 
 BEGINfreeWrkrInstance
+	int i;
 CODESTARTfreeWrkrInstance
+	if(pWrkrData->curlMulti != NULL) {
+		/* results of outstanding requests still go to stats and error file */
+		bulkWait(pWrkrData, 0);
+		curl_multi_cleanup(pWrkrData->curlMulti);
+		pWrkrData->curlMulti = NULL;
+	}
+	if(pWrkrData->bulkReqs != NULL) {
+		for(i = 0 ; i < pWrkrData->pData->inflightRequests ; ++i) {
+			if(pWrkrData->bulkReqs[i].curlHandle != NULL)
+				curl_easy_cleanup(pWrkrData->bulkReqs[i].curlHandle);
+			free(pWrkrData->bulkReqs[i].msgIdx);
+		}
+		free(pWrkrData->bulkReqs);
+	}
 	if(pWrkrData->postHeader) {
 		curl_slist_free_all(pWrkrData->postHeader);
 		pWrkrData->postHeader = NULL;
@@ -206,6 +262,8 @@ CODESTARTfreeWrkrInstance
 	}
 	free(pWrkrData->restURL);
 	es_deleteStr(pWrkrData->batch.data);
+	free(pWrkrData->batch.msgIdx);
+	free(pWrkrData->tx.msgState);
 ENDfreeWrkrInstance
 
 BEGINdbgPrintInstInfo
@@ -226,6 +284,8 @@ CODESTARTdbgPrintInstInfo
 	dbgprintf("\tasync replication=%d\n", pData->asyncRepl);
         dbgprintf("\tuse https=%d\n", pData->useHttps);
 	dbgprintf("\tbulkmode=%d\n", pData->bulkmode);
+	dbgprintf("\tmaxbytes=%zu\n", pData->maxbytes);
+	dbgprintf("\tinflightrequests=%d\n", pData->inflightRequests);
 	dbgprintf("\tallowUnsignedCerts=%d\n", pData->allowUnsignedCerts);
 	dbgprintf("\terrorfile='%s'\n", pData->errorFile == NULL ?
 		(uchar*)"(not configured)" : pData->errorFile);
@@ -465,12 +525,12 @@ finalize_it:
 }
 
 
-/* this method does not directly submit but builds a batch instead. It
- * may submit, if we have dynamic index/type and the current type or
- * index changes.
+/* append the bulk request lines for one message to *pBatch. Each
+ * message carries its own meta line, so any sequence of them forms a
+ * valid bulk request.
  */
 static rsRetVal
-buildBatch(wrkrInstanceData_t *pWrkrData, uchar *message, uchar **tpls)
+buildBatch(wrkrInstanceData_t *pWrkrData, es_str_t **pBatch, uchar *message, uchar **tpls)
 {
 	int length = strlen((char *)message);
 	int r;
@@ -486,29 +546,27 @@ buildBatch(wrkrInstanceData_t *pWrkrData, uchar *message, uchar **tpls)
 #	define META_END  "\"}}\n"
 
 	getIndexTypeAndParent(pWrkrData->pData, tpls, &searchIndex, &searchType, &parent, &bulkId);
-	r = es_addBuf(&pWrkrData->batch.data, META_STRT, sizeof(META_STRT)-1);
-	if(r == 0) r = es_addBuf(&pWrkrData->batch.data, (char*)searchIndex,
+	r = es_addBuf(pBatch, META_STRT, sizeof(META_STRT)-1);
+	if(r == 0) r = es_addBuf(pBatch, (char*)searchIndex,
 				 ustrlen(searchIndex));
-	if(r == 0) r = es_addBuf(&pWrkrData->batch.data, META_TYPE, sizeof(META_TYPE)-1);
-	if(r == 0) r = es_addBuf(&pWrkrData->batch.data, (char*)searchType,
+	if(r == 0) r = es_addBuf(pBatch, META_TYPE, sizeof(META_TYPE)-1);
+	if(r == 0) r = es_addBuf(pBatch, (char*)searchType,
 				 ustrlen(searchType));
 	if(parent != NULL) {
-		if(r == 0) r = es_addBuf(&pWrkrData->batch.data, META_PARENT, sizeof(META_PARENT)-1);
-		if(r == 0) r = es_addBuf(&pWrkrData->batch.data, (char*)parent, ustrlen(parent));
+		if(r == 0) r = es_addBuf(pBatch, META_PARENT, sizeof(META_PARENT)-1);
+		if(r == 0) r = es_addBuf(pBatch, (char*)parent, ustrlen(parent));
 	}
 	if(bulkId != NULL) {
-		if(r == 0) r = es_addBuf(&pWrkrData->batch.data, META_ID, sizeof(META_ID)-1);
-		if(r == 0) r = es_addBuf(&pWrkrData->batch.data, (char*)bulkId, ustrlen(bulkId));
+		if(r == 0) r = es_addBuf(pBatch, META_ID, sizeof(META_ID)-1);
+		if(r == 0) r = es_addBuf(pBatch, (char*)bulkId, ustrlen(bulkId));
 	}
-	if(r == 0) r = es_addBuf(&pWrkrData->batch.data, META_END, sizeof(META_END)-1);
-	if(r == 0) r = es_addBuf(&pWrkrData->batch.data, (char*)message, length);
-	if(r == 0) r = es_addBuf(&pWrkrData->batch.data, "\n", sizeof("\n")-1);
+	if(r == 0) r = es_addBuf(pBatch, META_END, sizeof(META_END)-1);
+	if(r == 0) r = es_addBuf(pBatch, (char*)message, length);
+	if(r == 0) r = es_addBuf(pBatch, "\n", sizeof("\n")-1);
 	if(r != 0) {
 		DBGPRINTF("omelasticsearch: growing batch failed with code %d\n", r);
 		ABORT_FINALIZE(RS_RET_ERR);
 	}
-	++pWrkrData->batch.nmemb;
-	iRet = RS_RET_DEFER_COMMIT;
 
 finalize_it:
 	RETiRet;
@@ -1085,23 +1143,354 @@ finalize_it:
 	RETiRet;
 }
 
+/* bulk request POST result */
+static size_t
+bulkResult(void *ptr, size_t size, size_t nmemb, void *userdata)
+{
+	esBulkReq_t *pReq = (esBulkReq_t*) userdata;
+	const size_t len = size*nmemb;
+	char *buf;
+
+	if((buf = realloc(pReq->reply, pReq->replyLen + len + 1)) == NULL) {
+		DBGPRINTF("omelasticsearch: realloc failed in bulkResult\n");
+		return 0; /* abort due to failure */
+	}
+	memcpy(buf+pReq->replyLen, ptr, len);
+	pReq->replyLen += len;
+	buf[pReq->replyLen] = '\0';
+	pReq->reply = buf;
+	return len;
+}
+
+
+/* process a completed bulk request. Errors are handled the same way as
+ * for the synchronous case (see curlPost()). ES replies with one item per
+ * message, in request order. So each message that has an item in the reply
+ * has been processed by ES (successfully or, if the item reports an error,
+ * it is written to the error file) and is flagged as committed. Messages
+ * without an item are retried with the transaction.
+ */
+static rsRetVal
+bulkReqDone(wrkrInstanceData_t *pWrkrData, esBulkReq_t *pReq, CURLcode code)
+{
+	cJSON *root = NULL;
+	cJSON *items;
+	cJSON *errors;
+	int nItems = 0;
+	int i;
+	DEFiRet;
+
+	if (   code == CURLE_COULDNT_RESOLVE_HOST
+	    || code == CURLE_COULDNT_RESOLVE_PROXY
+	    || code == CURLE_COULDNT_CONNECT
+	    || code == CURLE_WRITE_ERROR
+	   ) {
+		STATSCOUNTER_INC(indexHTTPReqFail, mutIndexHTTPReqFail);
+		indexHTTPFail += pReq->nmemb;
+		DBGPRINTF("omelasticsearch: we are suspending ourselfs due "
+			  "to failure %lld of bulk request\n", (long long) code);
+		ABORT_FINALIZE(RS_RET_SUSPENDED);
+	}
+
+	if(pReq->reply != NULL)
+		root = cJSON_Parse(pReq->reply);
+	if(root != NULL) {
+		items = cJSON_GetObjectItem(root, "items");
+		if(items != NULL && items->type == cJSON_Array)
+			nItems = cJSON_GetArraySize(items);
+	}
+	if(nItems > pReq->nmemb)
+		nItems = pReq->nmemb;
+	for(i = 0 ; i < nItems ; ++i)
+		pWrkrData->tx.msgState[pReq->msgIdx[i]] |= ES_MSG_DONE;
+	if(nItems > 0)
+		pWrkrData->tx.bCommitted = 1;
+
+	errors = (root == NULL) ? NULL : cJSON_GetObjectItem(root, "errors");
+	if(errors != NULL && errors->type == cJSON_False && nItems == pReq->nmemb) {
+		DBGPRINTF("omelasticsearch: bulk reply for %d messages reports no errors\n",
+			  pReq->nmemb);
+		FINALIZE;
+	}
+
+	if(nItems > 0) {
+		/* checkResult() works on the worker's reply buffer */
+		DBGPRINTF("omelasticsearch: bulk reply needs to be checked, replyLen = '%d'\n",
+			  pReq->replyLen);
+		pWrkrData->reply = pReq->reply;
+		pWrkrData->replyLen = pReq->replyLen;
+		iRet = checkResult(pWrkrData, (uchar*) pReq->body);
+		pWrkrData->reply = NULL;
+		pWrkrData->replyLen = 0;
+	}
+	if(nItems < pReq->nmemb) {
+		DBGPRINTF("omelasticsearch: bulk reply has items for %d of %d messages, "
+			  "retrying the others\n", nItems, pReq->nmemb);
+		STATSCOUNTER_INC(indexESFail, mutIndexESFail);
+		iRet = RS_RET_SUSPENDED;
+	}
+
+finalize_it:
+	if(root != NULL)
+		cJSON_Delete(root);
+	free(pReq->reply);
+	pReq->reply = NULL;
+	pReq->replyLen = 0;
+	free(pReq->body);
+	pReq->body = NULL;
+	RETiRet;
+}
+
+
+/* collect the results of all bulk requests that are completed. The
+ * first error is kept until it can be reported to the action. Which of
+ * the messages were committed is recorded by bulkReqDone().
+ */
+static void
+bulkReap(wrkrInstanceData_t *pWrkrData)
+{
+	CURLMsg *msg;
+	CURLcode code;
+	esBulkReq_t *pReq;
+	int nMsgs;
+	rsRetVal localRet;
+
+	while((msg = curl_multi_info_read(pWrkrData->curlMulti, &nMsgs)) != NULL) {
+		if(msg->msg != CURLMSG_DONE)
+			continue;
+		code = msg->data.result; /* msg is invalid after remove_handle! */
+		curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**) &pReq);
+		curl_multi_remove_handle(pWrkrData->curlMulti, pReq->curlHandle);
+		localRet = bulkReqDone(pWrkrData, pReq, code);
+		pReq->bBusy = 0;
+		--pWrkrData->nInFlight;
+		if(localRet != RS_RET_OK && pWrkrData->iRetBulk == RS_RET_OK)
+			pWrkrData->iRetBulk = localRet;
+		/* only suspension means ES did not get (some of) the messages.
+		 * Other errors are permanent and must not be retried.
+		 */
+		if(localRet == RS_RET_SUSPENDED)
+			pWrkrData->tx.bFailed = 1;
+	}
+}
+
+
+/* drive the in-flight bulk requests until at most maxInFlight are left */
+static void
+bulkWait(wrkrInstanceData_t *pWrkrData, int maxInFlight)
+{
+	int running;
+	int numfds;
+
+	curl_multi_perform(pWrkrData->curlMulti, &running);
+	bulkReap(pWrkrData);
+	while(pWrkrData->nInFlight > maxInFlight) {
+		curl_multi_wait(pWrkrData->curlMulti, NULL, 0, 1000, &numfds);
+		curl_multi_perform(pWrkrData->curlMulti, &running);
+		bulkReap(pWrkrData);
+	}
+}
+
+
+/* obtain (and reset) the result of the completed bulk requests */
+static rsRetVal
+bulkGetResult(wrkrInstanceData_t *pWrkrData)
+{
+	rsRetVal iRetBulk = pWrkrData->iRetBulk;
+	pWrkrData->iRetBulk = RS_RET_OK;
+	return iRetBulk;
+}
+
+
+/* submit the current batch as a bulk request. If the maximum number of
+ * requests is already in flight, we wait until one of them completes.
+ * The request is only started here; its result is checked when it
+ * completes, and errors are reported on the next call to the action.
+ */
+static rsRetVal
+bulkSubmit(wrkrInstanceData_t *pWrkrData)
+{
+	esBulkReq_t *pReq = NULL;
+	int *newIdx;
+	int running;
+	int i;
+	DEFiRet;
+
+	if(es_strlen(pWrkrData->batch.data) == 0)
+		FINALIZE;
+
+	bulkWait(pWrkrData, pWrkrData->pData->inflightRequests - 1);
+	for(i = 0 ; i < pWrkrData->pData->inflightRequests ; ++i) {
+		if(!pWrkrData->bulkReqs[i].bBusy) {
+			pReq = &pWrkrData->bulkReqs[i];
+			break;
+		}
+	}
+	assert(pReq != NULL);
+
+	if(pReq->maxMsgIdx < pWrkrData->batch.nmemb) {
+		CHKmalloc(newIdx = realloc(pReq->msgIdx, pWrkrData->batch.nmemb * sizeof(int)));
+		pReq->msgIdx = newIdx;
+		pReq->maxMsgIdx = pWrkrData->batch.nmemb;
+	}
+	memcpy(pReq->msgIdx, pWrkrData->batch.msgIdx, pWrkrData->batch.nmemb * sizeof(int));
+	CHKmalloc(pReq->body = es_str2cstr(pWrkrData->batch.data, NULL));
+	pReq->nmemb = pWrkrData->batch.nmemb;
+	DBGPRINTF("omelasticsearch: submitting bulk request with %d messages, %d bytes, "
+		  "%d requests already in flight\n", pReq->nmemb,
+		  (int) es_strlen(pWrkrData->batch.data), pWrkrData->nInFlight);
+	curl_easy_setopt(pReq->curlHandle, CURLOPT_POSTFIELDS, pReq->body);
+	curl_easy_setopt(pReq->curlHandle, CURLOPT_POSTFIELDSIZE, (long) es_strlen(pWrkrData->batch.data));
+	if(curl_multi_add_handle(pWrkrData->curlMulti, pReq->curlHandle) != CURLM_OK) {
+		DBGPRINTF("omelasticsearch: curl_multi_add_handle failed\n");
+		free(pReq->body);
+		pReq->body = NULL;
+		ABORT_FINALIZE(RS_RET_SUSPENDED);
+	}
+	pReq->bBusy = 1;
+	++pWrkrData->nInFlight;
+	curl_multi_perform(pWrkrData->curlMulti, &running);
+
+	es_emptyStr(pWrkrData->batch.data);
+	pWrkrData->batch.nmemb = 0;
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* Bulk mode transactions and retries.
+ * With maxbytes, parts of a batch are committed to ES while the batch
+ * is still being built. If a later request fails, the core retries the
+ * very same batch, which would index the already committed parts a second
+ * time. So we remember, by their index in the batch, which messages of a
+ * failed transaction were committed, and do not send them again when the
+ * retry comes in. If the core gives up on the batch instead, it calls
+ * abortTransaction(), and the next transaction is sent completely.
+ */
+
+/* begin a new try of a transaction, the state of the previous
+ * one is kept in the msgState flags.
+ */
+static void
+txReset(wrkrInstanceData_t *pWrkrData)
+{
+	pWrkrData->tx.iMsg = 0;
+	pWrkrData->tx.bFailed = 0;
+	pWrkrData->tx.bCommitted = 0;
+	es_emptyStr(pWrkrData->batch.data);
+	pWrkrData->batch.nmemb = 0;
+}
+
+
+/* make sure message iMsg fits into msgState and the batch */
+static rsRetVal
+txGrow(wrkrInstanceData_t *pWrkrData, int iMsg)
+{
+	uchar *newState;
+	int *newIdx;
+	int newSize;
+	DEFiRet;
+
+	if(iMsg >= pWrkrData->tx.maxMsgState) {
+		newSize = 2 * iMsg + 64;
+		CHKmalloc(newState = realloc(pWrkrData->tx.msgState, newSize));
+		memset(newState + pWrkrData->tx.maxMsgState, 0, newSize - pWrkrData->tx.maxMsgState);
+		pWrkrData->tx.msgState = newState;
+		pWrkrData->tx.maxMsgState = newSize;
+	}
+	if(pWrkrData->batch.nmemb >= pWrkrData->batch.maxMsgIdx) {
+		newSize = 2 * pWrkrData->batch.nmemb + 64;
+		CHKmalloc(newIdx = realloc(pWrkrData->batch.msgIdx, newSize * sizeof(int)));
+		pWrkrData->batch.msgIdx = newIdx;
+		pWrkrData->batch.maxMsgIdx = newSize;
+	}
+finalize_it:
+	RETiRet;
+}
+
+
+/* add message iMsg to the batch and submit it if maxbytes is reached.
+ * The request is processed asynchronously and we continue building the
+ * next batch while it is in flight.
+ */
+static rsRetVal
+batchAdd(wrkrInstanceData_t *pWrkrData, int iMsg, uchar **tpls)
+{
+	DEFiRet;
+
+	CHKiRet(buildBatch(pWrkrData, &pWrkrData->batch.data, tpls[0], tpls));
+	pWrkrData->batch.msgIdx[pWrkrData->batch.nmemb++] = iMsg;
+	if(pWrkrData->pData->maxbytes > 0
+	   && es_strlen(pWrkrData->batch.data) >= pWrkrData->pData->maxbytes) {
+		CHKiRet(bulkSubmit(pWrkrData));
+	}
+finalize_it:
+	RETiRet;
+}
+
+
+/* end a try of a transaction. If it failed, remember what it committed,
+ * including what the try before committed if this was its retry.
+ */
+static void
+txEnd(wrkrInstanceData_t *pWrkrData, rsRetVal iRet)
+{
+	uchar *const msgState = pWrkrData->tx.msgState;
+	int i;
+
+	if(iRet == RS_RET_OK) {
+		pWrkrData->tx.bRetry = 0;
+		if(msgState != NULL)
+			memset(msgState, 0, pWrkrData->tx.maxMsgState);
+	} else {
+		for(i = 0 ; i < pWrkrData->tx.iMsg ; ++i)
+			msgState[i] = (msgState[i] != 0) ? ES_MSG_DONE_PREV : 0;
+		pWrkrData->tx.bRetry = 1;
+		pWrkrData->tx.nMsgsPrev = pWrkrData->tx.iMsg;
+		DBGPRINTF("omelasticsearch: transaction with %d messages failed, "
+			  "committed messages will not be sent again on retry\n",
+			  pWrkrData->tx.iMsg);
+	}
+	txReset(pWrkrData);
+}
+
+
 BEGINbeginTransaction
 CODESTARTbeginTransaction
 	if(!pWrkrData->pData->bulkmode) {
 		FINALIZE;
 	}
 
-	es_emptyStr(pWrkrData->batch.data);
-	pWrkrData->batch.nmemb = 0;
+	txReset(pWrkrData);
 finalize_it:
 ENDbeginTransaction
 
 
+/* In bulk mode, errors of requests are not reported here, but only
+ * from endTransaction. Otherwise the core would start a new transaction
+ * for the rest of the batch, and we could not tell which messages must
+ * be retried.
+ */
 BEGINdoAction
+	int iMsg;
 CODESTARTdoAction
 	STATSCOUNTER_INC(indexSubmit, mutIndexSubmit);
 	if(pWrkrData->pData->bulkmode) {
-		CHKiRet(buildBatch(pWrkrData, ppString[0], ppString));
+		CHKiRet(txGrow(pWrkrData, pWrkrData->tx.iMsg));
+		iMsg = pWrkrData->tx.iMsg++;
+		if(pWrkrData->tx.bRetry && iMsg < pWrkrData->tx.nMsgsPrev
+		   && (pWrkrData->tx.msgState[iMsg] & ES_MSG_DONE_PREV)) {
+			DBGPRINTF("omelasticsearch: message %d committed by previous try, "
+				  "not sending it again\n", iMsg);
+		} else if(!pWrkrData->tx.bFailed) {
+			if(batchAdd(pWrkrData, iMsg, ppString) != RS_RET_OK) {
+				/* the message is retried with the transaction */
+				pWrkrData->tx.bFailed = 1;
+			}
+		}
+		iRet = pWrkrData->tx.bCommitted ? RS_RET_PREVIOUS_COMMITTED : RS_RET_DEFER_COMMIT;
+		pWrkrData->tx.bCommitted = 0;
 	} else {
 		CHKiRet(curlPost(pWrkrData, ppString[0], strlen((char*)ppString[0]),
 		                 ppString, 1));
@@ -1110,21 +1499,36 @@ finalize_it:
 ENDdoAction
 
 
+/* In bulk mode, the batch is only committed when all of its requests
+ * have completed. If one of them failed, the transaction is retried,
+ * but only with the messages that were not yet committed.
+ */
 BEGINendTransaction
-	char *cstr = NULL;
 CODESTARTendTransaction
 	/* End Transaction only if batch data is not empty */
-	if (pWrkrData->batch.data != NULL ) {
-		cstr = es_str2cstr(pWrkrData->batch.data, NULL);
-		dbgprintf("omelasticsearch: endTransaction, batch: '%s'\n", cstr);
-		CHKiRet(curlPost(pWrkrData, (uchar*) cstr, strlen(cstr), NULL, pWrkrData->batch.nmemb));
+	if (pWrkrData->pData->bulkmode && pWrkrData->batch.data != NULL ) {
+		if(!pWrkrData->tx.bFailed && bulkSubmit(pWrkrData) != RS_RET_OK)
+			pWrkrData->tx.bFailed = 1;
+		bulkWait(pWrkrData, 0);
+		iRet = bulkGetResult(pWrkrData);
+		if(pWrkrData->tx.bFailed)
+			iRet = RS_RET_SUSPENDED;
+		txEnd(pWrkrData, iRet);
 	}
 	else
 		dbgprintf("omelasticsearch: endTransaction, pWrkrData->batch.data is NULL, nothing to send. \n");
-finalize_it:
-	free(cstr);
 ENDendTransaction
 
+
+BEGINabortTransaction
+CODESTARTabortTransaction
+	if(pWrkrData->pData->bulkmode) {
+		pWrkrData->tx.bRetry = 0;
+		if(pWrkrData->tx.msgState != NULL)
+			memset(pWrkrData->tx.msgState, 0, pWrkrData->tx.maxMsgState);
+	}
+ENDabortTransaction
+
 /* elasticsearch POST result string ... useful for debugging */
 static size_t
 curlResult(void *ptr, size_t size, size_t nmemb, void *userdata)
@@ -1182,6 +1586,35 @@ curlSetup(wrkrInstanceData_t *pWrkrData, instanceData *pData)
 	return RS_RET_OK;
 }
 
+/* set up the handles for concurrent bulk requests. They share all
+ * options with the primary handle, so we simply duplicate it.
+ */
+static rsRetVal
+bulkSetup(wrkrInstanceData_t *pWrkrData, instanceData *pData)
+{
+	esBulkReq_t *pReq;
+	int i;
+	DEFiRet;
+
+	CHKmalloc(pWrkrData->bulkReqs = calloc(pData->inflightRequests, sizeof(esBulkReq_t)));
+	if((pWrkrData->curlMulti = curl_multi_init()) == NULL)
+		ABORT_FINALIZE(RS_RET_OBJ_CREATION_FAILED);
+	for(i = 0 ; i < pData->inflightRequests ; ++i) {
+		pReq = &pWrkrData->bulkReqs[i];
+		if((pReq->curlHandle = curl_easy_duphandle(pWrkrData->curlHandle)) == NULL)
+			ABORT_FINALIZE(RS_RET_OBJ_CREATION_FAILED);
+		curl_easy_setopt(pReq->curlHandle, CURLOPT_WRITEFUNCTION, bulkResult);
+		curl_easy_setopt(pReq->curlHandle, CURLOPT_WRITEDATA, pReq);
+		curl_easy_setopt(pReq->curlHandle, CURLOPT_PRIVATE, pReq);
+	}
+	pWrkrData->iRetBulk = RS_RET_OK;
+	DBGPRINTF("omelasticsearch: up to %d concurrent bulk requests per worker\n",
+		  pData->inflightRequests);
+
+finalize_it:
+	RETiRet;
+}
+
 static void
 setInstParamDefaults(instanceData *pData)
 {
@@ -1199,6 +1632,8 @@ setInstParamDefaults(instanceData *pData)
 	pData->asyncRepl = 0;
         pData->useHttps = 0;
 	pData->bulkmode = 0;
+	pData->maxbytes = 0;
+	pData->inflightRequests = 1;
 	pData->allowUnsignedCerts = 0;
 	pData->tplName = NULL;
 	pData->errorFile = NULL;
@@ -1251,6 +1686,10 @@ CODESTARTnewActInst
 			pData->dynParent = pvals[i].val.d.n;
 		} else if(!strcmp(actpblk.descr[i].name, "bulkmode")) {
 			pData->bulkmode = pvals[i].val.d.n;
+		} else if(!strcmp(actpblk.descr[i].name, "maxbytes")) {
+			pData->maxbytes = (size_t) pvals[i].val.d.n;
+		} else if(!strcmp(actpblk.descr[i].name, "inflightrequests")) {
+			pData->inflightRequests = (int) pvals[i].val.d.n;
 		} else if(!strcmp(actpblk.descr[i].name, "allowunsignedcerts")) {
 			pData->allowUnsignedCerts = pvals[i].val.d.n;
 		} else if(!strcmp(actpblk.descr[i].name, "timeout")) {
@@ -1435,6 +1874,7 @@ CODEqueryEtryPt_IsCompatibleWithFeature_IF_OMOD_QUERIES
 CODEqueryEtryPt_STD_CONF2_OMOD_QUERIES
 CODEqueryEtryPt_doHUP
 CODEqueryEtryPt_TXIF_OMOD_QUERIES /* we support the transactional interface! */
+CODEqueryEtryPt_abortTransaction
 ENDqueryEtryPt
 
 
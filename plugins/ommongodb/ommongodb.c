@@ -56,7 +56,6 @@ DEFobjCurrIf(errmsg)
 DEFobjCurrIf(datetime)
 
 typedef struct _instanceData {
-	mongo_sync_connection *conn;
 	struct json_tokener *json_tokener; /* only if (tplName != NULL) */
 	uchar *server;
 	int port;
@@ -66,11 +65,19 @@ typedef struct _instanceData {
 	uchar *pwd;
 	uchar *dbNcoll;
 	uchar *tplName;
-	int bErrMsgPermitted;	/* only one errmsg permitted per connection */
+	sbool bUnordered;	/* continue inserting the rest of a batch if one doc fails */
 } instanceData;
 
+/* each worker has its own connection, so workers can insert concurrently */
 typedef struct wrkrInstanceData {
 	instanceData *pData;
+	mongo_sync_connection *conn;
+	int bErrMsgPermitted;	/* only one errmsg permitted per connection */
+	bson **docs;		/* documents of current batch */
+	int nDocs;
+	int maxDocs;		/* current size of docs array */
+	int nDocsSent;		/* docs of a failed batch the server already accepted */
+	int nDocsTx;		/* size of the batch nDocsSent refers to */
 } wrkrInstanceData_t;
 
 
@@ -83,7 +90,8 @@ static struct cnfparamdescr actpdescr[] = {
 	{ "collection", eCmdHdlrGetWord, 0 },
 	{ "uid", eCmdHdlrGetWord, 0 },
 	{ "pwd", eCmdHdlrGetWord, 0 },
-	{ "template", eCmdHdlrGetWord, 0 }
+	{ "template", eCmdHdlrGetWord, 0 },
+	{ "unorderedinsert", eCmdHdlrBinary, 0 }
 };
 static struct cnfparamblk actpblk =
 	{ CNFPARAMBLK_VERSION,
@@ -91,8 +99,6 @@ static struct cnfparamblk actpblk =
 	  actpdescr
 	};
 
-static pthread_mutex_t mutDoAct = PTHREAD_MUTEX_INITIALIZER;
-
 BEGINcreateInstance
 CODESTARTcreateInstance
 ENDcreateInstance
@@ -111,18 +117,29 @@ CODESTARTisCompatibleWithFeature
 		iRet = RS_RET_OK;
 ENDisCompatibleWithFeature
 
-static void closeMongoDB(instanceData *pData)
+static void closeMongoDB(wrkrInstanceData_t *pWrkrData)
 {
-	if(pData->conn != NULL) {
-                mongo_sync_disconnect(pData->conn);
-		pData->conn = NULL;
+	if(pWrkrData->conn != NULL) {
+                mongo_sync_disconnect(pWrkrData->conn);
+		pWrkrData->conn = NULL;
 	}
 }
 
 
+/* discard the documents of the current batch */
+static void
+freeBatch(wrkrInstanceData_t *pWrkrData)
+{
+	int i;
+
+	for(i = 0 ; i < pWrkrData->nDocs ; ++i)
+		bson_free(pWrkrData->docs[i]);
+	pWrkrData->nDocs = 0;
+}
+
+
 BEGINfreeInstance
 CODESTARTfreeInstance
-	closeMongoDB(pData);
 	if (pData->json_tokener != NULL)
 		json_tokener_free(pData->json_tokener);
 	free(pData->server);
@@ -136,6 +153,9 @@ ENDfreeInstance
 
 BEGINfreeWrkrInstance
 CODESTARTfreeWrkrInstance
+	closeMongoDB(pWrkrData);
+	freeBatch(pWrkrData);
+	free(pWrkrData->docs);
 ENDfreeWrkrInstance
 
 
@@ -149,15 +169,15 @@ ENDdbgPrintInstInfo
 /* report error that occured during *last* operation
  */
 static void
-reportMongoError(instanceData *pData)
+reportMongoError(wrkrInstanceData_t *pWrkrData)
 {
 	char errStr[1024];
 	gchar *err;
 	int eno;
 
-	if(pData->bErrMsgPermitted) {
+	if(pWrkrData->bErrMsgPermitted) {
 		eno = errno;
-		if(mongo_sync_cmd_get_last_error(pData->conn, (gchar*)pData->db, &err) == TRUE) {
+		if(mongo_sync_cmd_get_last_error(pWrkrData->conn, (gchar*)pWrkrData->pData->db, &err) == TRUE) {
 			errmsg.LogError(0, RS_RET_ERR, "ommongodb: error: %s", err);
 		} else {
 			DBGPRINTF("ommongodb: we had an error, but can not obtain specifics, "
@@ -165,7 +185,7 @@ reportMongoError(instanceData *pData)
 			errmsg.LogError(0, RS_RET_ERR, "ommongodb: error: %s",
 				rs_strerror_r(eno, errStr, sizeof(errStr)));
 		}
-		pData->bErrMsgPermitted = 0;
+		pWrkrData->bErrMsgPermitted = 0;
 	}
 }
 
@@ -174,18 +194,19 @@ reportMongoError(instanceData *pData)
  * MongoDB connection.
  * Initially added 2004-10-28 mmeckelein
  */
-static rsRetVal initMongoDB(instanceData *pData, int bSilent)
+static rsRetVal initMongoDB(wrkrInstanceData_t *pWrkrData, int bSilent)
 {
+	instanceData *const pData = pWrkrData->pData;
 	const char *server;
 	DEFiRet;
 
 	server = (pData->server == NULL) ? "127.0.0.1" : (const char*) pData->server;
 	DBGPRINTF("ommongodb: trying connect to '%s' at port %d\n", server, pData->port);
 
-	pData->conn = mongo_sync_connect(server, pData->port, TRUE);
-	if(pData->conn == NULL) {
+	pWrkrData->conn = mongo_sync_connect(server, pData->port, TRUE);
+	if(pWrkrData->conn == NULL) {
 		if(!bSilent) {
-			reportMongoError(pData);
+			reportMongoError(pWrkrData);
 			dbgprintf("ommongodb: can not initialize MongoDB handle");
 		}
                 ABORT_FINALIZE(RS_RET_SUSPENDED);
@@ -198,15 +219,15 @@ static rsRetVal initMongoDB(instanceData *pData, int bSilent)
 	  if(!pData->uid || !pData->pwd) {
 	    dbgprintf("ommongodb: authentication requires uid and pwd attributes set; skipping");
 	  }
-	  else if(!mongo_sync_cmd_authenticate(pData->conn, (const gchar*)pData->db,
+	  else if(!mongo_sync_cmd_authenticate(pWrkrData->conn, (const gchar*)pData->db,
 	  	  			(const gchar*)pData->uid, (const gchar*)pData->pwd)) {
 	    if(!bSilent) {
-	      reportMongoError(pData);
+	      reportMongoError(pWrkrData);
 	      dbgprintf("ommongodb: could not authenticate %s against '%s'", pData->uid, pData->db);
 	    }
 
 	    /* no point in continuing with an unauthenticated connection */
-	    closeMongoDB(pData);
+	    closeMongoDB(pWrkrData);
 	    ABORT_FINALIZE(RS_RET_SUSPENDED);
 	  }
 	  else {
@@ -492,23 +513,134 @@ error:
 
 BEGINtryResume
 CODESTARTtryResume
-	if(pWrkrData->pData->conn == NULL) {
-		iRet = initMongoDB(pWrkrData->pData, 1);
+	if(pWrkrData->conn == NULL) {
+		iRet = initMongoDB(pWrkrData, 1);
 	}
 ENDtryResume
 
+
+/* send documents as a single OP_INSERT with the ContinueOnError flag
+ * set, so that the server inserts the remaining documents even if one
+ * of them fails (e.g. due to a duplicate key). libmongo-client does not
+ * provide an API for this flag, so we build the packet ourselves and
+ * patch the flags field, which is the first element of the message body.
+ */
+static gboolean
+insertUnorderedPacket(mongo_sync_connection *conn, const gchar *ns, gint32 n, const bson **docs)
+{
+	mongo_packet *p;
+	const guint8 *data;
+	guint8 *newData;
+	gint32 size;
+	const gint32 flags = GINT32_TO_LE(1); /* ContinueOnError, wire format is little endian */
+	gboolean ok = FALSE;
+
+	p = mongo_wire_cmd_insert_n(mongo_connection_get_requestid((mongo_connection*) conn) + 1,
+				    ns, n, docs);
+	if(p == NULL)
+		return FALSE;
+	if((size = mongo_wire_packet_get_data(p, &data)) < (gint32) sizeof(flags))
+		goto done;
+	if((newData = malloc(size)) == NULL)
+		goto done;
+	memcpy(newData, data, size);
+	memcpy(newData, &flags, sizeof(flags));
+	ok = mongo_wire_packet_set_data(p, newData, size);
+	free(newData);
+	if(ok)
+		ok = mongo_packet_send((mongo_connection*) conn, p);
+done:
+	mongo_wire_packet_free(p);
+	return ok;
+}
+
+
+/* As our own packets bypass the sync API, we also need to do its
+ * connection checks: make sure we talk to the master before sending,
+ * reconnecting if needed. If that fails, the connection is dropped and
+ * tryResume() builds a new one.
+ */
+static gboolean
+ensureMaster(wrkrInstanceData_t *pWrkrData)
+{
+	if(mongo_sync_cmd_is_master(pWrkrData->conn))
+		return TRUE;
+	if(mongo_sync_reconnect(pWrkrData->conn, TRUE) != NULL)
+		return TRUE;
+	DBGPRINTF("ommongodb: can not (re)connect to master\n");
+	closeMongoDB(pWrkrData);
+	return FALSE;
+}
+
+
+/* Batches and retries.
+ * A batch is sent in chunks that do not exceed the server's insert size
+ * limit, unordered ones as our own packets, ordered ones via the sync
+ * API. If a chunk fails, we return RS_RET_SUSPENDED and the core retries
+ * the very same batch. The chunks sent before the failing one have already
+ * been accepted by the server, so we remember how many documents of the
+ * batch were sent (nDocsSent) and start the retry after them. If the core
+ * gives up on the batch instead, it calls abortTransaction() and the next
+ * batch is sent completely.
+ */
+static gboolean
+insertChunk(wrkrInstanceData_t *pWrkrData, gint32 n, const bson **docs)
+{
+	instanceData *const pData = pWrkrData->pData;
+
+	if(pData->bUnordered)
+		return insertUnorderedPacket(pWrkrData->conn, (const gchar*) pData->dbNcoll, n, docs);
+	return mongo_sync_cmd_insert_n(pWrkrData->conn, (const gchar*) pData->dbNcoll, n, docs);
+}
+
+static gboolean
+insertBatch(wrkrInstanceData_t *pWrkrData)
+{
+	const gint32 maxSize = mongo_sync_conn_get_max_insert_size(pWrkrData->conn);
+	const bson **docs = (const bson**) pWrkrData->docs;
+	gint32 size = 0;
+	int first;
+	int i;
+
+	if(pWrkrData->nDocsTx != pWrkrData->nDocs)
+		pWrkrData->nDocsSent = 0; /* not a retry of the failed batch */
+	pWrkrData->nDocsTx = pWrkrData->nDocs;
+
+	if(pWrkrData->pData->bUnordered && !ensureMaster(pWrkrData))
+		return FALSE;
+
+	first = pWrkrData->nDocsSent;
+	for(i = first ; i < pWrkrData->nDocs ; ++i) {
+		if(i > first && size + bson_size(docs[i]) > maxSize) {
+			if(!insertChunk(pWrkrData, i - first, docs + first))
+				return FALSE;
+			pWrkrData->nDocsSent = first = i;
+			size = 0;
+		}
+		size += bson_size(docs[i]);
+	}
+	if(i > first && !insertChunk(pWrkrData, i - first, docs + first))
+		return FALSE;
+	pWrkrData->nDocsSent = 0;
+	return TRUE;
+}
+
+
+BEGINbeginTransaction
+CODESTARTbeginTransaction
+	freeBatch(pWrkrData);
+ENDbeginTransaction
+
+
+/* the documents are only collected here and sent in a single bulk
+ * insert at the end of the transaction.
+ */
 BEGINdoAction_NoStrings
 	bson *doc = NULL;
-	instanceData *pData;
+	bson **newDocs;
+	int newMax;
 CODESTARTdoAction
-	pthread_mutex_lock(&mutDoAct);
-	pData = pWrkrData->pData;
-	/* see if we are ready to proceed */
-	if(pData->conn == NULL) {
-		CHKiRet(initMongoDB(pData, 0));
-	}
-
-	if(pData->tplName == NULL) {
+	if(pWrkrData->pData->tplName == NULL) {
 		doc = getDefaultBSON((msg_t*)pMsgData);
 	} else {
 		doc = BSONFromJSONObject((struct json_object *)pMsgData);
@@ -518,21 +650,55 @@ CODESTARTdoAction
 		/* FIXME: is this a correct return code? */
 		ABORT_FINALIZE(RS_RET_ERR);
 	}
-	if(mongo_sync_cmd_insert(pData->conn, (char*)pData->dbNcoll, doc, NULL)) {
-		pData->bErrMsgPermitted = 1;
-	} else {
-		dbgprintf("ommongodb: insert error\n");
-		reportMongoError(pData);
-		ABORT_FINALIZE(RS_RET_SUSPENDED);
+
+	if(pWrkrData->nDocs == pWrkrData->maxDocs) {
+		newMax = (pWrkrData->maxDocs == 0) ? 64 : 2 * pWrkrData->maxDocs;
+		CHKmalloc(newDocs = realloc(pWrkrData->docs, newMax * sizeof(bson*)));
+		pWrkrData->docs = newDocs;
+		pWrkrData->maxDocs = newMax;
 	}
+	pWrkrData->docs[pWrkrData->nDocs++] = doc;
+	doc = NULL;
+	iRet = RS_RET_DEFER_COMMIT;
 
 finalize_it:
-	pthread_mutex_unlock(&mutDoAct);
 	if(doc != NULL)
 		bson_free(doc);
 ENDdoAction
 
 
+BEGINendTransaction
+CODESTARTendTransaction
+	if(pWrkrData->nDocs == 0)
+		FINALIZE;
+
+	/* see if we are ready to proceed */
+	if(pWrkrData->conn == NULL) {
+		CHKiRet(initMongoDB(pWrkrData, 0));
+	}
+
+	DBGPRINTF("ommongodb: inserting batch of %d documents (%s)\n", pWrkrData->nDocs,
+		  pWrkrData->pData->bUnordered ? "unordered" : "ordered");
+	if(insertBatch(pWrkrData)) {
+		pWrkrData->bErrMsgPermitted = 1;
+	} else {
+		dbgprintf("ommongodb: insert error\n");
+		reportMongoError(pWrkrData);
+		ABORT_FINALIZE(RS_RET_SUSPENDED);
+	}
+
+finalize_it:
+	/* on failure, the batch is resubmitted by the core */
+	freeBatch(pWrkrData);
+ENDendTransaction
+
+
+BEGINabortTransaction
+CODESTARTabortTransaction
+	pWrkrData->nDocsSent = 0;
+ENDabortTransaction
+
+
 static inline void
 setInstParamDefaults(instanceData *pData)
 {
@@ -543,6 +709,7 @@ setInstParamDefaults(instanceData *pData)
 	pData->uid = NULL;
 	pData->pwd = NULL;
 	pData->tplName = NULL;
+	pData->bUnordered = 0;
 }
 
 BEGINnewActInst
@@ -575,6 +742,8 @@ CODESTARTnewActInst
 			pData->pwd = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
 		} else if(!strcmp(actpblk.descr[i].name, "template")) {
 			pData->tplName = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
+		} else if(!strcmp(actpblk.descr[i].name, "unorderedinsert")) {
+			pData->bUnordered = pvals[i].val.d.n;
 		} else {
 			dbgprintf("ommongodb: program error, non-handled "
 			  "param '%s'\n", actpblk.descr[i].name);
@@ -636,6 +805,8 @@ CODESTARTqueryEtryPt
 CODEqueryEtryPt_STD_OMOD_QUERIES
 CODEqueryEtryPt_STD_OMOD8_QUERIES
 CODEqueryEtryPt_STD_CONF2_OMOD_QUERIES
+CODEqueryEtryPt_TXIF_OMOD_QUERIES /* we support the transactional interface! */
+CODEqueryEtryPt_abortTransaction
 ENDqueryEtryPt
 
 BEGINmodInit()
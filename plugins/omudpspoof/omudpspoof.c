@@ -107,6 +107,11 @@ typedef struct wrkrInstanceData {
 	int	*pSockArray;		/* sockets to use for UDP */
 	struct addrinfo *f_addr;
 	char errbuf[LIBNET_ERRBUF_SIZE];
+	/* progress of a failed transaction, so that its retry does not send
+	 * the already sent messages again (see commitTransaction)
+	 */
+	unsigned nTxSent;	/* messages sent before the failure */
+	unsigned nTxParams;	/* size of the failed transaction */
 } wrkrInstanceData_t;
 
 #define DFLT_SOURCE_PORT_START 32000
@@ -353,7 +358,8 @@ ENDdbgPrintInstInfo
 
 /* Send a message via UDP
  * Note: libnet is not thread-safe, so we need to ensure that only one
- * instance ever is calling libnet code.
+ * instance ever is calling libnet code. The caller must hold mutLibnet,
+ * which is acquired once per transaction (see commitTransaction).
  * rgehards, 2007-12-20
  */
 static inline rsRetVal
@@ -366,7 +372,6 @@ UDPSend(wrkrInstanceData_t *pWrkrData, uchar *pszSourcename, char *msg, size_t l
 	struct sockaddr_in *tempaddr,source_ip;
 	libnet_ptag_t ip, ipo;
 	libnet_ptag_t udp;
-	sbool bNeedUnlock = 0;
 	/* hdrOffs = fragmentation flags + offset (in bytes)
 	* divided by 8 */
 	unsigned msgOffs, hdrOffs; 
@@ -392,8 +397,6 @@ UDPSend(wrkrInstanceData_t *pWrkrData, uchar *pszSourcename, char *msg, size_t l
 	inet_pton(AF_INET, (char*)pszSourcename, &(source_ip.sin_addr));
 
 	bSendSuccess = RSFALSE;
-	d_pthread_mutex_lock(&mutLibnet);
-	bNeedUnlock = 1;
 	for (r = pWrkrData->f_addr; r && bSendSuccess == RSFALSE ; r = r->ai_next) {
 		tempaddr = (struct sockaddr_in *)r->ai_addr;
 		/* Getting max payload size (must be multiple of 8) */
@@ -516,9 +519,6 @@ finalize_it:
 			pWrkrData->libnet_handle = NULL;
 		}
 	}
-	if(bNeedUnlock) {
-		d_pthread_mutex_unlock(&mutLibnet);
-	}
 	RETiRet;
 }
 
@@ -593,26 +593,68 @@ CODESTARTtryResume
 	iRet = doTryResume(pWrkrData);
 ENDtryResume
 
-BEGINdoAction
-	char *psz; /* temporary buffering */
+BEGINbeginTransaction
+CODESTARTbeginTransaction
+	iRet = doTryResume(pWrkrData);
+ENDbeginTransaction
+
+
+/* We process the whole batch while holding the libnet mutex. This way,
+ * concurrent workers do not need to fight for the lock on each message.
+ * The packets themselves are still written by libnet, one per fragment,
+ * because the outcome of each write decides whether the next target
+ * address needs to be tried.
+ * If sending fails in the middle of a batch, the core retries the very
+ * same batch. As the messages before the failing one have already been
+ * sent, we remember how many of them there were and continue with the
+ * failed one. If the core gives up on the batch, abortTransaction() makes
+ * sure the next one is sent from the start.
+ */
+BEGINcommitTransaction
+	uchar *psz; /* temporary buffering */
 	unsigned l;
 	int iMaxLine;
-CODESTARTdoAction
+	unsigned i = 0;
+	sbool bNeedUnlock = 0;
+CODESTARTcommitTransaction
+	if(pWrkrData->nTxSent > 0 && pWrkrData->nTxParams == nParams) {
+		i = pWrkrData->nTxSent;
+		DBGPRINTF("omudpspoof: retried transaction, %u of %u messages already sent\n",
+			  i, nParams);
+	}
 	CHKiRet(doTryResume(pWrkrData));
 
-	DBGPRINTF(" %s:%s/omudpspoof, src '%s', msg strt '%.256s'\n", pWrkrData->pData->host,
-		  getFwdPt(pWrkrData->pData), ppString[1], ppString[0]);
-
 	iMaxLine = glbl.GetMaxLine();
-	psz = (char*) ppString[0];
-	l = strlen((char*) psz);
-	if((int) l > iMaxLine)
-		l = iMaxLine;
-
-	CHKiRet(UDPSend(pWrkrData, ppString[1], psz, l));
+	d_pthread_mutex_lock(&mutLibnet);
+	bNeedUnlock = 1;
+	for( ; i < nParams ; ++i) {
+		DBGPRINTF(" %s:%s/omudpspoof, src '%s', msg strt '%.256s'\n", pWrkrData->pData->host,
+			  getFwdPt(pWrkrData->pData), actParam(pParams, 2, i, 1).param,
+			  actParam(pParams, 2, i, 0).param);
+		psz = actParam(pParams, 2, i, 0).param;
+		l = actParam(pParams, 2, i, 0).lenStr;
+		if((int) l > iMaxLine)
+			l = iMaxLine;
+		CHKiRet(UDPSend(pWrkrData, actParam(pParams, 2, i, 1).param, (char*) psz, l));
+	}
 
 finalize_it:
-ENDdoAction
+	if(bNeedUnlock) {
+		d_pthread_mutex_unlock(&mutLibnet);
+	}
+	if(iRet == RS_RET_OK) {
+		pWrkrData->nTxSent = 0;
+	} else {
+		pWrkrData->nTxSent = i;
+		pWrkrData->nTxParams = nParams;
+	}
+ENDcommitTransaction
+
+
+BEGINabortTransaction
+CODESTARTabortTransaction
+	pWrkrData->nTxSent = 0;
+ENDabortTransaction
 
 
 static inline void
@@ -751,11 +793,12 @@ ENDmodExit
 
 BEGINqueryEtryPt
 CODESTARTqueryEtryPt
-CODEqueryEtryPt_STD_OMOD_QUERIES
+CODEqueryEtryPt_STD_OMODTX_QUERIES
 CODEqueryEtryPt_STD_OMOD8_QUERIES
 CODEqueryEtryPt_STD_CONF2_OMOD_QUERIES
 CODEqueryEtryPt_STD_CONF2_QUERIES
 CODEqueryEtryPt_STD_CONF2_setModCnf_QUERIES
+CODEqueryEtryPt_abortTransaction
 ENDqueryEtryPt
 
 
@@ -44,6 +44,7 @@
 #	define ATOMIC_INC(data, phlpmut) ((void) __sync_fetch_and_add(data, 1))
 #	define ATOMIC_INC_AND_FETCH_int(data, phlpmut) __sync_fetch_and_add(data, 1)
 #	define ATOMIC_INC_AND_FETCH_unsigned(data, phlpmut) __sync_fetch_and_add(data, 1)
+#	define ATOMIC_FETCH_AND_INC_unsigned(data, phlpmut) __sync_fetch_and_add(data, 1)
 #	define ATOMIC_DEC(data, phlpmut) ((void) __sync_sub_and_fetch(data, 1))
 #	define ATOMIC_DEC_AND_FETCH(data, phlpmut) __sync_sub_and_fetch(data, 1)
 #	define ATOMIC_FETCH_32BIT(data, phlpmut) ((unsigned) __sync_fetch_and_and(data, 0xffffffff))
@@ -54,6 +55,18 @@
 #	define ATOMIC_CAS(data, oldVal, newVal, phlpmut) __sync_bool_compare_and_swap(data, (oldVal), (newVal))
 #	define ATOMIC_CAS_time_t(data, oldVal, newVal, phlpmut) __sync_bool_compare_and_swap(data, (oldVal), (newVal))
 #	define ATOMIC_CAS_VAL(data, oldVal, newVal, phlpmut) __sync_val_compare_and_swap(data, (oldVal), (newVal));
+	/* load with acquire and store with release semantics. These are used to
+	 * publish a value that was computed once, so that readers can access it
+	 * without a lock. Older compilers only have the __sync builtins, where
+	 * we need to fall back to a full barrier.
+	 */
+#	ifdef __ATOMIC_ACQUIRE
+#		define ATOMIC_LOAD_ACQ(data) __atomic_load_n(data, __ATOMIC_ACQUIRE)
+#		define ATOMIC_STORE_REL(data, val) __atomic_store_n(data, (val), __ATOMIC_RELEASE)
+#	else
+#		define ATOMIC_LOAD_ACQ(data) __sync_fetch_and_add(data, 0)
+#		define ATOMIC_STORE_REL(data, val) { __sync_synchronize(); *(data) = (val); }
+#	endif
 
 	/* functions below are not needed if we have atomics */
 #	define DEF_ATOMIC_HELPER_MUT(x)
@@ -157,6 +170,16 @@
 		return(val);
 	}
 
+	/* returns the value before the increment, on all platforms */
+	static inline unsigned
+	ATOMIC_FETCH_AND_INC_unsigned(unsigned *data, pthread_mutex_t *phlpmut) {
+		unsigned val;
+		pthread_mutex_lock(phlpmut);
+		val = (*data)++;
+		pthread_mutex_unlock(phlpmut);
+		return(val);
+	}
+
 	static inline int
 	ATOMIC_DEC_AND_FETCH(int *data, pthread_mutex_t *phlpmut) {
 		int val;
@@ -181,6 +204,8 @@
 		(*data) -= val;
 		pthread_mutex_unlock(phlpmut);
 	}
+	/* without atomics, readers must hold the same lock as the writer. */
+#	define ATOMIC_STORE_REL(data, val) { *(data) = (val); }
 #	define DEF_ATOMIC_HELPER_MUT(x)  pthread_mutex_t x;
 #	define INIT_ATOMIC_HELPER_MUT(x) pthread_mutex_init(&(x), NULL);
 #	define DESTROY_ATOMIC_HELPER_MUT(x) pthread_mutex_destroy(&(x));
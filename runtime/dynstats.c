@@ -37,6 +37,7 @@ DEFobjCurrIf(statsobj)
 #define DYNSTATS_PARAM_RESETTABLE "resettable"
 #define DYNSTATS_PARAM_MAX_CARDINALITY "maxCardinality"
 #define DYNSTATS_PARAM_UNUSED_METRIC_LIFE "unusedMetricLife" /* in seconds */
+#define DYNSTATS_PARAM_TOP_K "topK"
 
 #define DYNSTATS_DEFAULT_RESETTABILITY 1
 #define DYNSTATS_DEFAULT_MAX_CARDINALITY 2000
@@ -50,7 +51,8 @@ static struct cnfparamdescr modpdescr[] = {
 	{ DYNSTATS_PARAM_NAME, eCmdHdlrString, CNFPARAM_REQUIRED },
 	{ DYNSTATS_PARAM_RESETTABLE, eCmdHdlrBinary, 0 },
 	{ DYNSTATS_PARAM_MAX_CARDINALITY, eCmdHdlrPositiveInt, 0},
-	{ DYNSTATS_PARAM_UNUSED_METRIC_LIFE, eCmdHdlrPositiveInt, 0} /* in minutes */
+	{ DYNSTATS_PARAM_UNUSED_METRIC_LIFE, eCmdHdlrPositiveInt, 0}, /* in minutes */
+	{ DYNSTATS_PARAM_TOP_K, eCmdHdlrPositiveInt, 0}
 };
 
 static struct cnfparamblk modpblk =
@@ -76,11 +78,13 @@ dynstats_destroyCtr(dynstats_ctr_t *ctr) {
 	free(ctr);
 }
 
-static inline void /* assumes exclusive access to bucket */
+static inline void /* assumes exclusive access to shard */
 dynstats_destroyCountersIn(dynstats_bucket_t *b, htable *table, dynstats_ctr_t *ctrs) {
 	dynstats_ctr_t *ctr;
 	int ctrs_purged = 0;
-	hashtable_destroy(table, 0);
+	if (table != NULL) {
+		hashtable_destroy(table, 0);
+	}
 	while (ctrs != NULL) {
 		ctr = ctrs;
 		ctrs = ctrs->next;
@@ -91,21 +95,50 @@ dynstats_destroyCountersIn(dynstats_bucket_t *b, htable *table, dynstats_ctr_t *
 	ATOMIC_SUB(&b->metricCount, ctrs_purged, &b->mutMetricCount);
 }
 
+static void
+dynstats_destroyUnlinkedCtrs(ctr_t *ctr) {
+	ctr_t *next;
+	while (ctr != NULL) {
+		next = ctr->next;
+		statsobj.DestructUnlinkedCounter(ctr);
+		ctr = next;
+	}
+}
+
 static inline void /* assumes exclusive access to bucket */
 dynstats_destroyCounters(dynstats_bucket_t *b) {
-	statsobj.UnlinkAllCounters(b->stats);
-	dynstats_destroyCountersIn(b, b->table, b->ctrs);
+	ctr_t *unlinked;
+	int i;
+	unlinked = statsobj.UnlinkAllCounters(b->stats);
+	if (b->topK) {
+		/* report slot counters are owned by the bucket itself */
+		dynstats_destroyUnlinkedCtrs(unlinked);
+	}
+	for (i = 0; i < DYNSTATS_SHARD_COUNT; i++) {
+		dynstats_destroyCountersIn(b, b->shards[i].table, b->shards[i].ctrs);
+	}
 }
 
 static void
 dynstats_destroyBucket(dynstats_bucket_t* b) {
 	dynstats_buckets_t *bkts;
+	int i;
 
 	bkts = &loadConf->dynstats_buckets;
 
 	pthread_rwlock_wrlock(&b->lock);
-	dynstats_destroyCounters(b);
-	dynstats_destroyCountersIn(b, b->survivor_table, b->survivor_ctrs);
+	if (b->stats != NULL) {
+		dynstats_destroyCounters(b);
+	}
+	for (i = 0; i < DYNSTATS_SHARD_COUNT; i++) {
+		dynstats_destroyCountersIn(b, b->shards[i].survivor_table, b->shards[i].survivor_ctrs);
+		free(b->shards[i].topkEntries);
+		free(b->shards[i].topkHeap);
+		pthread_rwlock_destroy(&b->shards[i].lock);
+		DESTROY_ATOMIC_HELPER_MUT(b->shards[i].mutTopkUnordered);
+		DESTROY_ATOMIC_HELPER_MUT64(b->shards[i].mutTopkCount);
+	}
+	free(b->topkSlots);
 	statsobj.Destruct(&b->stats);
 	free(b->name);
 	pthread_rwlock_unlock(&b->lock);
@@ -199,26 +232,42 @@ finalize_it:
 static void
 no_op_free(void __attribute__((unused)) *ignore)  {}
 
-static rsRetVal  /* assumes exclusive access to bucket */
-dynstats_rebuildSurvivorTable(dynstats_bucket_t *b) {
+static inline struct dynstats_shard_s *
+dynstats_getShard(dynstats_bucket_t *b, const uchar *metric) {
+	unsigned h;
+	/* hash_from_string() mixes the low bits poorly, so scramble it */
+	h = hash_from_string((void*) metric);
+	h ^= h >> 16;
+	h *= 0x45d9f3b;
+	h ^= h >> 16;
+	return &b->shards[h & (DYNSTATS_SHARD_COUNT - 1)];
+}
+
+static rsRetVal  /* assumes exclusive access to shard */
+dynstats_rebuildSurvivorTable(dynstats_bucket_t *b, struct dynstats_shard_s *shard) {
 	htable *survivor_table = NULL;
 	htable *new_table = NULL;
+	dynstats_ctr_t *ctr;
 	size_t htab_sz;
 	DEFiRet;
 	
-	htab_sz = (size_t) (DYNSTATS_HASHTABLE_SIZE_OVERPROVISIONING * b->maxCardinality + 1);
-	if (b->table == NULL) {
+	htab_sz = (size_t) (DYNSTATS_HASHTABLE_SIZE_OVERPROVISIONING * b->maxCardinality
+		/ DYNSTATS_SHARD_COUNT + 1);
+	if (shard->table == NULL) {
 		CHKmalloc(survivor_table = create_hashtable(htab_sz, hash_from_string, key_equals_string, no_op_free));
 	}
 	CHKmalloc(new_table = create_hashtable(htab_sz, hash_from_string, key_equals_string, no_op_free));
-	statsobj.UnlinkAllCounters(b->stats);
-	if (b->survivor_table != NULL) {
-		dynstats_destroyCountersIn(b, b->survivor_table, b->survivor_ctrs);
-	}
-	b->survivor_table = (b->table == NULL) ? survivor_table : b->table;
-	b->survivor_ctrs = b->ctrs;
-	b->table = new_table;
-	b->ctrs = NULL;
+	/* only this shard's counters go away, the others keep reporting */
+	for (ctr = shard->ctrs; ctr != NULL; ctr = ctr->next) {
+		statsobj.UnlinkCounter(b->stats, ctr->pCtr);
+	}
+	if (shard->survivor_table != NULL) {
+		dynstats_destroyCountersIn(b, shard->survivor_table, shard->survivor_ctrs);
+	}
+	shard->survivor_table = (shard->table == NULL) ? survivor_table : shard->table;
+	shard->survivor_ctrs = shard->ctrs;
+	shard->table = new_table;
+	shard->ctrs = NULL;
 finalize_it:
 	if (iRet != RS_RET_OK) {
 		errmsg.LogError(errno, RS_RET_INTERNAL_ERROR, "error trying to evict TTL-expired metrics of dyn-stats bucket named: %s", b->name);
@@ -227,7 +276,7 @@ finalize_it:
 		} else {
 			hashtable_destroy(new_table, 0);
 		}
-		if (b->table == NULL) {
+		if (shard->table == NULL) {
 			if (survivor_table == NULL) {
 				errmsg.LogError(errno, RS_RET_INTERNAL_ERROR, "error trying to initialize ttl-survivor hash-table for dyn-stats bucket named: %s", b->name);
 			} else {
@@ -238,11 +287,22 @@ finalize_it:
 	RETiRet;
 }
 
+/* reset the bucket. This is done shard by shard, so that at any time
+ * only a fraction of the metrics is blocked for the workers.
+ */
 static rsRetVal
 dynstats_resetBucket(dynstats_bucket_t *b) {
+	struct dynstats_shard_s *shard;
+	int i;
 	DEFiRet;
 	pthread_rwlock_wrlock(&b->lock);
-	CHKiRet(dynstats_rebuildSurvivorTable(b));
+	for (i = 0; i < DYNSTATS_SHARD_COUNT; i++) {
+		shard = &b->shards[i];
+		pthread_rwlock_wrlock(&shard->lock);
+		iRet = dynstats_rebuildSurvivorTable(b, shard);
+		pthread_rwlock_unlock(&shard->lock);
+		CHKiRet(iRet);
+	}
 	STATSCOUNTER_INC(b->ctrPurgeTriggered, b->mutCtrPurgeTriggered);
 	timeoutComp(&b->metricCleanupTimeout, b->unusedMetricLife);
 finalize_it:
@@ -250,6 +310,250 @@ finalize_it:
 	RETiRet;
 }
 
+/* Heavy-hitter (top-K) buckets.
+ * These use the Space-Saving algorithm (Metwally et al.): each shard keeps
+ * a fixed number of (metric, count) entries. A metric not yet tracked
+ * replaces the entry with the lowest count and inherits that count + 1.
+ * So counts are upper bounds, but every metric with a true count above
+ * the lowest tracked count is guaranteed to be in the summary. Memory is
+ * bounded by maxCardinality, no matter how many distinct metrics we see.
+ * Entries are kept in a min-heap so that the replacement candidate is
+ * always at the root. Increments of tracked metrics, by far the most
+ * common case, are done under the shard's read lock and only update the
+ * count atomically. This breaks the heap order, so it is restored under
+ * the write lock before the next eviction. Before stats are read, the
+ * topK entries over all shards are turned into counters of the bucket's
+ * stats object.
+ */
+static inline void
+dynstats_topkSwap(struct dynstats_shard_s *shard, uint32_t i, uint32_t j) {
+	struct dynstats_topk_entry_s *tmp;
+	tmp = shard->topkHeap[i];
+	shard->topkHeap[i] = shard->topkHeap[j];
+	shard->topkHeap[j] = tmp;
+	shard->topkHeap[i]->heapIdx = i;
+	shard->topkHeap[j]->heapIdx = j;
+}
+
+static void
+dynstats_topkSiftDown(struct dynstats_shard_s *shard, uint32_t i) {
+	uint32_t smallest, child;
+	while (1) {
+		smallest = i;
+		child = 2 * i + 1;
+		if (child < shard->topkSize
+			&& shard->topkHeap[child]->count < shard->topkHeap[smallest]->count) {
+			smallest = child;
+		}
+		++child;
+		if (child < shard->topkSize
+			&& shard->topkHeap[child]->count < shard->topkHeap[smallest]->count) {
+			smallest = child;
+		}
+		if (smallest == i) {
+			break;
+		}
+		dynstats_topkSwap(shard, i, smallest);
+		i = smallest;
+	}
+}
+
+static void /* must be called with shard write-locked */
+dynstats_topkHeapify(struct dynstats_shard_s *shard) {
+	uint32_t i;
+	for (i = shard->topkSize / 2; i > 0; i--) {
+		dynstats_topkSiftDown(shard, i - 1);
+	}
+	shard->topkUnordered = 0;
+}
+
+/* the hit path, must be called with shard (at least) read-locked.
+ * Returns 0 if the metric is not tracked.
+ */
+static int
+dynstats_topkIncTracked(struct dynstats_shard_s *shard, const uchar *metric) {
+	struct dynstats_topk_entry_s *entry;
+
+	entry = (struct dynstats_topk_entry_s *) hashtable_search(shard->table, (void*) metric);
+	if (entry == NULL) {
+		return 0;
+	}
+	ATOMIC_INC_uint64(&entry->count, &shard->mutTopkCount);
+	if (!shard->topkUnordered) {
+		ATOMIC_STORE_1_TO_INT(&shard->topkUnordered, &shard->mutTopkUnordered);
+	}
+	return 1;
+}
+
+static rsRetVal /* must be called with shard write-locked */
+dynstats_topkInc(dynstats_bucket_t *b, struct dynstats_shard_s *shard, const uchar *metric) {
+	struct dynstats_topk_entry_s *entry;
+	uchar *key = NULL;
+	DEFiRet;
+
+	/* someone may have added it while we waited for the lock */
+	if (dynstats_topkIncTracked(shard, metric)) {
+		FINALIZE;
+	}
+
+	CHKmalloc(key = ustrdup(metric));
+	if (shard->topkSize < shard->topkCapacity) {
+		entry = &shard->topkEntries[shard->topkSize];
+		if (!hashtable_insert(shard->table, key, entry)) {
+			ABORT_FINALIZE(RS_RET_OUT_OF_MEMORY);
+		}
+		entry->metric = key;
+		entry->count = 1;
+		entry->heapIdx = shard->topkSize;
+		shard->topkHeap[shard->topkSize++] = entry;
+		shard->topkUnordered = 1;
+		STATSCOUNTER_INC(b->ctrNewMetricAdd, b->mutCtrNewMetricAdd);
+	} else {
+		/* take over the entry with the lowest count */
+		if (shard->topkUnordered) {
+			dynstats_topkHeapify(shard);
+		}
+		entry = shard->topkHeap[0];
+		if (!hashtable_insert(shard->table, key, entry)) {
+			ABORT_FINALIZE(RS_RET_OUT_OF_MEMORY);
+		}
+		hashtable_remove(shard->table, entry->metric); /* frees the old name */
+		entry->metric = key;
+		entry->count++;
+		dynstats_topkSiftDown(shard, 0);
+		STATSCOUNTER_INC(b->ctrMetricsPurged, b->mutCtrMetricsPurged);
+	}
+	key = NULL;
+
+finalize_it:
+	free(key);
+	RETiRet;
+}
+
+static void
+dynstats_topkClear(dynstats_bucket_t *b) {
+	struct dynstats_shard_s *shard;
+	uint32_t j;
+	int i;
+	for (i = 0; i < DYNSTATS_SHARD_COUNT; i++) {
+		shard = &b->shards[i];
+		pthread_rwlock_wrlock(&shard->lock);
+		for (j = 0; j < shard->topkSize; j++) {
+			hashtable_remove(shard->table, shard->topkEntries[j].metric);
+		}
+		shard->topkSize = 0;
+		shard->topkUnordered = 0;
+		pthread_rwlock_unlock(&shard->lock);
+	}
+}
+
+static int
+dynstats_topkCmpEntries(const void *v1, const void *v2) {
+	const struct dynstats_topk_entry_s *e1 = *((struct dynstats_topk_entry_s * const *) v1);
+	const struct dynstats_topk_entry_s *e2 = *((struct dynstats_topk_entry_s * const *) v2);
+	/* descending by count */
+	return (e1->count < e2->count) ? 1 : ((e1->count > e2->count) ? -1 : 0);
+}
+
+/* called before the bucket's stats are read: publish the current topK.
+ * The shards are locked one after another, so the hot path is never
+ * blocked for long. A metric lives in exactly one shard, so the global
+ * topK is found among the per-shard topK.
+ */
+static void
+dynstats_topkPreRead(statsobj_t __attribute__((unused)) *ignore, void *ctx) {
+	dynstats_bucket_t *b = (dynstats_bucket_t *) ctx;
+	dynstats_buckets_t *bkts;
+	struct dynstats_shard_s *shard;
+	struct dynstats_topk_entry_s **sorted = NULL;
+	struct dynstats_topk_entry_s *cands = NULL;
+	uint32_t nCands = 0;
+	uint32_t maxCands;
+	uint32_t n, j;
+	int i;
+
+	bkts = &loadConf->dynstats_buckets;
+	pthread_rwlock_rdlock(&bkts->lock);
+	pthread_rwlock_wrlock(&b->lock);
+
+	dynstats_destroyUnlinkedCtrs(statsobj.UnlinkAllCounters(b->stats));
+
+	maxCands = b->topK * DYNSTATS_SHARD_COUNT;
+	if ((cands = calloc(maxCands, sizeof(*cands))) == NULL
+		|| (sorted = malloc(((b->shards[0].topkCapacity > maxCands) ? b->shards[0].topkCapacity
+			: maxCands) * sizeof(*sorted))) == NULL) {
+		errmsg.LogError(errno, RS_RET_OUT_OF_MEMORY, "dynstats: could not "
+			"compute top-%u metrics of bucket '%s'", b->topK, b->name);
+		goto done;
+	}
+
+	for (i = 0; i < DYNSTATS_SHARD_COUNT; i++) {
+		shard = &b->shards[i];
+		pthread_rwlock_rdlock(&shard->lock);
+		memcpy(sorted, shard->topkHeap, shard->topkSize * sizeof(*sorted));
+		qsort(sorted, shard->topkSize, sizeof(*sorted), dynstats_topkCmpEntries);
+		n = (shard->topkSize < b->topK) ? shard->topkSize : b->topK;
+		for (j = 0; j < n; j++) {
+			if ((cands[nCands].metric = ustrdup(sorted[j]->metric)) == NULL)
+				break;
+			cands[nCands++].count = sorted[j]->count;
+		}
+		pthread_rwlock_unlock(&shard->lock);
+	}
+
+	/* the candidates are sorted via the pointer array, too */
+	for (j = 0; j < nCands; j++) {
+		sorted[j] = &cands[j];
+	}
+	qsort(sorted, nCands, sizeof(*sorted), dynstats_topkCmpEntries);
+	n = (nCands < b->topK) ? nCands : b->topK;
+	for (j = 0; j < n; j++) {
+		b->topkSlots[j].val = sorted[j]->count;
+		if (statsobj.AddManagedCounter(b->stats, sorted[j]->metric, ctrType_IntCtr,
+			CTR_FLAG_NONE, &b->topkSlots[j].val, &b->topkSlots[j].pCtr, 1) != RS_RET_OK) {
+			break;
+		}
+	}
+
+done:
+	if (cands != NULL) {
+		for (j = 0; j < nCands; j++) {
+			free(cands[j].metric);
+		}
+	}
+	free(cands);
+	free(sorted);
+	pthread_rwlock_unlock(&b->lock);
+	pthread_rwlock_unlock(&bkts->lock);
+}
+
+static rsRetVal
+dynstats_topkInit(dynstats_bucket_t *b) {
+	struct dynstats_shard_s *shard;
+	uint32_t capacity;
+	size_t htab_sz;
+	int i;
+	DEFiRet;
+
+	capacity = (b->maxCardinality + DYNSTATS_SHARD_COUNT - 1) / DYNSTATS_SHARD_COUNT;
+	htab_sz = (size_t) (DYNSTATS_HASHTABLE_SIZE_OVERPROVISIONING * capacity + 1);
+	CHKmalloc(b->topkSlots = calloc(b->topK, sizeof(struct dynstats_topk_slot_s)));
+	for (i = 0; i < DYNSTATS_SHARD_COUNT; i++) {
+		shard = &b->shards[i];
+		shard->topkCapacity = capacity;
+		CHKmalloc(shard->topkEntries = calloc(capacity, sizeof(struct dynstats_topk_entry_s)));
+		CHKmalloc(shard->topkHeap = calloc(capacity, sizeof(struct dynstats_topk_entry_s *)));
+		CHKmalloc(shard->table = create_hashtable(htab_sz, hash_from_string, key_equals_string,
+			no_op_free));
+	}
+finalize_it:
+	if (iRet != RS_RET_OK) {
+		errmsg.LogError(errno, iRet, "dynstats: error trying to initialize top-K "
+			"summary of bucket '%s'", b->name);
+	}
+	RETiRet;
+}
+
 static inline void
 dynstats_resetIfExpired(dynstats_bucket_t *b) {
 	long timeout;
@@ -268,7 +572,14 @@ dynstats_readCallback(statsobj_t __attribute__((unused)) *ignore, void *b) {
 	bkts = &loadConf->dynstats_buckets;
 
 	pthread_rwlock_rdlock(&bkts->lock);
-	dynstats_resetIfExpired((dynstats_bucket_t *) b);
+	if (((dynstats_bucket_t *) b)->topK) {
+		/* heavy hitters are per reporting interval, if resettable */
+		if (((dynstats_bucket_t *) b)->resettable) {
+			dynstats_topkClear((dynstats_bucket_t *) b);
+		}
+	} else {
+		dynstats_resetIfExpired((dynstats_bucket_t *) b);
+	}
 	pthread_rwlock_unlock(&bkts->lock);
 }
 
@@ -281,6 +592,9 @@ dynstats_initNewBucketStats(dynstats_bucket_t *b) {
 	CHKiRet(statsobj.SetName(b->stats, b->name));
 	CHKiRet(statsobj.SetReportingNamespace(b->stats, UCHAR_CONSTANT("values")));
 	statsobj.SetReadNotifier(b->stats, dynstats_readCallback, b);
+	if (b->topK) {
+		CHKiRet(statsobj.SetPreReadNotifier(b->stats, dynstats_topkPreRead, b));
+	}
 	CHKiRet(statsobj.ConstructFinalize(b->stats));
 	
 finalize_it:
@@ -288,14 +602,16 @@ finalize_it:
 }
 
 static rsRetVal
-dynstats_newBucket(const uchar* name, uint8_t resettable, uint32_t maxCardinality, uint32_t unusedMetricLife) {
+dynstats_newBucket(const uchar* name, uint8_t resettable, uint32_t maxCardinality, uint32_t unusedMetricLife,
+	uint32_t topK) {
 	dynstats_bucket_t *b;
 	dynstats_buckets_t *bkts;
-	uint8_t lock_initialized, metric_count_mutex_initialized;
+	uint8_t lock_initialized;
 	pthread_rwlockattr_t bucket_lock_attr;
+	int i;
 	DEFiRet;
 
-	lock_initialized = metric_count_mutex_initialized = 0;
+	lock_initialized = 0;
 	b = NULL;
 	
 	bkts = &loadConf->dynstats_buckets;
@@ -304,6 +620,7 @@ dynstats_newBucket(const uchar* name, uint8_t resettable, uint32_t maxCardinalit
 		CHKmalloc(b = calloc(1, sizeof(dynstats_bucket_t)));
 		b->resettable = resettable;
 		b->maxCardinality = maxCardinality;
+		b->topK = topK;
 		b->unusedMetricLife = 1000 * unusedMetricLife; 
 		CHKmalloc(b->name = ustrdup(name));
 
@@ -313,13 +630,21 @@ dynstats_newBucket(const uchar* name, uint8_t resettable, uint32_t maxCardinalit
 #endif
 
 		pthread_rwlock_init(&b->lock, &bucket_lock_attr);
-		lock_initialized = 1;
+		for (i = 0; i < DYNSTATS_SHARD_COUNT; i++) {
+			pthread_rwlock_init(&b->shards[i].lock, &bucket_lock_attr);
+			INIT_ATOMIC_HELPER_MUT(b->shards[i].mutTopkUnordered);
+			INIT_ATOMIC_HELPER_MUT64(b->shards[i].mutTopkCount);
+		}
 		pthread_mutex_init(&b->mutMetricCount, NULL);
-		metric_count_mutex_initialized = 1;
+		lock_initialized = 1;
 
-		CHKiRet(dynstats_initNewBucketStats(b));
+		if (topK) {
+			CHKiRet(dynstats_topkInit(b));
+		} else {
+			CHKiRet(dynstats_resetBucket(b));
+		}
 
-		CHKiRet(dynstats_resetBucket(b));
+		CHKiRet(dynstats_initNewBucketStats(b));
 
 		CHKiRet(dynstats_addBucketMetrics(bkts, b, name));
 
@@ -337,14 +662,11 @@ dynstats_newBucket(const uchar* name, uint8_t resettable, uint32_t maxCardinalit
 	}
 finalize_it:
 	if (iRet != RS_RET_OK) {
-		if (metric_count_mutex_initialized) {
-			pthread_mutex_destroy(&b->mutMetricCount);
-		}
 		if (lock_initialized) {
-			pthread_rwlock_destroy(&b->lock);
-		}
-		if (b != NULL) {
 			dynstats_destroyBucket(b);
+		} else if (b != NULL) {
+			free(b->name);
+			free(b);
 		}
 	}
 	RETiRet;
@@ -358,6 +680,7 @@ dynstats_processCnf(struct cnfobj *o) {
 	uint8_t resettable = DYNSTATS_DEFAULT_RESETTABILITY;
 	uint32_t maxCardinality = DYNSTATS_DEFAULT_MAX_CARDINALITY;
 	uint32_t unusedMetricLife = DYNSTATS_DEFAULT_UNUSED_METRIC_LIFE;
+	uint32_t topK = 0;
 	DEFiRet;
 
 	pvals = nvlstGetParams(o->nvlst, &modpblk, NULL);
@@ -376,13 +699,22 @@ dynstats_processCnf(struct cnfobj *o) {
 			maxCardinality = (uint32_t) pvals[i].val.d.n;
 		} else if (!strcmp(modpblk.descr[i].name, DYNSTATS_PARAM_UNUSED_METRIC_LIFE)) {
 			unusedMetricLife = (uint32_t) pvals[i].val.d.n;
+		} else if (!strcmp(modpblk.descr[i].name, DYNSTATS_PARAM_TOP_K)) {
+			topK = (uint32_t) pvals[i].val.d.n;
 		} else {
 			dbgprintf("dyn_stats: program error, non-handled "
 					  "param '%s'\n", modpblk.descr[i].name);
 		}
 	}
+	if (topK > maxCardinality) {
+		errmsg.LogError(0, RS_RET_INVALID_PARAMS, "dynstats: bucket '%s': %s (%u) must not "
+			"be larger than %s (%u)", name == NULL ? (uchar*) "(unnamed)" : name,
+			DYNSTATS_PARAM_TOP_K, topK,
+			DYNSTATS_PARAM_MAX_CARDINALITY, maxCardinality);
+		ABORT_FINALIZE(RS_RET_INVALID_PARAMS);
+	}
 	if (name != NULL) {
-		CHKiRet(dynstats_newBucket(name, resettable, maxCardinality, unusedMetricLife));
+		CHKiRet(dynstats_newBucket(name, resettable, maxCardinality, unusedMetricLife, topK));
 	}
 
 finalize_it:
@@ -481,7 +813,8 @@ finalize_it:
 }
 
 static rsRetVal
-dynstats_addNewCtr(dynstats_bucket_t *b, const uchar* metric, uint8_t doInitialIncrement) {
+dynstats_addNewCtr(dynstats_bucket_t *b, struct dynstats_shard_s *shard, const uchar* metric,
+	uint8_t doInitialIncrement) {
 	dynstats_ctr_t *ctr;
 	dynstats_ctr_t *found_ctr, *survivor_ctr, *effective_ctr;
 	int created;
@@ -497,8 +830,8 @@ dynstats_addNewCtr(dynstats_bucket_t *b, const uchar* metric, uint8_t doInitialI
 	
 	CHKiRet(dynstats_createCtr(b, metric, &ctr));
 
-	pthread_rwlock_wrlock(&b->lock);
-	found_ctr = (dynstats_ctr_t*) hashtable_search(b->table, ctr->metric);
+	pthread_rwlock_wrlock(&shard->lock);
+	found_ctr = (dynstats_ctr_t*) hashtable_search(shard->table, ctr->metric);
 	if (found_ctr != NULL) {
 		if (doInitialIncrement) {
 			STATSCOUNTER_INC(found_ctr->ctr, found_ctr->mutCtr);
@@ -506,7 +839,7 @@ dynstats_addNewCtr(dynstats_bucket_t *b, const uchar* metric, uint8_t doInitialI
 	} else {
 		copy_of_key = ustrdup(ctr->metric);
 		if (copy_of_key != NULL) {
-			survivor_ctr = (dynstats_ctr_t*) hashtable_search(b->survivor_table, ctr->metric);
+			survivor_ctr = (dynstats_ctr_t*) hashtable_search(shard->survivor_table, ctr->metric);
 			if (survivor_ctr == NULL) {
 				effective_ctr = ctr;
 			} else {
@@ -517,27 +850,27 @@ dynstats_addNewCtr(dynstats_bucket_t *b, const uchar* metric, uint8_t doInitialI
 				if (survivor_ctr->next != NULL) {
 					survivor_ctr->next->prev = survivor_ctr->prev;
 				}
-				if (survivor_ctr == b->survivor_ctrs) {
-					b->survivor_ctrs = survivor_ctr->next;
+				if (survivor_ctr == shard->survivor_ctrs) {
+					shard->survivor_ctrs = survivor_ctr->next;
 				}
 			}
-			if ((created = hashtable_insert(b->table, copy_of_key, effective_ctr))) {
+			if ((created = hashtable_insert(shard->table, copy_of_key, effective_ctr))) {
 				statsobj.AddPreCreatedCtr(b->stats, effective_ctr->pCtr);
 			}
 		}
 		if (created) {
-			if (b->ctrs != NULL) {
-				b->ctrs->prev = effective_ctr;
+			if (shard->ctrs != NULL) {
+				shard->ctrs->prev = effective_ctr;
 			}
 			effective_ctr->prev = NULL;
-			effective_ctr->next = b->ctrs;
-			b->ctrs = effective_ctr;
+			effective_ctr->next = shard->ctrs;
+			shard->ctrs = effective_ctr;
 			if (doInitialIncrement) {
 				STATSCOUNTER_INC(effective_ctr->ctr, effective_ctr->mutCtr);
 			}
 		}
 	}
-	pthread_rwlock_unlock(&b->lock);
+	pthread_rwlock_unlock(&shard->lock);
 
 	if (found_ctr != NULL) {
 		//ignore
@@ -560,7 +893,9 @@ finalize_it:
 
 rsRetVal
 dynstats_inc(dynstats_bucket_t *b, uchar* metric) {
+	struct dynstats_shard_s *shard;
 	dynstats_ctr_t *ctr;
+	int found;
 	DEFiRet;
 
 	if (! GatherStats) {
@@ -572,18 +907,34 @@ dynstats_inc(dynstats_bucket_t *b, uchar* metric) {
 		FINALIZE;
 	}
 
-	if (pthread_rwlock_tryrdlock(&b->lock) == 0) {
-		ctr = (dynstats_ctr_t *) hashtable_search(b->table, metric);
+	shard = dynstats_getShard(b, metric);
+	if (b->topK) {
+		/* we must not drop ops here, as this would falsify the counts. Only
+		 * inserts and evictions need the write lock.
+		 */
+		pthread_rwlock_rdlock(&shard->lock);
+		found = dynstats_topkIncTracked(shard, metric);
+		pthread_rwlock_unlock(&shard->lock);
+		if (!found) {
+			pthread_rwlock_wrlock(&shard->lock);
+			iRet = dynstats_topkInc(b, shard, metric);
+			pthread_rwlock_unlock(&shard->lock);
+		}
+		FINALIZE;
+	}
+
+	if (pthread_rwlock_tryrdlock(&shard->lock) == 0) {
+		ctr = (dynstats_ctr_t *) hashtable_search(shard->table, metric);
 		if (ctr != NULL) {
 			STATSCOUNTER_INC(ctr->ctr, ctr->mutCtr);
 		}
-		pthread_rwlock_unlock(&b->lock);
+		pthread_rwlock_unlock(&shard->lock);
 	} else {
 		ABORT_FINALIZE(RS_RET_NOENTRY);
 	}
 
 	if (ctr == NULL) {
-		CHKiRet(dynstats_addNewCtr(b, metric, 1));
+		CHKiRet(dynstats_addNewCtr(b, shard, metric, 1));
 	}
 finalize_it:
 	if (iRet != RS_RET_OK) {
@@ -31,10 +31,49 @@ struct dynstats_ctr_s {
 	struct dynstats_ctr_s *prev;
 };
 
-struct dynstats_bucket_s {
+#define DYNSTATS_SHARD_COUNT 16 /* must be a power of 2 */
+
+/* entry of the Space-Saving summary kept by heavy-hitter (top-K) buckets */
+struct dynstats_topk_entry_s {
+	uchar *metric; /* also the key in the shard's table, freed by it */
+	intctr_t count;
+	uint32_t heapIdx;
+};
+
+/* reporting slot of a top-K bucket, re-populated before each stats read */
+struct dynstats_topk_slot_s {
+	intctr_t val;
+	ctr_t *pCtr;
+};
+
+/* The metrics of a bucket are spread over a number of shards, selected
+ * by hashing the metric name. Each shard has its own lock, so workers
+ * counting different metrics do not contend on a single lock, and a
+ * reset blocks only one shard at a time.
+ */
+struct dynstats_shard_s {
 	htable *table;
-	uchar *name;
 	pthread_rwlock_t lock;
+	struct dynstats_ctr_s *ctrs;
+	/*survivor objects are used to keep counter values around for upto unused-ttl duration,
+	  so in case it is accessed within (ttl - 2 * ttl) time-period we can re-store the accumulator value from this */
+	struct dynstats_ctr_s *survivor_ctrs;
+	htable *survivor_table;
+	/* top-K buckets keep a Space-Saving summary instead of counters. The
+	   table maps metric names to entries, the heap orders them by count. */
+	struct dynstats_topk_entry_s *topkEntries;
+	struct dynstats_topk_entry_s **topkHeap; /* min-heap */
+	uint32_t topkSize;
+	uint32_t topkCapacity;
+	int topkUnordered; /* heap order is broken, must be restored before an eviction */
+	DEF_ATOMIC_HELPER_MUT(mutTopkUnordered)
+	DEF_ATOMIC_HELPER_MUT64(mutTopkCount)
+};
+
+struct dynstats_bucket_s {
+	struct dynstats_shard_s shards[DYNSTATS_SHARD_COUNT];
+	uchar *name;
+	pthread_rwlock_t lock; /* guards cleanup timeout, serializes resets */
 	statsobj_t *stats;
 	STATSCOUNTER_DEF(ctrOpsOverflow, mutCtrOpsOverflow);
 	ctr_t *pOpsOverflowCtr;
@@ -49,13 +88,10 @@ struct dynstats_bucket_s {
 	STATSCOUNTER_DEF(ctrPurgeTriggered, mutCtrPurgeTriggered);
 	ctr_t *pPurgeTriggeredCtr;
 	struct dynstats_bucket_s *next; /* linked list ptr */
-	struct dynstats_ctr_s *ctrs;
-	/*survivor objects are used to keep counter values around for upto unused-ttl duration,
-	  so in case it is accessed within (ttl - 2 * ttl) time-period we can re-store the accumulator value from this */
-	struct dynstats_ctr_s *survivor_ctrs;
-	htable *survivor_table;
 	
 	uint32_t maxCardinality;
+	uint32_t topK; /* if non-zero, only the topK heavy hitters are tracked and reported */
+	struct dynstats_topk_slot_s *topkSlots;
 	uint32_t metricCount;
 	pthread_mutex_t mutMetricCount;
 	uint32_t unusedMetricLife;
@@ -51,6 +51,7 @@
 #include "rainerscript.h"
 #include "net.h"
 #include "rsconf.h"
+#include "trace.h"
 
 /* some defaults */
 #ifndef DFLT_NETSTRM_DRVR
@@ -117,6 +118,7 @@ int glblReportGoneAwaySenders = 0;
 int glblSenderStatsTimeout = 12 * 60 * 60; /* 12 hr timeout for senders */
 int glblSenderKeepTrack = 0;  /* keep track of known senders? */
 int glblUnloadModules = 1;
+int glblAsyncWriterThreads = 4; /* max nbr of threads in the stream async writer pool */
 
 pid_t glbl_ourpid;
 #ifndef HAVE_ATOMIC_BUILTINS
@@ -157,6 +159,7 @@ static struct cnfparamdescr cnfparamdescr[] = {
 	{ "parser.parsehostnameandtag", eCmdHdlrBinary, 0 },
 	{ "stdlog.channelspec", eCmdHdlrString, 0 },
 	{ "janitor.interval", eCmdHdlrPositiveInt, 0 },
+	{ "asyncwriter.threads", eCmdHdlrPositiveInt, 0 },
 	{ "senders.reportnew", eCmdHdlrBinary, 0 },
 	{ "senders.reportgoneaway", eCmdHdlrBinary, 0 },
 	{ "senders.timeoutafter", eCmdHdlrPositiveInt, 0 },
@@ -167,7 +170,9 @@ static struct cnfparamdescr cnfparamdescr[] = {
 	{ "net.aclresolvehostname", eCmdHdlrBinary, 0 },
 	{ "net.enabledns", eCmdHdlrBinary, 0 },
 	{ "net.permitACLwarning", eCmdHdlrBinary, 0 },
-	{ "processinternalmessages", eCmdHdlrBinary, 0 }
+	{ "processinternalmessages", eCmdHdlrBinary, 0 },
+	{ "trace.samplerate", eCmdHdlrNonNegInt, 0 },
+	{ "trace.file", eCmdHdlrString, 0 }
 };
 static struct cnfparamblk paramblk =
 	{ CNFPARAMBLK_VERSION,
@@ -1108,6 +1113,8 @@ glblDoneLoadCnf(void)
 			errmsg.LogError(0, RS_RET_OK, "debug log file is '%s', fd %d", pszAltDbgFileName, altdbg);
 		} else if(!strcmp(paramblk.descr[i].name, "janitor.interval")) {
 			janitorInterval = (int) cnfparamvals[i].val.d.n;
+		} else if(!strcmp(paramblk.descr[i].name, "asyncwriter.threads")) {
+			glblAsyncWriterThreads = (int) cnfparamvals[i].val.d.n;
 		} else if(!strcmp(paramblk.descr[i].name, "net.ipprotocol")) {
 			char *proto = es_str2cstr(cnfparamvals[i].val.d.estr, NULL);
 			if(!strcmp(proto, "unspecified")) {
@@ -1139,6 +1146,10 @@ glblDoneLoadCnf(void)
 		        setDisableDNS(!((int) cnfparamvals[i].val.d.n));
 		} else if(!strcmp(paramblk.descr[i].name, "net.permitwarning")) {
 		        setOption_DisallowWarning(!((int) cnfparamvals[i].val.d.n));
+		} else if(!strcmp(paramblk.descr[i].name, "trace.samplerate")) {
+			traceSetCnf((int) cnfparamvals[i].val.d.n, NULL);
+		} else if(!strcmp(paramblk.descr[i].name, "trace.file")) {
+			traceSetCnf(traceSampleRate, (uchar*) es_str2cstr(cnfparamvals[i].val.d.estr, NULL));
 		} else {
 			dbgprintf("glblDoneLoadCnf: program error, non-handled "
 			  "param '%s'\n", paramblk.descr[i].name);
@@ -114,6 +114,7 @@ extern int glblReportGoneAwaySenders;
 extern int glblSenderStatsTimeout;
 extern int glblSenderKeepTrack;
 extern int glblUnloadModules;
+extern int glblAsyncWriterThreads;
 extern short janitorInterval;
 
 #define glblGetOurPid() glbl_ourpid
@@ -0,0 +1,162 @@
+/* histogram.c
+ * Latency histograms for the statistics subsystem. Recording a value is
+ * a single atomic increment, so it is cheap enough to be done for each
+ * message. When stats are read, the percentiles of all values recorded
+ * since the previous read are computed and exposed as regular counters.
+ * This means the reported values always refer to the last stats interval.
+ *
+ * Copyright 2026 Adiscon GmbH.
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+
+#include "rsyslog.h"
+#include "atomic.h"
+#include "histogram.h"
+
+
+/* compute the bucket index for a value */
+static inline int
+histogramBucket(unsigned long long val)
+{
+	int msb;
+
+	if(val < HISTOGRAM_SUB_BUCKETS)
+		return (int) val;
+	msb = 63 - __builtin_clzll(val);
+	if(msb > HISTOGRAM_MAX_EXP)
+		return HISTOGRAM_NBUCKETS - 1;
+	return (msb - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS
+		+ (int) ((val >> (msb - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+
+/* the highest value that belongs to a bucket */
+static inline intctr_t
+histogramBucketMax(int idx)
+{
+	int shift;
+
+	if(idx < HISTOGRAM_SUB_BUCKETS)
+		return idx;
+	shift = idx / HISTOGRAM_SUB_BUCKETS - 1;
+	return ((intctr_t) (HISTOGRAM_SUB_BUCKETS + idx % HISTOGRAM_SUB_BUCKETS + 1) << shift) - 1;
+}
+
+
+void
+histogramInit(histogram_t *pThis)
+{
+	memset(pThis, 0, sizeof(histogram_t));
+	INIT_ATOMIC_HELPER_MUT(pThis->mutBuckets);
+}
+
+
+void
+histogramExit(histogram_t *pThis)
+{
+	DESTROY_ATOMIC_HELPER_MUT(pThis->mutBuckets);
+}
+
+
+/* record a value; may be called concurrently from multiple threads */
+void
+histogramRecord(histogram_t *pThis, long long usecs)
+{
+	if(usecs < 0) /* can not happen with a monotonic clock, but be safe */
+		usecs = 0;
+	ATOMIC_INC(&pThis->buckets[histogramBucket(usecs)], &pThis->mutBuckets);
+}
+
+
+/* add the counters for the histogram results to a stats object. The
+ * counter names are formed by the prefix and ".count", ".p50", ".p99",
+ * ".p999" and ".max".
+ */
+rsRetVal
+histogramAddCounters(histogram_t *pThis, statsobj_if_t *pStatsIf, statsobj_t *stats, const char *prefix)
+{
+	uchar ctrName[128];
+	DEFiRet;
+
+	snprintf((char*) ctrName, sizeof(ctrName), "%s.count", prefix);
+	CHKiRet(pStatsIf->AddCounter(stats, ctrName, ctrType_IntCtr, CTR_FLAG_NONE, &pThis->ctrCount));
+	snprintf((char*) ctrName, sizeof(ctrName), "%s.p50", prefix);
+	CHKiRet(pStatsIf->AddCounter(stats, ctrName, ctrType_IntCtr, CTR_FLAG_NONE, &pThis->ctrP50));
+	snprintf((char*) ctrName, sizeof(ctrName), "%s.p99", prefix);
+	CHKiRet(pStatsIf->AddCounter(stats, ctrName, ctrType_IntCtr, CTR_FLAG_NONE, &pThis->ctrP99));
+	snprintf((char*) ctrName, sizeof(ctrName), "%s.p999", prefix);
+	CHKiRet(pStatsIf->AddCounter(stats, ctrName, ctrType_IntCtr, CTR_FLAG_NONE, &pThis->ctrP999));
+	snprintf((char*) ctrName, sizeof(ctrName), "%s.max", prefix);
+	CHKiRet(pStatsIf->AddCounter(stats, ctrName, ctrType_IntCtr, CTR_FLAG_NONE, &pThis->ctrMax));
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* find the value at a given rank (1-based) */
+static intctr_t
+histogramValueAtRank(unsigned *counts, intctr_t rank)
+{
+	intctr_t sum = 0;
+	int i;
+
+	for(i = 0 ; i < HISTOGRAM_NBUCKETS ; ++i) {
+		sum += counts[i];
+		if(sum >= rank)
+			break;
+	}
+	return histogramBucketMax(i < HISTOGRAM_NBUCKETS ? i : HISTOGRAM_NBUCKETS - 1);
+}
+
+
+/* compute the results for all values recorded since the last call. This
+ * is meant to be called from a stats pre-read notifier, so there is only
+ * a single caller at a time. Concurrent recording is fine, values just
+ * show up in one interval or the next.
+ */
+void
+histogramUpdateCounters(histogram_t *pThis)
+{
+	unsigned delta[HISTOGRAM_NBUCKETS];
+	unsigned cur;
+	intctr_t total = 0;
+	int i;
+
+	for(i = 0 ; i < HISTOGRAM_NBUCKETS ; ++i) {
+		cur = pThis->buckets[i];
+		delta[i] = cur - pThis->prev[i]; /* unsigned arithmetic handles wrap-around */
+		pThis->prev[i] = cur;
+		total += delta[i];
+	}
+
+	pThis->ctrCount = total;
+	if(total == 0) {
+		pThis->ctrP50 = pThis->ctrP99 = pThis->ctrP999 = pThis->ctrMax = 0;
+		return;
+	}
+
+	/* nearest-rank method, rank rounded up */
+	pThis->ctrP50 = histogramValueAtRank(delta, (total * 500 + 999) / 1000);
+	pThis->ctrP99 = histogramValueAtRank(delta, (total * 990 + 999) / 1000);
+	pThis->ctrP999 = histogramValueAtRank(delta, (total * 999 + 999) / 1000);
+	pThis->ctrMax = histogramValueAtRank(delta, total);
+}
@@ -0,0 +1,57 @@
+/* Definitions for the latency histogram helper.
+ *
+ * Copyright 2026 Adiscon GmbH.
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef INCLUDED_HISTOGRAM_H
+#define INCLUDED_HISTOGRAM_H
+
+#include "statsobj.h"
+
+/* Values (microseconds) are recorded in log-linear buckets: each power of
+ * two is split into HISTOGRAM_SUB_BUCKETS linear sub-buckets, which keeps
+ * the relative error below 1/HISTOGRAM_SUB_BUCKETS. Values below
+ * HISTOGRAM_SUB_BUCKETS are exact, values above 2^(HISTOGRAM_MAX_EXP+1)
+ * (about 19 hours) are clamped.
+ */
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_MAX_EXP 35
+#define HISTOGRAM_NBUCKETS ((HISTOGRAM_MAX_EXP - HISTOGRAM_SUB_BITS + 2) * HISTOGRAM_SUB_BUCKETS)
+
+typedef struct histogram_s {
+	unsigned buckets[HISTOGRAM_NBUCKETS];	/* cumulative, updated atomically */
+	unsigned prev[HISTOGRAM_NBUCKETS];	/* bucket values at last stats read */
+	DEF_ATOMIC_HELPER_MUT(mutBuckets)
+	/* results for the last stats interval, all but count in microseconds */
+	intctr_t ctrCount;
+	intctr_t ctrP50;
+	intctr_t ctrP99;
+	intctr_t ctrP999;
+	intctr_t ctrMax;
+} histogram_t;
+
+/* prototypes */
+void histogramInit(histogram_t *pThis);
+void histogramExit(histogram_t *pThis);
+void histogramRecord(histogram_t *pThis, long long usecs);
+rsRetVal histogramAddCounters(histogram_t *pThis, statsobj_if_t *pStatsIf, statsobj_t *stats,
+	const char *prefix);
+void histogramUpdateCounters(histogram_t *pThis);
+
+#endif /* #ifndef INCLUDED_HISTOGRAM_H */
@@ -0,0 +1,528 @@
+/* lazyjson.c
+ * Lazy JSON document. Building a full json-c object tree for every
+ * message is expensive, while usually only a handful of fields are
+ * ever referenced by filters and templates. So instead of the tree,
+ * we keep the JSON text together with a compact index of its
+ * structural elements (containers, strings and other scalars) and
+ * create json-c objects only for values that are actually requested.
+ *
+ * The index is built in a single validating pass over the text. For
+ * each container, it records the index of the matching closing
+ * element, so that lookups can skip over nested values in constant
+ * time. Only strictly valid JSON objects are accepted. Everything
+ * else is left to the regular json-c parser, so that callers get
+ * exactly the same results for invalid or non-standard input.
+ *
+ * A document is immutable after construction and reference counted,
+ * so it can be shared between message copies without locking.
+ *
+ * Copyright 2026 Adiscon GmbH.
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <json.h>
+
+#include "rsyslog.h"
+#include "atomic.h"
+#include "lazyjson.h"
+
+#define LAZYJSON_MAX_DEPTH 32	/* same limit as the json-c tokener */
+#define LAZYJSON_MAX_LEN UINT32_MAX
+
+/* an element of the structural index. For containers, aux is the
+ * index of the matching closing element; for strings and other
+ * scalars, it is the offset one past the end of the value.
+ */
+typedef struct {
+	uint32_t off;
+	uint32_t aux;
+} lazyjsonElt_t;
+
+struct lazyjson_s {
+	int iRefCount;
+	DEF_ATOMIC_HELPER_MUT(mutRefCount)
+	char *text;	/* JSON text, '\0'-terminated */
+	size_t len;
+	lazyjsonElt_t *elts;
+	int nElts;
+	int maxElts;
+};
+
+/* parser states for the index builder */
+enum {
+	LJ_VALUE,
+	LJ_VALUE_OR_CLOSE,
+	LJ_KEY,
+	LJ_KEY_OR_CLOSE,
+	LJ_COLON,
+	LJ_COMMA_OR_CLOSE,
+	LJ_DONE
+};
+
+
+static inline int
+isWS(const char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static inline int
+isDigit(const char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static inline int
+isContainer(lazyjson_t *pThis, int i)
+{
+	const char c = pThis->text[pThis->elts[i].off];
+	return c == '{' || c == '[';
+}
+
+/* index of the element following value i */
+static inline int
+nextElt(lazyjson_t *pThis, int i)
+{
+	return isContainer(pThis, i) ? (int) pThis->elts[i].aux + 1 : i + 1;
+}
+
+
+static rsRetVal
+addElt(lazyjson_t *pThis, size_t off, size_t aux)
+{
+	lazyjsonElt_t *newElts;
+	int newMax;
+	DEFiRet;
+
+	if(pThis->nElts == pThis->maxElts) {
+		newMax = (pThis->maxElts == 0) ? (int) (pThis->len / 8) + 16 : 2 * pThis->maxElts;
+		CHKmalloc(newElts = realloc(pThis->elts, newMax * sizeof(lazyjsonElt_t)));
+		pThis->elts = newElts;
+		pThis->maxElts = newMax;
+	}
+	pThis->elts[pThis->nElts].off = (uint32_t) off;
+	pThis->elts[pThis->nElts].aux = (uint32_t) aux;
+	++pThis->nElts;
+finalize_it:
+	RETiRet;
+}
+
+
+/* check the string starting at *pi (which must be the opening quote)
+ * and advance *pi past the closing quote.
+ */
+static rsRetVal
+scanString(lazyjson_t *pThis, size_t *pi)
+{
+	const char *const text = pThis->text;
+	size_t i = *pi + 1;
+	int j;
+	DEFiRet;
+
+	while(i < pThis->len && text[i] != '"') {
+		if(text[i] == '\\') {
+			++i;
+			if(i >= pThis->len)
+				ABORT_FINALIZE(RS_RET_JSON_PARSE_ERR);
+			if(text[i] == 'u') {
+				for(j = 1 ; j <= 4 ; ++j) {
+					if(i + j >= pThis->len || !isxdigit((unsigned char) text[i + j]))
+						ABORT_FINALIZE(RS_RET_JSON_PARSE_ERR);
+				}
+				i += 4;
+			} else if(strchr("\"\\/bfnrt", text[i]) == NULL) {
+				ABORT_FINALIZE(RS_RET_JSON_PARSE_ERR);
+			}
+		} else if((unsigned char) text[i] < 0x20) {
+			ABORT_FINALIZE(RS_RET_JSON_PARSE_ERR);
+		}
+		++i;
+	}
+	if(i >= pThis->len)
+		ABORT_FINALIZE(RS_RET_JSON_PARSE_ERR);
+	*pi = i + 1;
+finalize_it:
+	RETiRet;
+}
+
+
+/* check a number or literal starting at *pi and advance *pi past it */
+static rsRetVal
+scanScalar(lazyjson_t *pThis, size_t *pi)
+{
+	const char *const text = pThis->text;
+	const size_t len = pThis->len;
+	size_t i = *pi;
+	DEFiRet;
+
+	if(!strncmp(text + i, "true", 4)) {
+		i += 4;
+	} else if(!strncmp(text + i, "false", 5)) {
+		i += 5;
+	} else if(!strncmp(text + i, "null", 4)) {
+		i += 4;
+	} else {
+		if(i < len && text[i] == '-')
+			++i;
+		if(i < len && text[i] == '0') {
+			++i;
+		} else if(i < len && isDigit(text[i])) {
+			while(i < len && isDigit(text[i]))
+				++i;
+		} else {
+			ABORT_FINALIZE(RS_RET_JSON_PARSE_ERR);
+		}
+		if(i < len && text[i] == '.') {
+			++i;
+			if(i >= len || !isDigit(text[i]))
+				ABORT_FINALIZE(RS_RET_JSON_PARSE_ERR);
+			while(i < len && isDigit(text[i]))
+				++i;
+		}
+		if(i < len && (text[i] == 'e' || text[i] == 'E')) {
+			++i;
+			if(i < len && (text[i] == '+' || text[i] == '-'))
+				++i;
+			if(i >= len || !isDigit(text[i]))
+				ABORT_FINALIZE(RS_RET_JSON_PARSE_ERR);
+			while(i < len && isDigit(text[i]))
+				++i;
+		}
+	}
+	*pi = i;
+finalize_it:
+	RETiRet;
+}
+
+
+/* build the structural index. This also validates the text, which
+ * must be a single JSON object, optionally surrounded by whitespace.
+ */
+static rsRetVal
+buildIndex(lazyjson_t *pThis)
+{
+	const char *const text = pThis->text;
+	int stack[LAZYJSON_MAX_DEPTH];
+	int depth = 0;
+	int state = LJ_VALUE;
+	size_t i = 0;
+	size_t start;
+	char c;
+	DEFiRet;
+
+	while(i < pThis->len && isWS(text[i]))
+		++i;
+	if(i >= pThis->len || text[i] != '{')
+		ABORT_FINALIZE(RS_RET_JSON_PARSE_ERR);
+
+	while(i < pThis->len) {
+		c = text[i];
+		if(isWS(c)) {
+			++i;
+			continue;
+		}
+		switch(state) {
+		case LJ_VALUE_OR_CLOSE:
+		case LJ_KEY_OR_CLOSE:
+			if(c == (state == LJ_KEY_OR_CLOSE ? '}' : ']'))
+				goto close_container;
+			if(state == LJ_KEY_OR_CLOSE)
+				goto key;
+			/*FALLTHROUGH*/
+		case LJ_VALUE:
+			if(c == '{' || c == '[') {
+				if(depth == LAZYJSON_MAX_DEPTH)
+					ABORT_FINALIZE(RS_RET_JSON_PARSE_ERR);
+				stack[depth++] = pThis->nElts;
+				CHKiRet(addElt(pThis, i, 0));
+				state = (c == '{') ? LJ_KEY_OR_CLOSE : LJ_VALUE_OR_CLOSE;
+				++i;
+			} else {
+				start = i;
+				if(c == '"') {
+					CHKiRet(scanString(pThis, &i));
+				} else {
+					CHKiRet(scanScalar(pThis, &i));
+				}
+				CHKiRet(addElt(pThis, start, i));
+				state = LJ_COMMA_OR_CLOSE;
+			}
+			break;
+		case LJ_KEY:
+		key:
+			if(c != '"')
+				ABORT_FINALIZE(RS_RET_JSON_PARSE_ERR);
+			start = i;
+			CHKiRet(scanString(pThis, &i));
+			CHKiRet(addElt(pThis, start, i));
+			state = LJ_COLON;
+			break;
+		case LJ_COLON:
+			if(c != ':')
+				ABORT_FINALIZE(RS_RET_JSON_PARSE_ERR);
+			state = LJ_VALUE;
+			++i;
+			break;
+		case LJ_COMMA_OR_CLOSE:
+			if(c == ',') {
+				state = (text[pThis->elts[stack[depth-1]].off] == '{') ? LJ_KEY : LJ_VALUE;
+				++i;
+				break;
+			}
+			if(c != (text[pThis->elts[stack[depth-1]].off] == '{' ? '}' : ']'))
+				ABORT_FINALIZE(RS_RET_JSON_PARSE_ERR);
+		close_container:
+			pThis->elts[stack[--depth]].aux = pThis->nElts;
+			CHKiRet(addElt(pThis, i, 0));
+			state = (depth == 0) ? LJ_DONE : LJ_COMMA_OR_CLOSE;
+			++i;
+			break;
+		case LJ_DONE:
+		default:
+			/* only whitespace permitted after the object */
+			ABORT_FINALIZE(RS_RET_JSON_PARSE_ERR);
+		}
+	}
+	if(state != LJ_DONE)
+		ABORT_FINALIZE(RS_RET_JSON_PARSE_ERR);
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* create a lazy JSON document from text. The text is copied. Returns
+ * RS_RET_JSON_PARSE_ERR if the text is not a valid JSON object; in that
+ * case, the caller should use the regular parser, which may be more
+ * lenient and provides the error details.
+ */
+rsRetVal
+lazyjsonConstruct(lazyjson_t **ppThis, const char *text, size_t len)
+{
+	lazyjson_t *pThis = NULL;
+	DEFiRet;
+
+	if(len >= LAZYJSON_MAX_LEN)
+		ABORT_FINALIZE(RS_RET_JSON_PARSE_ERR);
+	CHKmalloc(pThis = calloc(1, sizeof(lazyjson_t)));
+	CHKmalloc(pThis->text = malloc(len + 1));
+	memcpy(pThis->text, text, len);
+	pThis->text[len] = '\0';
+	pThis->len = len;
+	pThis->iRefCount = 1;
+	INIT_ATOMIC_HELPER_MUT(pThis->mutRefCount);
+	CHKiRet(buildIndex(pThis));
+	*ppThis = pThis;
+
+finalize_it:
+	if(iRet != RS_RET_OK && pThis != NULL) {
+		lazyjsonRelease(&pThis);
+	}
+	RETiRet;
+}
+
+
+void
+lazyjsonAddRef(lazyjson_t *pThis)
+{
+	ATOMIC_INC(&pThis->iRefCount, &pThis->mutRefCount);
+}
+
+
+void
+lazyjsonRelease(lazyjson_t **ppThis)
+{
+	lazyjson_t *pThis = *ppThis;
+
+	if(ATOMIC_DEC_AND_FETCH(&pThis->iRefCount, &pThis->mutRefCount) == 0) {
+		DESTROY_ATOMIC_HELPER_MUT(pThis->mutRefCount);
+		free(pThis->text);
+		free(pThis->elts);
+		free(pThis);
+	}
+	*ppThis = NULL;
+}
+
+
+/* create a json-c object from the text of element i. Returns NULL
+ * for JSON null (and if we run out of memory). Strings without escapes
+ * and literals are by far the most common values, so they are created
+ * directly. Everything else is left to the json-c parser, so that the
+ * result is exactly the same as with a full parse.
+ */
+static struct json_object *
+eltToJSON(lazyjson_t *pThis, int i)
+{
+	const size_t off = pThis->elts[i].off;
+	const size_t end = isContainer(pThis, i) ? pThis->elts[pThis->elts[i].aux].off + 1
+						 : pThis->elts[i].aux;
+	const char *const val = pThis->text + off;
+	struct json_object *json;
+	char *buf;
+
+	if(val[0] == '"' && memchr(val + 1, '\\', end - off - 2) == NULL)
+		return json_object_new_string_len(val + 1, end - off - 2);
+	if(val[0] == 't')
+		return json_object_new_boolean(1);
+	if(val[0] == 'f')
+		return json_object_new_boolean(0);
+	if(val[0] == 'n')
+		return NULL;
+
+	if((buf = malloc(end - off + 1)) == NULL)
+		return NULL;
+	memcpy(buf, pThis->text + off, end - off);
+	buf[end - off] = '\0';
+	json = json_tokener_parse(buf);
+	free(buf);
+	return json;
+}
+
+
+/* check if the key at element i equals the given name */
+static int
+keyEquals(lazyjson_t *pThis, int i, const char *name, size_t lenName)
+{
+	const char *const raw = pThis->text + pThis->elts[i].off + 1;
+	const size_t lenRaw = pThis->elts[i].aux - pThis->elts[i].off - 2;
+	struct json_object *json;
+	int ret;
+
+	if(memchr(raw, '\\', lenRaw) == NULL)
+		return lenRaw == lenName && !memcmp(raw, name, lenName);
+	/* escaped key, rare, so we do not care about speed */
+	if((json = eltToJSON(pThis, i)) == NULL)
+		return 0;
+	ret = (size_t) json_object_get_string_len(json) == lenName
+		&& !memcmp(json_object_get_string(json), name, lenName);
+	json_object_put(json);
+	return ret;
+}
+
+
+/* find a member of the object at element obj. As with json-c, the
+ * last one wins if a name is used multiple times.
+ */
+static int
+findMember(lazyjson_t *pThis, int obj, const char *name, size_t lenName)
+{
+	int found = -1;
+	int i;
+
+	if(pThis->text[pThis->elts[obj].off] != '{')
+		return -1;
+	for(i = obj + 1 ; i < (int) pThis->elts[obj].aux ; i = nextElt(pThis, i + 1)) {
+		if(keyEquals(pThis, i, name, lenName))
+			found = i + 1;
+	}
+	return found;
+}
+
+
+static int
+findArrayElt(lazyjson_t *pThis, int arr, int idx)
+{
+	int i;
+
+	for(i = arr + 1 ; i < (int) pThis->elts[arr].aux ; i = nextElt(pThis, i)) {
+		if(idx-- == 0)
+			return i;
+	}
+	return -1;
+}
+
+
+/* find the element for one component of a property path. Array
+ * subscripts ("name[2]") are handled like jsonVarExtract() in msg.c does.
+ */
+static int
+findComponent(lazyjson_t *pThis, int parent, const char *name, size_t lenName)
+{
+	const char *lbrack;
+	char *end;
+	int arr;
+	long idx;
+
+	if(lenName > 2 && name[lenName-1] == ']'
+	   && (lbrack = memchr(name, '[', lenName - 1)) != NULL) {
+		idx = strtol(lbrack + 1, &end, 10);
+		if(end == name + lenName - 1 && end != lbrack + 1 && idx >= 0) {
+			arr = findMember(pThis, parent, name, lbrack - name);
+			if(arr != -1 && pThis->text[pThis->elts[arr].off] == '[')
+				return findArrayElt(pThis, arr, (int) idx);
+		}
+	}
+	return findMember(pThis, parent, name, lenName);
+}
+
+
+/* obtain the value for a property path like "!a!b". The resulting json
+ * object is owned by the caller; it is NULL for JSON null values.
+ * Returns RS_RET_NOT_FOUND if the path does not exist.
+ */
+rsRetVal
+lazyjsonGetPath(lazyjson_t *pThis, const uchar *path, struct json_object **pjson)
+{
+	const char *name = (const char*) path;
+	const char *sep;
+	size_t lenName;
+	int i = 0;
+	DEFiRet;
+
+	if(*name == '!')
+		++name;
+	while(1) {
+		sep = strchr(name, '!');
+		lenName = (sep == NULL) ? strlen(name) : (size_t) (sep - name);
+		if((i = findComponent(pThis, i, name, lenName)) == -1)
+			ABORT_FINALIZE(RS_RET_NOT_FOUND);
+		if(sep == NULL)
+			break;
+		name = sep + 1;
+	}
+	*pjson = eltToJSON(pThis, i);
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* create the full json-c object tree */
+struct json_object *
+lazyjsonToJSON(lazyjson_t *pThis)
+{
+	return json_tokener_parse(pThis->text);
+}
+
+
+/* obtain the JSON text as it was received. The text stays valid as
+ * long as the caller holds a reference to the document.
+ */
+const char *
+lazyjsonGetText(lazyjson_t *pThis, size_t *pLen)
+{
+	*pLen = pThis->len;
+	return pThis->text;
+}
+
+/* vi:set ai:
+ */
@@ -0,0 +1,40 @@
+/* Definitions for the lazy JSON document.
+ *
+ * A lazy JSON document keeps the JSON text as received together with
+ * an index of its structural elements. Values are converted into json-c
+ * objects only when they are actually requested.
+ *
+ * Copyright 2026 Adiscon GmbH.
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef INCLUDED_LAZYJSON_H
+#define INCLUDED_LAZYJSON_H
+
+#include <json.h>
+
+typedef struct lazyjson_s lazyjson_t;
+
+/* prototypes */
+rsRetVal lazyjsonConstruct(lazyjson_t **ppThis, const char *text, size_t len);
+void lazyjsonAddRef(lazyjson_t *pThis);
+void lazyjsonRelease(lazyjson_t **ppThis);
+rsRetVal lazyjsonGetPath(lazyjson_t *pThis, const uchar *path, struct json_object **pjson);
+struct json_object *lazyjsonToJSON(lazyjson_t *pThis);
+const char *lazyjsonGetText(lazyjson_t *pThis, size_t *pLen);
+
+#endif /* #ifndef INCLUDED_LAZYJSON_H */
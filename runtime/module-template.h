@@ -273,6 +273,31 @@ static rsRetVal endTransaction(wrkrInstanceData_t __attribute__((unused)) *pWrkr
 }
 
 
+/* abortTransaction()
+ * This function is optional. If a commitTransaction() call fails, the core
+ * retries the very same batch, so until the transaction is committed, each
+ * further commitTransaction() call receives the same messages at the same
+ * indexes. A plugin may use that to continue with the first message it could
+ * not yet process instead of processing the whole batch again. If the core
+ * finally gives up on the batch, it calls abortTransaction(); the next
+ * commitTransaction() call then brings a new batch.
+ */
+#define CODEqueryEtryPt_abortTransaction \
+	else if(!strcmp((char*) name, "abortTransaction")) {\
+		*pEtryPoint = abortTransaction;\
+	}
+#define BEGINabortTransaction \
+static rsRetVal abortTransaction(wrkrInstanceData_t __attribute__((unused)) *pWrkrData)\
+{\
+	DEFiRet;
+
+#define CODESTARTabortTransaction /* currently empty, but may be extended */
+
+#define ENDabortTransaction \
+	RETiRet;\
+}
+
+
 /* doAction()
  */
 #define BEGINdoAction \
@@ -138,6 +138,7 @@ struct modInfo_s {
 			rsRetVal (*commitTransaction)(void *const, actWrkrIParams_t *const, const unsigned);
 			rsRetVal (*doAction)(void** params, void*pWrkrData);
 			rsRetVal (*endTransaction)(void*);
+			rsRetVal (*abortTransaction)(void*);	/* optional: core gave up a failed tx */
 			rsRetVal (*parseSelectorAct)(uchar**, void**,omodStringRequest_t**);
 			rsRetVal (*newActInst)(uchar *modName, struct nvlst *lst, void **, omodStringRequest_t **);
 			rsRetVal (*SetShutdownImmdtPtr)(void *pData, void *pPtr);
@@ -36,6 +36,7 @@
 #include <assert.h>
 #include <ctype.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 #ifdef HAVE_SYSINFO_UPTIME
 #include <sys/sysinfo.h>
 #endif
@@ -75,6 +76,65 @@ extern void msgSetPRI(msg_t *const __restrict__ pMsg, syslog_pri_t pri);
  */
 static pthread_mutex_t glblVars_lock;
 struct json_object *global_var_root = NULL;
+/* JSON trees may be shared between messages (see MsgDup()). Such a tree
+ * is owned by a holder, which keeps the only json-c reference to it, as
+ * json-c's reference count is not atomic. The messages reference the
+ * holder instead, with an atomic count. Shared trees are never modified,
+ * but json-c keeps the serialized form inside the object, so serializing
+ * any part of the tree, as well as taking references to its nodes, must
+ * be done under the holder's mutex.
+ */
+struct msgJSONShare_s {
+	struct json_object *root;
+	int nRefs;
+	pthread_mutex_t mut;
+	DEF_ATOMIC_HELPER_MUT(mutRefs)
+};
+static inline void LockSharedJSON(msgJSONShare_t *const pShare)
+{
+	if(pShare != NULL)
+		pthread_mutex_lock(&pShare->mut);
+}
+static inline void UnlockSharedJSON(msgJSONShare_t *const pShare)
+{
+	if(pShare != NULL)
+		pthread_mutex_unlock(&pShare->mut);
+}
+
+/* share a message's tree with another message. If the tree is not yet
+ * shared, a holder is created, which takes over the message's reference.
+ * Returns the holder, or NULL if out of memory. Must be called with the
+ * message locked.
+ */
+static msgJSONShare_t *
+jsonShareAddRef(struct json_object *const root, msgJSONShare_t **const ppShare)
+{
+	msgJSONShare_t *pShare = *ppShare;
+
+	if(pShare == NULL) {
+		if((pShare = malloc(sizeof(msgJSONShare_t))) == NULL)
+			return NULL;
+		pShare->root = root;
+		pShare->nRefs = 1;
+		pthread_mutex_init(&pShare->mut, NULL);
+		INIT_ATOMIC_HELPER_MUT(pShare->mutRefs);
+		*ppShare = pShare;
+	}
+	ATOMIC_INC(&pShare->nRefs, &pShare->mutRefs);
+	return pShare;
+}
+
+/* drop a message's reference to a shared tree; the last one frees it */
+static void
+jsonShareRelease(msgJSONShare_t *const pShare)
+{
+	if(ATOMIC_DEC_AND_FETCH(&pShare->nRefs, &pShare->mutRefs) == 0) {
+		json_object_put(pShare->root);
+		pthread_mutex_destroy(&pShare->mut);
+		DESTROY_ATOMIC_HELPER_MUT(pShare->mutRefs);
+		free(pShare);
+	}
+}
 
 /* static data */
 DEFobjStaticHelpers
@@ -424,6 +484,50 @@ MsgUnlock(msg_t *pThis)
 	pthread_mutex_unlock(&pThis->mut);
 }
 
+/* Properties derived lazily from other message fields (PROGNAME, APPNAME,
+ * PROCID and the formatted timestamps) are computed once under the message
+ * lock and then published with release semantics. Once a property is
+ * published, it never changes again. So readers can check with an acquire
+ * load and need the lock only if the property is not yet available. This
+ * avoids contention on the message mutex when a message is processed by
+ * many action queues concurrently. Without atomic builtins, we always check
+ * under the lock.
+ */
+#ifdef HAVE_ATOMIC_BUILTINS
+#	define MsgLazyIsReady(data, unset) (ATOMIC_LOAD_ACQ(data) != (unset))
+#else
+#	define MsgLazyIsReady(data, unset) 0
+#endif
+
+
+/* check if the message has a lazy $! tree which is not yet converted */
+static inline int
+msgHasLazyJSON(msg_t * const pM)
+{
+	return pM->lazyjson != NULL && !pM->bLazyJSONDone;
+}
+
+
+/* convert the lazy $! tree into a regular json-c tree. This is needed
+ * for all operations that work on the tree as a whole or modify it.
+ * We keep the lazy document, as it may be shared with message copies;
+ * it is freed together with the message.
+ * Must be called with the message locked.
+ */
+static rsRetVal
+msgMaterializeLazyJSON(msg_t * const pM)
+{
+	DEFiRet;
+
+	if(msgHasLazyJSON(pM)) {
+		assert(pM->json == NULL);
+		CHKmalloc(pM->json = lazyjsonToJSON(pM->lazyjson));
+		pM->bLazyJSONDone = 1;
+	}
+finalize_it:
+	RETiRet;
+}
+
 
 /* set RcvFromIP name in msg object WITHOUT calling AddRef.
  * rgerhards, 2013-01-22
@@ -639,6 +743,8 @@ propNameToID(uchar *pName, propid_t *pPropID)
 		*pPropID = PROP_SYS_BOM;
 	} else if(!strcasecmp((char*) pName, "$UPTIME")) {
 		*pPropID = PROP_SYS_UPTIME;
+	} else if(!strcasecmp((char*) pName, "$now-unixtimestamp-us")) {
+		*pPropID = PROP_SYS_NOW_UNIXTS_US;
 	} else if(!strncmp((char*) pName, "$!", 2) || pName[0] == '!') {
 		*pPropID = PROP_CEE;
 	} else if(!strncmp((char*) pName, "$.", 2) || pName[0] == '.') {
@@ -755,6 +861,8 @@ uchar *propIDToName(propid_t propID)
 			return UCHAR_CONSTANT("$BOM");
 		case PROP_SYS_UPTIME:
 			return UCHAR_CONSTANT("$UPTIME");
+		case PROP_SYS_NOW_UNIXTS_US:
+			return UCHAR_CONSTANT("$NOW-UNIXTIMESTAMP-US");
 		case PROP_CEE:
 			return UCHAR_CONSTANT("*CEE-based property*");
 		case PROP_LOCAL_VAR:
@@ -767,6 +875,16 @@ uchar *propIDToName(propid_t propID)
 }
 
 
+static inline void
+initTimeCache(struct msgTimeCache *const pCache)
+{
+	pCache->sz3164[0] = '\0';
+	pCache->sz3339[0] = '\0';
+	pCache->szSecFrac[0] = '\0';
+	pCache->szUnix[0] = '\0';
+}
+
+
 /* This is common code for all Constructors. It is defined in an
  * inline'able function so that we can save a function call in the
  * actual constructors (otherwise, the msgConstruct would need
@@ -798,6 +916,7 @@ static inline rsRetVal msgBaseConstruct(msg_t **ppThis)
 	/* initialize members in ORDER they appear in structure (think "cache line"!) */
 	pM->flowCtlType = 0;
 	pM->bParseSuccess = 0;
+	pM->bPROCIDDone = 0;
 	pM->iRefCount = 1;
 	pM->iSeverity = LOG_DEBUG;
 	pM->iFacility = LOG_INVLD;
@@ -812,14 +931,6 @@ static inline rsRetVal msgBaseConstruct(msg_t **ppThis)
 	pM->iLenHOSTNAME = 0;
 	pM->pszRawMsg = NULL;
 	pM->pszHOSTNAME = NULL;
-	pM->pszRcvdAt3164 = NULL;
-	pM->pszRcvdAt3339 = NULL;
-	pM->pszRcvdAt_MySQL = NULL;
-        pM->pszRcvdAt_PgSQL = NULL;
-	pM->pszTIMESTAMP3164 = NULL;
-	pM->pszTIMESTAMP3339 = NULL;
-	pM->pszTIMESTAMP_MySQL = NULL;
-        pM->pszTIMESTAMP_PgSQL = NULL;
 	pM->pszStrucData = NULL;
 	pM->pCSAPPNAME = NULL;
 	pM->pCSPROCID = NULL;
@@ -830,16 +941,18 @@ static inline rsRetVal msgBaseConstruct(msg_t **ppThis)
 	pM->pRuleset = NULL;
 	pM->json = NULL;
 	pM->localvars = NULL;
+	pM->pJSONShare = NULL;
+	pM->pLocalVarsShare = NULL;
+	pM->lazyjson = NULL;
+	pM->bLazyJSONDone = 0;
+	pM->ttEnqueued = 0;
+	pM->pTrace = NULL;
 	pM->dfltTZ[0] = '\0';
 	memset(&pM->tRcvdAt, 0, sizeof(pM->tRcvdAt));
 	memset(&pM->tTIMESTAMP, 0, sizeof(pM->tTIMESTAMP));
 	pM->TAG.pszTAG = NULL;
-	pM->pszTimestamp3164[0] = '\0';
-	pM->pszTimestamp3339[0] = '\0';
-	pM->pszTIMESTAMP_SecFrac[0] = '\0';
-	pM->pszRcvdAt_SecFrac[0] = '\0';
-	pM->pszTIMESTAMP_Unix[0] = '\0';
-	pM->pszRcvdAt_Unix[0] = '\0';
+	initTimeCache(&pM->tcTIMESTAMP);
+	initTimeCache(&pM->tcRcvdAt);
 	pM->pszUUID = NULL;
 	pthread_mutex_init(&pM->mut, NULL);
 
@@ -958,12 +1071,6 @@ CODESTARTobjDestruct(msg)
 		}
 		if(pThis->pRcvFromIP != NULL)
 			prop.Destruct(&pThis->pRcvFromIP);
-		free(pThis->pszRcvdAt3164);
-		free(pThis->pszRcvdAt3339);
-		free(pThis->pszRcvdAt_MySQL);
-		free(pThis->pszRcvdAt_PgSQL);
-		free(pThis->pszTIMESTAMP_MySQL);
-		free(pThis->pszTIMESTAMP_PgSQL);
 		free(pThis->pszStrucData);
 		if(pThis->iLenPROGNAME >= CONF_PROGNAME_BUFSIZE)
 			free(pThis->PROGNAME.ptr);
@@ -973,12 +1080,20 @@ CODESTARTobjDestruct(msg)
 			rsCStrDestruct(&pThis->pCSPROCID);
 		if(pThis->pCSMSGID != NULL)
 			rsCStrDestruct(&pThis->pCSMSGID);
-		if(pThis->json != NULL)
+		if(pThis->pJSONShare != NULL)
+			jsonShareRelease(pThis->pJSONShare);
+		else if(pThis->json != NULL)
 			json_object_put(pThis->json);
-		if(pThis->localvars != NULL)
+		if(pThis->pLocalVarsShare != NULL)
+			jsonShareRelease(pThis->pLocalVarsShare);
+		else if(pThis->localvars != NULL)
 			json_object_put(pThis->localvars);
+		if(pThis->lazyjson != NULL)
+			lazyjsonRelease(&pThis->lazyjson);
 		if(pThis->pszUUID != NULL)
 			free(pThis->pszUUID);
+		if(pThis->pTrace != NULL)
+			traceFinish(pThis->pTrace);
 #	ifndef HAVE_ATOMIC_BUILTINS
 		MsgUnlock(pThis);
 # 	endif
@@ -1129,10 +1244,33 @@ msg_t* MsgDup(msg_t* pOld)
 	tmpCOPYCSTR(PROCID);
 	tmpCOPYCSTR(MSGID);
 
-	if(pOld->json != NULL)
-		pNew->json = jsonDeepCopy(pOld->json);
-	if(pOld->localvars != NULL)
-		pNew->localvars = jsonDeepCopy(pOld->localvars);
+	/* the JSON trees are potentially large, so we do not copy them here.
+	 * Instead, both messages share them and whoever modifies a shared
+	 * tree first gets its private copy (see msgUnshareJSON()). As
+	 * messages may be modified by other threads, we need the lock. If
+	 * there is not even memory for the holder, we copy after all.
+	 */
+	MsgLock(pOld);
+	if(pOld->json != NULL) {
+		if((pNew->pJSONShare = jsonShareAddRef(pOld->json, &pOld->pJSONShare)) != NULL)
+			pNew->json = pOld->json;
+		else
+			pNew->json = jsonDeepCopy(pOld->json);
+	}
+	if(pOld->localvars != NULL) {
+		if((pNew->pLocalVarsShare = jsonShareAddRef(pOld->localvars, &pOld->pLocalVarsShare)) != NULL)
+			pNew->localvars = pOld->localvars;
+		else
+			pNew->localvars = jsonDeepCopy(pOld->localvars);
+	}
+	if(pOld->lazyjson != NULL) {
+		lazyjsonAddRef(pOld->lazyjson);
+		pNew->lazyjson = pOld->lazyjson;
+		pNew->bLazyJSONDone = pOld->bLazyJSONDone;
+	}
+	MsgUnlock(pOld);
+	if(pOld->pTrace != NULL)
+		pNew->pTrace = traceAddRef(pOld->pTrace);
 
 	/* we do not copy all other cache properties, as we do not even know
 	 * if they are needed once again. So we let them re-create if needed.
@@ -1161,6 +1299,8 @@ static rsRetVal MsgSerialize(msg_t *pThis, strm_t *pStrm)
 {
 	uchar *psz;
 	int len;
+	size_t lenText;
+	rsRetVal localRet;
 	DEFiRet;
 
 	assert(pThis != NULL);
@@ -1189,13 +1329,25 @@ static rsRetVal MsgSerialize(msg_t *pThis, strm_t *pStrm)
 	CHKiRet(obj.SerializeProp(pStrm, UCHAR_CONSTANT("pszRcvFromIP"), PROPTYPE_PSZ, (void*) psz));
 	psz = pThis->pszStrucData; 
 	CHKiRet(obj.SerializeProp(pStrm, UCHAR_CONSTANT("pszStrucData"), PROPTYPE_PSZ, (void*) psz));
-	if(pThis->json != NULL) {
-		psz = (uchar*) json_object_get_string(pThis->json);
+	if(pThis->lazyjson != NULL && !pThis->bLazyJSONDone) {
+		/* the text is parsed by MsgDeserialize(), which results in the
+		 * same tree as converting the lazy document.
+		 */
+		psz = (uchar*) lazyjsonGetText(pThis->lazyjson, &lenText);
 		CHKiRet(obj.SerializeProp(pStrm, UCHAR_CONSTANT("json"), PROPTYPE_PSZ, (void*) psz));
+	} else if(pThis->json != NULL) {
+		LockSharedJSON(pThis->pJSONShare);
+		psz = (uchar*) json_object_get_string(pThis->json);
+		localRet = obj.SerializeProp(pStrm, UCHAR_CONSTANT("json"), PROPTYPE_PSZ, (void*) psz);
+		UnlockSharedJSON(pThis->pJSONShare);
+		CHKiRet(localRet);
 	}
 	if(pThis->localvars != NULL) {
+		LockSharedJSON(pThis->pLocalVarsShare);
 		psz = (uchar*) json_object_get_string(pThis->localvars);
-		CHKiRet(obj.SerializeProp(pStrm, UCHAR_CONSTANT("localvars"), PROPTYPE_PSZ, (void*) psz));
+		localRet = obj.SerializeProp(pStrm, UCHAR_CONSTANT("localvars"), PROPTYPE_PSZ, (void*) psz);
+		UnlockSharedJSON(pThis->pLocalVarsShare);
+		CHKiRet(localRet);
 	}
 
 	objSerializePTR(pStrm, pCSAPPNAME, CSTR);
@@ -1428,15 +1580,16 @@ static rsRetVal aquirePROCIDFromTAG(msg_t * const pM)
 {
 	register int i;
 	uchar *pszTag;
+	cstr_t *pCSPROCID = NULL;
 	DEFiRet;
 
 	assert(pM != NULL);
 
 	if(pM->pCSPROCID != NULL)
-		return RS_RET_OK; /* we are already done ;) */
+		FINALIZE; /* we are already done ;) */
 
 	if(msgGetProtocolVersion(pM) != 0)
-		return RS_RET_OK; /* we can only emulate if we have legacy format */
+		FINALIZE; /* we can only emulate if we have legacy format */
 
 	pszTag = (uchar*) ((pM->iLenTAG < CONF_TAG_BUFSIZE) ? pM->TAG.szBuf : pM->TAG.pszTAG);
 
@@ -1445,14 +1598,16 @@ static rsRetVal aquirePROCIDFromTAG(msg_t * const pM)
 	while((i < pM->iLenTAG) && (pszTag[i] != '['))
 		++i;
 	if(!(i < pM->iLenTAG))
-		return RS_RET_OK;	/* no [, so can not emulate... */
+		FINALIZE;	/* no [, so can not emulate... */
 	
 	++i; /* skip '[' */
 
-	/* now obtain the PROCID string... */
-	CHKiRet(cstrConstruct(&pM->pCSPROCID));
+	/* now obtain the PROCID string... We build it in a local
+	 * object, so that lock-free readers never see a partial one.
+	 */
+	CHKiRet(cstrConstruct(&pCSPROCID));
 	while((i < pM->iLenTAG) && (pszTag[i] != ']')) {
-		CHKiRet(cstrAppendChar(pM->pCSPROCID, pszTag[i]));
+		CHKiRet(cstrAppendChar(pCSPROCID, pszTag[i]));
 		++i;
 	}
 
@@ -1462,14 +1617,18 @@ static rsRetVal aquirePROCIDFromTAG(msg_t * const pM)
 		 * the buffer and simply return. Note that this is NOT an error
 		 * case!
 		 */
-		cstrDestruct(&pM->pCSPROCID);
 		FINALIZE;
 	}
 
 	/* OK, finally we could obtain a PROCID. So let's use it ;) */
-	cstrFinalize(pM->pCSPROCID);
+	cstrFinalize(pCSPROCID);
+	ATOMIC_STORE_REL(&pM->pCSPROCID, pCSPROCID);
+	pCSPROCID = NULL;
 
 finalize_it:
+	if(pCSPROCID != NULL)
+		cstrDestruct(&pCSPROCID);
+	ATOMIC_STORE_REL(&pM->bPROCIDDone, 1);
 	RETiRet;
 }
 
@@ -1511,7 +1670,8 @@ aquireProgramName(msg_t * const pM)
 	}
 	memcpy((char*)pszProgName, (char*)pszTag, i);
 	pszProgName[i] = '\0';
-	pM->iLenPROGNAME = i;
+	/* the length is the "ready" indication for lock-free readers */
+	ATOMIC_STORE_REL(&pM->iLenPROGNAME, i);
 finalize_it:
 	RETiRet;
 }
@@ -1708,6 +1868,91 @@ getPRI(msg_t * const pM)
 }
 
 
+/* obtain one of the formatted timestamp variants which are cached
+ * inside the message object. Note that the RFC3164 formats share a
+ * single entry, so the first one requested defines it. The SQL formats
+ * are not cached, see getTimeSQL().
+ */
+static const char *
+getTimeCached(msg_t *const pM, struct syslogTime *const pTm, struct msgTimeCache *const pCache,
+	const enum tplFormatTypes eFmt)
+{
+	char *buf;
+
+	switch(eFmt) {
+	case tplFmtRFC3339Date:
+		buf = pCache->sz3339;
+		break;
+	case tplFmtUnixDate:
+		buf = pCache->szUnix;
+		break;
+	case tplFmtSecFrac:
+		buf = pCache->szSecFrac;
+		break;
+	default:
+		buf = pCache->sz3164;
+		break;
+	}
+
+	/* the first byte being non-NUL tells the entry is complete */
+	if(MsgLazyIsReady(&buf[0], '\0'))
+		return buf;
+
+	MsgLock(pM);
+	if(buf[0] == '\0') {
+		/* format into a temporary buffer (RFC3339 is the longest
+		 * format) and publish the first byte last.
+		 */
+		char tmp[sizeof(pCache->sz3339)];
+		switch(eFmt) {
+		case tplFmtRFC3339Date:
+			datetime.formatTimestamp3339(pTm, tmp);
+			break;
+		case tplFmtUnixDate:
+			datetime.formatTimestampUnix(pTm, tmp);
+			break;
+		case tplFmtSecFrac:
+			datetime.formatTimestampSecFrac(pTm, tmp);
+			break;
+		default:
+			datetime.formatTimestamp3164(pTm, tmp, (eFmt == tplFmtRFC3164BuggyDate));
+			break;
+		}
+		memcpy(buf + 1, tmp + 1, strlen(tmp));
+		ATOMIC_STORE_REL(&buf[0], tmp[0]);
+	}
+	MsgUnlock(pM);
+	return buf;
+}
+
+
+/* The SQL formats are only used by the database outputs, so we do not
+ * spend space in every message to cache them, but format them into a
+ * new buffer on each use.
+ */
+static const char *
+getTimeSQL(struct syslogTime *const __restrict__ pTm,
+	const enum tplFormatTypes eFmt,
+	unsigned short *const __restrict__ pbMustBeFreed)
+{
+	char *retbuf;
+
+	if((retbuf = MALLOC(21)) == NULL) {
+		*pbMustBeFreed = 0;
+		return "internal error: malloc problem";
+	}
+	if(eFmt == tplFmtMySQLDate)
+		datetime.formatTimestampToMySQL(pTm, retbuf);
+	else
+		datetime.formatTimestampToPgSQL(pTm, retbuf);
+	*pbMustBeFreed = 1;
+	return retbuf;
+}
+
+
+/* Note: the SQL formats are not available here, as they are not cached
+ * in the message, see getTimeSQL().
+ */
 const char *
 getTimeReported(msg_t * const pM, enum tplFormatTypes eFmt)
 {
@@ -1719,61 +1964,13 @@ getTimeReported(msg_t * const pM, enum tplFormatTypes eFmt)
 	case tplFmtDefault:
 	case tplFmtRFC3164Date:
 	case tplFmtRFC3164BuggyDate:
-		MsgLock(pM);
-		if(pM->pszTIMESTAMP3164 == NULL) {
-			pM->pszTIMESTAMP3164 = pM->pszTimestamp3164;
-			datetime.formatTimestamp3164(&pM->tTIMESTAMP, pM->pszTIMESTAMP3164,
-						     (eFmt == tplFmtRFC3164BuggyDate));
-		}
-		MsgUnlock(pM);
-		return(pM->pszTIMESTAMP3164);
-	case tplFmtMySQLDate:
-		MsgLock(pM);
-		if(pM->pszTIMESTAMP_MySQL == NULL) {
-			if((pM->pszTIMESTAMP_MySQL = MALLOC(15)) == NULL) {
-				MsgUnlock(pM);
-				return "";
-			}
-			datetime.formatTimestampToMySQL(&pM->tTIMESTAMP, pM->pszTIMESTAMP_MySQL);
-		}
-		MsgUnlock(pM);
-		return(pM->pszTIMESTAMP_MySQL);
-        case tplFmtPgSQLDate:
-                MsgLock(pM);
-                if(pM->pszTIMESTAMP_PgSQL == NULL) {
-                        if((pM->pszTIMESTAMP_PgSQL = MALLOC(21)) == NULL) {
-                                MsgUnlock(pM);
-                                return "";
-                        }
-                        datetime.formatTimestampToPgSQL(&pM->tTIMESTAMP, pM->pszTIMESTAMP_PgSQL);
-                }
-                MsgUnlock(pM);
-                return(pM->pszTIMESTAMP_PgSQL);
 	case tplFmtRFC3339Date:
-		MsgLock(pM);
-		if(pM->pszTIMESTAMP3339 == NULL) {
-			pM->pszTIMESTAMP3339 = pM->pszTimestamp3339;
-			datetime.formatTimestamp3339(&pM->tTIMESTAMP, pM->pszTIMESTAMP3339);
-		}
-		MsgUnlock(pM);
-		return(pM->pszTIMESTAMP3339);
 	case tplFmtUnixDate:
-		MsgLock(pM);
-		if(pM->pszTIMESTAMP_Unix[0] == '\0') {
-			datetime.formatTimestampUnix(&pM->tTIMESTAMP, pM->pszTIMESTAMP_Unix);
-		}
-		MsgUnlock(pM);
-		return(pM->pszTIMESTAMP_Unix);
 	case tplFmtSecFrac:
-		if(pM->pszTIMESTAMP_SecFrac[0] == '\0') {
-			MsgLock(pM);
-			/* re-check, may have changed while we did not hold lock */
-			if(pM->pszTIMESTAMP_SecFrac[0] == '\0') {
-				datetime.formatTimestampSecFrac(&pM->tTIMESTAMP, pM->pszTIMESTAMP_SecFrac);
-			}
-			MsgUnlock(pM);
-		}
-		return(pM->pszTIMESTAMP_SecFrac);
+		return getTimeCached(pM, &pM->tTIMESTAMP, &pM->tcTIMESTAMP, eFmt);
+	case tplFmtMySQLDate:
+	case tplFmtPgSQLDate:
+		break;
 	case tplFmtWDayName:
 		return wdayNames[getWeekdayNbr(&pM->tTIMESTAMP)];
 	case tplFmtWDay:
@@ -1923,79 +2120,15 @@ getTimeGenerated(msg_t *const __restrict__ pM,
 
 	switch(eFmt) {
 	case tplFmtDefault:
-		MsgLock(pM);
-		if(pM->pszRcvdAt3164 == NULL) {
-			if((pM->pszRcvdAt3164 = MALLOC(16)) == NULL) {
-				MsgUnlock(pM);
-				return "";
-			}
-			datetime.formatTimestamp3164(pTm, pM->pszRcvdAt3164, 0);
-		}
-		MsgUnlock(pM);
-		return(pM->pszRcvdAt3164);
-	case tplFmtMySQLDate:
-		MsgLock(pM);
-		if(pM->pszRcvdAt_MySQL == NULL) {
-			if((pM->pszRcvdAt_MySQL = MALLOC(15)) == NULL) {
-				MsgUnlock(pM);
-				return "";
-			}
-			datetime.formatTimestampToMySQL(pTm, pM->pszRcvdAt_MySQL);
-		}
-		MsgUnlock(pM);
-		return(pM->pszRcvdAt_MySQL);
-        case tplFmtPgSQLDate:
-                MsgLock(pM);
-                if(pM->pszRcvdAt_PgSQL == NULL) {
-                        if((pM->pszRcvdAt_PgSQL = MALLOC(21)) == NULL) {
-                                MsgUnlock(pM);
-                                return "";
-                        }
-                        datetime.formatTimestampToPgSQL(pTm, pM->pszRcvdAt_PgSQL);
-                }
-                MsgUnlock(pM);
-                return(pM->pszRcvdAt_PgSQL);
 	case tplFmtRFC3164Date:
 	case tplFmtRFC3164BuggyDate:
-		MsgLock(pM);
-		if(pM->pszRcvdAt3164 == NULL) {
-			if((pM->pszRcvdAt3164 = MALLOC(16)) == NULL) {
-					MsgUnlock(pM);
-					return "";
-				}
-			datetime.formatTimestamp3164(pTm, pM->pszRcvdAt3164,
-						     (eFmt == tplFmtRFC3164BuggyDate));
-		}
-		MsgUnlock(pM);
-		return(pM->pszRcvdAt3164);
 	case tplFmtRFC3339Date:
-		MsgLock(pM);
-		if(pM->pszRcvdAt3339 == NULL) {
-			if((pM->pszRcvdAt3339 = MALLOC(33)) == NULL) {
-				MsgUnlock(pM);
-				return "";
-			}
-			datetime.formatTimestamp3339(pTm, pM->pszRcvdAt3339);
-		}
-		MsgUnlock(pM);
-		return(pM->pszRcvdAt3339);
 	case tplFmtUnixDate:
-		MsgLock(pM);
-		if(pM->pszRcvdAt_Unix[0] == '\0') {
-			datetime.formatTimestampUnix(pTm, pM->pszRcvdAt_Unix);
-		}
-		MsgUnlock(pM);
-		return(pM->pszRcvdAt_Unix);
 	case tplFmtSecFrac:
-		if(pM->pszRcvdAt_SecFrac[0] == '\0') {
-			MsgLock(pM);
-			/* re-check, may have changed while we did not hold lock */
-			if(pM->pszRcvdAt_SecFrac[0] == '\0') {
-				datetime.formatTimestampSecFrac(pTm, pM->pszRcvdAt_SecFrac);
-			}
-			MsgUnlock(pM);
-		}
-		return(pM->pszRcvdAt_SecFrac);
+		return getTimeCached(pM, pTm, &pM->tcRcvdAt, eFmt);
+	case tplFmtMySQLDate:
+	case tplFmtPgSQLDate:
+		break;
 	case tplFmtWDayName:
 		return wdayNames[getWeekdayNbr(pTm)];
 	case tplFmtWDay:
@@ -2174,11 +2307,11 @@ finalize_it:
  */
 static inline void preparePROCID(msg_t * const pM, sbool bLockMutex)
 {
-	if(pM->pCSPROCID == NULL) {
+	if(!MsgLazyIsReady(&pM->bPROCIDDone, 0)) {
 		if(bLockMutex == LOCK_MUTEX)
 			MsgLock(pM);
 		/* re-query, things may have changed in the mean time... */
-		if(pM->pCSPROCID == NULL)
+		if(!pM->bPROCIDDone)
 			aquirePROCIDFromTAG(pM);
 		if(bLockMutex == LOCK_MUTEX)
 			MsgUnlock(pM);
@@ -2205,15 +2338,12 @@ char *getPROCID(msg_t * const pM, sbool bLockMutex)
 	uchar *pszRet;
 
 	ISOBJ_TYPE_assert(pM, msg);
-	if(bLockMutex == LOCK_MUTEX)
-		MsgLock(pM);
-	preparePROCID(pM, MUTEX_ALREADY_LOCKED);
+	/* once prepared, PROCID does no longer change, so we need no lock */
+	preparePROCID(pM, bLockMutex);
 	if(pM->pCSPROCID == NULL)
 		pszRet = UCHAR_CONSTANT("-");
 	else 
 		pszRet = rsCStrGetSzStrNoNULL(pM->pCSPROCID);
-	if(bLockMutex == LOCK_MUTEX)
-		MsgUnlock(pM);
 	return (char*) pszRet;
 }
 
@@ -2350,10 +2480,17 @@ msgGetJSONMESG(msg_t *__restrict__ const pMsg)
 	json_object_object_add(json, "uuid", jval);
 #endif
 
+	/* json references the message's (maybe shared) tree, so we must
+	 * keep the locks until the reference is dropped again.
+	 */
+	MsgLock(pMsg);
+	msgMaterializeLazyJSON(pMsg);
+	LockSharedJSON(pMsg->pJSONShare);
 	json_object_object_add(json, "$!", json_object_get(pMsg->json));
-
 	pRes = (uchar*) strdup(json_object_get_string(json));
 	json_object_put(json);
+	UnlockSharedJSON(pMsg->pJSONShare);
+	MsgUnlock(pMsg);
 	return pRes;
 }
 
@@ -2375,6 +2512,8 @@ void MsgSetTAG(msg_t *__restrict__ const pMsg, const uchar* pszBuf, const size_t
 	assert(pMsg != NULL);
 
 	freeTAG(pMsg);
+	/* the new TAG may permit to emulate a PROCID the old one did not */
+	pMsg->bPROCIDDone = 0;
 
 	pMsg->iLenTAG = lenBuf;
 	if(pMsg->iLenTAG < CONF_TAG_BUFSIZE) {
@@ -2545,16 +2684,14 @@ MsgGetStructuredData(msg_t * const pM, uchar **pBuf, rs_size_t *len)
  */
 uchar *getProgramName(msg_t * const pM, sbool bLockMutex)
 {
-	if(pM->iLenPROGNAME == -1) {
-		if(bLockMutex == LOCK_MUTEX) {
+	if(!MsgLazyIsReady(&pM->iLenPROGNAME, -1)) {
+		if(bLockMutex == LOCK_MUTEX)
 			MsgLock(pM);
-			/* need to re-check, things may have change in between! */
-			if(pM->iLenPROGNAME == -1)
-				aquireProgramName(pM);
-			MsgUnlock(pM);
-		} else {
+		/* need to re-check, things may have change in between! */
+		if(pM->iLenPROGNAME == -1)
 			aquireProgramName(pM);
-		}
+		if(bLockMutex == LOCK_MUTEX)
+			MsgUnlock(pM);
 	}
 	return (pM->iLenPROGNAME < CONF_PROGNAME_BUFSIZE) ? pM->PROGNAME.szBuf
 						       : pM->PROGNAME.ptr;
@@ -2568,13 +2705,24 @@ uchar *getProgramName(msg_t * const pM, sbool bLockMutex)
  */
 static void tryEmulateAPPNAME(msg_t * const pM)
 {
+	cstr_t *pCSAPPNAME;
+
 	assert(pM != NULL);
 	if(pM->pCSAPPNAME != NULL)
 		return; /* we are already done */
 
 	if(msgGetProtocolVersion(pM) == 0) {
-		/* only then it makes sense to emulate */
-		MsgSetAPPNAME(pM, (char*)getProgramName(pM, MUTEX_ALREADY_LOCKED));
+		/* only then it makes sense to emulate. We do not use
+		 * MsgSetAPPNAME(), as lock-free readers must only see
+		 * the fully constructed object.
+		 */
+		if(rsCStrConstruct(&pCSAPPNAME) != RS_RET_OK)
+			return;
+		if(rsCStrSetSzStr(pCSAPPNAME, getProgramName(pM, MUTEX_ALREADY_LOCKED)) != RS_RET_OK) {
+			rsCStrDestruct(&pCSAPPNAME);
+			return;
+		}
+		ATOMIC_STORE_REL(&pM->pCSAPPNAME, pCSAPPNAME);
 	}
 }
 
@@ -2586,7 +2734,10 @@ static void tryEmulateAPPNAME(msg_t * const pM)
  */
 static inline void prepareAPPNAME(msg_t * const pM, sbool bLockMutex)
 {
-	if(pM->pCSAPPNAME == NULL) {
+	/* APPNAME can only be emulated for legacy messages; for all others,
+	 * it is final as it was set by the parser.
+	 */
+	if(!MsgLazyIsReady(&pM->pCSAPPNAME, NULL) && msgGetProtocolVersion(pM) == 0) {
 		if(bLockMutex == LOCK_MUTEX)
 			MsgLock(pM);
 
@@ -2606,15 +2757,12 @@ char *getAPPNAME(msg_t * const pM, sbool bLockMutex)
 	uchar *pszRet;
 
 	assert(pM != NULL);
-	if(bLockMutex == LOCK_MUTEX)
-		MsgLock(pM);
-	prepareAPPNAME(pM, MUTEX_ALREADY_LOCKED);
+	/* once prepared, APPNAME does no longer change, so we need no lock */
+	prepareAPPNAME(pM, bLockMutex);
 	if(pM->pCSAPPNAME == NULL)
 		pszRet = UCHAR_CONSTANT("");
 	else 
 		pszRet = rsCStrGetSzStrNoNULL(pM->pCSAPPNAME);
-	if(bLockMutex == LOCK_MUTEX)
-		MsgUnlock(pM);
 	return (char*)pszRet;
 }
 
@@ -2967,6 +3115,7 @@ getJSONPropVal(msg_t * const pMsg, msgPropDescr_t *pProp, uchar **pRes, rs_size_
 	struct json_object *jroot;
 	struct json_object *parent;
 	struct json_object *field;
+	msgJSONShare_t *pShare = NULL;
 	DEFiRet;
 
 	if(*pbMustBeFreed)
@@ -2974,11 +3123,26 @@ getJSONPropVal(msg_t * const pMsg, msgPropDescr_t *pProp, uchar **pRes, rs_size_
 	*pRes = NULL;
 
 	if(pProp->id == PROP_CEE) {
-		jroot = pMsg->json;
 		MsgLock(pMsg);
+		if(msgHasLazyJSON(pMsg)) {
+			if(strcmp((char*)pProp->name, "!")) {
+				if(lazyjsonGetPath(pMsg->lazyjson, pProp->name, &field) == RS_RET_OK
+				   && field != NULL) {
+					*pRes = (uchar*) strdup(json_object_get_string(field));
+					*buflen = (int) ustrlen(*pRes);
+					*pbMustBeFreed = 1;
+					json_object_put(field);
+				}
+				FINALIZE;
+			}
+			CHKiRet(msgMaterializeLazyJSON(pMsg));
+		}
+		jroot = pMsg->json;
+		pShare = pMsg->pJSONShare;
 	} else if(pProp->id == PROP_LOCAL_VAR) {
-		jroot = pMsg->localvars;
 		MsgLock(pMsg);
+		jroot = pMsg->localvars;
+		pShare = pMsg->pLocalVarsShare;
 	} else if(pProp->id == PROP_GLOBAL_VAR) {
 		jroot = global_var_root;
 		pthread_mutex_lock(&glblVars_lock);
@@ -2994,12 +3158,14 @@ getJSONPropVal(msg_t * const pMsg, msgPropDescr_t *pProp, uchar **pRes, rs_size_
 		field = jroot;
 	} else {
 		leaf = jsonPathGetLeaf(pProp->name, pProp->nameLen);
-		CHKiRet(jsonPathFindParent(jroot, pProp->name, leaf, &parent, 1));
+		CHKiRet(jsonPathFindParent(jroot, pProp->name, leaf, &parent, 0));
 		if(jsonVarExtract(parent, (char*)leaf, &field) == FALSE)
 			field = NULL;
 	}
 	if(field != NULL) {
+		LockSharedJSON(pShare);
 		*pRes = (uchar*) strdup(json_object_get_string(field));
+		UnlockSharedJSON(pShare);
 		*buflen = (int) ustrlen(*pRes);
 		*pbMustBeFreed = 1;
 	}
@@ -3036,13 +3202,29 @@ msgGetJSONPropJSONorString(msg_t * const pMsg, msgPropDescr_t *pProp, struct jso
 	struct json_object *jroot;
 	uchar *leaf;
 	struct json_object *parent;
+	sbool bOwned = 0; /* *pjson is a private object, no copy required */
 	DEFiRet;
 
 	*pjson = NULL, *pcstr = NULL;
 
 	if(pProp->id == PROP_CEE) {
-		jroot = pMsg->json;
 		MsgLock(pMsg);
+		if(msgHasLazyJSON(pMsg)) {
+			if(strcmp((char*)pProp->name, "!")) {
+				CHKiRet(lazyjsonGetPath(pMsg->lazyjson, pProp->name, pjson));
+				bOwned = 1;
+				if(*pjson == NULL) {
+					*pcstr = (uchar*) strdup("");
+				} else if(json_object_get_type(*pjson) == json_type_string) {
+					*pcstr = (uchar*) strdup(json_object_get_string(*pjson));
+					json_object_put(*pjson);
+					*pjson = NULL;
+				}
+				FINALIZE;
+			}
+			CHKiRet(msgMaterializeLazyJSON(pMsg));
+		}
+		jroot = pMsg->json;
 	} else if(pProp->id == PROP_LOCAL_VAR) {
 		jroot = pMsg->localvars;
 		MsgLock(pMsg);
@@ -3060,7 +3242,7 @@ msgGetJSONPropJSONorString(msg_t * const pMsg, msgPropDescr_t *pProp, struct jso
 		FINALIZE;
 	}
 	leaf = jsonPathGetLeaf(pProp->name, pProp->nameLen);
-	CHKiRet(jsonPathFindParent(jroot, pProp->name, leaf, &parent, 1));
+	CHKiRet(jsonPathFindParent(jroot, pProp->name, leaf, &parent, 0));
 	if(jsonVarExtract(parent, (char*)leaf, pjson) == FALSE) {
 		ABORT_FINALIZE(RS_RET_NOT_FOUND);
 	}
@@ -3076,7 +3258,7 @@ msgGetJSONPropJSONorString(msg_t * const pMsg, msgPropDescr_t *pProp, struct jso
 
 finalize_it:
 	/* we need a deep copy, as another thread may modify the object */
-	if(*pjson != NULL)
+	if(*pjson != NULL && !bOwned)
 		*pjson = jsonDeepCopy(*pjson);
 	if(pProp->id == PROP_GLOBAL_VAR)
 		pthread_mutex_unlock(&glblVars_lock);
@@ -3094,13 +3276,22 @@ msgGetJSONPropJSON(msg_t * const pMsg, msgPropDescr_t *pProp, struct json_object
 	struct json_object *jroot;
 	uchar *leaf;
 	struct json_object *parent;
+	sbool bOwned = 0; /* *pjson is a private object, no copy required */
 	DEFiRet;
 
 	*pjson = NULL;
 
 	if(pProp->id == PROP_CEE) {
-		jroot = pMsg->json;
 		MsgLock(pMsg);
+		if(msgHasLazyJSON(pMsg)) {
+			if(strcmp((char*)pProp->name, "!")) {
+				CHKiRet(lazyjsonGetPath(pMsg->lazyjson, pProp->name, pjson));
+				bOwned = 1;
+				FINALIZE;
+			}
+			CHKiRet(msgMaterializeLazyJSON(pMsg));
+		}
+		jroot = pMsg->json;
 	} else if(pProp->id == PROP_LOCAL_VAR) {
 		jroot = pMsg->localvars;
 		MsgLock(pMsg);
@@ -3118,14 +3309,14 @@ msgGetJSONPropJSON(msg_t * const pMsg, msgPropDescr_t *pProp, struct json_object
 		FINALIZE;
 	}
 	leaf = jsonPathGetLeaf(pProp->name, pProp->nameLen);
-	CHKiRet(jsonPathFindParent(jroot, pProp->name, leaf, &parent, 1));
+	CHKiRet(jsonPathFindParent(jroot, pProp->name, leaf, &parent, 0));
 	if(jsonVarExtract(parent, (char*)leaf, pjson) == FALSE) {
 		ABORT_FINALIZE(RS_RET_NOT_FOUND);
 	}
 
 finalize_it:
 	/* we need a deep copy, as another thread may modify the object */
-	if(*pjson != NULL)
+	if(*pjson != NULL && !bOwned)
 		*pjson = jsonDeepCopy(*pjson);
 	if(pProp->id == PROP_GLOBAL_VAR)
 		pthread_mutex_unlock(&glblVars_lock);
@@ -3395,6 +3586,8 @@ uchar *MsgGetProp(msg_t *__restrict__ const pMsg, struct templateEntry *__restri
 			}
 			if(bDateInUTC) {
 				pRes = (uchar*)getTimeUTC(&pMsg->tTIMESTAMP, datefmt, pbMustBeFreed);
+			} else if(datefmt == tplFmtMySQLDate || datefmt == tplFmtPgSQLDate) {
+				pRes = (uchar*)getTimeSQL(&pMsg->tTIMESTAMP, datefmt, pbMustBeFreed);
 			} else {
 				pRes = (uchar*)getTimeReported(pMsg, datefmt);
 			}
@@ -3456,6 +3649,8 @@ uchar *MsgGetProp(msg_t *__restrict__ const pMsg, struct templateEntry *__restri
 			}
 			if(bDateInUTC) {
 				pRes = (uchar*)getTimeUTC(&pMsg->tRcvdAt, datefmt, pbMustBeFreed);
+			} else if(datefmt == tplFmtMySQLDate || datefmt == tplFmtPgSQLDate) {
+				pRes = (uchar*)getTimeSQL(&pMsg->tRcvdAt, datefmt, pbMustBeFreed);
 			} else {
 				pRes = (uchar*)getTimeGenerated(pMsg, datefmt);
 			}
@@ -3623,13 +3818,23 @@ uchar *MsgGetProp(msg_t *__restrict__ const pMsg, struct templateEntry *__restri
 			break;
 		case PROP_CEE_ALL_JSON:
 		case PROP_CEE_ALL_JSON_PLAIN:
+			MsgLock(pMsg);
+			/* the text as received may differ from what json-c generates
+			 * (whitespace, escapes, numbers), so a lazy tree is converted
+			 * to get the same output as without lazy mode.
+			 */
+			if(msgMaterializeLazyJSON(pMsg) != RS_RET_OK) {
+				MsgUnlock(pMsg);
+				RET_OUT_OF_MEMORY;
+			}
 			if(pMsg->json == NULL) {
+				MsgUnlock(pMsg);
 				pRes = (uchar*) "{}";
 				bufLen = 2;
 				*pbMustBeFreed = 0;
 			} else {
 				const char *jstr;
-				MsgLock(pMsg);
+				LockSharedJSON(pMsg->pJSONShare);
 				int jflag = 0;
 				if(pProp->id == PROP_CEE_ALL_JSON) {
 					jflag = JSON_C_TO_STRING_SPACED;
@@ -3637,11 +3842,11 @@ uchar *MsgGetProp(msg_t *__restrict__ const pMsg, struct templateEntry *__restri
 					jflag = JSON_C_TO_STRING_PLAIN;
 				}
 				jstr = json_object_to_json_string_ext(pMsg->json, jflag);
+				/* the string lives inside the (maybe shared) object, so
+				 * we must copy it while still holding the lock */
+				pRes = (jstr == NULL) ? NULL : (uchar*)strdup(jstr);
+				UnlockSharedJSON(pMsg->pJSONShare);
 				MsgUnlock(pMsg);
-				if(jstr == NULL) {
-					RET_OUT_OF_MEMORY;
-				}
-				pRes = (uchar*)strdup(jstr);
 				if(pRes == NULL) {
 					RET_OUT_OF_MEMORY;
 				}
@@ -3706,6 +3911,22 @@ uchar *MsgGetProp(msg_t *__restrict__ const pMsg, struct templateEntry *__restri
 			}
 #			endif
 		break;
+		case PROP_SYS_NOW_UNIXTS_US:
+			/* unlike the other $now properties, this is not the cached time of
+			 * the batch but always the actual time. It is meant for latency
+			 * measurements.
+			 */
+			{
+			struct timeval tv;
+
+			if((pRes = (uchar*) MALLOC(32)) == NULL) {
+				RET_OUT_OF_MEMORY;
+			}
+			gettimeofday(&tv, NULL);
+			*pbMustBeFreed = 1;
+			snprintf((char*) pRes, 32, "%lld%6.6ld", (long long) tv.tv_sec, (long) tv.tv_usec);
+			}
+		break;
 		default:
 			/* there is no point in continuing, we may even otherwise render the
 			 * error message unreadable. rgerhards, 2007-07-10
@@ -4622,7 +4843,7 @@ jsonPathFindParent(struct json_object *jroot, uchar *name, uchar *leaf, struct j
 	namestart = name;
 	*parent = jroot;
 	while(name < leaf-1) {
-		jsonPathFindNext(*parent, namestart, &name, leaf, parent, bCreate);
+		CHKiRet(jsonPathFindNext(*parent, namestart, &name, leaf, parent, bCreate));
 	}
 	if(*parent == NULL)
 		ABORT_FINALIZE(RS_RET_NOT_FOUND);
@@ -4651,6 +4872,63 @@ jsonMerge(struct json_object *existing, struct json_object *json)
 	RETiRet;
 }
 
+/* obtain a subtree of the $! tree (for templates with "subtree"). The
+ * caller receives its own reference. If the tree is shared, it receives
+ * a private copy instead, as it may serialize the subtree. *pjson is
+ * NULL if there is no such subtree.
+ */
+rsRetVal
+msgGetJSONSubtree(msg_t * const pM, msgPropDescr_t *pProp, struct json_object **pjson)
+{
+	struct json_object *json = NULL;
+	DEFiRet;
+
+	*pjson = NULL;
+	MsgLock(pM);
+	CHKiRet(msgMaterializeLazyJSON(pM));
+	CHKiRet(jsonFind(pM->json, pProp, &json));
+	if(json != NULL) {
+		if(pM->pJSONShare != NULL) {
+			CHKmalloc(*pjson = jsonDeepCopy(json));
+		} else {
+			*pjson = json_object_get(json);
+		}
+	}
+finalize_it:
+	MsgUnlock(pM);
+	RETiRet;
+}
+
+
+/* Make sure the JSON tree we are about to modify is private to this
+ * message. After MsgDup(), original and copy share their trees, and each
+ * one that modifies a tree replaces its reference by a deep copy. The last
+ * message referencing the tree takes it over instead. Reading the tree
+ * for the copy needs no lock, as shared trees are never modified and
+ * jsonDeepCopy() does not serialize. Must be called with the message locked.
+ */
+static rsRetVal
+msgUnshareJSON(struct json_object **pjroot, msgJSONShare_t **ppShare)
+{
+	msgJSONShare_t *const pShare = *ppShare;
+	struct json_object *copy;
+	DEFiRet;
+
+	if(pShare != NULL) {
+		/* no one else can take a new reference while we hold our message's lock */
+		if(ATOMIC_FETCH_32BIT(&pShare->nRefs, &pShare->mutRefs) == 1) {
+			pShare->root = NULL;
+		} else {
+			CHKmalloc(copy = jsonDeepCopy(*pjroot));
+			*pjroot = copy;
+		}
+		jsonShareRelease(pShare);
+		*ppShare = NULL;
+	}
+finalize_it:
+	RETiRet;
+}
+
 /* find a JSON structure element (field or container doesn't matter).  */
 rsRetVal
 jsonFind(struct json_object *jroot, msgPropDescr_t *pProp, struct json_object **jsonres)
@@ -4686,14 +4964,17 @@ msgAddJSON(msg_t * const pM, uchar *name, struct json_object *json, int force_re
 	struct json_object **pjroot;
 	struct json_object *parent, *leafnode;
 	struct json_object *given = NULL;
+	msgJSONShare_t **ppShare = NULL;
 	uchar *leaf;
 	DEFiRet;
 
 	if(name[0] == '!') {
 		pjroot = &pM->json;
+		ppShare = &pM->pJSONShare;
 		MsgLock(pM);
 	} else if(name[0] == '.') {
 		pjroot = &pM->localvars;
+		ppShare = &pM->pLocalVarsShare;
 		MsgLock(pM);
 	} else if (name[0] == '/') { /* globl var */
 		pjroot = &global_var_root;
@@ -4708,6 +4989,17 @@ msgAddJSON(msg_t * const pM, uchar *name, struct json_object *json, int force_re
 		ABORT_FINALIZE(RS_RET_INVLD_SETOP);
 	}
 
+	if(ppShare != NULL) {
+		if(name[0] == '!')
+			iRet = msgMaterializeLazyJSON(pM);
+		if(iRet == RS_RET_OK)
+			iRet = msgUnshareJSON(pjroot, ppShare);
+		if(iRet != RS_RET_OK) {
+			json_object_put(json);
+			FINALIZE;
+		}
+	}
+
 	if(name[1] == '\0') { /* full tree? */
 		if(*pjroot == NULL)
 			*pjroot = json;
@@ -4765,19 +5057,52 @@ finalize_it:
 }
 
 
+/* set the $! tree from a lazy JSON document. The message takes over the
+ * reference to doc. The lazy document can only be used if $! is empty;
+ * otherwise, it is converted and merged like msgAddJSON() does.
+ */
+rsRetVal
+msgSetLazyJSON(msg_t * const pM, lazyjson_t *doc)
+{
+	struct json_object *json;
+	sbool bSet = 0;
+	DEFiRet;
+
+	MsgLock(pM);
+	if(pM->json == NULL && pM->lazyjson == NULL) {
+		pM->lazyjson = doc;
+		pM->bLazyJSONDone = 0;
+		bSet = 1;
+	}
+	MsgUnlock(pM);
+
+	if(!bSet) {
+		json = lazyjsonToJSON(doc);
+		lazyjsonRelease(&doc);
+		CHKmalloc(json);
+		CHKiRet(msgAddJSON(pM, (uchar*)"!", json, 0, 0));
+	}
+finalize_it:
+	RETiRet;
+}
+
+
 rsRetVal
 msgDelJSON(msg_t * const pM, uchar *name)
 {
 	struct json_object **jroot;
 	struct json_object *parent, *leafnode;
+	msgJSONShare_t **ppShare = NULL;
 	uchar *leaf;
 	DEFiRet;
 
 	if(name[0] == '!') {
 		jroot = &pM->json;
+		ppShare = &pM->pJSONShare;
 		MsgLock(pM);
 	} else if(name[0] == '.') {
 		jroot = &pM->localvars;
+		ppShare = &pM->pLocalVarsShare;
 		MsgLock(pM);
 	} else if (name[0] == '/') { /* globl var */
 		jroot = &global_var_root;
@@ -4788,6 +5113,9 @@ msgDelJSON(msg_t * const pM, uchar *name)
 		ABORT_FINALIZE(RS_RET_INVLD_SETOP);
 	}
 
+	if(name[0] == '!')
+		CHKiRet(msgMaterializeLazyJSON(pM));
+
 	if(*jroot == NULL) {
 		DBGPRINTF("msgDelJSONVar; jroot empty in unset for property %s\n",
 			  name);
@@ -4799,9 +5127,16 @@ msgDelJSON(msg_t * const pM, uchar *name)
 		 * we trust rsyslog.conf to be written by the admin.
 		 */
 		DBGPRINTF("unsetting JSON root object\n");
-		json_object_put(*jroot);
+		if(ppShare != NULL && *ppShare != NULL) {
+			jsonShareRelease(*ppShare);
+			*ppShare = NULL;
+		} else {
+			json_object_put(*jroot);
+		}
 		*jroot = NULL;
 	} else {
+		if(ppShare != NULL)
+			CHKiRet(msgUnshareJSON(jroot, ppShare));
 		leaf = jsonPathGetLeaf(name, ustrlen(name));
 		CHKiRet(jsonPathFindParent(*jroot, name, leaf, &parent, 1));
 		if(jsonVarExtract(parent, (char*)leaf, &leafnode) == FALSE)
@@ -32,6 +32,8 @@
 #include <libestr.h>
 #include <stdint.h>
 #include <json.h>
+#include "lazyjson.h"
+#include "trace.h"
 #include "obj.h"
 #include "syslogd-types.h"
 #include "template.h"
@@ -57,48 +59,59 @@
  * msgBaseConstruct(). That function header comment also describes
  * why this is the case.
  */
+/* cache for the formatted variants of a timestamp. These are kept
+ * inside the message object itself, so that formatting does not need
+ * any memory allocation. An entry is valid if its first char is not NUL.
+ */
+struct msgTimeCache {
+	char sz3164[CONST_LEN_TIMESTAMP_3164 + 1];
+	char sz3339[CONST_LEN_TIMESTAMP_3339 + 1];
+	char szSecFrac[7];
+	char szUnix[12];
+};
+
+/* Field order matters: the fields needed by almost every message (parsing,
+ * filtering, default templates) come first, so that they share as few
+ * cache lines as possible. Rarely used fields and large buffers follow.
+ */
 struct msg {
 	BEGINobjInstance;	/* Data to implement generic object - MUST be the first data element! */
-	flowControl_t flowCtlType; /**< type of flow control we can apply, for enqueueing, needs not to be persisted because
-				        once data has entered the queue, this property is no longer needed. */
-	pthread_mutex_t mut;
+	/* hot fields */
 	int	iRefCount;	/* reference counter (0 = unused) */
-	sbool	bParseSuccess;	/* set to reflect state of last executed higher level parser */
+	int	msgFlags;	/* flags associated with this message */
+	pthread_mutex_t mut;	/* taken for every lazily formatted property, so it is hot, too */
 	unsigned short	iSeverity;/* the severity  */
 	unsigned short	iFacility;/* Facility code */
 	short	offAfterPRI;	/* offset, at which raw message WITHOUT PRI part starts in pszRawMsg */
 	short	offMSG;		/* offset at which the MSG part starts in pszRawMsg */
 	short	iProtocolVersion;/* protocol version of message received 0 - legacy, 1 syslog-protocol) */
-	int	msgFlags;	/* flags associated with this message */
+	sbool	bParseSuccess;	/* set to reflect state of last executed higher level parser */
+	sbool	bLazyJSONDone;	/* lazyjson has been converted into json, only text is still used */
+	sbool	bPROCIDDone;	/* PROCID emulation from TAG has been tried (pCSPROCID may still be NULL) */
+	uint16_t lenStrucData;	/* (cached) length of STRUCTURED-DATA, rarely used, but fills a padding hole */
 	int	iLenRawMsg;	/* length of raw message */
 	int	iLenMSG;	/* Length of the MSG part */
 	int	iLenTAG;	/* Length of the TAG part */
 	int	iLenHOSTNAME;	/* Length of HOSTNAME */
 	int	iLenPROGNAME;	/* Length of PROGNAME (-1 = not yet set) */
+	flowControl_t flowCtlType; /**< type of flow control we can apply, for enqueueing, needs not to be persisted because
+				        once data has entered the queue, this property is no longer needed. Placed here
+				        to fill a padding hole. */
 	uchar	*pszRawMsg;	/* message as it was received on the wire. This is important in case we
 				 * need to preserve cryptographic verifiers.  */
 	uchar	*pszHOSTNAME;	/* HOSTNAME from syslog message */
-	char *pszRcvdAt3164;	/* time as RFC3164 formatted string (always 15 charcters) */
-	char *pszRcvdAt3339;	/* time as RFC3164 formatted string (32 charcters at most) */
-	char *pszRcvdAt_MySQL;	/* rcvdAt as MySQL formatted string (always 14 charcters) */
-        char *pszRcvdAt_PgSQL;  /* rcvdAt as PgSQL formatted string (always 21 characters) */
-	char *pszTIMESTAMP3164;	/* TIMESTAMP as RFC3164 formatted string (always 15 charcters) */
-	char *pszTIMESTAMP3339;	/* TIMESTAMP as RFC3339 formatted string (32 charcters at most) */
-	char *pszTIMESTAMP_MySQL;/* TIMESTAMP as MySQL formatted string (always 14 charcters) */
-        char *pszTIMESTAMP_PgSQL;/* TIMESTAMP as PgSQL formatted string (always 21 characters) */
-	uchar *pszStrucData;    /* STRUCTURED-DATA */
-	uint16_t lenStrucData;	/* (cached) length of STRUCTURED-DATA */
-	cstr_t *pCSAPPNAME;	/* APP-NAME */
-	cstr_t *pCSPROCID;	/* PROCID */
-	cstr_t *pCSMSGID;	/* MSGID */
+	ruleset_t *pRuleset;	/* ruleset to be used for processing this message */
 	prop_t *pInputName;	/* input name property */
 	prop_t *pRcvFromIP;	/* IP of system message was received from */
 	union {
 		prop_t *pRcvFrom;/* name of system message was received from */
 		struct sockaddr_storage *pfrominet; /* unresolved name */
 	} rcvFrom;
-
-	ruleset_t *pRuleset;	/* ruleset to be used for processing this message */
+	struct json_object *json;
+	struct json_object *localvars;
+	msgJSONShare_t *pJSONShare;	/* holder if json is shared with MsgDup() copies, else NULL */
+	msgJSONShare_t *pLocalVarsShare;/* same for localvars */
+	lazyjson_t *lazyjson;	/* unparsed $! tree (mmjsonparse lazy mode), NULL if none */
 	time_t ttGenTime;	/* time msg object was generated, same as tRcvdAt, but a Unix timestamp.
 				   While this field looks redundant, it is required because a Unix timestamp
 				   is used at later processing stages (namely in the output arena). Thanks to
@@ -106,13 +119,19 @@ struct msg {
 				   the Unix timestamp from the syslogTime fields (in practice, we may be close
 				   enough to reliable, but I prefer to leave the subtle things to the OS, where
 				   it obviously is solved in way or another...). */
+	long long ttEnqueued;	/* monotonic time (usecs) of the most recent queue enqueue, 0 if
+				   unknown (e.g. after reading from a disk queue); for latency stats */
+	msgtrace_t *pTrace;	/* pipeline trace, NULL if this message is not sampled */
 	struct syslogTime tRcvdAt;/* time the message entered this program */
 	struct syslogTime tTIMESTAMP;/* (parsed) value of the timestamp */
-	struct json_object *json;
-	struct json_object *localvars;
+	/* less frequently used fields */
+	uchar *pszStrucData;    /* STRUCTURED-DATA */
+	cstr_t *pCSAPPNAME;	/* APP-NAME */
+	cstr_t *pCSPROCID;	/* PROCID */
+	cstr_t *pCSMSGID;	/* MSGID */
+	uchar *pszUUID; /* The message's UUID */
+	char dfltTZ[8];	    /* 7 chars max, less overhead than ptr! */
 	/* some fixed-size buffers to save malloc()/free() for frequently used fields (from the default templates) */
-	uchar szRawMsg[CONF_RAWMSG_BUFSIZE];	/* most messages are small, and these are stored here (without malloc/free!) */
-	uchar szHOSTNAME[CONF_HOSTNAME_BUFSIZE];
 	union {
 		uchar	*ptr;	/* pointer to progname value */
 		uchar	szBuf[CONF_PROGNAME_BUFSIZE];
@@ -121,14 +140,10 @@ struct msg {
 		uchar	*pszTAG;	/* pointer to tag value */
 		uchar	szBuf[CONF_TAG_BUFSIZE];
 	} TAG;
-	char pszTimestamp3164[CONST_LEN_TIMESTAMP_3164 + 1];
-	char pszTimestamp3339[CONST_LEN_TIMESTAMP_3339 + 1];
-	char pszTIMESTAMP_SecFrac[7]; /* Note: a pointer is 64 bits/8 char, so this is actually fewer than a pointer! */
-	char pszRcvdAt_SecFrac[7];	     /* same as above. Both are fractional seconds for their respective timestamp */
-	char pszTIMESTAMP_Unix[12]; /* almost as small as a pointer! */
-	char pszRcvdAt_Unix[12];
-	char dfltTZ[8];	    /* 7 chars max, less overhead than ptr! */
-	uchar *pszUUID; /* The message's UUID */
+	uchar szHOSTNAME[CONF_HOSTNAME_BUFSIZE];
+	struct msgTimeCache tcTIMESTAMP;	/* formatted variants of tTIMESTAMP */
+	struct msgTimeCache tcRcvdAt;		/* formatted variants of tRcvdAt */
+	uchar szRawMsg[CONF_RAWMSG_BUFSIZE];	/* most messages are small, and these are stored here (without malloc/free!) */
 };
 
 
@@ -193,6 +208,8 @@ const char *getTimeReported(msg_t *pM, enum tplFormatTypes eFmt);
 const char *getPRI(msg_t *pMsg);
 void getRawMsg(msg_t *pM, uchar **pBuf, int *piLen);
 rsRetVal msgAddJSON(msg_t *pM, uchar *name, struct json_object *json, int force_reset, int sharedReference);
+rsRetVal msgSetLazyJSON(msg_t *pM, lazyjson_t *doc);
+rsRetVal msgGetJSONSubtree(msg_t *pM, msgPropDescr_t *pProp, struct json_object **pjson);
 rsRetVal msgAddMetadata(msg_t *msg, uchar *metaname, uchar *metaval);
 rsRetVal MsgGetSeverity(msg_t *pThis, int *piSeverity);
 rsRetVal MsgDeserialize(msg_t *pMsg, strm_t *pStrm);
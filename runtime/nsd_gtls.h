@@ -70,10 +70,11 @@ struct nsd_gtls_s {
 
 /* prototypes */
 PROTOTYPEObj(nsd_gtls);
-/* some prototypes for things used by our nsdsel_gtls helper class */
+/* some prototypes for things used by our nsdsel_gtls and nsdpoll_gtls helper classes */
 uchar *gtlsStrerror(int error);
 rsRetVal gtlsChkPeerAuth(nsd_gtls_t *pThis);
 rsRetVal gtlsRecordRecv(nsd_gtls_t *pThis);
+rsRetVal gtlsDoRetry(nsd_gtls_t *pNsd);
 
 /* the name of our library binary */
 #define LM_NSD_GTLS_FILENAME "lmnsd_gtls"
@@ -0,0 +1,484 @@
+/* nsdpoll_gtls.c
+ *
+ * An implementation of the nsd epoll() interface for GnuTLS.
+ *
+ * The socket handling is the same as for plain tcp, but GnuTLS adds two
+ * things we need to care about: first, GnuTLS may already have read (and
+ * decrypted) data from the socket which the upper layer did not yet
+ * consume. For such sessions, the socket will not necessarily become
+ * readable again, so we must report them without epoll telling us.
+ * Secondly, handshakes are done non-blocking and need to be continued
+ * when the socket becomes ready in the direction GnuTLS wants. This is
+ * done inside this driver, the upper layer sees the session only after
+ * the handshake is done (or has failed).
+ *
+ * Copyright (C) 2026 Adiscon GmbH.
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "config.h"
+
+#ifdef HAVE_EPOLL_CREATE /* this module requires epoll! */
+
+#include <stdlib.h>
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_EPOLL_H
+#	include <sys/epoll.h>
+#endif
+#include <gnutls/gnutls.h>
+
+#include "rsyslog.h"
+#include "module-template.h"
+#include "obj.h"
+#include "errmsg.h"
+#include "srUtils.h"
+#include "nspoll.h"
+#include "nsd_ptcp.h"
+#include "nsd_gtls.h"
+#include "nsdpoll_gtls.h"
+
+/* static data */
+DEFobjStaticHelpers
+DEFobjCurrIf(errmsg)
+DEFobjCurrIf(glbl)
+
+
+/* check if the session has data that can be read without waiting for the
+ * socket. This is the case if our own receive buffer is not yet exhausted
+ * or GnuTLS has buffered records. A connection that shall be aborted is
+ * also reported, so that the upper layer learns about it and closes it.
+ */
+static int
+gtlsHasPendingData(nsd_gtls_t *pSock)
+{
+	if(pSock->bAbortConn)
+		return 1;
+	if(pSock->iMode != 1 || pSock->rtryCall != gtlsRtry_None)
+		return 0;
+	if(pSock->pszRcvBuf != NULL && pSock->lenRcvBuf != -1)
+		return 1;
+	return pSock->bHaveSess && gnutls_record_check_pending(pSock->sess) > 0;
+}
+
+
+/* obtain the epoll event mask for an entry. While a GnuTLS operation is
+ * pending, we must wait for the direction GnuTLS needs, which may be
+ * different from what the upper layer requested (e.g. the handshake
+ * may need to write).
+ */
+static uint32_t
+evtMask(nsdpoll_gtlsevt_lst_t *pEvt)
+{
+	nsd_gtls_t *const pSock = pEvt->pSock;
+	uint32_t events = 0;
+
+	if(pSock->iMode == 1 && pSock->rtryCall != gtlsRtry_None)
+		return (gnutls_record_get_direction(pSock->sess) == 0) ? EPOLLIN : EPOLLOUT;
+	if(pEvt->mode & NSDPOLL_IN)
+		events |= EPOLLIN;
+	if(pEvt->mode & NSDPOLL_OUT)
+		events |= EPOLLOUT;
+	return events;
+}
+
+
+/* obtain the socket descriptor from our aggregated ptcp driver */
+static inline int
+gtlsSockFd(nsd_gtls_t *pSock)
+{
+	return ((nsd_ptcp_t*) pSock->pTcp)->sock;
+}
+
+
+/* -START------------------------- helpers for event list ------------------------------------ */
+
+/* add an entry to the ready candidate list. The caller must hold mutEvtLst. */
+static inline void
+addRdyCandidate(nsdpoll_gtls_t *pThis, nsdpoll_gtlsevt_lst_t *pEvt)
+{
+	if(pEvt->bInRdyLst)
+		return;
+	pEvt->pNextRdy = pThis->pRdyRoot;
+	pThis->pRdyRoot = pEvt;
+	pEvt->bInRdyLst = 1;
+}
+
+
+/* add new entry to list. We assume that the fd is not already present and DO NOT check this!
+ * Returns newly created entry in pEvtLst. As with the ptcp driver, we use level-triggered
+ * mode. If GnuTLS already has data for the session (this may happen if the peer sent data
+ * together with the final handshake message), it immediately becomes a ready candidate.
+ */
+static inline rsRetVal
+addEvent(nsdpoll_gtls_t *pThis, int id, void *pUsr, int mode, nsd_gtls_t *pSock, nsdpoll_gtlsevt_lst_t **pEvtLst) {
+	nsdpoll_gtlsevt_lst_t *pNew;
+	DEFiRet;
+
+	CHKmalloc(pNew = (nsdpoll_gtlsevt_lst_t*) calloc(1, sizeof(nsdpoll_gtlsevt_lst_t)));
+	pNew->id = id;
+	pNew->pUsr = pUsr;
+	pNew->mode = mode;
+	pNew->pSock = pSock;
+	pNew->event.events = evtMask(pNew);
+	pNew->event.data.ptr = pNew;
+	pthread_mutex_lock(&pThis->mutEvtLst);
+	pNew->pNext = pThis->pRoot;
+	pThis->pRoot = pNew;
+	if((mode & NSDPOLL_IN) && gtlsHasPendingData(pSock))
+		addRdyCandidate(pThis, pNew);
+	pthread_mutex_unlock(&pThis->mutEvtLst);
+	*pEvtLst = pNew;
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* find and unlink the entry identified by id/pUsr from the list. This includes
+ * removing it from the ready candidate list, if it is a member of it.
+ */
+static inline rsRetVal
+unlinkEvent(nsdpoll_gtls_t *pThis, int id, void *pUsr, nsdpoll_gtlsevt_lst_t **ppEvtLst) {
+	nsdpoll_gtlsevt_lst_t *pEvtLst;
+	nsdpoll_gtlsevt_lst_t *pPrev = NULL;
+	nsdpoll_gtlsevt_lst_t **ppRdy;
+	DEFiRet;
+
+	pthread_mutex_lock(&pThis->mutEvtLst);
+	pEvtLst = pThis->pRoot;
+	while(pEvtLst != NULL && !(pEvtLst->id == id && pEvtLst->pUsr == pUsr)) {
+		pPrev = pEvtLst;
+		pEvtLst = pEvtLst->pNext;
+	}
+	if(pEvtLst == NULL)
+		ABORT_FINALIZE(RS_RET_NOT_FOUND);
+
+	*ppEvtLst = pEvtLst;
+
+	/* unlink */
+	if(pPrev == NULL)
+		pThis->pRoot = pEvtLst->pNext;
+	else
+		pPrev->pNext = pEvtLst->pNext;
+
+	if(pEvtLst->bInRdyLst) {
+		for(ppRdy = &pThis->pRdyRoot ; *ppRdy != pEvtLst ; ppRdy = &(*ppRdy)->pNextRdy)
+			/* just search */;
+		*ppRdy = pEvtLst->pNextRdy;
+		pEvtLst->bInRdyLst = 0;
+	}
+
+finalize_it:
+	pthread_mutex_unlock(&pThis->mutEvtLst);
+	RETiRet;
+}
+
+
+/* destruct the provided element. It must already be unlinked from the list.
+ */
+static inline rsRetVal
+delEvent(nsdpoll_gtlsevt_lst_t **ppEvtLst) {
+	DEFiRet;
+	free(*ppEvtLst);
+	*ppEvtLst = NULL;
+	RETiRet;
+}
+
+
+/* -END--------------------------- helpers for event list ------------------------------------ */
+
+
+/* Standard-Constructor
+ */
+BEGINobjConstruct(nsdpoll_gtls) /* be sure to specify the object type also in END macro! */
+#if defined(EPOLL_CLOEXEC) && defined(HAVE_EPOLL_CREATE1)
+	DBGPRINTF("nsdpoll_gtls uses epoll_create1()\n");
+	pThis->efd = epoll_create1(EPOLL_CLOEXEC);
+	if(pThis->efd < 0 && errno == ENOSYS)
+#endif
+	{
+		DBGPRINTF("nsdpoll_gtls uses epoll_create()\n");
+		pThis->efd = epoll_create(100); /* size is ignored in newer kernels, but 100 is not bad... */
+	}
+
+	if(pThis->efd < 0) {
+		DBGPRINTF("epoll_create1() could not create fd\n");
+		ABORT_FINALIZE(RS_RET_IO_ERROR);
+	}
+	pthread_mutex_init(&pThis->mutEvtLst, NULL);
+finalize_it:
+ENDobjConstruct(nsdpoll_gtls)
+
+
+/* destructor for the nsdpoll_gtls object */
+BEGINobjDestruct(nsdpoll_gtls) /* be sure to specify the object type also in END and CODESTART macros! */
+	nsdpoll_gtlsevt_lst_t *node;
+	nsdpoll_gtlsevt_lst_t *nextnode;
+CODESTARTobjDestruct(nsdpoll_gtls)
+	/* we check if the epoll list still holds entries. This may happen, but
+	 * is a bit unusual.
+	 */
+	for(node = pThis->pRoot ; node != NULL ; node = nextnode) {
+		nextnode = node->pNext;
+		dbgprintf("nsdpoll_gtls destruct, need to destruct node %p\n", node);
+		delEvent(&node);
+	}
+	if(pThis->efd >= 0)
+		close(pThis->efd);
+	pthread_mutex_destroy(&pThis->mutEvtLst);
+ENDobjDestruct(nsdpoll_gtls)
+
+
+/* Modify socket set */
+static rsRetVal
+Ctl(nsdpoll_t *pNsdpoll, nsd_t *pNsd, int id, void *pUsr, int mode, int op) {
+	nsdpoll_gtls_t *pThis = (nsdpoll_gtls_t*) pNsdpoll;
+	nsd_gtls_t *pSock = (nsd_gtls_t*) pNsd;
+	nsdpoll_gtlsevt_lst_t *pEventLst;
+	int errSave;
+	char errStr[512];
+	DEFiRet;
+
+	ISOBJ_TYPE_assert(pSock, nsd_gtls);
+	if(op == NSDPOLL_ADD) {
+		dbgprintf("adding nsdpoll_gtls entry %d/%p, sock %d\n", id, pUsr, gtlsSockFd(pSock));
+		CHKiRet(addEvent(pThis, id, pUsr, mode, pSock, &pEventLst));
+		if(epoll_ctl(pThis->efd, EPOLL_CTL_ADD, gtlsSockFd(pSock), &pEventLst->event) < 0) {
+			errSave = errno;
+			rs_strerror_r(errSave, errStr, sizeof(errStr));
+			errmsg.LogError(errSave, RS_RET_ERR_EPOLL_CTL,
+				"epoll_ctl failed on fd %d, id %d/%p, op %d with %s\n",
+				gtlsSockFd(pSock), id, pUsr, mode, errStr);
+		}
+	} else if(op == NSDPOLL_DEL) {
+		dbgprintf("removing nsdpoll_gtls entry %d/%p, sock %d\n", id, pUsr, gtlsSockFd(pSock));
+		CHKiRet(unlinkEvent(pThis, id, pUsr, &pEventLst));
+		if(epoll_ctl(pThis->efd, EPOLL_CTL_DEL, gtlsSockFd(pSock), &pEventLst->event) < 0) {
+			errSave = errno;
+			rs_strerror_r(errSave, errStr, sizeof(errStr));
+			errmsg.LogError(errSave, RS_RET_ERR_EPOLL_CTL,
+				"epoll_ctl failed on fd %d, id %d/%p, op %d with %s\n",
+				gtlsSockFd(pSock), id, pUsr, mode, errStr);
+			delEvent(&pEventLst);
+			ABORT_FINALIZE(RS_RET_ERR_EPOLL_CTL);
+		}
+		CHKiRet(delEvent(&pEventLst));
+	} else {
+		dbgprintf("program error: invalid NSDPOLL_mode %d - ignoring request\n", op);
+		ABORT_FINALIZE(RS_RET_ERR);
+	}
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* process an event epoll reported for a session where a GnuTLS operation
+ * needs to be retried. The handshake is continued here, and the session is
+ * only reported to the upper layer once it fails or data is available.
+ * If GnuTLS now needs to wait for the other direction, the epoll set is
+ * updated accordingly. Returns 1 if the upper layer shall be notified.
+ */
+static int
+processRetry(nsdpoll_gtls_t *pThis, nsdpoll_gtlsevt_lst_t *pEvt)
+{
+	nsd_gtls_t *const pSock = pEvt->pSock;
+	gtlsRtryCall_t rtryCall = pSock->rtryCall;
+	uint32_t newMask;
+	int bIsReady;
+	rsRetVal localRet;
+	char errStr[512];
+
+	localRet = gtlsDoRetry(pSock);
+	if(rtryCall == gtlsRtry_handshake) {
+		/* a failed handshake is reported so that the session is closed */
+		bIsReady = (localRet != RS_RET_OK) || gtlsHasPendingData(pSock);
+	} else {
+		/* a successful recv retry means there is now data (or EOS) in the buffer */
+		bIsReady = (localRet != RS_RET_RETRY);
+	}
+
+	newMask = evtMask(pEvt);
+	if(!pSock->bAbortConn && newMask != pEvt->event.events) {
+		DBGPRINTF("nsdpoll_gtls: sock %d now waits for %s\n", gtlsSockFd(pSock),
+			(newMask & EPOLLOUT) ? "write" : "read");
+		pEvt->event.events = newMask;
+		if(epoll_ctl(pThis->efd, EPOLL_CTL_MOD, gtlsSockFd(pSock), &pEvt->event) < 0) {
+			rs_strerror_r(errno, errStr, sizeof(errStr));
+			errmsg.LogError(errno, RS_RET_ERR_EPOLL_CTL,
+				"epoll_ctl failed to modify fd %d, id %d/%p with %s\n",
+				gtlsSockFd(pSock), pEvt->id, pEvt->pUsr, errStr);
+		}
+	}
+	return bIsReady;
+}
+
+
+/* Wait for io to become ready. After the successful call, idRdy contains the
+ * id set by the caller for that i/o event, ppUsr is a pointer to a location
+ * where the user pointer shall be stored.
+ * numEntries contains the maximum number of entries on entry and the actual
+ * number of entries actually read on exit.
+ *
+ * Sessions with data buffered inside GnuTLS are returned first. In that case,
+ * we only poll epoll without waiting, as we already have something to do.
+ * Only sessions we returned on the previous call (or which were just added)
+ * can have buffered data, because the upper layer reads from reported
+ * sessions only. So we do not need to check all sessions on each call.
+ */
+static rsRetVal
+Wait(nsdpoll_t *pNsdpoll, int timeout, int *numEntries, nsd_epworkset_t workset[]) {
+	nsdpoll_gtls_t *pThis = (nsdpoll_gtls_t*) pNsdpoll;
+	nsdpoll_gtlsevt_lst_t *pOurEvt;
+	nsdpoll_gtlsevt_lst_t *pCand;
+	nsdpoll_gtlsevt_lst_t *pNextCand;
+	struct epoll_event event[128];
+	int maxEntries;
+	int nRdy = 0;
+	int nfds = 0;
+	int i;
+	DEFiRet;
+
+	assert(workset != NULL);
+
+	if(*numEntries > 128)
+		*numEntries = 128;
+	maxEntries = *numEntries;
+
+	/* check the candidates. Those that still have buffered data are kept on
+	 * the list, even if we have no more room to report them this time.
+	 */
+	pthread_mutex_lock(&pThis->mutEvtLst);
+	pCand = pThis->pRdyRoot;
+	pThis->pRdyRoot = NULL;
+	for( ; pCand != NULL ; pCand = pNextCand) {
+		pNextCand = pCand->pNextRdy;
+		pCand->bInRdyLst = 0;
+		if(!(pCand->mode & NSDPOLL_IN) || !gtlsHasPendingData(pCand->pSock))
+			continue;
+		if(nRdy < maxEntries) {
+			workset[nRdy].id = pCand->id;
+			workset[nRdy].pUsr = pCand->pUsr;
+			pCand->bReported = 1;
+			++nRdy;
+		}
+		addRdyCandidate(pThis, pCand);
+	}
+	pthread_mutex_unlock(&pThis->mutEvtLst);
+
+	if(nRdy > 0)
+		DBGPRINTF("nsdpoll_gtls: %d sessions have data buffered\n", nRdy);
+
+	if(nRdy < maxEntries) {
+		DBGPRINTF("doing epoll_wait for max %d events\n", maxEntries - nRdy);
+		nfds = epoll_wait(pThis->efd, event, maxEntries - nRdy, (nRdy > 0) ? 0 : timeout);
+		if(nfds == -1) {
+			if(nRdy > 0) {
+				nfds = 0; /* we still have something to return */
+			} else if(errno == EINTR) {
+				ABORT_FINALIZE(RS_RET_EINTR);
+			} else {
+				DBGPRINTF("epoll() returned with error code %d\n", errno);
+				ABORT_FINALIZE(RS_RET_ERR_EPOLL);
+			}
+		}
+	}
+
+	DBGPRINTF("epoll returned %d entries\n", nfds);
+	for(i = 0 ; i < nfds ; ++i) {
+		pOurEvt = (nsdpoll_gtlsevt_lst_t*) event[i].data.ptr;
+		if(pOurEvt->bReported)
+			continue; /* already returned because of buffered data */
+		if(   pOurEvt->pSock->iMode == 1
+		   && pOurEvt->pSock->rtryCall != gtlsRtry_None
+		   && !pOurEvt->pSock->bAbortConn
+		   && !processRetry(pThis, pOurEvt))
+			continue; /* we consumed the event for our own processing */
+		workset[nRdy].id = pOurEvt->id;
+		workset[nRdy].pUsr = pOurEvt->pUsr;
+		pOurEvt->bReported = 1;
+		++nRdy;
+		/* after the upper layer has read, GnuTLS may still have data */
+		pthread_mutex_lock(&pThis->mutEvtLst);
+		addRdyCandidate(pThis, pOurEvt);
+		pthread_mutex_unlock(&pThis->mutEvtLst);
+	}
+
+	if(nRdy == 0)
+		ABORT_FINALIZE(RS_RET_TIMEOUT);
+	*numEntries = nRdy;
+
+finalize_it:
+	/* all reported entries are on the candidate list, reset their flag */
+	pthread_mutex_lock(&pThis->mutEvtLst);
+	for(pCand = pThis->pRdyRoot ; pCand != NULL ; pCand = pCand->pNextRdy)
+		pCand->bReported = 0;
+	pthread_mutex_unlock(&pThis->mutEvtLst);
+	RETiRet;
+}
+
+
+/* ------------------------------ end support for the epoll() interface ------------------------------ */
+
+
+/* queryInterface function */
+BEGINobjQueryInterface(nsdpoll_gtls)
+CODESTARTobjQueryInterface(nsdpoll_gtls)
+	if(pIf->ifVersion != nsdCURR_IF_VERSION) {/* check for current version, increment on each change */
+		ABORT_FINALIZE(RS_RET_INTERFACE_NOT_SUPPORTED);
+	}
+
+	/* ok, we have the right interface, so let's fill it
+	 * Please note that we may also do some backwards-compatibility
+	 * work here (if we can support an older interface version - that,
+	 * of course, also affects the "if" above).
+	 */
+	pIf->Construct = (rsRetVal(*)(nsdpoll_t**)) nsdpoll_gtlsConstruct;
+	pIf->Destruct = (rsRetVal(*)(nsdpoll_t**)) nsdpoll_gtlsDestruct;
+	pIf->Ctl = Ctl;
+	pIf->Wait = Wait;
+finalize_it:
+ENDobjQueryInterface(nsdpoll_gtls)
+
+
+/* exit our class
+ */
+BEGINObjClassExit(nsdpoll_gtls, OBJ_IS_CORE_MODULE) /* CHANGE class also in END MACRO! */
+CODESTARTObjClassExit(nsdpoll_gtls)
+	/* release objects we no longer need */
+	objRelease(glbl, CORE_COMPONENT);
+	objRelease(errmsg, CORE_COMPONENT);
+ENDObjClassExit(nsdpoll_gtls)
+
+
+/* Initialize the nsdpoll_gtls class. Must be called as the very first method
+ * before anything else is called inside this class.
+ */
+BEGINObjClassInit(nsdpoll_gtls, 1, OBJ_IS_CORE_MODULE) /* class, version */
+	/* request objects we use */
+	CHKiRet(objUse(errmsg, CORE_COMPONENT));
+	CHKiRet(objUse(glbl, CORE_COMPONENT));
+
+	/* set our own handlers */
+ENDObjClassInit(nsdpoll_gtls)
+#endif /* #ifdef HAVE_EPOLL_CREATE this module requires epoll! */
+
+/* vi:set ai:
+ */
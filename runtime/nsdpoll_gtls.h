@@ -0,0 +1,66 @@
+/* An implementation of the nsd poll interface for GnuTLS.
+ *
+ * Copyright 2026 Adiscon GmbH.
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INCLUDED_NSDPOLL_GTLS_H
+#define INCLUDED_NSDPOLL_GTLS_H
+
+#include "nsd.h"
+#ifdef HAVE_SYS_EPOLL_H
+#	include <sys/epoll.h>
+#endif
+typedef nsdpoll_if_t nsdpoll_gtls_if_t; /* we just *implement* this interface */
+
+/* a helper object to keep track of the epoll event records. In addition to
+ * what the ptcp driver needs, we must keep track of sessions where GnuTLS
+ * already has data buffered. For those, the socket does not necessarily
+ * become readable again, so epoll alone would not wake us up.
+ */
+typedef struct nsdpoll_gtlsevt_lst_s nsdpoll_gtlsevt_lst_t;
+struct nsdpoll_gtlsevt_lst_s {
+#ifdef HAVE_SYS_EPOLL_H
+	epoll_event_t event;
+#endif
+	int id;
+	void *pUsr;
+	int mode;		/* NSDPOLL_IN/NSDPOLL_OUT as requested by the upper layer */
+	nsd_gtls_t *pSock;	/* our associated netstream driver data */
+	sbool bInRdyLst;	/* entry is member of the ready candidate list */
+	sbool bReported;	/* entry already returned in the current Wait() call */
+	nsdpoll_gtlsevt_lst_t *pNext;
+	nsdpoll_gtlsevt_lst_t *pNextRdy; /* next entry in ready candidate list */
+};
+
+/* the nsdpoll_gtls object */
+struct nsdpoll_gtls_s {
+	BEGINobjInstance;	/* Data to implement generic object - MUST be the first data element! */
+	int efd;		/* file descriptor used by epoll */
+	nsdpoll_gtlsevt_lst_t *pRoot;	/* Root of the epoll event list */
+	nsdpoll_gtlsevt_lst_t *pRdyRoot; /* entries that may have data buffered inside GnuTLS */
+	pthread_mutex_t mutEvtLst;
+};
+
+/* interface is defined in nsd.h, we just implement it! */
+#define nsdpoll_gtlsCURR_IF_VERSION nsdCURR_IF_VERSION
+
+/* prototypes */
+PROTOTYPEObj(nsdpoll_gtls);
+
+#endif /* #ifndef INCLUDED_NSDPOLL_GTLS_H */
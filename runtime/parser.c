@@ -622,6 +622,7 @@ ParseMsg(msg_t *pMsg)
 	if(pMsg->iLenRawMsg == 0)
 		ABORT_FINALIZE(RS_RET_EMPTY_MSG);
 
+	TRACE_EVT(pMsg, TRACE_PARSE_BEGIN, NULL);
 	CHKiRet(uncompressMessage(pMsg));
 
 	/* we take the risk to print a non-sanitized string, because this is the best we can get
@@ -684,6 +685,7 @@ ParseMsg(msg_t *pMsg)
 	pMsg->msgFlags &= ~NEEDS_PARSING; /* this message is now parsed */
 
 finalize_it:
+	TRACE_EVT(pMsg, TRACE_PARSE_END, NULL);
 	RETiRet;
 }
 /* queryInterface function-- rgerhards, 2009-11-03
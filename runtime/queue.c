@@ -45,6 +45,7 @@
 #include <sys/stat.h>	 /* required for HP UX */
 #include <time.h>
 #include <errno.h>
+#include <stddef.h>
 
 #include "rsyslog.h"
 #include "queue.h"
@@ -60,6 +61,8 @@
 #include "unicode-helper.h"
 #include "statsobj.h"
 #include "parserif.h"
+#include "ruleset.h"
+#include "hashtable.h"
 
 #ifdef OS_SOLARIS
 #	include <sched.h>
@@ -104,6 +107,9 @@ static struct cnfparamdescr cnfpdescr[] = {
 	{ "queue.spooldirectory", eCmdHdlrGetWord, 0 },
 	{ "queue.size", eCmdHdlrSize, 0 },
 	{ "queue.dequeuebatchsize", eCmdHdlrInt, 0 },
+	{ "queue.dequeuebatchsize.adaptive", eCmdHdlrBinary, 0 },
+	{ "queue.dequeuebatchsize.min", eCmdHdlrPositiveInt, 0 },
+	{ "queue.dequeuebatchsize.targetlatency", eCmdHdlrInt, 0 },
 	{ "queue.maxdiskspace", eCmdHdlrSize, 0 },
 	{ "queue.highwatermark", eCmdHdlrInt, 0 },
 	{ "queue.lowwatermark", eCmdHdlrInt, 0 },
@@ -125,7 +131,17 @@ static struct cnfparamdescr cnfpdescr[] = {
 	{ "queue.dequeueslowdown", eCmdHdlrInt, 0 },
 	{ "queue.dequeuetimebegin", eCmdHdlrInt, 0 },
 	{ "queue.dequeuetimeend", eCmdHdlrInt, 0 },
-	{ "queue.cry.provider", eCmdHdlrGetWord, 0 }
+	{ "queue.cry.provider", eCmdHdlrGetWord, 0 },
+	{ "queue.fairness.key", eCmdHdlrGetWord, 0 },
+	{ "queue.fairness.weights", eCmdHdlrArray, 0 },
+	{ "queue.fairness.quantum", eCmdHdlrPositiveInt, 0 },
+	{ "queue.fairness.keydiscardmark", eCmdHdlrInt, 0 },
+	{ "queue.fairness.maxkeys", eCmdHdlrPositiveInt, 0 },
+	{ "queue.priority.lanes", eCmdHdlrPositiveInt, 0 }, /* must be before other lane params */
+	{ "queue.priority.key", eCmdHdlrGetWord, 0 },
+	{ "queue.priority.weights", eCmdHdlrArray, 0 },
+	{ "queue.priority.lanesizes", eCmdHdlrArray, 0 },
+	{ "queue.priority.lanediscardmarks", eCmdHdlrArray, 0 }
 };
 static struct cnfparamblk pblk =
 	{ CNFPARAMBLK_VERSION,
@@ -267,6 +283,10 @@ qqueueDbgPrint(qqueue_t *pThis)
 		(pThis->pszFilePrefix == NULL) ? "[NONE]" : (char*)pThis->pszFilePrefix);
 	dbgoprint((obj_t*) pThis, "queue.size: %d\n", pThis->iMaxQueueSize);
 	dbgoprint((obj_t*) pThis, "queue.dequeuebatchsize: %d\n", pThis->iDeqBatchSize);
+	dbgoprint((obj_t*) pThis, "queue.dequeuebatchsize.adaptive: %d\n", pThis->bDeqBatchAdaptive);
+	dbgoprint((obj_t*) pThis, "queue.dequeuebatchsize.min: %d\n", pThis->iMinDeqBatchSize);
+	dbgoprint((obj_t*) pThis, "queue.dequeuebatchsize.targetlatency: %d\n",
+		pThis->iDeqBatchTargetLatency);
 	dbgoprint((obj_t*) pThis, "queue.maxdiskspace: %lld\n", pThis->sizeOnDiskMax);
 	dbgoprint((obj_t*) pThis, "queue.highwatermark: %d\n", pThis->iHighWtrMrk);
 	dbgoprint((obj_t*) pThis, "queue.lowwatermark: %d\n", pThis->iLowWtrMrk);
@@ -288,6 +308,15 @@ qqueueDbgPrint(qqueue_t *pThis)
 	dbgoprint((obj_t*) pThis, "queue.dequeueslowdown: %d\n", pThis->iDeqSlowdown);
 	dbgoprint((obj_t*) pThis, "queue.dequeuetimebegin: %d\n", pThis->iDeqtWinFromHr);
 	dbgoprint((obj_t*) pThis, "queue.dequeuetimeend: %d\n", pThis->iDeqtWinToHr);
+	dbgoprint((obj_t*) pThis, "queue.fairness.key: '%s'\n",
+		(pThis->pszFairKey == NULL) ? "[NONE]" : (char*)pThis->pszFairKey);
+	dbgoprint((obj_t*) pThis, "queue.fairness.quantum: %d\n", pThis->iFairQuantum);
+	dbgoprint((obj_t*) pThis, "queue.fairness.keydiscardmark: %d\n", pThis->iFairKeyDiscardMrk);
+	dbgoprint((obj_t*) pThis, "queue.fairness.maxkeys: %d\n", pThis->iFairMaxKeys);
+	dbgoprint((obj_t*) pThis, "queue.priority.lanes: %d\n", pThis->iPrioLanes);
+	dbgoprint((obj_t*) pThis, "queue.priority.key: '%s'\n",
+		(pThis->pszPrioKey == NULL) ? "[severity]" : (char*)pThis->pszPrioKey);
+	dbgoprint((obj_t*) pThis, "queue.priority.weighted: %d\n", pThis->bPrioWeighted);
 }
 
 
@@ -438,6 +467,13 @@ StartDA(qqueue_t *pThis)
 	CHKiRet(qqueueSettoQShutdown(pThis->pqDA, pThis->toQShutdown));
 	CHKiRet(qqueueSetiHighWtrMrk(pThis->pqDA, 0));
 	CHKiRet(qqueueSetiDiscardMrk(pThis->pqDA, 0));
+	if(pThis->bDeqBatchAdaptive) {
+		/* the disk queue runs the action in DA mode, so it must adapt, too */
+		pThis->pqDA->bDeqBatchAdaptive = 1;
+		pThis->pqDA->iDeqBatchSize = pThis->iDeqBatchSize;
+		pThis->pqDA->iMinDeqBatchSize = pThis->iMinDeqBatchSize;
+		pThis->pqDA->iDeqBatchTargetLatency = pThis->iDeqBatchTargetLatency;
+	}
 
 	iRet = qqueueStart(pThis->pqDA);
 	/* file not found is expected, that means it is no previous QIF available */
@@ -691,6 +727,483 @@ static rsRetVal qDelLinkedList(qqueue_t *pThis)
 }
 
 
+/* -------------------- sub-queue helpers -------------------- */
+
+/* Fair and priority mode split an in-memory queue into multiple FIFO
+ * sub-queues and dequeue from them in some order other than arrival.
+ * Once an entry is dequeued, it is moved to a single list in dequeue
+ * order. As the queue core deletes entries in exactly the order they
+ * were dequeued (see DoDeleteBatchFromQStore()), qDel simply works off
+ * that list. This keeps batch dequeue and DA mode unchanged.
+ */
+
+/* append a new entry for pMsg to a sub-queue */
+static rsRetVal
+qSubqAppend(qLinkedList_t **ppRoot, qLinkedList_t **ppLast, msg_t *pMsg)
+{
+	qLinkedList_t *pEntry;
+	DEFiRet;
+
+	CHKmalloc((pEntry = (qLinkedList_t*) MALLOC(sizeof(qLinkedList_t))));
+	pEntry->pNext = NULL;
+	pEntry->pMsg = pMsg;
+
+	if(*ppRoot == NULL) {
+		*ppRoot = pEntry;
+	} else {
+		(*ppLast)->pNext = pEntry;
+	}
+	*ppLast = pEntry;
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* move a just dequeued entry to the delete list */
+static inline void
+qSubqMoveToDel(qqueue_t *pThis, qLinkedList_t *pEntry)
+{
+	pEntry->pNext = NULL;
+	if(pThis->tVars.subq.pDelRoot == NULL) {
+		pThis->tVars.subq.pDelRoot = pEntry;
+	} else {
+		pThis->tVars.subq.pDelLast->pNext = pEntry;
+	}
+	pThis->tVars.subq.pDelLast = pEntry;
+}
+
+
+/* free all entries of a list; if bFreeMsg is set, the messages are
+ * destructed as well.
+ */
+static void
+qSubqFreeList(qLinkedList_t *pEntry, int bFreeMsg)
+{
+	qLinkedList_t *pDel;
+
+	while(pEntry != NULL) {
+		pDel = pEntry;
+		pEntry = pEntry->pNext;
+		if(bFreeMsg)
+			msgDestruct(&pDel->pMsg);
+		free(pDel);
+	}
+}
+
+
+static rsRetVal qDelSubq(qqueue_t *pThis)
+{
+	qLinkedList_t *pEntry;
+	DEFiRet;
+
+	pEntry = pThis->tVars.subq.pDelRoot;
+	pThis->tVars.subq.pDelRoot = pEntry->pNext;
+	if(pThis->tVars.subq.pDelRoot == NULL)
+		pThis->tVars.subq.pDelLast = NULL;
+
+	free(pEntry);
+
+	RETiRet;
+}
+
+
+/* -------------------- fair (weighted, per-key) memory queue -------------------- */
+
+/* In fair mode, an in-memory queue keeps one FIFO sub-queue per key (for
+ * example the input name or the sending host) and dequeues from them via
+ * deficit round robin (DRR). Each key may be dequeued quantum * weight
+ * messages per round, so a single noisy sender can no longer starve
+ * everyone else. Keys are never removed during the lifetime of the queue,
+ * so their number is limited by queue.fairness.maxKeys.
+ */
+
+/* obtain the fairness key for a message. The returned string must be freed
+ * by the caller if *pbMustBeFreed is set.
+ */
+static uchar *
+qFairGetKeyStr(qqueue_t *pThis, msg_t *pMsg, unsigned short *pbMustBeFreed)
+{
+	rs_size_t lenKey;
+	uchar *pszKey;
+
+	if(pThis->bFairKeyRuleset) {
+		*pbMustBeFreed = 0;
+		pszKey = (pMsg->pRuleset == NULL) ? UCHAR_CONSTANT("") : rulesetGetName(pMsg->pRuleset);
+	} else {
+		pszKey = MsgGetProp(pMsg, NULL, &pThis->fairKeyProp, &lenKey, pbMustBeFreed, NULL);
+	}
+	return pszKey;
+}
+
+
+/* find the weight configured for a key; defaults to 1 */
+static int
+qFairGetWeight(qqueue_t *pThis, uchar *pszKey)
+{
+	int i;
+
+	for(i = 0 ; i < pThis->nFairWeights ; ++i) {
+		if(!ustrcmp(pThis->fairWeights[i].pszKey, pszKey))
+			return pThis->fairWeights[i].iWeight;
+	}
+	return 1;
+}
+
+
+/* add a new key to the hash table. pszKey is handed over to the hash table
+ * and freed on failure.
+ */
+static rsRetVal
+qFairAddKey(qqueue_t *pThis, uchar *pszKey, qFairKey_t **ppKey)
+{
+	qFairKey_t *pKey = NULL;
+	DEFiRet;
+
+	CHKmalloc(pKey = (qFairKey_t*) calloc(1, sizeof(qFairKey_t)));
+	pKey->pszKey = pszKey;
+	pKey->iWeight = qFairGetWeight(pThis, pszKey);
+	if(!hashtable_insert(pThis->tVars.fair.ht, pszKey, pKey)) {
+		ABORT_FINALIZE(RS_RET_OUT_OF_MEMORY);
+	}
+	++pThis->tVars.fair.nKeys;
+	*ppKey = pKey;
+
+finalize_it:
+	if(iRet != RS_RET_OK) {
+		free(pszKey);
+		free(pKey);
+	}
+	RETiRet;
+}
+
+
+/* find the sub-queue for a message, creating it if needed */
+static rsRetVal
+qFairFindKey(qqueue_t *pThis, msg_t *pMsg, qFairKey_t **ppKey)
+{
+	uchar *pszKey;
+	uchar *pszKeyDup = NULL;
+	unsigned short bMustBeFreed;
+	qFairKey_t *pKey;
+	DEFiRet;
+
+	pszKey = qFairGetKeyStr(pThis, pMsg, &bMustBeFreed);
+	pKey = (qFairKey_t*) hashtable_search(pThis->tVars.fair.ht, pszKey);
+	if(pKey == NULL) {
+		if(pThis->tVars.fair.nKeys < pThis->iFairMaxKeys) {
+			if(bMustBeFreed) {
+				pszKeyDup = pszKey;
+				bMustBeFreed = 0;
+			} else {
+				CHKmalloc(pszKeyDup = ustrdup(pszKey));
+			}
+			CHKiRet(qFairAddKey(pThis, pszKeyDup, &pKey));
+		} else {
+			if(pThis->tVars.fair.pOverflow == NULL) {
+				DBGOPRINT((obj_t*) pThis, "fair queue: max number of keys (%d) reached, further "
+					"keys share a single sub-queue\n", pThis->iFairMaxKeys);
+				CHKmalloc(pThis->tVars.fair.pOverflow = (qFairKey_t*) calloc(1, sizeof(qFairKey_t)));
+				pThis->tVars.fair.pOverflow->iWeight = 1;
+			}
+			pKey = pThis->tVars.fair.pOverflow;
+		}
+	}
+	*ppKey = pKey;
+
+finalize_it:
+	if(bMustBeFreed)
+		free(pszKey);
+	RETiRet;
+}
+
+
+static rsRetVal qConstructFair(qqueue_t *pThis)
+{
+	qFairKey_t *pKey;
+	uchar *pszKey;
+	int i;
+	DEFiRet;
+
+	ASSERT(pThis != NULL);
+
+	CHKmalloc(pThis->tVars.fair.ht = create_hashtable(100, hash_from_string, key_equals_string, NULL));
+	pThis->tVars.fair.pOverflow = NULL;
+	pThis->tVars.fair.nKeys = 0;
+	pThis->tVars.fair.pActRoot = pThis->tVars.fair.pActLast = NULL;
+	pThis->tVars.subq.pDelRoot = pThis->tVars.subq.pDelLast = NULL;
+
+	/* keys with configured weights are created right away */
+	for(i = 0 ; i < pThis->nFairWeights ; ++i) {
+		if(hashtable_search(pThis->tVars.fair.ht, pThis->fairWeights[i].pszKey) != NULL)
+			continue;
+		CHKmalloc(pszKey = ustrdup(pThis->fairWeights[i].pszKey));
+		CHKiRet(qFairAddKey(pThis, pszKey, &pKey));
+	}
+
+	qqueueChkIsDA(pThis);
+
+finalize_it:
+	RETiRet;
+}
+
+
+static rsRetVal qDestructFair(qqueue_t *pThis)
+{
+	qFairKey_t *pKey;
+	DEFiRet;
+
+	queueDrain(pThis); /* discard any remaining queue entries */
+
+	/* entries on the delete list are owned by their batch, all others by us */
+	qSubqFreeList(pThis->tVars.subq.pDelRoot, 0);
+	for(pKey = pThis->tVars.fair.pActRoot ; pKey != NULL ; pKey = pKey->pNextAct) {
+		qSubqFreeList(pKey->pRoot, 1);
+	}
+	if(pThis->tVars.fair.ht != NULL)
+		hashtable_destroy(pThis->tVars.fair.ht, 1);
+	free(pThis->tVars.fair.pOverflow);
+
+	RETiRet;
+}
+
+
+static rsRetVal qAddFair(qqueue_t *pThis, msg_t* pMsg)
+{
+	qFairKey_t *pKey;
+	DEFiRet;
+
+	CHKiRet(qFairFindKey(pThis, pMsg, &pKey));
+
+	if(pThis->iFairKeyDiscardMrk > 0 && pKey->nEntries >= pThis->iFairKeyDiscardMrk) {
+		DBGOPRINT((obj_t*) pThis, "fair queue: key '%s' has reached its discard mark (%d entries), "
+			  "message discarded\n", pKey->pszKey == NULL ? "[overflow]" : (char*) pKey->pszKey,
+			  pKey->nEntries);
+		STATSCOUNTER_INC(pThis->ctrFairDscrd, pThis->mutCtrFairDscrd);
+		msgDestruct(&pMsg);
+		ABORT_FINALIZE(RS_RET_QUEUE_FULL);
+	}
+
+	CHKiRet(qSubqAppend(&pKey->pRoot, &pKey->pLast, pMsg));
+	++pKey->nEntries;
+
+	if(!pKey->bActive) {
+		/* newly active keys queue up at the end of the current round */
+		pKey->bActive = 1;
+		pKey->iDeficit = pThis->iFairQuantum * pKey->iWeight;
+		pKey->pNextAct = NULL;
+		if(pThis->tVars.fair.pActRoot == NULL) {
+			pThis->tVars.fair.pActRoot = pKey;
+		} else {
+			pThis->tVars.fair.pActLast->pNextAct = pKey;
+		}
+		pThis->tVars.fair.pActLast = pKey;
+	}
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* dequeue via deficit round robin. Each message costs one unit of deficit.
+ * A key whose deficit is used up goes to the end of the active list and
+ * receives a new quantum for its next turn. Must only be called if the
+ * logical queue size is > 0, so there is always an active key.
+ */
+static rsRetVal qDeqFair(qqueue_t *pThis, msg_t **ppMsg)
+{
+	qFairKey_t *pKey;
+	qLinkedList_t *pEntry;
+	DEFiRet;
+
+	pKey = pThis->tVars.fair.pActRoot;
+	while(pKey->iDeficit <= 0) {
+		pKey->iDeficit += pThis->iFairQuantum * pKey->iWeight;
+		if(pKey->pNextAct != NULL) {
+			pThis->tVars.fair.pActRoot = pKey->pNextAct;
+			pKey->pNextAct = NULL;
+			pThis->tVars.fair.pActLast->pNextAct = pKey;
+			pThis->tVars.fair.pActLast = pKey;
+			pKey = pThis->tVars.fair.pActRoot;
+		}
+	}
+
+	pEntry = pKey->pRoot;
+	pKey->pRoot = pEntry->pNext;
+	--pKey->iDeficit;
+	if(--pKey->nEntries == 0) {
+		/* an idle key does not keep its deficit (standard DRR) */
+		pKey->pLast = NULL;
+		pKey->bActive = 0;
+		pKey->iDeficit = 0;
+		pThis->tVars.fair.pActRoot = pKey->pNextAct;
+		if(pThis->tVars.fair.pActRoot == NULL)
+			pThis->tVars.fair.pActLast = NULL;
+		pKey->pNextAct = NULL;
+	}
+
+	qSubqMoveToDel(pThis, pEntry);
+	*ppMsg = pEntry->pMsg;
+
+	RETiRet;
+}
+
+
+/* -------------------- priority lanes memory queue -------------------- */
+
+/* In priority mode, an in-memory queue keeps a small number of lanes,
+ * lane 0 having the highest priority. By default, the lane is selected
+ * by severity, so that emergency messages do not need to wait behind a
+ * backlog of debug messages. Alternatively, the lane number can be taken
+ * from a message property (e.g. "$!lane"). Dequeue is either strict
+ * priority or weighted round robin between lanes.
+ */
+
+/* select the lane for a message. Without a key property, severities are
+ * spread evenly over the lanes (e.g. 0-2, 3-5, 6-7 for three lanes). A key
+ * property must contain the lane number; invalid values select the lowest
+ * priority lane.
+ */
+static int
+qPrioGetLane(qqueue_t *pThis, msg_t *pMsg)
+{
+	uchar *pszVal;
+	rs_size_t lenVal;
+	unsigned short bMustBeFreed;
+	int iSeverity;
+	int iLane;
+
+	if(pThis->pszPrioKey == NULL) {
+		if(MsgGetSeverity(pMsg, &iSeverity) != RS_RET_OK)
+			return pThis->iPrioLanes - 1;
+		iLane = iSeverity * pThis->iPrioLanes / 8;
+	} else {
+		pszVal = MsgGetProp(pMsg, NULL, &pThis->prioKeyProp, &lenVal, &bMustBeFreed, NULL);
+		iLane = (pszVal[0] >= '0' && pszVal[0] <= '9') ? atoi((char*) pszVal) : pThis->iPrioLanes - 1;
+		if(bMustBeFreed)
+			free(pszVal);
+	}
+	if(iLane < 0 || iLane >= pThis->iPrioLanes)
+		iLane = pThis->iPrioLanes - 1;
+	return iLane;
+}
+
+
+static rsRetVal qConstructPrio(qqueue_t *pThis)
+{
+	DEFiRet;
+
+	ASSERT(pThis != NULL);
+
+	pThis->tVars.prio.iCurrLane = 0;
+	pThis->tVars.subq.pDelRoot = pThis->tVars.subq.pDelLast = NULL;
+
+	qqueueChkIsDA(pThis);
+
+	RETiRet;
+}
+
+
+static rsRetVal qDestructPrio(qqueue_t *pThis)
+{
+	int i;
+	DEFiRet;
+
+	queueDrain(pThis); /* discard any remaining queue entries */
+
+	/* entries on the delete list are owned by their batch, all others by us */
+	qSubqFreeList(pThis->tVars.subq.pDelRoot, 0);
+	for(i = 0 ; i < pThis->iPrioLanes ; ++i) {
+		qSubqFreeList(pThis->prioLanes[i].pRoot, 1);
+		pThis->prioLanes[i].pRoot = NULL;
+	}
+
+	RETiRet;
+}
+
+
+static rsRetVal qAddPrio(qqueue_t *pThis, msg_t* pMsg)
+{
+	qPrioLane_t *pLane;
+	int iLane;
+	int iSeverity;
+	DEFiRet;
+
+	iLane = qPrioGetLane(pThis, pMsg);
+	pLane = &pThis->prioLanes[iLane];
+
+	STATSCOUNTER_INC(pLane->ctrEnqueued, pLane->mutCtrEnqueued);
+	if(pLane->iMaxEntries > 0 && pLane->nEntries >= pLane->iMaxEntries) {
+		DBGOPRINT((obj_t*) pThis, "priority lane %d full (%d entries), message discarded\n",
+			  iLane, pLane->nEntries);
+		STATSCOUNTER_INC(pLane->ctrDscrd, pLane->mutCtrDscrd);
+		msgDestruct(&pMsg);
+		ABORT_FINALIZE(RS_RET_QUEUE_FULL);
+	}
+	if(pLane->iDiscardMrk > 0 && pLane->nEntries >= pLane->iDiscardMrk
+	   && MsgGetSeverity(pMsg, &iSeverity) == RS_RET_OK
+	   && iSeverity >= pThis->iDiscardSeverity) {
+		DBGOPRINT((obj_t*) pThis, "priority lane %d nearly full (%d entries), discarded "
+			  "severity %d message\n", iLane, pLane->nEntries, iSeverity);
+		STATSCOUNTER_INC(pLane->ctrDscrd, pLane->mutCtrDscrd);
+		msgDestruct(&pMsg);
+		ABORT_FINALIZE(RS_RET_QUEUE_FULL);
+	}
+
+	CHKiRet(qSubqAppend(&pLane->pRoot, &pLane->pLast, pMsg));
+	++pLane->nEntries;
+	STATSCOUNTER_SETMAX_NOMUT(pLane->ctrMaxqsize, pLane->nEntries);
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* dequeue the next entry. With strict priority, this is the first entry
+ * of the highest priority non-empty lane. With weighted dequeue, lanes
+ * are served round robin, each for up to its weight in messages per
+ * round (deficit round robin with a cost of one per message). Must only
+ * be called if the logical queue size is > 0.
+ */
+static rsRetVal qDeqPrio(qqueue_t *pThis, msg_t **ppMsg)
+{
+	qPrioLane_t *pLane;
+	qLinkedList_t *pEntry;
+	int i;
+	DEFiRet;
+
+	if(pThis->bPrioWeighted) {
+		i = pThis->tVars.prio.iCurrLane;
+		pLane = &pThis->prioLanes[i];
+		while(pLane->nEntries == 0 || pLane->iDeficit <= 0) {
+			/* lane's turn is over, idle lanes do not keep unused credit */
+			if(pLane->nEntries == 0)
+				pLane->iDeficit = 0;
+			i = (i + 1) % pThis->iPrioLanes;
+			pLane = &pThis->prioLanes[i];
+			if(pLane->nEntries > 0)
+				pLane->iDeficit += pLane->iWeight;
+		}
+		pThis->tVars.prio.iCurrLane = i;
+		--pLane->iDeficit;
+	} else {
+		for(i = 0 ; pThis->prioLanes[i].nEntries == 0 ; ++i)
+			/* just search */;
+		pLane = &pThis->prioLanes[i];
+	}
+
+	pEntry = pLane->pRoot;
+	pLane->pRoot = pEntry->pNext;
+	if(--pLane->nEntries == 0)
+		pLane->pLast = NULL;
+
+	qSubqMoveToDel(pThis, pEntry);
+	*ppMsg = pEntry->pMsg;
+
+	RETiRet;
+}
+
+
 /* -------------------- disk  -------------------- */
 
 
@@ -1376,6 +1889,9 @@ rsRetVal qqueueConstruct(qqueue_t **ppThis, queueType_t qType, int iWorkerThread
 	pThis->iNumWorkerThreads = iWorkerThreads;
 	pThis->iDeqtWinToHr = 25; /* disable time-windowed dequeuing by default */
 	pThis->iDeqBatchSize = 8; /* conservative default, should still provide good performance */
+	pThis->iMinDeqBatchSize = 8;
+	pThis->iFairQuantum = 64;
+	pThis->iFairMaxKeys = 1000;
 
 	pThis->pszFilePrefix = NULL;
 	pThis->qType = qType;
@@ -1383,6 +1899,7 @@ rsRetVal qqueueConstruct(qqueue_t **ppThis, queueType_t qType, int iWorkerThread
 
 	INIT_ATOMIC_HELPER_MUT(pThis->mutQueueSize);
 	INIT_ATOMIC_HELPER_MUT(pThis->mutLogDeq);
+	histogramInit(&pThis->histWait);
 
 finalize_it:
 	OBJCONSTRUCT_CHECK_SUCCESS_AND_CLEANUP
@@ -1649,6 +2166,7 @@ DequeueConsumableElements(qqueue_t *pThis, wti_t *pWti, int *piRemainingQueueSiz
 	int nDeleted;
 	int iQueueSize;
 	msg_t *pMsg;
+	long long ttNow;
 	rsRetVal localRet;
 	DEFiRet;
 
@@ -1656,11 +2174,12 @@ DequeueConsumableElements(qqueue_t *pThis, wti_t *pWti, int *piRemainingQueueSiz
 	DeleteProcessedBatch(pThis, &pWti->batch);
 
 	nDequeued = nDiscarded = 0;
+	ttNow = currentMonotonicUsecs(); /* one timestamp per batch is precise enough */
 	if(pThis->qType == QUEUETYPE_DISK) {
 		pThis->tVars.disk.deqFileNumIn = strmGetCurrFileNum(pThis->tVars.disk.pReadDeq);
 	}
 
-	while((iQueueSize = getLogicalQueueSize(pThis)) > 0 && nDequeued < pThis->iDeqBatchSize) {
+	while((iQueueSize = getLogicalQueueSize(pThis)) > 0 && nDequeued < pThis->iCurrDeqBatchSize) {
 		int rd_fd = -1;
 		int64_t rd_offs = 0;
 		int wr_fd = -1;
@@ -1705,6 +2224,9 @@ DequeueConsumableElements(qqueue_t *pThis, wti_t *pWti, int *piRemainingQueueSiz
 		}
 
 		/* all well, use this element */
+		if(pMsg->ttEnqueued != 0)
+			histogramRecord(&pThis->histWait, ttNow - pMsg->ttEnqueued);
+		TRACE_EVT(pMsg, TRACE_DEQ, obj.GetName((obj_t*) pThis));
 		pWti->batch.pElem[nDequeued].pMsg = pMsg;
 		pWti->batch.eltState[nDequeued] = BATCH_STATE_RDY;
 		++nDequeued;
@@ -1933,6 +2455,60 @@ batchProcessed(qqueue_t *pThis, wti_t *pWti)
 }
 
 
+
+/* adapt the dequeue batch size to what we observed for the batch just
+ * processed. The batch is grown as long as there is more work waiting in
+ * the queue than fits into a single batch and the latency target (if any)
+ * is comfortably met - in that case, per-batch overhead (commit, locking)
+ * limits throughput. It is shrunk if the latency target was missed or
+ * the consumer reported trouble (action retry/suspension), as large
+ * batches are expensive to redo in that case. Both are multiplicative,
+ * but growth is by a quarter and shrinking by half, so that we back off
+ * faster than we grow.
+ * In DA mode, the disk queue runs the action and adapts on its own. The
+ * DA worker only moves messages to disk; it does not adapt, but uses the
+ * current size.
+ * Must be called with the queue mutex locked.
+ */
+static void
+AdaptDeqBatchSize(qqueue_t *pThis, const int nProcessed, const long long ttProc)
+{
+	const long long ttTarget = (long long) pThis->iDeqBatchTargetLatency * 1000;
+	int iNewSize = pThis->iCurrDeqBatchSize;
+
+	if(pThis->bDeqBatchBackoff || (ttTarget > 0 && ttProc > ttTarget)) {
+		iNewSize /= 2;
+		pThis->bDeqBatchBackoff = 0;
+	} else if(nProcessed >= pThis->iCurrDeqBatchSize
+		  && getLogicalQueueSize(pThis) >= pThis->iCurrDeqBatchSize
+		  && (ttTarget == 0 || ttProc < ttTarget / 2)) {
+		iNewSize += iNewSize / 4 + 1;
+	}
+
+	if(iNewSize < pThis->iMinDeqBatchSize)
+		iNewSize = pThis->iMinDeqBatchSize;
+	if(iNewSize > pThis->iDeqBatchSize)
+		iNewSize = pThis->iDeqBatchSize;
+	if(iNewSize != pThis->iCurrDeqBatchSize) {
+		DBGOPRINT((obj_t*) pThis, "adaptive dequeue batch size %d -> %d (last batch %d "
+			"msgs in %lld usecs)\n", pThis->iCurrDeqBatchSize, iNewSize, nProcessed, ttProc);
+		pThis->iCurrDeqBatchSize = iNewSize;
+	}
+}
+
+
+/* tell the queue that its consumer ran into trouble. With adaptive batch
+ * sizing, this shrinks the next batch. May be called without the queue
+ * mutex, a lost update just delays the backoff by one batch.
+ */
+void
+qqueueDeqBatchBackoff(qqueue_t *pThis)
+{
+	if(pThis->bDeqBatchAdaptive)
+		pThis->bDeqBatchBackoff = 1;
+}
+
+
 /* This is the queue consumer in the regular (non-DA) case. It is 
  * protected by the queue mutex, but MUST release it as soon as possible.
  * rgerhards, 2008-01-21
@@ -1944,6 +2520,9 @@ ConsumerReg(qqueue_t *pThis, wti_t *pWti)
 	int bNeedReLock = 0;	/**< do we need to lock the mutex again? */
 	int skippedMsgs = 0;	/**< did the queue loose any messages (can happen with 
 	                         ** disk queue if .qi file is corrupt */
+	int nProcessed = 0;	/**< batch size, for adaptive batch sizing */
+	long long ttStart = 0;
+	long long ttProc = 0;
 	DEFiRet;
 
 	ISOBJ_TYPE_assert(pThis, qqueue);
@@ -1979,7 +2558,13 @@ ConsumerReg(qqueue_t *pThis, wti_t *pWti)
 
 
 	pWti->pbShutdownImmediate = &pThis->bShutdownImmediate;
+	if(pThis->bDeqBatchAdaptive)
+		ttStart = currentMonotonicUsecs();
 	CHKiRet(pThis->pConsumer(pThis->pAction, &pWti->batch, pWti));
+	if(pThis->bDeqBatchAdaptive) {
+		ttProc = currentMonotonicUsecs() - ttStart;
+		nProcessed = pWti->batch.nElem;
+	}
 
 	/* we now need to check if we should deliberately delay processing a bit
 	 * and, if so, do that. -- rgerhards, 2008-01-30
@@ -2002,6 +2587,9 @@ finalize_it:
 	if(bNeedReLock)
 		d_pthread_mutex_lock(pThis->mut);
 
+	if(nProcessed > 0)
+		AdaptDeqBatchSize(pThis, nProcessed, ttProc);
+
 	RETiRet;
 }
 
@@ -2148,6 +2736,45 @@ if(pThis->pqParent != NULL) // TODO: check why we actually do this!
 }
 
 
+/* called before the queue stats are read */
+static void
+qqueueStatsPreRead(statsobj_t __attribute__((unused)) *stats, void *ctx)
+{
+	qqueue_t *pThis = (qqueue_t*) ctx;
+	histogramUpdateCounters(&pThis->histWait);
+}
+
+
+/* add the stats counters for a priority lane */
+static rsRetVal
+qqueueAddPrioLaneCounters(qqueue_t *pThis, int iLane)
+{
+	qPrioLane_t *pLane = &pThis->prioLanes[iLane];
+	uchar ctrName[32];
+	DEFiRet;
+
+	/* nEntries is a dual-use counter: no init, no mutex! */
+	snprintf((char*) ctrName, sizeof(ctrName), "lane%d.size", iLane);
+	CHKiRet(statsobj.AddCounter(pThis->statsobj, ctrName,
+		ctrType_Int, CTR_FLAG_NONE, &pLane->nEntries));
+	STATSCOUNTER_INIT(pLane->ctrEnqueued, pLane->mutCtrEnqueued);
+	snprintf((char*) ctrName, sizeof(ctrName), "lane%d.enqueued", iLane);
+	CHKiRet(statsobj.AddCounter(pThis->statsobj, ctrName,
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pLane->ctrEnqueued));
+	STATSCOUNTER_INIT(pLane->ctrDscrd, pLane->mutCtrDscrd);
+	snprintf((char*) ctrName, sizeof(ctrName), "lane%d.discarded", iLane);
+	CHKiRet(statsobj.AddCounter(pThis->statsobj, ctrName,
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pLane->ctrDscrd));
+	pLane->ctrMaxqsize = 0; /* no mutex needed, thus no init call */
+	snprintf((char*) ctrName, sizeof(ctrName), "lane%d.maxqsize", iLane);
+	CHKiRet(statsobj.AddCounter(pThis->statsobj, ctrName,
+		ctrType_Int, CTR_FLAG_NONE, &pLane->ctrMaxqsize));
+
+finalize_it:
+	RETiRet;
+}
+
+
 /* start up the queue - it must have been constructed and parameters defined
  * before.
  */
@@ -2158,6 +2785,7 @@ qqueueStart(qqueue_t *pThis) /* this is the ConstructionFinalizer */
 	uchar pszBuf[64];
 	uchar pszQIFNam[MAXFNAME];
 	int wrk;
+	int i;
 	int goodval; /* a "good value" to use for comparisons (different objects) */
 	uchar *qName;
 	size_t lenBuf;
@@ -2223,6 +2851,43 @@ qqueueStart(qqueue_t *pThis) /* this is the ConstructionFinalizer */
 			break;
 	}
 
+	/* fair and priority mode replace the store of in-memory queues */
+	if(pThis->pszFairKey != NULL && pThis->iPrioLanes > 0) {
+		errmsg.LogError(0, RS_RET_PARAM_ERROR, "queue \"%s\": queue.fairness.key "
+				"and queue.priority.lanes cannot be combined - priority "
+				"lanes ignored", obj.GetName((obj_t*) pThis));
+		pThis->iPrioLanes = 0;
+	}
+	if(pThis->iPrioLanes > 0) {
+		if(pThis->qType == QUEUETYPE_LINKEDLIST || pThis->qType == QUEUETYPE_FIXED_ARRAY) {
+			pThis->qConstruct = qConstructPrio;
+			pThis->qDestruct = qDestructPrio;
+			pThis->qAdd = qAddPrio;
+			pThis->qDeq = qDeqPrio;
+			pThis->qDel = qDelSubq;
+		} else {
+			errmsg.LogError(0, RS_RET_PARAM_ERROR, "queue \"%s\": queue.priority.lanes "
+					"is only supported for in-memory queues (FixedArray, "
+					"LinkedList) - ignored", obj.GetName((obj_t*) pThis));
+			pThis->iPrioLanes = 0;
+		}
+	}
+	if(pThis->pszFairKey != NULL) {
+		if(pThis->qType == QUEUETYPE_LINKEDLIST || pThis->qType == QUEUETYPE_FIXED_ARRAY) {
+			pThis->qConstruct = qConstructFair;
+			pThis->qDestruct = qDestructFair;
+			pThis->qAdd = qAddFair;
+			pThis->qDeq = qDeqFair;
+			pThis->qDel = qDelSubq;
+		} else {
+			errmsg.LogError(0, RS_RET_PARAM_ERROR, "queue \"%s\": queue.fairness.key "
+					"is only supported for in-memory queues (FixedArray, "
+					"LinkedList) - ignored", obj.GetName((obj_t*) pThis));
+			free(pThis->pszFairKey);
+			pThis->pszFairKey = NULL;
+		}
+	}
+
 	if(pThis->iMaxQueueSize < 100
 	   && (pThis->qType == QUEUETYPE_LINKEDLIST || pThis->qType == QUEUETYPE_FIXED_ARRAY)) {
 		errmsg.LogMsg(0, RS_RET_OK_WARN, LOG_WARNING, "Note: queue.size=\"%d\" is very "
@@ -2322,10 +2987,28 @@ qqueueStart(qqueue_t *pThis) /* this is the ConstructionFinalizer */
 		}
 	}
 
+	if(pThis->pszFairKey != NULL && pThis->iFairKeyDiscardMrk > pThis->iMaxQueueSize) {
+		errmsg.LogError(0, RS_RET_PARAM_ERROR, "error: queue \"%s\": "
+				"queue.fairness.keyDiscardMark %d is set larger than queue.size",
+				obj.GetName((obj_t*) pThis), pThis->iFairKeyDiscardMrk);
+	}
+
 	if(pThis->iMaxQueueSize > 0 && pThis->iDeqBatchSize > pThis->iMaxQueueSize) {
 		pThis->iDeqBatchSize = pThis->iMaxQueueSize;
 	}
 
+	if(pThis->bDeqBatchAdaptive && pThis->qType == QUEUETYPE_DIRECT) {
+		DBGOPRINT((obj_t*) pThis, "adaptive dequeue batch size has no effect on direct queues\n");
+		pThis->bDeqBatchAdaptive = 0;
+	}
+	if(pThis->bDeqBatchAdaptive) {
+		if(pThis->iMinDeqBatchSize > pThis->iDeqBatchSize)
+			pThis->iMinDeqBatchSize = pThis->iDeqBatchSize;
+		pThis->iCurrDeqBatchSize = pThis->iMinDeqBatchSize; /* grow on demand */
+	} else {
+		pThis->iCurrDeqBatchSize = pThis->iDeqBatchSize;
+	}
+
 	/* finalize some initializations that could not yet be done because it is
 	 * influenced by properties which might have been set after queueConstruct ()
 	 */
@@ -2422,10 +3105,26 @@ qqueueStart(qqueue_t *pThis) /* this is the ConstructionFinalizer */
 	STATSCOUNTER_INIT(pThis->ctrNFDscrd, pThis->mutCtrNFDscrd);
 	CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("discarded.nf"),
 		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pThis->ctrNFDscrd));
+	if(pThis->pszFairKey != NULL) {
+		STATSCOUNTER_INIT(pThis->ctrFairDscrd, pThis->mutCtrFairDscrd);
+		CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("discarded.fairness"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pThis->ctrFairDscrd));
+	}
+	for(i = 0 ; i < pThis->iPrioLanes ; ++i) {
+		CHKiRet(qqueueAddPrioLaneCounters(pThis, i));
+	}
 
 	pThis->ctrMaxqsize = 0; /* no mutex needed, thus no init call */
 	CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("maxqsize"),
 		ctrType_Int, CTR_FLAG_NONE, &pThis->ctrMaxqsize));
+	if(pThis->bDeqBatchAdaptive) {
+		/* like iQueueSize, this is not a real counter, so no init, no mutex */
+		CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("dequeuebatchsize"),
+			ctrType_Int, CTR_FLAG_NONE, &pThis->iCurrDeqBatchSize));
+	}
+
+	CHKiRet(histogramAddCounters(&pThis->histWait, &statsobj, pThis->statsobj, "waittime"));
+	CHKiRet(statsobj.SetPreReadNotifier(pThis->statsobj, qqueueStatsPreRead, pThis));
 
 	CHKiRet(statsobj.ConstructFinalize(pThis->statsobj));
 
@@ -2612,6 +3311,7 @@ DoSaveOnShutdown(qqueue_t *pThis)
 
 /* destructor for the queue object */
 BEGINobjDestruct(qqueue) /* be sure to specify the object type also in END and CODESTART macros! */
+	int i;
 CODESTARTobjDestruct(qqueue)
 	DBGOPRINT((obj_t*) pThis, "shutdown: begin to destruct queue\n");
 	if(pThis->bQueueStarted) {
@@ -2678,6 +3378,7 @@ CODESTARTobjDestruct(qqueue)
 
 		DESTROY_ATOMIC_HELPER_MUT(pThis->mutQueueSize);
 		DESTROY_ATOMIC_HELPER_MUT(pThis->mutLogDeq);
+		histogramExit(&pThis->histWait);
 
 		/* type-specific destructor */
 		iRet = pThis->qDestruct(pThis);
@@ -2685,6 +3386,16 @@ CODESTARTobjDestruct(qqueue)
 
 	free(pThis->pszFilePrefix);
 	free(pThis->pszSpoolDir);
+	if(pThis->pszFairKey != NULL && !pThis->bFairKeyRuleset)
+		msgPropDescrDestruct(&pThis->fairKeyProp);
+	if(pThis->pszPrioKey != NULL)
+		msgPropDescrDestruct(&pThis->prioKeyProp);
+	free(pThis->pszPrioKey);
+	free(pThis->prioLanes);
+	free(pThis->pszFairKey);
+	for(i = 0 ; i < pThis->nFairWeights ; ++i)
+		free(pThis->fairWeights[i].pszKey);
+	free(pThis->fairWeights);
 	if(pThis->useCryprov) {
 		pThis->cryprov.Destruct(&pThis->cryprovData);
 		obj.ReleaseObj(__FILE__, pThis->cryprovNameFull+2, pThis->cryprovNameFull,
@@ -2876,6 +3587,8 @@ doEnqSingleObj(qqueue_t *pThis, flowControl_t flowCtlType, msg_t *pMsg)
 	}
 
 	/* and finally enqueue the message */
+	pMsg->ttEnqueued = currentMonotonicUsecs();
+	TRACE_EVT(pMsg, TRACE_ENQ, obj.GetName((obj_t*) pThis));
 	CHKiRet(qqueueAdd(pThis, pMsg));
 	STATSCOUNTER_SETMAX_NOMUT(pThis->ctrMaxqsize, pThis->iQueueSize);
 
@@ -3057,6 +3770,130 @@ finalize_it:
 	RETiRet;
 }
 
+/* set the fairness key. Either "ruleset" or the name of a message property
+ * (e.g. "inputname", "fromhost" or "$!tenant"). On error, fair mode stays off.
+ */
+static void
+qqueueSetFairKey(qqueue_t *pThis, es_str_t *estr)
+{
+	uchar *pszKey;
+
+	free(pThis->pszFairKey);
+	pThis->pszFairKey = NULL;
+	pszKey = (uchar*) es_str2cstr(estr, NULL);
+	if(pszKey == NULL)
+		return;
+	if(!strcasecmp((char*) pszKey, "ruleset")) {
+		pThis->bFairKeyRuleset = 1;
+	} else if(msgPropDescrFill(&pThis->fairKeyProp, pszKey, ustrlen(pszKey)) != RS_RET_OK) {
+		parser_errmsg("queue.fairness.key '%s' is invalid, fair queueing disabled", pszKey);
+		free(pszKey);
+		return;
+	}
+	pThis->pszFairKey = pszKey;
+}
+
+
+/* set per-key weights, each array element has the form "key=weight" */
+static void
+qqueueSetFairWeights(qqueue_t *pThis, struct cnfarray *ar)
+{
+	uchar *pszElem;
+	char *pEq;
+	int iWeight;
+	int i;
+
+	pThis->fairWeights = calloc(ar->nmemb, sizeof(qFairWeight_t));
+	if(pThis->fairWeights == NULL)
+		return;
+	for(i = 0 ; i < ar->nmemb ; ++i) {
+		pszElem = (uchar*) es_str2cstr(ar->arr[i], NULL);
+		if(pszElem == NULL)
+			continue;
+		pEq = strrchr((char*) pszElem, '=');
+		iWeight = (pEq == NULL) ? 0 : atoi(pEq + 1);
+		if(iWeight < 1) {
+			parser_errmsg("queue.fairness.weights: element '%s' is invalid, must be "
+				      "\"key=weight\" with weight > 0 - ignored", pszElem);
+			free(pszElem);
+			continue;
+		}
+		*pEq = '\0';
+		pThis->fairWeights[pThis->nFairWeights].pszKey = pszElem;
+		pThis->fairWeights[pThis->nFairWeights].iWeight = iWeight;
+		++pThis->nFairWeights;
+	}
+}
+
+/* set the number of priority lanes. Lanes are allocated right away, as the
+ * other lane parameters are stored inside them.
+ */
+static void
+qqueueSetPrioLanes(qqueue_t *pThis, int iLanes)
+{
+	int i;
+
+	if(iLanes < 2 || iLanes > QUEUE_MAX_PRIO_LANES) {
+		parser_errmsg("queue.priority.lanes must be between 2 and %d, but is %d - "
+			      "priority lanes disabled", QUEUE_MAX_PRIO_LANES, iLanes);
+		return;
+	}
+	if((pThis->prioLanes = calloc(iLanes, sizeof(qPrioLane_t))) == NULL)
+		return;
+	for(i = 0 ; i < iLanes ; ++i)
+		pThis->prioLanes[i].iWeight = 1;
+	pThis->iPrioLanes = iLanes;
+}
+
+
+/* set the property that selects the lane (instead of severity) */
+static void
+qqueueSetPrioKey(qqueue_t *pThis, es_str_t *estr)
+{
+	uchar *pszKey;
+
+	pszKey = (uchar*) es_str2cstr(estr, NULL);
+	if(pszKey == NULL)
+		return;
+	if(msgPropDescrFill(&pThis->prioKeyProp, pszKey, ustrlen(pszKey)) != RS_RET_OK) {
+		parser_errmsg("queue.priority.key '%s' is invalid, lanes are selected by severity", pszKey);
+		free(pszKey);
+		return;
+	}
+	pThis->pszPrioKey = pszKey;
+}
+
+
+/* set a per-lane integer parameter from an array with one element per lane */
+static void
+qqueueSetPrioLaneParam(qqueue_t *pThis, struct cnfarray *ar, const char *name, size_t offs)
+{
+	char *pszElem;
+	int iVal;
+	int i;
+
+	if(pThis->iPrioLanes == 0) {
+		parser_errmsg("%s requires queue.priority.lanes - ignored", name);
+		return;
+	}
+	if(ar->nmemb != pThis->iPrioLanes) {
+		parser_errmsg("%s has %d elements, but there are %d lanes", name,
+			      ar->nmemb, pThis->iPrioLanes);
+	}
+	for(i = 0 ; i < ar->nmemb && i < pThis->iPrioLanes ; ++i) {
+		if((pszElem = es_str2cstr(ar->arr[i], NULL)) == NULL)
+			continue;
+		iVal = atoi(pszElem);
+		if(iVal < 0 || (iVal == 0 && offs == offsetof(qPrioLane_t, iWeight))) {
+			parser_errmsg("%s: invalid value '%s' for lane %d - ignored", name, pszElem, i);
+		} else {
+			*(int*)((char*) &pThis->prioLanes[i] + offs) = iVal;
+		}
+		free(pszElem);
+	}
+}
+
+
 /* apply all params from param block to queue. Must be called before
  * finalizing. This supports the v6 config system. Defaults were already
  * set during queue creation. The pvals object is destructed by this
@@ -3095,6 +3932,12 @@ qqueueApplyCnfParam(qqueue_t *pThis, struct nvlst *lst)
 			pThis->iMaxQueueSize = pvals[i].val.d.n;
 		} else if(!strcmp(pblk.descr[i].name, "queue.dequeuebatchsize")) {
 			pThis->iDeqBatchSize = pvals[i].val.d.n;
+		} else if(!strcmp(pblk.descr[i].name, "queue.dequeuebatchsize.adaptive")) {
+			pThis->bDeqBatchAdaptive = pvals[i].val.d.n;
+		} else if(!strcmp(pblk.descr[i].name, "queue.dequeuebatchsize.min")) {
+			pThis->iMinDeqBatchSize = pvals[i].val.d.n;
+		} else if(!strcmp(pblk.descr[i].name, "queue.dequeuebatchsize.targetlatency")) {
+			pThis->iDeqBatchTargetLatency = pvals[i].val.d.n;
 		} else if(!strcmp(pblk.descr[i].name, "queue.maxdiskspace")) {
 			pThis->sizeOnDiskMax = pvals[i].val.d.n;
 		} else if(!strcmp(pblk.descr[i].name, "queue.highwatermark")) {
@@ -3137,6 +3980,31 @@ qqueueApplyCnfParam(qqueue_t *pThis, struct nvlst *lst)
 			pThis->iDeqtWinFromHr = pvals[i].val.d.n;
 		} else if(!strcmp(pblk.descr[i].name, "queue.dequeuetimeend")) {
 			pThis->iDeqtWinToHr = pvals[i].val.d.n;
+		} else if(!strcmp(pblk.descr[i].name, "queue.fairness.key")) {
+			qqueueSetFairKey(pThis, pvals[i].val.d.estr);
+		} else if(!strcmp(pblk.descr[i].name, "queue.fairness.weights")) {
+			qqueueSetFairWeights(pThis, pvals[i].val.d.ar);
+		} else if(!strcmp(pblk.descr[i].name, "queue.fairness.quantum")) {
+			pThis->iFairQuantum = pvals[i].val.d.n;
+		} else if(!strcmp(pblk.descr[i].name, "queue.fairness.keydiscardmark")) {
+			pThis->iFairKeyDiscardMrk = pvals[i].val.d.n;
+		} else if(!strcmp(pblk.descr[i].name, "queue.fairness.maxkeys")) {
+			pThis->iFairMaxKeys = pvals[i].val.d.n;
+		} else if(!strcmp(pblk.descr[i].name, "queue.priority.lanes")) {
+			qqueueSetPrioLanes(pThis, pvals[i].val.d.n);
+		} else if(!strcmp(pblk.descr[i].name, "queue.priority.key")) {
+			qqueueSetPrioKey(pThis, pvals[i].val.d.estr);
+		} else if(!strcmp(pblk.descr[i].name, "queue.priority.weights")) {
+			qqueueSetPrioLaneParam(pThis, pvals[i].val.d.ar, "queue.priority.weights",
+				offsetof(qPrioLane_t, iWeight));
+			if(pThis->iPrioLanes > 0)
+				pThis->bPrioWeighted = 1;
+		} else if(!strcmp(pblk.descr[i].name, "queue.priority.lanesizes")) {
+			qqueueSetPrioLaneParam(pThis, pvals[i].val.d.ar, "queue.priority.laneSizes",
+				offsetof(qPrioLane_t, iMaxEntries));
+		} else if(!strcmp(pblk.descr[i].name, "queue.priority.lanediscardmarks")) {
+			qqueueSetPrioLaneParam(pThis, pvals[i].val.d.ar, "queue.priority.laneDiscardMarks",
+				offsetof(qPrioLane_t, iDiscardMrk));
 		} else {
 			DBGPRINTF("queue: program error, non-handled "
 			  "param '%s'\n", pblk.descr[i].name);
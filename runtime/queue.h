@@ -30,6 +30,7 @@
 #include "batch.h"
 #include "stream.h"
 #include "statsobj.h"
+#include "histogram.h"
 #include "cryprov.h"
 
 /* support for the toDelete list */
@@ -55,6 +56,44 @@ typedef struct qLinkedList_S {
 	msg_t *pMsg;
 } qLinkedList_t;
 
+/* per-key sub-queue for in-memory queues running in fair mode. All
+ * sub-queues are kept in a hash table by key. Keys which have entries
+ * are additionally chained into the deficit round robin active list.
+ */
+typedef struct qFairKey_s {
+	struct qFairKey_s *pNextAct; /* next key in DRR active list */
+	qLinkedList_t *pRoot;	/* first entry not yet dequeued */
+	qLinkedList_t *pLast;
+	uchar *pszKey;		/* owned by the hash table (NOT by this object) */
+	int nEntries;		/* nbr of entries not yet dequeued */
+	int iWeight;
+	int iDeficit;		/* DRR deficit counter, in messages */
+	sbool bActive;		/* is this key in the active list? */
+} qFairKey_t;
+
+/* a lane of an in-memory queue running in priority mode. Lane 0 has
+ * the highest priority.
+ */
+typedef struct qPrioLane_s {
+	qLinkedList_t *pRoot;	/* first entry not yet dequeued */
+	qLinkedList_t *pLast;
+	int nEntries;		/* nbr of entries not yet dequeued, dual-use as stats counter */
+	int iMaxEntries;	/* lane size, 0 - only limited by queue.size */
+	int iDiscardMrk;	/* lane discard mark (applies queue.discardSeverity), 0 - off */
+	int iWeight;		/* messages per round for weighted dequeue */
+	int iDeficit;
+	STATSCOUNTER_DEF(ctrEnqueued, mutCtrEnqueued)
+	STATSCOUNTER_DEF(ctrDscrd, mutCtrDscrd)
+	int ctrMaxqsize; /* NOT guarded by a mutex */
+} qPrioLane_t;
+#define QUEUE_MAX_PRIO_LANES 8
+
+/* configured weight for a specific fairness key */
+typedef struct qFairWeight_s {
+	uchar *pszKey;
+	int iWeight;
+} qFairWeight_t;
+
 
 /* the queue object */
 struct queue_s {
@@ -82,6 +121,21 @@ struct queue_s {
 	int	iFullDlyMrk;	/* if the queue is above this mark, FULL_DELAYable message are put on hold */
 	int	iLightDlyMrk;	/* if the queue is above this mark, LIGHT_DELAYable message are put on hold */
 	int	iDiscardSeverity;/* messages of this severity above are discarded on too-full queue */
+	/* fair queueing (in-memory queues only), enabled if pszFairKey != NULL */
+	uchar	*pszFairKey;	/* "ruleset" or a message property name */
+	sbool	bFairKeyRuleset;/* key is the message's ruleset name */
+	msgPropDescr_t fairKeyProp; /* key property, if not ruleset */
+	int	iFairQuantum;	/* DRR quantum per weight unit, in messages */
+	int	iFairKeyDiscardMrk;/* max entries per key, above that messages are discarded; 0 - off */
+	int	iFairMaxKeys;	/* max nbr of distinct keys, excess keys share one overflow sub-queue */
+	qFairWeight_t *fairWeights; /* configured per-key weights (default weight is 1) */
+	int	nFairWeights;
+	/* priority lanes (in-memory queues only), enabled if iPrioLanes > 0 */
+	int	iPrioLanes;	/* nbr of lanes */
+	uchar	*pszPrioKey;	/* lane selector property, NULL - select by severity */
+	msgPropDescr_t prioKeyProp;
+	sbool	bPrioWeighted;	/* weighted (1) or strict priority (0) dequeue? */
+	qPrioLane_t *prioLanes;	/* lane config and state, iPrioLanes entries */
 	sbool	bNeedDelQIF;	/* does the QIF file need to be deleted when queue becomes empty? */
 	int	toQShutdown;	/* timeout for regular queue shutdown in ms */
 	int	toActShutdown;	/* timeout for long-running action shutdown in ms */
@@ -89,6 +143,12 @@ struct queue_s {
 	toDeleteLst_t *toDeleteLst;/* this queue's to-delete list */
 	int	toEnq;		/* enqueue timeout */
 	int	iDeqBatchSize;	/* max number of elements that shall be dequeued at once */
+	/* adaptive dequeue batch sizing, iDeqBatchSize is the upper bound */
+	sbool	bDeqBatchAdaptive;
+	int	iMinDeqBatchSize;	/* lower bound for adaptive batch size */
+	int	iDeqBatchTargetLatency; /* max desired processing time per batch in ms, 0 - none */
+	int	iCurrDeqBatchSize;	/* batch size currently in use (guarded by queue mutex) */
+	sbool	bDeqBatchBackoff;	/* consumer ran into trouble, shrink batch on next occasion */
 	/* rate limiting settings (will be expanded) */
 	int	iDeqSlowdown; /* slow down dequeue by specified nbr of microseconds */
 	/* end rate limiting */
@@ -158,6 +218,22 @@ struct queue_s {
 			qLinkedList_t *pDelRoot;
 			qLinkedList_t *pLast;
 		} linklist;
+		struct {
+			struct hashtable *ht;	/* key -> qFairKey_t */
+			qFairKey_t *pOverflow;	/* shared sub-queue once iFairMaxKeys is reached */
+			int nKeys;
+			qFairKey_t *pActRoot;	/* DRR active list, head is served next */
+			qFairKey_t *pActLast;
+		} fair;
+		struct {
+			int iCurrLane;		/* lane currently served by weighted dequeue */
+		} prio;
+		struct {
+			/* dequeued, not yet deleted entries of sub-queue based stores
+			 * (fair and priority mode), in dequeue order */
+			qLinkedList_t *pDelRoot;
+			qLinkedList_t *pDelLast;
+		} subq;
 		struct {
 			int64 sizeOnDisk; /* current amount of disk space used */
 			int64 deqOffs; /* offset after dequeue batch - used for file deleter */
@@ -182,7 +258,9 @@ struct queue_s {
 	STATSCOUNTER_DEF(ctrFull, mutCtrFull)
 	STATSCOUNTER_DEF(ctrFDscrd, mutCtrFDscrd)
 	STATSCOUNTER_DEF(ctrNFDscrd, mutCtrNFDscrd)
+	STATSCOUNTER_DEF(ctrFairDscrd, mutCtrFairDscrd)
 	int ctrMaxqsize; /* NOT guarded by a mutex */
+	histogram_t histWait;	/* time between enqueue and dequeue */
 };
 
 
@@ -206,6 +284,7 @@ rsRetVal qqueueApplyCnfParam(qqueue_t *pThis, struct nvlst *lst);
 void qqueueSetDefaultsRulesetQueue(qqueue_t *pThis);
 void qqueueSetDefaultsActionQueue(qqueue_t *pThis);
 void qqueueDbgPrint(qqueue_t *pThis);
+void qqueueDeqBatchBackoff(qqueue_t *pThis);
 
 PROTOTYPEObjClassInit(qqueue);
 PROTOTYPEpropSetMeth(qqueue, iPersistUpdCnt, int);
@@ -67,6 +67,7 @@
 #include "modules.h"
 #include "dirty.h"
 #include "template.h"
+#include "trace.h"
 
 extern char* yytext;
 /* static data */
@@ -221,6 +222,7 @@ CODESTARTobjDestruct(rsconf)
 	free(pThis->globals.mainQ.pszMainMsgQFName);
 	free(pThis->globals.pszConfDAGFile);
 	lookupDestroyCnf();
+	traceExit();
 	llDestroy(&(pThis->rulesets.llRulesets));
 ENDobjDestruct(rsconf)
 
@@ -863,6 +865,7 @@ activate(rsconf_t *cnf)
 	CHKiRet(dropPrivileges(cnf));
 
 	tellModulesActivateConfig();
+	traceActivate(); /* on failure, we just run without tracing */
 	startInputModules();
 	CHKiRet(activateActions());
 	CHKiRet(activateRulesetQueues());
@@ -82,6 +82,7 @@
 #include "statsobj.h"
 #include "atomic.h"
 #include "srUtils.h"
+#include "trace.h"
 
 pthread_attr_t default_thread_attr;
 #ifdef HAVE_PTHREAD_SETSCHEDPARAM
@@ -198,6 +199,8 @@ rsrtInit(const char **ppErrObj, obj_if_t *pObjIF)
 		CHKiRet(lookupClassInit());
 		if(ppErrObj != NULL) *ppErrObj = "dynstats";
 		CHKiRet(dynstatsClassInit());
+		if(ppErrObj != NULL) *ppErrObj = "trace";
+		CHKiRet(traceClassInit());
 
 		/* dummy "classes" */
 		if(ppErrObj != NULL) *ppErrObj = "str";
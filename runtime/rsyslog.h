@@ -460,6 +460,9 @@ enum rsRetVal_				/** return value. All methods return this if not specified oth
 	RS_RET_FILE_OPEN_ERROR = -2433, /**< error other than "not found" occured during open() */
 	RS_RET_FILE_CHOWN_ERROR = -2434, /**< error during chown() */
 	RS_RET_RENAME_TMP_QI_ERROR = -2435, /**< renaming temporary .qi file failed */
+	RS_RET_ZSTD_ERR = -2436, /**< error during zstd call */
+	RS_RET_LZ4_ERR = -2437, /**< error during lz4 call */
+	RS_RET_CODEC_NOT_AVAILABLE = -2438, /**< requested compression codec not supported by this build */
 
 	/* RainerScript error messages (range 1000.. 1999) */
 	RS_RET_SYSVAR_NOT_FOUND = 1001, /**< system variable could not be found (maybe misspelled) */
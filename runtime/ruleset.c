@@ -233,7 +233,14 @@ execCall(struct cnfstmt *stmt, msg_t *pMsg, wti_t *pWti)
 {
 	DEFiRet;
 	if(stmt->d.s_call.ruleset == NULL) {
-		CHKiRet(scriptExec(stmt->d.s_call.stmt, pMsg, pWti));
+		if(pMsg->pTrace != NULL)
+			traceAddEvt(pMsg->pTrace, TRACE_RULESET_BEGIN, es_getBufAddr(stmt->d.s_call.name),
+				es_strlen(stmt->d.s_call.name), 0);
+		iRet = scriptExec(stmt->d.s_call.stmt, pMsg, pWti);
+		if(pMsg->pTrace != NULL)
+			traceAddEvt(pMsg->pTrace, TRACE_RULESET_END, es_getBufAddr(stmt->d.s_call.name),
+				es_strlen(stmt->d.s_call.name), 0);
+		CHKiRet(iRet);
 	} else {
 		CHKmalloc(pMsg = MsgDup((msg_t*) pMsg));
 		DBGPRINTF("CALL: forwarding message to async ruleset %p\n",
@@ -592,7 +599,9 @@ processBatch(batch_t *pBatch, wti_t *pWti)
 		pMsg = pBatch->pElem[i].pMsg;
 		DBGPRINTF("processBATCH: next msg %d: %.128s\n", i, pMsg->pszRawMsg);
 		pRuleset = (pMsg->pRuleset == NULL) ? ourConf->rulesets.pDflt : pMsg->pRuleset;
+		TRACE_EVT(pMsg, TRACE_RULESET_BEGIN, pRuleset->pszName);
 		localRet = scriptExec(pRuleset->root, pMsg, pWti);
+		TRACE_EVT(pMsg, TRACE_RULESET_END, pRuleset->pszName);
 		/* the most important case here is that processing may be aborted
 		 * due to pbShutdownImmediate, in which case we MUST NOT flag this
 		 * message as committed. If we would do so, the message would
@@ -97,6 +97,7 @@ void seedRandomNumber(void);
 #define MAX_RANDOM_NUMBER RAND_MAX
 long int randomNumber(void);
 long long currentTimeMills(void);
+long long currentMonotonicUsecs(void);
 
 /* mutex operations */
 /* some useful constants */
@@ -452,6 +452,27 @@ currentTimeMills(void)
 }
 
 
+/* obtain a monotonic timestamp in microseconds, for measuring durations.
+ * The absolute value has no meaning. If there is no monotonic clock, we
+ * fall back to the wall clock (which may jump).
+ */
+long long
+currentMonotonicUsecs(void)
+{
+#	if _POSIX_TIMERS > 0 && defined(CLOCK_MONOTONIC)
+	struct timespec tm;
+
+	clock_gettime(CLOCK_MONOTONIC, &tm);
+	return ((long long) tm.tv_sec) * 1000000 + (tm.tv_nsec / 1000);
+#	else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return ((long long) tv.tv_sec) * 1000000 + tv.tv_usec;
+#	endif
+}
+
+
 /* This function is kind of the reverse of timeoutComp() - it takes an absolute
  * timeout value and computes how far this is in the future. If the value is already
  * in the past, 0 is returned. The return value is in ms.
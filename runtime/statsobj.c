@@ -127,6 +127,7 @@ BEGINobjConstruct(statsobj) /* be sure to specify the object type also in END ma
 	pThis->ctrLast = NULL;
 	pThis->ctrRoot = NULL;
 	pThis->read_notifier = NULL;
+	pThis->pre_read_notifier = NULL;
 	pThis->flags = 0;
 ENDobjConstruct(statsobj)
 
@@ -153,6 +154,19 @@ setReadNotifier(statsobj_t *pThis, statsobj_read_notifier_t notifier, void* ctx)
 	RETiRet;
 }
 
+/* set pre_read_notifier (a function which is invoked before stats are read).
+ * This permits the owner to update the set of counters right before they
+ * are reported.
+ */
+static rsRetVal
+setPreReadNotifier(statsobj_t *pThis, statsobj_read_notifier_t notifier, void* ctx)
+{
+	DEFiRet;
+	pThis->pre_read_notifier = notifier;
+	pThis->pre_read_notifier_ctx = ctx;
+	RETiRet;
+}
+
 
 /* set origin (module name, etc).
  * Note that we make our own copy of the memory, caller is
@@ -266,9 +280,9 @@ destructUnlinkedCounter(ctr_t *ctr) {
 }
 
 static void
-destructCounter(statsobj_t *pThis, ctr_t *pCtr)
+unlinkCounter(statsobj_t *pThis, ctr_t *pCtr)
 {
-    pthread_mutex_lock(&pThis->mutCtr);
+	pthread_mutex_lock(&pThis->mutCtr);
 	if (pCtr->prev != NULL) {
 		pCtr->prev->next = pCtr->next;
 	}
@@ -281,7 +295,15 @@ destructCounter(statsobj_t *pThis, ctr_t *pCtr)
 	if (pThis->ctrRoot == pCtr) {
 		pThis->ctrRoot = pCtr->next;
 	}
+	pCtr->next = NULL;
+	pCtr->prev = NULL;
 	pthread_mutex_unlock(&pThis->mutCtr);
+}
+
+static void
+destructCounter(statsobj_t *pThis, ctr_t *pCtr)
+{
+	unlinkCounter(pThis, pCtr);
 	destructUnlinkedCounter(pCtr);
 }
 
@@ -525,6 +547,9 @@ getAllStatsLines(rsRetVal(*cb)(void*, const char*), void *usrptr, statsFmtType_t
 	DEFiRet;
 
 	for(o = objRoot ; o != NULL ; o = o->next) {
+		if (o->pre_read_notifier != NULL) {
+			o->pre_read_notifier(o, o->pre_read_notifier_ctx);
+		}
 		switch(fmt) {
 		case statsFmt_Legacy:
 			CHKiRet(getStatsLine(o, &cstr, bResetCtrs));
@@ -714,6 +739,8 @@ CODESTARTobjQueryInterface(statsobj)
 	pIf->DestructCounter = destructCounter;
 	pIf->DestructUnlinkedCounter = destructUnlinkedCounter;
 	pIf->UnlinkAllCounters = unlinkAllCounters;
+	pIf->UnlinkCounter = unlinkCounter;
+	pIf->SetPreReadNotifier = setPreReadNotifier;
 	pIf->EnableStats = enableStats;
 finalize_it:
 ENDobjQueryInterface(statsobj)
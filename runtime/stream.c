@@ -76,11 +76,43 @@ DEFobjStaticHelpers
 DEFobjCurrIf(errmsg)
 DEFobjCurrIf(zlibw)
 
+/* Async writes are carried out by a pool of writer threads shared by all
+ * streams. A stream is put into the pool's work queue whenever it has
+ * buffers to write or its flush interval expired. A stream is serviced by
+ * at most one writer at a time, so per-file write order is retained.
+ * Threads are started on demand (up to glblAsyncWriterThreads, but never
+ * more than there are async streams) and terminated when the last async
+ * stream is destructed.
+ * Lock order: stream mutex before pool mutex. Writers never acquire a
+ * stream mutex while holding the pool mutex.
+ */
+#define STRM_WRK_IDLE 0		/* not in work queue */
+#define STRM_WRK_QUEUED 1	/* in work queue */
+#define STRM_WRK_BUSY 2		/* being serviced by a writer */
+#define STRM_WRK_BUSY_REQUEUE 3	/* being serviced, new work arrived meanwhile */
+static struct {
+	pthread_mutex_t mut;
+	pthread_cond_t workAvail;	/* signaled when work is queued or timers change */
+	pthread_cond_t wrkDone;		/* broadcast when a writer finished a stream */
+	strm_t *wrkRoot, *wrkLast;	/* work queue */
+	strm_t *tmrRoot;		/* streams with armed flush timer */
+	int nTimers;			/* number of armed timers */
+	time_t ttNextTimer;		/* earliest armed deadline */
+	int nStreams;			/* number of registered async streams */
+	int nThreads;			/* number of running writer threads */
+	int nMaxThreads;		/* size of tids array */
+	pthread_t *tids;
+	unsigned gen;			/* threads of an older generation terminate */
+} wrtPool;
+
 /* forward definitions */
 static rsRetVal strmFlushInternal(strm_t *pThis, int bFlushZip);
 static rsRetVal strmWrite(strm_t *__restrict__ const pThis, const uchar *__restrict__ const pBuf, const size_t lenBuf);
 static rsRetVal strmCloseFile(strm_t *pThis);
-static void *asyncWriterThread(void *pPtr);
+static rsRetVal asyncWrtRegister(strm_t *pThis);
+static void asyncWrtUnregister(strm_t *pThis);
+static void asyncWrtEnqueue(strm_t *pThis);
+static void asyncWrtArmTimer(strm_t *pThis);
 static rsRetVal doZipWrite(strm_t *pThis, uchar *pBuf, size_t lenBuf, int bFlush);
 static rsRetVal doZipFinish(strm_t *pThis);
 static rsRetVal strmPhysWrite(strm_t *pThis, uchar *pBuf, size_t lenBuf);
@@ -388,18 +420,17 @@ finalize_it:
 }
 
 
-/* wait for the output writer thread to be done. This must be called before actions
- * that require data to be persisted. May be called in non-async mode and is a null
- * operation than. Must be called with the mutex locked.
+/* wait for the pool writers to be done with this stream. This must be called before
+ * actions that require data to be persisted. May be called in non-async mode and is
+ * a null operation than. Must be called with the mutex locked.
  */
 static inline void
 strmWaitAsyncWriterDone(strm_t *pThis)
 {
 	BEGINfunc
 	if(pThis->bAsyncWrite) {
-		/* awake writer thread and make it write out everything */
+		/* any buffer counted in iCnt has already been queued to the pool */
 		while(pThis->iCnt > 0) {
-			pthread_cond_signal(&pThis->notEmpty);
 			d_pthread_cond_wait(&pThis->isEmpty, &pThis->mut);
 		}
 	}
@@ -717,6 +748,57 @@ static rsRetVal strmUnreadChar(strm_t *pThis, uchar c)
 	return RS_RET_OK;
 }
 
+/* read the remainder of the current line from the stream and append it to
+ * pCStr. The terminating LF is consumed, but not appended. Instead of
+ * going through strmReadChar() for each octet, we search the LF inside
+ * the buffer with memchr() and copy everything up to it in one step.
+ * Returns RS_RET_EOF if the stream ends before a LF is found; in that
+ * case, pCStr contains all data read so far.
+ */
+static rsRetVal
+strmReadLineSegment(strm_t *pThis, cstr_t *pCStr)
+{
+	uchar *pStart;
+	uchar *pLF;
+	size_t len;
+	int padBytes;
+	uchar c;
+	DEFiRet;
+
+	if(pThis->iUngetC != -1) {	/* "unread" char must be processed first */
+		c = pThis->iUngetC;
+		pThis->iUngetC = -1;
+		++pThis->iCurrOffs;
+		if(c == '\n')
+			FINALIZE;
+		CHKiRet(cstrAppendChar(pCStr, c));
+	}
+
+	while(1) {
+		if(pThis->iBufPtr >= pThis->iBufPtrMax) {
+			padBytes = 0;
+			CHKiRet(strmReadBuf(pThis, &padBytes));
+			pThis->iCurrOffs += padBytes;
+		}
+		pStart = pThis->pIOBuf + pThis->iBufPtr;
+		len = pThis->iBufPtrMax - pThis->iBufPtr;
+		pLF = memchr(pStart, '\n', len);
+		if(pLF != NULL)
+			len = pLF - pStart;
+		CHKiRet(rsCStrAppendStrWithLen(pCStr, pStart, len));
+		pThis->iBufPtr += len;
+		pThis->iCurrOffs += len;
+		if(pLF != NULL) {
+			++pThis->iBufPtr; /* eat LF */
+			++pThis->iCurrOffs;
+			break;
+		}
+	}
+
+finalize_it:
+	RETiRet;
+}
+
 /* read a 'paragraph' from a strm file.
  * A paragraph may be terminated by a LF, by a LFLF, or by LF<not whitespace> depending on the option set.
  * The termination LF characters are read, but are
@@ -728,20 +810,27 @@ static rsRetVal strmUnreadChar(strm_t *pThis, uchar c)
  * mode = 1 LFLF mode (paragraph, blank line between entries)
  * mode = 2 LF <not whitespace> mode, a log line starts at the beginning of
  * a line, but following lines that are indented are part of the same log entry
+ *
+ * All modes work on complete line segments (see strmReadLineSegment()). In
+ * multi-line modes, bPrevWasNL tells if the last thing appended was a line
+ * separator. It persists accross calls, so that an EOF in the middle of a
+ * paragraph can be resumed from prevLineSegment.
  */
 static rsRetVal
 strmReadLine(strm_t *pThis, cstr_t **ppCStr, uint8_t mode, sbool bEscapeLF, uint32_t trimLineOverBytes)
 {
-        uchar c;
+	uchar c;
 	uchar finished;
-	rsRetVal readCharRet;
-        DEFiRet;
+	int lenBefore;
+	rsRetVal readRet;
+	const uchar *const sep = (bEscapeLF) ? (uchar*)"#012" : (uchar*)"\n";
+	const size_t lenSep = (bEscapeLF) ? 4 : 1;
+	DEFiRet;
 
-        ASSERT(pThis != NULL);
-        ASSERT(ppCStr != NULL);
+	ASSERT(pThis != NULL);
+	ASSERT(ppCStr != NULL);
 
-        CHKiRet(cstrConstruct(ppCStr));
-        CHKiRet(strmReadChar(pThis, &c));
+	CHKiRet(cstrConstruct(ppCStr));
 
 	/* append previous message to current message if necessary */
 	if(pThis->prevLineSegment != NULL) {
@@ -750,111 +839,82 @@ strmReadLine(strm_t *pThis, cstr_t **ppCStr, uint8_t mode, sbool bEscapeLF, uint
 		CHKiRet(cstrAppendCStr(*ppCStr, pThis->prevLineSegment));
 		cstrDestruct(&pThis->prevLineSegment);
 	}
-        if(mode == 0) {
-		while(c != '\n') {
-                	CHKiRet(cstrAppendChar(*ppCStr, c));
-                	readCharRet = strmReadChar(pThis, &c);
-                	if(readCharRet == RS_RET_EOF) {/* end of file reached without \n? */
-				CHKiRet(rsCStrConstructFromCStr(&pThis->prevLineSegment, *ppCStr));
-                	}
-                	CHKiRet(readCharRet);
-        	}
-		if (trimLineOverBytes > 0 && (uint32_t) cstrLen(*ppCStr) > trimLineOverBytes) {
-			/* Truncate long line at trimLineOverBytes position */
-			dbgprintf("Truncate long line at %u, mode %d\n", trimLineOverBytes, mode);
-			rsCStrTruncate(*ppCStr, cstrLen(*ppCStr) - trimLineOverBytes);
-			cstrAppendChar(*ppCStr, '\n');
-		}
-		cstrFinalize(*ppCStr);
+	if(mode == 0) {
+		CHKiRet(strmReadLineSegment(pThis, *ppCStr));
 	} else if(mode == 1) {
 		finished=0;
 		while(finished == 0){
-        		if(c != '\n') {
-                		CHKiRet(cstrAppendChar(*ppCStr, c));
-                		CHKiRet(strmReadChar(pThis, &c));
+			lenBefore = cstrLen(*ppCStr);
+			readRet = strmReadLineSegment(pThis, *ppCStr);
+			if(cstrLen(*ppCStr) != lenBefore)
 				pThis->bPrevWasNL = 0;
+			CHKiRet(readRet);
+			/* we are at a LF */
+			if(cstrLen(*ppCStr) == 0) {
+				finished=1;  /* this is a blank line, a \n with nothing since the last complete record */
+			} else if(pThis->bPrevWasNL) {
+				rsCStrTruncate(*ppCStr, lenSep); /* remove the prior newline */
+				finished=1;
 			} else {
-				if ((((*ppCStr)->iStrLen) > 0) ){
-					if(pThis->bPrevWasNL) {
-						rsCStrTruncate(*ppCStr, (bEscapeLF) ? 4 : 1); /* remove the prior newline */
-						finished=1;
-					} else {
-						if(bEscapeLF) {
-							CHKiRet(rsCStrAppendStrWithLen(*ppCStr, (uchar*)"#012", sizeof("#012")-1));
-						} else {
-							CHKiRet(cstrAppendChar(*ppCStr, c));
-						}
-               					CHKiRet(strmReadChar(pThis, &c));
-						pThis->bPrevWasNL = 1;
-					}
-				} else {
-					finished=1;  /* this is a blank line, a \n with nothing since the last complete record */
-				}
+				CHKiRet(rsCStrAppendStrWithLen(*ppCStr, sep, lenSep));
+				pThis->bPrevWasNL = 1;
 			}
 		}
-		cstrFinalize(*ppCStr);
 		pThis->bPrevWasNL = 0;
 	} else if(mode == 2) {
 		/* indented follow-up lines */
 		finished=0;
 		while(finished == 0){
-			if ((*ppCStr)->iStrLen == 0){
-        			if(c != '\n') {
-				/* nothing in the buffer, and it's not a newline, add it to the buffer */
-               				CHKiRet(cstrAppendChar(*ppCStr, c));
-               				CHKiRet(strmReadChar(pThis, &c));
-				} else {
+			if(cstrLen(*ppCStr) == 0) {
+				CHKiRet(strmReadLineSegment(pThis, *ppCStr));
+				if(cstrLen(*ppCStr) == 0) {
 					finished=1;  /* this is a blank line, a \n with nothing since the last complete record */
+					continue;
 				}
-			} else {
-				if(pThis->bPrevWasNL) {
-					if ((c == ' ') || (c == '\t')){
-               					CHKiRet(cstrAppendChar(*ppCStr, c));
-               					CHKiRet(strmReadChar(pThis, &c));
-						pThis->bPrevWasNL = 0;
-					} else {
-						/* clean things up by putting the character we just read back into
-						 * the input buffer and removing the LF character that is currently at the
-						 * end of the output string */
-						CHKiRet(strmUnreadChar(pThis, c));
-						rsCStrTruncate(*ppCStr, (bEscapeLF) ? 4 : 1);
-						finished=1;
-					}
-				} else { /* not the first character after a newline, add it to the buffer */
-					if(c == '\n') {
-						pThis->bPrevWasNL = 1;
-						if(bEscapeLF) {
-							CHKiRet(rsCStrAppendStrWithLen(*ppCStr, (uchar*)"#012", sizeof("#012")-1));
-						} else {
-							CHKiRet(cstrAppendChar(*ppCStr, c));
-						}
-					} else {
-						CHKiRet(cstrAppendChar(*ppCStr, c));
-					}
-               				CHKiRet(strmReadChar(pThis, &c));
+			} else if(pThis->bPrevWasNL) {
+				/* only the first character tells if the next line belongs to us */
+				CHKiRet(strmReadChar(pThis, &c));
+				if((c == ' ') || (c == '\t')) {
+					CHKiRet(cstrAppendChar(*ppCStr, c));
+					pThis->bPrevWasNL = 0;
+					CHKiRet(strmReadLineSegment(pThis, *ppCStr));
+				} else {
+					/* clean things up by putting the character we just read back into
+					 * the input buffer and removing the LF character that is currently at the
+					 * end of the output string */
+					CHKiRet(strmUnreadChar(pThis, c));
+					rsCStrTruncate(*ppCStr, lenSep);
+					finished=1;
+					continue;
 				}
+			} else {
+				/* continue a line we got only partially before */
+				CHKiRet(strmReadLineSegment(pThis, *ppCStr));
 			}
+			CHKiRet(rsCStrAppendStrWithLen(*ppCStr, sep, lenSep));
+			pThis->bPrevWasNL = 1;
 		}
-		if (trimLineOverBytes > 0 && (uint32_t) cstrLen(*ppCStr) > trimLineOverBytes) {
-			/* Truncate long line at trimLineOverBytes position */
-			dbgprintf("Truncate long line at %u, mode %d\n", trimLineOverBytes, mode);
-			rsCStrTruncate(*ppCStr, cstrLen(*ppCStr) - trimLineOverBytes);
-			cstrAppendChar(*ppCStr, '\n');
-		}
-		cstrFinalize(*ppCStr);
 		pThis->bPrevWasNL = 0;
 	}
 
+	if(mode != 1 && trimLineOverBytes > 0 && (uint32_t) cstrLen(*ppCStr) > trimLineOverBytes) {
+		/* Truncate long line at trimLineOverBytes position */
+		dbgprintf("Truncate long line at %u, mode %d\n", trimLineOverBytes, mode);
+		rsCStrTruncate(*ppCStr, cstrLen(*ppCStr) - trimLineOverBytes);
+		cstrAppendChar(*ppCStr, '\n');
+	}
+	cstrFinalize(*ppCStr);
+
 finalize_it:
-        if(iRet != RS_RET_OK && *ppCStr != NULL) {
+	if(iRet != RS_RET_OK && *ppCStr != NULL) {
 		if(cstrLen(*ppCStr) > 0) {
 		/* we may have an empty string in an unsuccsfull poll or after restart! */
 			rsCStrConstructFromCStr(&pThis->prevLineSegment, *ppCStr);
 		}
-                cstrDestruct(ppCStr);
+		cstrDestruct(ppCStr);
 	}
 
-        RETiRet;
+	RETiRet;
 }
 
 /* read a multi-line message from a strm file.
@@ -866,17 +926,15 @@ finalize_it:
 rsRetVal
 strmReadMultiLine(strm_t *pThis, cstr_t **ppCStr, regex_t *preg, sbool bEscapeLF)
 {
-        uchar c;
 	uchar finished = 0;
 	cstr_t *thisLine = NULL;
-	rsRetVal readCharRet;
-        DEFiRet;
+	rsRetVal readRet;
+	DEFiRet;
 
-        ASSERT(pThis != NULL);
-        ASSERT(ppCStr != NULL);
+	ASSERT(pThis != NULL);
+	ASSERT(ppCStr != NULL);
 
 	do {
-		CHKiRet(strmReadChar(pThis, &c)); /* immediately exit on EOF */
 		CHKiRet(cstrConstruct(&thisLine));
 		/* append previous message to current message if necessary */
 		if(pThis->prevLineSegment != NULL) {
@@ -884,14 +942,11 @@ strmReadMultiLine(strm_t *pThis, cstr_t **ppCStr, regex_t *preg, sbool bEscapeLF
 			cstrDestruct(&pThis->prevLineSegment);
 		}
 
-		while(c != '\n') {
-			CHKiRet(cstrAppendChar(thisLine, c));
-			readCharRet = strmReadChar(pThis, &c);
-			if(readCharRet == RS_RET_EOF) {/* end of file reached without \n? */
-				CHKiRet(rsCStrConstructFromCStr(&pThis->prevLineSegment, thisLine));
-			}
-			CHKiRet(readCharRet);
+		readRet = strmReadLineSegment(pThis, thisLine);
+		if(readRet == RS_RET_EOF && cstrLen(thisLine) > 0) {/* end of file reached without \n? */
+			CHKiRet(rsCStrConstructFromCStr(&pThis->prevLineSegment, thisLine));
 		}
+		CHKiRet(readRet);
 		cstrFinalize(thisLine);
 
 		/* we have a line, now let's assemble the message */
@@ -925,7 +980,9 @@ strmReadMultiLine(strm_t *pThis, cstr_t **ppCStr, regex_t *preg, sbool bEscapeLF
 	} while(finished == 0);
 
 finalize_it:
-        RETiRet;
+	if(thisLine != NULL)
+		cstrDestruct(&thisLine);
+	RETiRet;
 }
 
 /* Standard-Constructor for the strm object
@@ -998,18 +1055,13 @@ static rsRetVal strmConstructFinalize(strm_t *pThis)
 	if(pThis->bAsyncWrite) {
 		pthread_mutex_init(&pThis->mut, 0);
 		pthread_cond_init(&pThis->notFull, 0);
-		pthread_cond_init(&pThis->notEmpty, 0);
 		pthread_cond_init(&pThis->isEmpty, 0);
+		CHKiRet(asyncWrtRegister(pThis));
 		pThis->iCnt = pThis->iEnq = pThis->iDeq = 0;
 		for(i = 0 ; i < STREAM_ASYNC_NUMBUFS ; ++i) {
 			CHKmalloc(pThis->asyncBuf[i].pBuf = (uchar*) MALLOC(pThis->sIOBufSize));
 		}
 		pThis->pIOBuf = pThis->asyncBuf[0].pBuf;
-		pThis->bStopWriter = 0;
-		if(pthread_create(&pThis->writerThreadID,
-			    	  &default_thread_attr,
-				  asyncWriterThread, pThis) != 0)
-			DBGPRINTF("ERROR: stream %p cold not create writer thread\n", pThis);
 	} else {
 		/* we work synchronously, so we need to alloc a fixed pIOBuf */
 		CHKmalloc(pThis->pIOBuf = (uchar*) MALLOC(pThis->sIOBufSize));
@@ -1020,28 +1072,12 @@ finalize_it:
 }
 
 
-/* stop the writer thread (we MUST be runnnig asynchronously when this method
- * is called!). Note that the mutex must be locked! -- rgerhards, 2009-07-06
- */
-static inline void
-stopWriter(strm_t *pThis)
-{
-	BEGINfunc
-	pThis->bStopWriter = 1;
-	pthread_cond_signal(&pThis->notEmpty);
-	d_pthread_mutex_unlock(&pThis->mut);
-	pthread_join(pThis->writerThreadID, NULL);
-	ENDfunc
-}
-
-
 /* destructor for the strm object */
 BEGINobjDestruct(strm) /* be sure to specify the object type also in END and CODESTART macros! */
 	int i;
 CODESTARTobjDestruct(strm)
 	/* we need to stop the ZIP writer */
 	if(pThis->bAsyncWrite)
-		/* Note: mutex will be unlocked in stopWriter! */
 		d_pthread_mutex_lock(&pThis->mut);
 
 	/* strmClose() will handle read-only files as well as need to open
@@ -1050,10 +1086,10 @@ CODESTARTobjDestruct(strm)
 	strmCloseFile(pThis);
 
 	if(pThis->bAsyncWrite) {
-		stopWriter(pThis);
+		d_pthread_mutex_unlock(&pThis->mut);
+		asyncWrtUnregister(pThis);
 		pthread_mutex_destroy(&pThis->mut);
 		pthread_cond_destroy(&pThis->notFull);
-		pthread_cond_destroy(&pThis->notEmpty);
 		pthread_cond_destroy(&pThis->isEmpty);
 		for(i = 0 ; i < STREAM_ASYNC_NUMBUFS ; ++i) {
 			free(pThis->asyncBuf[i].pBuf);
@@ -1063,7 +1099,7 @@ CODESTARTobjDestruct(strm)
 	}
 
 	/* Finally, we can free the resources.
-	 * IMPORTANT: we MUST free this only AFTER the ansyncWriter has been stopped, else
+	 * IMPORTANT: we MUST free this only AFTER the stream left the writer pool, else
 	 * we get random errors...
 	 */
 	if(pThis->prevLineSegment)
@@ -1075,7 +1111,6 @@ CODESTARTobjDestruct(strm)
 	free(pThis->pszCurrFName);
 	free(pThis->pszFName);
 	free(pThis->pszSizeLimitCmd);
-	pThis->bStopWriter = 2; /* RG: use as flag for destruction */
 ENDobjDestruct(strm)
 
 
@@ -1255,10 +1290,8 @@ doAsyncWriteInternal(strm_t *pThis, size_t lenBuf, const int bFlushZip)
 		pThis->bFlushNow = bFlushZip;
 
 	pThis->bDoTimedWait = 0; /* everything written, no need to timeout partial buffer writes */
-	if(++pThis->iCnt == 1) {
-		pthread_cond_signal(&pThis->notEmpty);
-		DBGOPRINT((obj_t*) pThis, "doAsyncWriteInternal signaled notEmpty\n");
-	}
+	++pThis->iCnt;
+	asyncWrtEnqueue(pThis);
 	DBGOPRINT((obj_t*) pThis, "file %d(%s) doAsyncWriteInternal at exit: "
 		"iCnt %d, iEnq %d, bFlushZip %d\n",
 		pThis->fd, getFileDebugName(pThis),
@@ -1302,98 +1335,316 @@ finalize_it:
 
 
 
-/* This is the writer thread for asynchronous mode.
- * -- rgerhards, 2009-07-06
+/* remove a stream from the flush timer list (if it is on it).
+ * The pool mutex must be locked.
+ */
+static void
+asyncWrtDisarmTimerLocked(strm_t *const pThis)
+{
+	if(pThis->ttFlushDeadline == 0)
+		return;
+	if(pThis->pPrevTmr == NULL)
+		wrtPool.tmrRoot = pThis->pNextTmr;
+	else
+		pThis->pPrevTmr->pNextTmr = pThis->pNextTmr;
+	if(pThis->pNextTmr != NULL)
+		pThis->pNextTmr->pPrevTmr = pThis->pPrevTmr;
+	pThis->pPrevTmr = pThis->pNextTmr = NULL;
+	pThis->ttFlushDeadline = 0;
+	--wrtPool.nTimers;
+}
+
+
+/* hand a stream to the writer pool. If a writer is currently busy with
+ * the stream, it will pick it up again when done. This makes sure a
+ * stream is never serviced by two writers at the same time.
+ * The pool mutex must be locked.
+ */
+static void
+asyncWrtEnqueueLocked(strm_t *const pThis)
+{
+	switch(pThis->wrkState) {
+	case STRM_WRK_IDLE:
+		pThis->pNextWrk = NULL;
+		if(wrtPool.wrkLast == NULL)
+			wrtPool.wrkRoot = pThis;
+		else
+			wrtPool.wrkLast->pNextWrk = pThis;
+		wrtPool.wrkLast = pThis;
+		pThis->wrkState = STRM_WRK_QUEUED;
+		pthread_cond_signal(&wrtPool.workAvail);
+		break;
+	case STRM_WRK_BUSY:
+		pThis->wrkState = STRM_WRK_BUSY_REQUEUE;
+		break;
+	default: /* already scheduled, nothing to do */
+		break;
+	}
+}
+
+
+/* schedule writing of the stream's pending buffers. As everything is
+ * written now, a pending flush timer is no longer needed.
+ * Must be called with the stream mutex locked.
+ */
+static void
+asyncWrtEnqueue(strm_t *const pThis)
+{
+	d_pthread_mutex_lock(&wrtPool.mut);
+	asyncWrtDisarmTimerLocked(pThis);
+	asyncWrtEnqueueLocked(pThis);
+	d_pthread_mutex_unlock(&wrtPool.mut);
+}
+
+
+/* arm the flush timer for a partially filled buffer. When it expires,
+ * a writer will flush the buffer. With a flush interval of zero, the
+ * buffer is flushed right away.
+ * Must be called with the stream mutex locked.
+ */
+static void
+asyncWrtArmTimer(strm_t *const pThis)
+{
+	d_pthread_mutex_lock(&wrtPool.mut);
+	if(pThis->iFlushInterval == 0) {
+		pThis->bFlushReq = 1;
+		asyncWrtEnqueueLocked(pThis);
+	} else if(pThis->ttFlushDeadline == 0) {
+		pThis->ttFlushDeadline = time(NULL) + pThis->iFlushInterval;
+		pThis->pPrevTmr = NULL;
+		pThis->pNextTmr = wrtPool.tmrRoot;
+		if(wrtPool.tmrRoot != NULL)
+			wrtPool.tmrRoot->pPrevTmr = pThis;
+		wrtPool.tmrRoot = pThis;
+		if(wrtPool.nTimers++ == 0 || pThis->ttFlushDeadline < wrtPool.ttNextTimer) {
+			/* a writer must wake up earlier than planned */
+			wrtPool.ttNextTimer = pThis->ttFlushDeadline;
+			pthread_cond_signal(&wrtPool.workAvail);
+		}
+	}
+	d_pthread_mutex_unlock(&wrtPool.mut);
+}
+
+
+/* queue all streams whose flush timer expired and compute when the
+ * next one expires. The pool mutex must be locked.
+ */
+static void
+asyncWrtCheckTimers(const time_t ttNow)
+{
+	strm_t *pStrm;
+	strm_t *pNext;
+
+	wrtPool.ttNextTimer = 0;
+	for(pStrm = wrtPool.tmrRoot ; pStrm != NULL ; pStrm = pNext) {
+		pNext = pStrm->pNextTmr;
+		if(pStrm->ttFlushDeadline <= ttNow) {
+			DBGOPRINT((obj_t*) pStrm, "file %d(%s) flush interval expired\n",
+				  pStrm->fd, getFileDebugName(pStrm));
+			asyncWrtDisarmTimerLocked(pStrm);
+			pStrm->bFlushReq = 1;
+			asyncWrtEnqueueLocked(pStrm);
+		} else if(wrtPool.ttNextTimer == 0 || pStrm->ttFlushDeadline < wrtPool.ttNextTimer) {
+			wrtPool.ttNextTimer = pStrm->ttFlushDeadline;
+		}
+	}
+}
+
+
+/* write out everything that is pending for a stream. Called by a pool
+ * writer, which has exclusive ownership of the stream's writer side.
+ */
+static void
+asyncWrtService(strm_t *const pThis, sbool bFlushReq)
+{
+	int iDeq;
+	int bFlush;
+
+	d_pthread_mutex_lock(&pThis->mut);
+	while(1) { /* loop broken inside */
+		while(pThis->iCnt > 0) {
+			iDeq = pThis->iDeq++ % STREAM_ASYNC_NUMBUFS;
+			bFlush = pThis->bFlushNow;
+			pThis->bFlushNow = 0;
+
+			/* now we can do the actual write in parallel */
+			d_pthread_mutex_unlock(&pThis->mut);
+			doWriteInternal(pThis, pThis->asyncBuf[iDeq].pBuf, pThis->asyncBuf[iDeq].lenBuf, bFlush);
+			// TODO: error check????? 2009-07-06
+			d_pthread_mutex_lock(&pThis->mut);
+
+			--pThis->iCnt;
+			pthread_cond_signal(&pThis->notFull);
+			if(pThis->iCnt == 0)
+				pthread_cond_broadcast(&pThis->isEmpty);
+		}
+		if(!bFlushReq)
+			break;
+		/* flush interval expired: push out the partial buffer. This must
+		 * only be done when no buffer is in flight, as it may otherwise
+		 * block waiting for ourselves.
+		 */
+		bFlushReq = 0;
+		if(pThis->iBufPtr > 0) {
+			strmFlushInternal(pThis, 1);
+		} else {
+			pThis->bDoTimedWait = 0;
+		}
+	}
+	d_pthread_mutex_unlock(&pThis->mut);
+}
+
+
+/* This is a writer thread of the async writer pool. Threads terminate
+ * when the pool generation they were started for has ended.
  */
 static void*
 asyncWriterThread(void *pPtr)
 {
-	int iDeq;
+	const unsigned myGen = (unsigned) (uintptr_t) pPtr;
+	strm_t *pThis;
+	sbool bFlushReq;
+	time_t ttNow;
 	struct timespec t;
-	sbool bTimedOut = 0;
-	strm_t *pThis = (strm_t*) pPtr;
-	int err;
-	uchar thrdName[256] = "rs:";
-	ISOBJ_TYPE_assert(pThis, strm);
 
 	BEGINfunc
-	ustrncpy(thrdName+3, pThis->pszFName, sizeof(thrdName)-4);
-	dbgOutputTID((char*)thrdName);
+	dbgOutputTID((char*)"rs:strm writer");
 #	if defined(HAVE_PRCTL) && defined(PR_SET_NAME)
-	if(prctl(PR_SET_NAME, (char*)thrdName, 0, 0, 0) != 0) {
+	if(prctl(PR_SET_NAME, "rs:strm writer", 0, 0, 0) != 0) {
 		DBGPRINTF("prctl failed, not setting thread name for '%s'\n", "stream writer");
 	}
 #	endif
 
-	d_pthread_mutex_lock(&pThis->mut);
-	while(1) { /* loop broken inside */
-		while(pThis->iCnt == 0) {
-			DBGOPRINT((obj_t*) pThis, "file %d(%s) asyncWriterThread new iteration, "
-				  "iCnt %d, bTimedOut %d, iFlushInterval %d\n", pThis->fd,
-				  getFileDebugName(pThis),
-				  pThis->iCnt, bTimedOut, pThis->iFlushInterval);
-			if(pThis->bStopWriter) {
-				pthread_cond_broadcast(&pThis->isEmpty);
-				d_pthread_mutex_unlock(&pThis->mut);
-				goto finalize_it; /* break main loop */
-			}
-			if(bTimedOut && pThis->iBufPtr > 0) {
-				/* if we timed out, we need to flush pending data */
-				d_pthread_mutex_unlock(&pThis->mut);
-				strmFlushInternal(pThis, 1);
-				bTimedOut = 0;
-				d_pthread_mutex_lock(&pThis->mut); 
-				continue;
-			}
-			bTimedOut = 0;
-			if(pThis->bDoTimedWait) {
-				timeoutComp(&t, pThis->iFlushInterval * 1000); /* 1000 *millisconds* */
-				if((err = pthread_cond_timedwait(&pThis->notEmpty, &pThis->mut, &t)) != 0) {
-					DBGOPRINT((obj_t*) pThis, "file %d(%s) asyncWriterThread timed out\n",
-						  pThis->fd, getFileDebugName(pThis));
-					bTimedOut = 1; /* simulate in any case */
-					if(err != ETIMEDOUT) {
-						char errStr[1024];
-						rs_strerror_r(err, errStr, sizeof(errStr));
-						DBGPRINTF("stream async writer timeout with error (%d): %s - ignoring\n",
-							   err, errStr);
-					}
-				}
+	d_pthread_mutex_lock(&wrtPool.mut);
+	while(wrtPool.gen == myGen) {
+		if(wrtPool.nTimers > 0) {
+			ttNow = time(NULL);
+			if(ttNow >= wrtPool.ttNextTimer)
+				asyncWrtCheckTimers(ttNow);
+		}
+
+		if(wrtPool.wrkRoot == NULL) {
+			if(wrtPool.nTimers > 0) {
+				t.tv_sec = wrtPool.ttNextTimer;
+				t.tv_nsec = 0;
+				pthread_cond_timedwait(&wrtPool.workAvail, &wrtPool.mut, &t);
 			} else {
-				d_pthread_cond_wait(&pThis->notEmpty, &pThis->mut);
+				d_pthread_cond_wait(&wrtPool.workAvail, &wrtPool.mut);
 			}
+			continue;
 		}
 
-		DBGOPRINT((obj_t*) pThis, "file %d(%s) asyncWriterThread awoken, "
-			  "iCnt %d, bTimedOut %d\n", pThis->fd, getFileDebugName(pThis),
-			  pThis->iCnt, bTimedOut);
-		bTimedOut = 0; /* we may have timed out, but there *is* work to do... */
+		pThis = wrtPool.wrkRoot;
+		if((wrtPool.wrkRoot = pThis->pNextWrk) == NULL)
+			wrtPool.wrkLast = NULL;
+		pThis->wrkState = STRM_WRK_BUSY;
+		bFlushReq = pThis->bFlushReq;
+		pThis->bFlushReq = 0;
+		d_pthread_mutex_unlock(&wrtPool.mut);
 
-		iDeq = pThis->iDeq++ % STREAM_ASYNC_NUMBUFS;
-		const int bFlush = (pThis->bFlushNow || bTimedOut) ? 1 : 0;
-		pThis->bFlushNow = 0;
+		asyncWrtService(pThis, bFlushReq);
 
-		/* now we can do the actual write in parallel */
-		d_pthread_mutex_unlock(&pThis->mut);
-		doWriteInternal(pThis, pThis->asyncBuf[iDeq].pBuf, pThis->asyncBuf[iDeq].lenBuf, bFlush);
-		// TODO: error check????? 2009-07-06
-		d_pthread_mutex_lock(&pThis->mut);
-
-		--pThis->iCnt;
-		if(pThis->iCnt < STREAM_ASYNC_NUMBUFS) {
-			pthread_cond_signal(&pThis->notFull);
-			if(pThis->iCnt == 0)
-				pthread_cond_broadcast(&pThis->isEmpty);
+		d_pthread_mutex_lock(&wrtPool.mut);
+		if(pThis->wrkState == STRM_WRK_BUSY_REQUEUE) {
+			pThis->wrkState = STRM_WRK_IDLE;
+			asyncWrtEnqueueLocked(pThis);
+		} else {
+			pThis->wrkState = STRM_WRK_IDLE;
 		}
+		pthread_cond_broadcast(&wrtPool.wrkDone);
 	}
-	/* Not reached */	
+	d_pthread_mutex_unlock(&wrtPool.mut);
 
-finalize_it:
 	ENDfunc
 	return NULL; /* to keep pthreads happy */
 }
 
 
+/* add an async stream to the writer pool. Starts an additional writer
+ * thread if we have less writers than streams and the configured
+ * maximum is not yet reached.
+ */
+static rsRetVal
+asyncWrtRegister(strm_t *const pThis)
+{
+	pthread_t *tids;
+	DEFiRet;
+
+	d_pthread_mutex_lock(&wrtPool.mut);
+	pThis->wrkState = STRM_WRK_IDLE;
+	++wrtPool.nStreams;
+	if(wrtPool.nThreads < wrtPool.nStreams && wrtPool.nThreads < glblAsyncWriterThreads) {
+		if(wrtPool.nThreads == wrtPool.nMaxThreads) {
+			CHKmalloc(tids = realloc(wrtPool.tids, glblAsyncWriterThreads * sizeof(pthread_t)));
+			wrtPool.tids = tids;
+			wrtPool.nMaxThreads = glblAsyncWriterThreads;
+		}
+		if(pthread_create(&wrtPool.tids[wrtPool.nThreads], &default_thread_attr,
+				  asyncWriterThread, (void*) (uintptr_t) wrtPool.gen) == 0) {
+			++wrtPool.nThreads;
+			DBGPRINTF("stream writer pool: started writer %d for %d streams\n",
+				  wrtPool.nThreads, wrtPool.nStreams);
+		} else {
+			DBGPRINTF("ERROR: stream writer pool could not create writer thread\n");
+		}
+	}
+	/* we can live with less writers than desired, but not without any */
+	if(wrtPool.nThreads == 0)
+		ABORT_FINALIZE(RS_RET_ERR);
+
+finalize_it:
+	d_pthread_mutex_unlock(&wrtPool.mut);
+	RETiRet;
+}
+
+
+/* remove an async stream from the writer pool. Waits until no writer is
+ * busy with it any longer. When the last stream is removed, the writer
+ * threads are terminated.
+ * Must be called with the stream mutex UNlocked and all data written.
+ */
+static void
+asyncWrtUnregister(strm_t *const pThis)
+{
+	strm_t *pStrm;
+	strm_t *pPrev;
+	pthread_t *tids = NULL;
+	int nThreads = 0;
+	int i;
+
+	d_pthread_mutex_lock(&wrtPool.mut);
+	while(pThis->wrkState == STRM_WRK_BUSY || pThis->wrkState == STRM_WRK_BUSY_REQUEUE)
+		d_pthread_cond_wait(&wrtPool.wrkDone, &wrtPool.mut);
+	if(pThis->wrkState == STRM_WRK_QUEUED) {
+		for(pPrev = NULL, pStrm = wrtPool.wrkRoot ; pStrm != pThis ;
+		    pPrev = pStrm, pStrm = pStrm->pNextWrk)
+			/* just search */;
+		if(pPrev == NULL)
+			wrtPool.wrkRoot = pThis->pNextWrk;
+		else
+			pPrev->pNextWrk = pThis->pNextWrk;
+		if(wrtPool.wrkLast == pThis)
+			wrtPool.wrkLast = pPrev;
+	}
+	asyncWrtDisarmTimerLocked(pThis);
+	pThis->wrkState = STRM_WRK_IDLE;
+
+	if(--wrtPool.nStreams == 0 && wrtPool.nThreads > 0) {
+		/* end this generation of writers; new streams will start new ones */
+		++wrtPool.gen;
+		tids = wrtPool.tids;
+		nThreads = wrtPool.nThreads;
+		wrtPool.tids = NULL;
+		wrtPool.nThreads = wrtPool.nMaxThreads = 0;
+		pthread_cond_broadcast(&wrtPool.workAvail);
+	}
+	d_pthread_mutex_unlock(&wrtPool.mut);
+
+	for(i = 0 ; i < nThreads ; ++i)
+		pthread_join(tids[i], NULL);
+	free(tids);
+}
+
 /* sync the file to disk, so that any unwritten data is persisted. This
  * also syncs the directory and thus makes sure that the file survives
  * fatal failure. Note that we do NOT return an error status if the
@@ -1844,12 +2095,12 @@ strmWrite(strm_t *__restrict__ const pThis, const uchar *__restrict__ const pBuf
 
 finalize_it:
 	if(pThis->bAsyncWrite) {
-		if(pThis->bDoTimedWait == 0) {
-			/* we potentially have a partial buffer, so re-activate the
-			 * writer thread that it can set and pick up timeouts.
+		if(pThis->bDoTimedWait == 0 && pThis->iBufPtr > 0) {
+			/* we have a partial buffer, so make sure it is
+			 * written when the flush interval expires.
 			 */
 			pThis->bDoTimedWait = 1;
-			pthread_cond_signal(&pThis->notEmpty);
+			asyncWrtArmTimer(pThis);
 		}
 		d_pthread_mutex_unlock(&pThis->mut);
 	}
@@ -2252,6 +2503,11 @@ BEGINObjClassInit(strm, 1, OBJ_IS_CORE_MODULE)
 	OBJSetMethodHandler(objMethod_SERIALIZE, strmSerialize);
 	OBJSetMethodHandler(objMethod_SETPROPERTY, strmSetProperty);
 	OBJSetMethodHandler(objMethod_CONSTRUCTION_FINALIZER, strmConstructFinalize);
+
+	/* writer pool threads are only started when async streams exist */
+	pthread_mutex_init(&wrtPool.mut, NULL);
+	pthread_cond_init(&wrtPool.workAvail, NULL);
+	pthread_cond_init(&wrtPool.wrkDone, NULL);
 ENDObjClassInit(strm)
 
 /* vi:set ai:
@@ -128,15 +128,13 @@ typedef struct strm_s {
 	Bytef *pZipBuf;
 	/* support for async flush procesing */
 	sbool bAsyncWrite;	/* do asynchronous writes (always if a flush interval is given) */
-	sbool bStopWriter;	/* shall writer thread terminate? */
-	sbool bDoTimedWait;	/* instruct writer thread to do a times wait to support flush timeouts */
+	sbool bDoTimedWait;	/* flush timer is armed for a partial buffer */
 	sbool bzInitDone;	/* did we do an init of zstrm already? */
 	sbool bFlushNow;	/* shall we flush with the next async write? */
 	sbool bVeryReliableZip; /* shall we write interim headers to create a very reliable ZIP file? */
 	int iFlushInterval; /* flush in which interval - 0, no flushing */
 	pthread_mutex_t mut;/* mutex for flush in async mode */
 	pthread_cond_t notFull;
-	pthread_cond_t notEmpty;
 	pthread_cond_t isEmpty;
 	unsigned short iEnq;	/* this MUST be unsigned as we use module arithmetic (else invalid indexing happens!) */
 	unsigned short iDeq;	/* this MUST be unsigned as we use module arithmetic (else invalid indexing happens!) */
@@ -149,7 +147,12 @@ typedef struct strm_s {
 		uchar *pBuf;
 		size_t lenBuf;
 	} asyncBuf[STREAM_ASYNC_NUMBUFS];
-	pthread_t writerThreadID;
+	/* writer pool state, protected by the pool mutex (NOT by mut!) */
+	struct strm_s *pNextWrk;	/* next stream in writer pool work queue */
+	struct strm_s *pPrevTmr, *pNextTmr; /* list of streams with armed flush timer */
+	time_t ttFlushDeadline;	/* when to flush a partial buffer, 0 - timer not armed */
+	sbool bFlushReq;	/* writer shall flush partial buffer */
+	uint8_t wrkState;	/* STRM_WRK_* */
 	/* support for omfile size-limiting commands, special counters, NOT persisted! */
 	off_t	iSizeLimit;	/* file size limit, 0 = no limit */
 	uchar	*pszSizeLimitCmd;	/* command to carry out when size limit is reached */
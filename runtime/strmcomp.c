@@ -0,0 +1,640 @@
+/* strmcomp.c
+ * Stream compression codec helper. This wraps zlib, zstd and lz4
+ * streaming (de)compression behind a single interface, so that
+ * omfwd and imptcp can handle all codecs with the same code.
+ *
+ * Output is handed to a caller-provided callback in chunks of at
+ * most the size of the internal buffer, which is allocated once per
+ * stream. This keeps large buffers off the stack and avoids per-call
+ * mallocs.
+ *
+ * In decompression mode, the codec can be auto-detected by looking
+ * at the first bytes of the stream: zstd and lz4 frames start with a
+ * well-known magic number, everything else is treated as zlib, which
+ * is what older senders emit. That way a receiver accepts all codecs
+ * without any protocol change and stays compatible with senders that
+ * do not know about codec selection.
+ *
+ * Copyright 2026 Adiscon GmbH.
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_LIBLZ4
+#include <lz4frame.h>
+#endif
+
+#include "rsyslog.h"
+#include "strmcomp.h"
+
+#define STRMCOMP_BUFSIZE (64*1024)	/* size of output buffer */
+#define STRMCOMP_MAGIC_LEN 4		/* bytes needed to detect codec */
+#define STRMCOMP_MAX_DICT (10*1024*1024) /* sanity limit for dictionary files */
+#ifdef HAVE_LIBLZ4
+#define LZ4_CHUNK (16*1024)		/* max input handed to LZ4F_compressUpdate() */
+#define LZ4_HDR_MAX 19			/* LZ4F_HEADER_SIZE_MAX, not present in older lz4 */
+#endif
+
+static const uchar zstdMagic[STRMCOMP_MAGIC_LEN] = { 0x28, 0xb5, 0x2f, 0xfd };
+static const uchar lz4Magic[STRMCOMP_MAGIC_LEN] = { 0x04, 0x22, 0x4d, 0x18 };
+
+struct strmcomp_s {
+	int codec;
+	sbool bDecompress;
+	sbool bInitDone;	/* codec state initialized? */
+	int level;
+	uchar *dict;		/* dictionary (zstd only), not owned by us */
+	size_t lenDict;
+	uchar *outBuf;
+	size_t lenOutBuf;
+	uchar magic[STRMCOMP_MAGIC_LEN]; /* initial bytes for codec detection */
+	unsigned lenMagic;
+	sbool bFrameStarted;	/* lz4 compression: frame header emitted? */
+	z_stream zstrm;
+#	ifdef HAVE_LIBZSTD
+	ZSTD_CCtx *zstdC;
+	ZSTD_DCtx *zstdD;
+#	endif
+#	ifdef HAVE_LIBLZ4
+	LZ4F_compressionContext_t lz4C;
+	LZ4F_decompressionContext_t lz4D;
+	LZ4F_preferences_t lz4Prefs;
+#	endif
+};
+
+
+/* codec names as used in config parameters */
+const char *
+strmcompCodecName(int codec)
+{
+	switch(codec) {
+	case STRMCOMP_ZLIB:
+		return "zlib";
+	case STRMCOMP_ZSTD:
+		return "zstd";
+	case STRMCOMP_LZ4:
+		return "lz4";
+	case STRMCOMP_AUTO:
+		return "auto";
+	default:
+		return "invalid";
+	}
+}
+
+/* returns codec ID or -1 if the name is not known */
+int
+strmcompCodecFromName(const char *name)
+{
+	if(!strcasecmp(name, "zlib"))
+		return STRMCOMP_ZLIB;
+	else if(!strcasecmp(name, "zstd"))
+		return STRMCOMP_ZSTD;
+	else if(!strcasecmp(name, "lz4"))
+		return STRMCOMP_LZ4;
+	else if(!strcasecmp(name, "auto"))
+		return STRMCOMP_AUTO;
+	return -1;
+}
+
+/* check if support for the codec was compiled in */
+sbool
+strmcompCodecAvailable(int codec)
+{
+	switch(codec) {
+	case STRMCOMP_ZLIB:
+	case STRMCOMP_AUTO:
+		return RSTRUE;
+	case STRMCOMP_ZSTD:
+#		ifdef HAVE_LIBZSTD
+		return RSTRUE;
+#		else
+		return RSFALSE;
+#		endif
+	case STRMCOMP_LZ4:
+#		ifdef HAVE_LIBLZ4
+		return RSTRUE;
+#		else
+		return RSFALSE;
+#		endif
+	default:
+		return RSFALSE;
+	}
+}
+
+/* default compression level for each codec. zlib keeps the level
+ * omfwd always used for stream compression.
+ */
+int
+strmcompDfltLevel(int codec)
+{
+	switch(codec) {
+	case STRMCOMP_ZSTD:
+		return 3;
+	case STRMCOMP_LZ4:
+		return 0;
+	default:
+		return 9;
+	}
+}
+
+int
+strmcompGetCodec(strmcomp_t *pThis)
+{
+	return pThis->codec;
+}
+
+
+/* read a dictionary file into memory. The caller must free the
+ * buffer.
+ */
+rsRetVal
+strmcompLoadDict(const char *fileName, uchar **ppDict, size_t *pLenDict)
+{
+	int fd = -1;
+	struct stat sb;
+	uchar *dict = NULL;
+	size_t offs;
+	ssize_t nRead;
+	DEFiRet;
+
+	if((fd = open(fileName, O_RDONLY|O_CLOEXEC)) == -1) {
+		ABORT_FINALIZE(RS_RET_FILE_OPEN_ERROR);
+	}
+	if(fstat(fd, &sb) == -1 || sb.st_size == 0 || sb.st_size > STRMCOMP_MAX_DICT) {
+		ABORT_FINALIZE(RS_RET_INVALID_VALUE);
+	}
+	CHKmalloc(dict = malloc(sb.st_size));
+	for(offs = 0 ; offs < (size_t) sb.st_size ; offs += nRead) {
+		nRead = read(fd, dict + offs, sb.st_size - offs);
+		if(nRead <= 0) {
+			if(nRead == -1 && errno == EINTR) {
+				nRead = 0;
+				continue;
+			}
+			ABORT_FINALIZE(RS_RET_IO_ERROR);
+		}
+	}
+	*ppDict = dict;
+	*pLenDict = sb.st_size;
+	dict = NULL;
+
+finalize_it:
+	if(fd != -1)
+		close(fd);
+	free(dict);
+	RETiRet;
+}
+
+
+/* initialize codec state. For auto-detection, this is done when the
+ * codec is known.
+ */
+static rsRetVal
+initCodec(strmcomp_t *pThis)
+{
+	int zRet;
+	DEFiRet;
+
+	switch(pThis->codec) {
+	case STRMCOMP_ZLIB:
+		pThis->zstrm.zalloc = Z_NULL;
+		pThis->zstrm.zfree = Z_NULL;
+		pThis->zstrm.opaque = Z_NULL;
+		if(pThis->bDecompress) {
+			pThis->zstrm.next_in = Z_NULL;
+			pThis->zstrm.avail_in = 0;
+			zRet = inflateInit(&pThis->zstrm);
+		} else {
+			zRet = deflateInit(&pThis->zstrm, pThis->level);
+		}
+		if(zRet != Z_OK) {
+			DBGPRINTF("strmcomp: error %d returned from zlib init\n", zRet);
+			ABORT_FINALIZE(RS_RET_ZLIB_ERR);
+		}
+		break;
+#	ifdef HAVE_LIBZSTD
+	case STRMCOMP_ZSTD:
+	{
+		size_t zstdRet = 0;
+		if(pThis->bDecompress) {
+			CHKmalloc(pThis->zstdD = ZSTD_createDCtx());
+			if(pThis->dict != NULL)
+				zstdRet = ZSTD_DCtx_loadDictionary(pThis->zstdD, pThis->dict, pThis->lenDict);
+		} else {
+			CHKmalloc(pThis->zstdC = ZSTD_createCCtx());
+			zstdRet = ZSTD_CCtx_setParameter(pThis->zstdC, ZSTD_c_compressionLevel,
+					pThis->level);
+			if(!ZSTD_isError(zstdRet) && pThis->dict != NULL)
+				zstdRet = ZSTD_CCtx_loadDictionary(pThis->zstdC, pThis->dict, pThis->lenDict);
+		}
+		if(ZSTD_isError(zstdRet)) {
+			DBGPRINTF("strmcomp: zstd init error: %s\n", ZSTD_getErrorName(zstdRet));
+			ABORT_FINALIZE(RS_RET_ZSTD_ERR);
+		}
+		break;
+	}
+#	endif
+#	ifdef HAVE_LIBLZ4
+	case STRMCOMP_LZ4:
+	{
+		LZ4F_errorCode_t lz4Ret;
+		if(pThis->bDecompress) {
+			lz4Ret = LZ4F_createDecompressionContext(&pThis->lz4D, LZ4F_VERSION);
+		} else {
+			memset(&pThis->lz4Prefs, 0, sizeof(pThis->lz4Prefs));
+			pThis->lz4Prefs.compressionLevel = pThis->level;
+			lz4Ret = LZ4F_createCompressionContext(&pThis->lz4C, LZ4F_VERSION);
+		}
+		if(LZ4F_isError(lz4Ret)) {
+			DBGPRINTF("strmcomp: lz4 init error: %s\n", LZ4F_getErrorName(lz4Ret));
+			ABORT_FINALIZE(RS_RET_LZ4_ERR);
+		}
+		if(!pThis->bDecompress) {
+			/* compressUpdate() requires room for the worst case */
+			pThis->lenOutBuf = LZ4F_compressBound(LZ4_CHUNK, &pThis->lz4Prefs) + LZ4_HDR_MAX;
+			if(pThis->lenOutBuf < STRMCOMP_BUFSIZE)
+				pThis->lenOutBuf = STRMCOMP_BUFSIZE;
+		}
+		break;
+	}
+#	endif
+	default:
+		ABORT_FINALIZE(RS_RET_CODEC_NOT_AVAILABLE);
+	}
+
+	CHKmalloc(pThis->outBuf = malloc(pThis->lenOutBuf));
+	pThis->bInitDone = RSTRUE;
+
+finalize_it:
+	RETiRet;
+}
+
+
+rsRetVal
+strmcompConstruct(strmcomp_t **ppThis, int codec, sbool bDecompress, int level,
+	uchar *dict, size_t lenDict)
+{
+	strmcomp_t *pThis = NULL;
+	DEFiRet;
+
+	if(!strmcompCodecAvailable(codec) || (codec == STRMCOMP_AUTO && !bDecompress)) {
+		ABORT_FINALIZE(RS_RET_CODEC_NOT_AVAILABLE);
+	}
+
+	CHKmalloc(pThis = calloc(1, sizeof(strmcomp_t)));
+	pThis->codec = codec;
+	pThis->bDecompress = bDecompress;
+	pThis->level = level;
+	pThis->dict = dict;
+	pThis->lenDict = lenDict;
+	pThis->lenOutBuf = STRMCOMP_BUFSIZE;
+
+	if(codec != STRMCOMP_AUTO)
+		CHKiRet(initCodec(pThis));
+	*ppThis = pThis;
+
+finalize_it:
+	if(iRet != RS_RET_OK && pThis != NULL) {
+		strmcompDestruct(&pThis);
+	}
+	RETiRet;
+}
+
+
+rsRetVal
+strmcompDestruct(strmcomp_t **ppThis)
+{
+	strmcomp_t *pThis = *ppThis;
+	DEFiRet;
+
+	if(pThis->bInitDone && pThis->codec == STRMCOMP_ZLIB) {
+		if(pThis->bDecompress)
+			inflateEnd(&pThis->zstrm);
+		else
+			deflateEnd(&pThis->zstrm);
+	}
+#	ifdef HAVE_LIBZSTD
+	if(pThis->zstdC != NULL)
+		ZSTD_freeCCtx(pThis->zstdC);
+	if(pThis->zstdD != NULL)
+		ZSTD_freeDCtx(pThis->zstdD);
+#	endif
+#	ifdef HAVE_LIBLZ4
+	if(pThis->lz4C != NULL)
+		LZ4F_freeCompressionContext(pThis->lz4C);
+	if(pThis->lz4D != NULL)
+		LZ4F_freeDecompressionContext(pThis->lz4D);
+#	endif
+	free(pThis->outBuf);
+	free(pThis);
+	*ppThis = NULL;
+	RETiRet;
+}
+
+
+static rsRetVal
+processZlib(strmcomp_t *pThis, uchar *buf, size_t len, int op,
+	strmcompOutFunc_t outFunc, void *usrptr)
+{
+	int zRet;
+	int zOp;
+	size_t outavail;
+	DEFiRet;
+
+	pThis->zstrm.next_in = (Bytef*) buf;
+	pThis->zstrm.avail_in = len;
+	if(pThis->bDecompress) {
+		zOp = (op == STRMCOMP_FINISH) ? Z_FINISH : Z_SYNC_FLUSH;
+	} else {
+		if(op == STRMCOMP_FINISH)
+			zOp = Z_FINISH;
+		else if(op == STRMCOMP_FLUSH)
+			zOp = Z_SYNC_FLUSH;
+		else
+			zOp = Z_NO_FLUSH;
+	}
+	/* run the codec on buffer until everything has been processed */
+	do {
+		pThis->zstrm.avail_out = pThis->lenOutBuf;
+		pThis->zstrm.next_out = pThis->outBuf;
+		if(pThis->bDecompress)
+			zRet = inflate(&pThis->zstrm, zOp);
+		else
+			zRet = deflate(&pThis->zstrm, zOp);
+		if(zRet == Z_STREAM_ERROR || zRet == Z_DATA_ERROR || zRet == Z_MEM_ERROR
+		   || zRet == Z_NEED_DICT) {
+			DBGPRINTF("strmcomp: zlib error %d, avail_in %u\n", zRet,
+				pThis->zstrm.avail_in);
+			ABORT_FINALIZE(RS_RET_ZLIB_ERR);
+		}
+		outavail = pThis->lenOutBuf - pThis->zstrm.avail_out;
+		if(outavail != 0) {
+			CHKiRet(outFunc(usrptr, pThis->outBuf, outavail));
+		}
+	} while (pThis->zstrm.avail_out == 0);
+
+finalize_it:
+	RETiRet;
+}
+
+
+#ifdef HAVE_LIBZSTD
+static rsRetVal
+processZstd(strmcomp_t *pThis, uchar *buf, size_t len, int op,
+	strmcompOutFunc_t outFunc, void *usrptr)
+{
+	ZSTD_inBuffer in;
+	ZSTD_outBuffer out;
+	ZSTD_EndDirective mode;
+	size_t zstdRet;
+	sbool bDone;
+	DEFiRet;
+
+	in.src = buf;
+	in.size = len;
+	in.pos = 0;
+	if(op == STRMCOMP_FINISH)
+		mode = ZSTD_e_end;
+	else if(op == STRMCOMP_FLUSH)
+		mode = ZSTD_e_flush;
+	else
+		mode = ZSTD_e_continue;
+
+	do {
+		out.dst = pThis->outBuf;
+		out.size = pThis->lenOutBuf;
+		out.pos = 0;
+		if(pThis->bDecompress) {
+			zstdRet = ZSTD_decompressStream(pThis->zstdD, &out, &in);
+			/* output buffer full means there may be more buffered */
+			bDone = (in.pos == in.size && out.pos < out.size);
+		} else {
+			zstdRet = ZSTD_compressStream2(pThis->zstdC, &out, &in, mode);
+			/* for flush/end, zstdRet is the number of bytes still to emit */
+			bDone = (mode == ZSTD_e_continue) ? (in.pos == in.size) : (zstdRet == 0);
+		}
+		if(ZSTD_isError(zstdRet)) {
+			DBGPRINTF("strmcomp: zstd error: %s\n", ZSTD_getErrorName(zstdRet));
+			ABORT_FINALIZE(RS_RET_ZSTD_ERR);
+		}
+		if(out.pos != 0) {
+			CHKiRet(outFunc(usrptr, pThis->outBuf, out.pos));
+		}
+	} while(!bDone);
+
+finalize_it:
+	RETiRet;
+}
+#endif
+
+
+#ifdef HAVE_LIBLZ4
+static rsRetVal
+processLz4Compress(strmcomp_t *pThis, uchar *buf, size_t len, int op,
+	strmcompOutFunc_t outFunc, void *usrptr)
+{
+	size_t lz4Ret;
+	size_t lenChunk;
+	DEFiRet;
+
+	if(!pThis->bFrameStarted) {
+		lz4Ret = LZ4F_compressBegin(pThis->lz4C, pThis->outBuf, pThis->lenOutBuf,
+				&pThis->lz4Prefs);
+		if(LZ4F_isError(lz4Ret)) {
+			DBGPRINTF("strmcomp: lz4 error: %s\n", LZ4F_getErrorName(lz4Ret));
+			ABORT_FINALIZE(RS_RET_LZ4_ERR);
+		}
+		CHKiRet(outFunc(usrptr, pThis->outBuf, lz4Ret));
+		pThis->bFrameStarted = RSTRUE;
+	}
+
+	while(len > 0) {
+		lenChunk = (len > LZ4_CHUNK) ? LZ4_CHUNK : len;
+		lz4Ret = LZ4F_compressUpdate(pThis->lz4C, pThis->outBuf, pThis->lenOutBuf,
+				buf, lenChunk, NULL);
+		if(LZ4F_isError(lz4Ret)) {
+			DBGPRINTF("strmcomp: lz4 error: %s\n", LZ4F_getErrorName(lz4Ret));
+			ABORT_FINALIZE(RS_RET_LZ4_ERR);
+		}
+		if(lz4Ret != 0) {
+			CHKiRet(outFunc(usrptr, pThis->outBuf, lz4Ret));
+		}
+		buf += lenChunk;
+		len -= lenChunk;
+	}
+
+	if(op == STRMCOMP_NOFLUSH)
+		FINALIZE;
+	if(op == STRMCOMP_FINISH) {
+		lz4Ret = LZ4F_compressEnd(pThis->lz4C, pThis->outBuf, pThis->lenOutBuf, NULL);
+		pThis->bFrameStarted = RSFALSE;
+	} else
+		lz4Ret = LZ4F_flush(pThis->lz4C, pThis->outBuf, pThis->lenOutBuf, NULL);
+	if(LZ4F_isError(lz4Ret)) {
+		DBGPRINTF("strmcomp: lz4 error: %s\n", LZ4F_getErrorName(lz4Ret));
+		ABORT_FINALIZE(RS_RET_LZ4_ERR);
+	}
+	if(lz4Ret != 0) {
+		CHKiRet(outFunc(usrptr, pThis->outBuf, lz4Ret));
+	}
+
+finalize_it:
+	RETiRet;
+}
+
+static rsRetVal
+processLz4Decompress(strmcomp_t *pThis, uchar *buf, size_t len,
+	strmcompOutFunc_t outFunc, void *usrptr)
+{
+	size_t lenIn;
+	size_t lenOut;
+	size_t lz4Ret;
+	DEFiRet;
+
+	do {
+		lenIn = len;
+		lenOut = pThis->lenOutBuf;
+		lz4Ret = LZ4F_decompress(pThis->lz4D, pThis->outBuf, &lenOut, buf, &lenIn, NULL);
+		if(LZ4F_isError(lz4Ret)) {
+			DBGPRINTF("strmcomp: lz4 error: %s\n", LZ4F_getErrorName(lz4Ret));
+			ABORT_FINALIZE(RS_RET_LZ4_ERR);
+		}
+		if(lenOut != 0) {
+			CHKiRet(outFunc(usrptr, pThis->outBuf, lenOut));
+		}
+		buf += lenIn;
+		len -= lenIn;
+		/* a full output buffer means lz4 may still hold data */
+	} while(len > 0 || lenOut == pThis->lenOutBuf);
+
+finalize_it:
+	RETiRet;
+}
+#endif
+
+
+/* auto-detect codec from the initial bytes of the stream. Returns
+ * with *pbDetected == 0 if more data is needed; in that case all
+ * data has been consumed.
+ */
+static rsRetVal
+detectCodec(strmcomp_t *pThis, uchar **pBuf, size_t *pLen, sbool *pbDetected)
+{
+	size_t lenCopy;
+	DEFiRet;
+
+	lenCopy = STRMCOMP_MAGIC_LEN - pThis->lenMagic;
+	if(lenCopy > *pLen)
+		lenCopy = *pLen;
+	memcpy(pThis->magic + pThis->lenMagic, *pBuf, lenCopy);
+	pThis->lenMagic += lenCopy;
+	*pBuf += lenCopy;
+	*pLen -= lenCopy;
+
+	if(pThis->lenMagic < STRMCOMP_MAGIC_LEN) {
+		*pbDetected = 0;
+		FINALIZE;
+	}
+
+	if(!memcmp(pThis->magic, zstdMagic, STRMCOMP_MAGIC_LEN))
+		pThis->codec = STRMCOMP_ZSTD;
+	else if(!memcmp(pThis->magic, lz4Magic, STRMCOMP_MAGIC_LEN))
+		pThis->codec = STRMCOMP_LZ4;
+	else
+		pThis->codec = STRMCOMP_ZLIB;
+	DBGPRINTF("strmcomp: detected stream codec %s\n", strmcompCodecName(pThis->codec));
+	CHKiRet(initCodec(pThis));
+	*pbDetected = 1;
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* forward data to the codec-specific handler */
+static rsRetVal
+dispatch(strmcomp_t *pThis, uchar *buf, size_t len, int op,
+	strmcompOutFunc_t outFunc, void *usrptr)
+{
+	DEFiRet;
+
+	switch(pThis->codec) {
+	case STRMCOMP_ZLIB:
+		iRet = processZlib(pThis, buf, len, op, outFunc, usrptr);
+		break;
+#	ifdef HAVE_LIBZSTD
+	case STRMCOMP_ZSTD:
+		iRet = processZstd(pThis, buf, len, op, outFunc, usrptr);
+		break;
+#	endif
+#	ifdef HAVE_LIBLZ4
+	case STRMCOMP_LZ4:
+		if(pThis->bDecompress)
+			iRet = processLz4Decompress(pThis, buf, len, outFunc, usrptr);
+		else
+			iRet = processLz4Compress(pThis, buf, len, op, outFunc, usrptr);
+		break;
+#	endif
+	default:
+		iRet = RS_RET_CODEC_NOT_AVAILABLE;
+		break;
+	}
+	RETiRet;
+}
+
+
+/* (de)compress a buffer. All output generated is passed to outFunc,
+ * potentially in multiple calls. For compression, op specifies if the
+ * codec may keep data buffered (STRMCOMP_NOFLUSH), must emit all data
+ * so that the peer can decode it (STRMCOMP_FLUSH) or shall finish the
+ * stream (STRMCOMP_FINISH). For decompression, only STRMCOMP_FINISH
+ * makes a difference, and only for zlib.
+ */
+rsRetVal
+strmcompProcess(strmcomp_t *pThis, uchar *buf, size_t len, int op,
+	strmcompOutFunc_t outFunc, void *usrptr)
+{
+	sbool bDetected;
+	DEFiRet;
+
+	if(!pThis->bInitDone) {
+		/* auto-detection: magic bytes are sent through the codec, too */
+		CHKiRet(detectCodec(pThis, &buf, &len, &bDetected));
+		if(!bDetected)
+			FINALIZE;
+		CHKiRet(dispatch(pThis, pThis->magic, STRMCOMP_MAGIC_LEN, op, outFunc, usrptr));
+		if(len == 0)
+			FINALIZE;
+	}
+
+	CHKiRet(dispatch(pThis, buf, len, op, outFunc, usrptr));
+
+finalize_it:
+	RETiRet;
+}
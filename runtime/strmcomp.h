@@ -0,0 +1,58 @@
+/* Definitions for the stream compression codec helper.
+ *
+ * This provides a common interface to the different stream
+ * compression libraries (zlib, zstd, lz4) so that senders and
+ * receivers of compressed TCP streams do not need to care which
+ * codec is actually in use.
+ *
+ * Copyright 2026 Adiscon GmbH.
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef INCLUDED_STRMCOMP_H
+#define INCLUDED_STRMCOMP_H
+
+/* codec IDs */
+#define STRMCOMP_ZLIB 0
+#define STRMCOMP_ZSTD 1
+#define STRMCOMP_LZ4 2
+#define STRMCOMP_AUTO 255	/* decompression only: detect codec from stream */
+
+/* operations for strmcompProcess() */
+#define STRMCOMP_NOFLUSH 0	/* buffer as the codec sees fit */
+#define STRMCOMP_FLUSH 1	/* emit everything so that peer can decompress it */
+#define STRMCOMP_FINISH 2	/* end of stream, codec state is no longer usable */
+
+typedef struct strmcomp_s strmcomp_t;
+
+/* called for each chunk of (de)compressed data */
+typedef rsRetVal (*strmcompOutFunc_t)(void *usrptr, uchar *buf, size_t len);
+
+/* prototypes */
+rsRetVal strmcompConstruct(strmcomp_t **ppThis, int codec, sbool bDecompress, int level,
+	uchar *dict, size_t lenDict);
+rsRetVal strmcompDestruct(strmcomp_t **ppThis);
+rsRetVal strmcompProcess(strmcomp_t *pThis, uchar *buf, size_t len, int op,
+	strmcompOutFunc_t outFunc, void *usrptr);
+int strmcompGetCodec(strmcomp_t *pThis);
+int strmcompCodecFromName(const char *name);
+const char *strmcompCodecName(int codec);
+sbool strmcompCodecAvailable(int codec);
+int strmcompDfltLevel(int codec);
+rsRetVal strmcompLoadDict(const char *fileName, uchar **ppDict, size_t *pLenDict);
+
+#endif /* #ifndef INCLUDED_STRMCOMP_H */
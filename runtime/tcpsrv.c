@@ -51,6 +51,7 @@
 #include <netinet/in.h>
 #include <netdb.h>
 #include <pthread.h>
+#include <signal.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #if HAVE_FCNTL_H
@@ -74,6 +75,9 @@
 #include "ruleset.h"
 #include "ratelimit.h"
 #include "unicode-helper.h"
+#ifdef HAVE_SYS_PRCTL_H
+#  include <sys/prctl.h>
+#endif
 
 #pragma GCC diagnostic ignored "-Wswitch-enum"
 
@@ -101,15 +105,15 @@ DEFobjCurrIf(statsobj)
 
 static void startWorkerPool(void);
 
-/* The following structure controls the worker threads. Global data is
- * needed for their access.
+/* The following structure controls the worker threads used in select()
+ * mode. Global data is needed for their access. In epoll mode, each
+ * server has its own I/O threads (see tcpsrvIOThrd_t) instead.
  */
 static struct wrkrInfo_s {
 	pthread_t tid;	/* the worker's thread ID */
 	pthread_cond_t run;
 	int idx;
 	tcpsrv_t *pSrv; /* pSrv == NULL -> idle */
-	nspoll_t *pPoll;
 	void *pUsr;
 	sbool enabled;
 	long long unsigned numCalled;	/* how often was this called */
@@ -554,13 +558,14 @@ finalize_it:
 
 
 /* process a receive request on one of the streams
- * If pPoll is non-NULL, we have a netstream in epoll mode, which means we need
- * to remove any descriptor we close from the epoll set.
+ * If pIOThrd is non-NULL, we have a netstream in epoll mode, which means we need
+ * to remove any descriptor we close from the I/O thread's epoll set.
  * rgerhards, 2009-07-020
  */
 static rsRetVal
-doReceive(tcpsrv_t *pThis, tcps_sess_t **ppSess, nspoll_t *pPoll)
+doReceive(tcpsrv_t *pThis, tcps_sess_t **ppSess, tcpsrvIOThrd_t *const pIOThrd)
 {
+	nspoll_t *const pPoll = (pIOThrd == NULL) ? NULL : pIOThrd->pPoll;
 	char buf[128*1024]; /* reception buffer - may hold a partial or multiple messages */
 	ssize_t iRcvd;
 	rsRetVal localRet;
@@ -587,6 +592,8 @@ doReceive(tcpsrv_t *pThis, tcps_sess_t **ppSess, nspoll_t *pPoll)
 		break;
 	case RS_RET_OK:
 		/* valid data received, process it! */
+		if(pIOThrd != NULL)
+			STATSCOUNTER_ADD(pIOThrd->ctrBytesRcvd, pIOThrd->mutCtrBytesRcvd, iRcvd);
 		localRet = tcps_sess.DataRcvd(*ppSess, buf, iRcvd);
 		if(localRet != RS_RET_OK && localRet != RS_RET_QUEUE_FULL) {
 			/* in this case, something went awfully wrong.
@@ -611,10 +618,10 @@ finalize_it:
 	RETiRet;
 }
 
-/* process a single workset item
+/* process a single workset item (select mode)
  */
 static inline rsRetVal
-processWorksetItem(tcpsrv_t *pThis, nspoll_t *pPoll, int idx, void *pUsr)
+processWorksetItem(tcpsrv_t *pThis, int idx, void *pUsr)
 {
 	tcps_sess_t *pNewSess = NULL;
 	DEFiRet;
@@ -624,22 +631,18 @@ processWorksetItem(tcpsrv_t *pThis, nspoll_t *pPoll, int idx, void *pUsr)
 		DBGPRINTF("New connect on NSD %p.\n", pThis->ppLstn[idx]);
 		iRet = SessAccept(pThis, pThis->ppLstnPort[idx], &pNewSess, pThis->ppLstn[idx]);
 		if(iRet == RS_RET_OK) {
-			if(pPoll != NULL) {
-				CHKiRet(nspoll.Ctl(pPoll, pNewSess->pStrm, 0, pNewSess, NSDPOLL_IN, NSDPOLL_ADD));
-			}
 			DBGPRINTF("New session created with NSD %p.\n", pNewSess);
 		} else {
 			DBGPRINTF("tcpsrv: error %d during accept\n", iRet);
 		}
 	} else {
 		pNewSess = (tcps_sess_t*) pUsr;
-		doReceive(pThis, &pNewSess, pPoll);
-		if(pPoll == NULL && pNewSess == NULL) {
+		doReceive(pThis, &pNewSess, NULL);
+		if(pNewSess == NULL) {
 			pThis->pSessions[idx] = NULL;
 		}
 	}
 
-finalize_it:
 	RETiRet;
 }
 
@@ -663,7 +666,7 @@ wrkr(void *myself)
 		pthread_mutex_unlock(&wrkrMut);
 
 		++me->numCalled;
-		processWorksetItem(me->pSrv, me->pPoll, me->idx, me->pUsr);
+		processWorksetItem(me->pSrv, me->idx, me->pUsr);
 
 		pthread_mutex_lock(&wrkrMut);
 		me->pSrv = NULL;	/* indicate we are free again */
@@ -678,12 +681,11 @@ wrkr(void *myself)
 
 
 /* Process a workset, that is handle io. We become activated
- * from either select or epoll handler. We split the workload
- * out to a pool of threads, but try to avoid context switches
- * as much as possible.
+ * from the select handler. We split the workload out to a pool
+ * of threads, but try to avoid context switches as much as possible.
  */
 static rsRetVal
-processWorkset(tcpsrv_t *pThis, nspoll_t *pPoll, int numEntries, nsd_epworkset_t workset[])
+processWorkset(tcpsrv_t *pThis, int numEntries, nsd_epworkset_t workset[])
 {
 	int i;
 	int origEntries = numEntries;
@@ -696,7 +698,7 @@ processWorkset(tcpsrv_t *pThis, nspoll_t *pPoll, int numEntries, nsd_epworkset_t
 			ABORT_FINALIZE(RS_RET_FORCE_TERM);
 		if(numEntries == 1) {
 			/* process self, save context switch */
-			processWorksetItem(pThis, pPoll, workset[numEntries-1].id, workset[numEntries-1].pUsr);
+			processWorksetItem(pThis, workset[numEntries-1].id, workset[numEntries-1].pUsr);
 		} else {
 			pthread_mutex_lock(&wrkrMut);
 			/* check if there is a free worker */
@@ -705,7 +707,6 @@ processWorkset(tcpsrv_t *pThis, nspoll_t *pPoll, int numEntries, nsd_epworkset_t
 			if(i < wrkrMax) {
 				/* worker free -> use it! */
 				wrkrInfo[i].pSrv = pThis;
-				wrkrInfo[i].pPoll = pPoll;
 				wrkrInfo[i].idx = workset[numEntries -1].id;
 				wrkrInfo[i].pUsr = workset[numEntries -1].pUsr;
 				/* Note: we must increment wrkrRunning HERE and not inside the worker's
@@ -719,7 +720,7 @@ processWorkset(tcpsrv_t *pThis, nspoll_t *pPoll, int numEntries, nsd_epworkset_t
 			} else {
 				pthread_mutex_unlock(&wrkrMut);
 				/* no free worker, so we process this one ourselfs */
-				processWorksetItem(pThis, pPoll, workset[numEntries-1].id,
+				processWorksetItem(pThis, workset[numEntries-1].id,
 						   workset[numEntries-1].pUsr);
 			}
 		}
@@ -729,7 +730,7 @@ processWorkset(tcpsrv_t *pThis, nspoll_t *pPoll, int numEntries, nsd_epworkset_t
 	if(origEntries > 1) {
 		/* we now need to wait until all workers finish. This is because the
 		 * rest of this module can not handle the concurrency introduced
-		 * by workers running during the epoll call.
+		 * by workers running during the select call.
 		 */
 		pthread_mutex_lock(&wrkrMut);
 		while(wrkrRunning > 0) {
@@ -802,7 +803,7 @@ RunSelect(tcpsrv_t *pThis, nsd_epworkset_t workset[], size_t sizeWorkset)
 				workset[iWorkset].pUsr = (void*) pThis->ppLstn; /* this is a flag to indicate listen sock */
 				++iWorkset;
 				if(iWorkset >= (int) sizeWorkset) {
-					processWorkset(pThis, NULL, iWorkset, workset);
+					processWorkset(pThis, iWorkset, workset);
 					iWorkset = 0;
 				}
 				//DBGPRINTF("New connect on NSD %p.\n", pThis->ppLstn[i]);
@@ -822,7 +823,7 @@ RunSelect(tcpsrv_t *pThis, nsd_epworkset_t workset[], size_t sizeWorkset)
 				workset[iWorkset].pUsr = (void*) pThis->pSessions[iTCPSess];
 				++iWorkset;
 				if(iWorkset >= (int) sizeWorkset) {
-					processWorkset(pThis, NULL, iWorkset, workset);
+					processWorkset(pThis, iWorkset, workset);
 					iWorkset = 0;
 				}
 				--nfds; /* indicate we have processed one */
@@ -831,7 +832,7 @@ RunSelect(tcpsrv_t *pThis, nsd_epworkset_t workset[], size_t sizeWorkset)
 		}
 
 		if(iWorkset > 0)
-			processWorkset(pThis, NULL, iWorkset, workset);
+			processWorkset(pThis, iWorkset, workset);
 
 		/* we need to copy back close descriptors */
 		CHKiRet(nssel.Destruct(&pSel));
@@ -854,9 +855,207 @@ finalize_it: /* this is a very special case - this time only we do not exit the
 #pragma GCC diagnostic warning "-Wempty-body"
 
 
+/* I/O thread for epoll mode. Waits for data on the sessions it owns and
+ * processes them. There is no coordination with the other I/O threads, so
+ * a slow session only delays the sessions of the same thread.
+ */
+static void *
+ioThrdMain(void *arg)
+{
+	tcpsrvIOThrd_t *const pIOThrd = (tcpsrvIOThrd_t*) arg;
+	tcpsrv_t *const pThis = pIOThrd->pSrv;
+	nsd_epworkset_t workset[128]; /* 128 is currently fixed num of concurrent requests */
+	tcps_sess_t *pSess;
+	int numEntries;
+	int i;
+	rsRetVal localRet;
+	char thrdName[32];
+
+	snprintf(thrdName, sizeof(thrdName), "in:tcpsrv-io%d", pIOThrd->idx);
+	dbgOutputTID(thrdName);
+#	if defined(HAVE_PRCTL) && defined(PR_SET_NAME)
+	if(prctl(PR_SET_NAME, thrdName, 0, 0, 0) != 0) {
+		DBGPRINTF("prctl failed, not setting thread name for '%s'\n", thrdName);
+	}
+#	endif
+
+	while(!pIOThrd->bShallStop && glbl.GetGlobalInputTermState() == 0) {
+		numEntries = sizeof(workset)/sizeof(nsd_epworkset_t);
+		localRet = nspoll.Wait(pIOThrd->pPoll, -1, &numEntries, workset);
+		if(pIOThrd->bShallStop || glbl.GetGlobalInputTermState() == 1)
+			break; /* terminate input! */
+		if(localRet != RS_RET_OK)
+			continue;
+
+		for(i = 0 ; i < numEntries ; ++i) {
+			pSess = (tcps_sess_t*) workset[i].pUsr;
+			doReceive(pThis, &pSess, pIOThrd);
+			if(pSess == NULL) /* session was closed */
+				ATOMIC_DEC(&pIOThrd->nSess, &pIOThrd->mutNSess);
+		}
+	}
+
+	d_pthread_mutex_lock(&pThis->mutIOThrds);
+	pIOThrd->bActive = 0;
+	pthread_cond_broadcast(&pThis->condIOThrdTerm);
+	d_pthread_mutex_unlock(&pThis->mutIOThrds);
+	return NULL;
+}
+
+
+/* stop the I/O threads and free their resources. Sessions still owned by
+ * the threads are not closed, as in epoll mode we do not keep track of them.
+ */
+static void
+stopIOThrds(tcpsrv_t *pThis)
+{
+	tcpsrvIOThrd_t *pIOThrd;
+	struct timespec tTimeout;
+	int i;
+
+	if(pThis->pIOThrds == NULL)
+		return;
+
+	for(i = 0 ; i < pThis->iNumIOThrds ; ++i) {
+		pIOThrd = &pThis->pIOThrds[i];
+		if(pIOThrd->bStarted) {
+			pIOThrd->bShallStop = RSTRUE;
+			d_pthread_mutex_lock(&pThis->mutIOThrds);
+			while(pIOThrd->bActive) {
+				/* awake it from epoll_wait(). We need to repeat this, as the
+				 * thread may not yet have been waiting when we sent the signal.
+				 */
+				pthread_kill(pIOThrd->tid, SIGTTIN);
+				timeoutComp(&tTimeout, 100);
+				d_pthread_cond_timedwait(&pThis->condIOThrdTerm, &pThis->mutIOThrds, &tTimeout);
+			}
+			d_pthread_mutex_unlock(&pThis->mutIOThrds);
+			pthread_join(pIOThrd->tid, NULL);
+		}
+		if(pIOThrd->pPoll != NULL)
+			nspoll.Destruct(&pIOThrd->pPoll);
+		if(pIOThrd->stats != NULL)
+			statsobj.Destruct(&pIOThrd->stats);
+		DESTROY_ATOMIC_HELPER_MUT(pIOThrd->mutNSess);
+	}
+	free(pThis->pIOThrds);
+	pThis->pIOThrds = NULL;
+}
+
+
+/* start the I/O threads for epoll mode. Each one gets its own epoll set
+ * and statistics counters.
+ */
+static rsRetVal
+startIOThrds(tcpsrv_t *pThis)
+{
+	tcpsrvIOThrd_t *pIOThrd;
+	pthread_attr_t sessThrdAttr;
+	uchar statname[64];
+	int i;
+	DEFiRet;
+
+	pthread_attr_init(&sessThrdAttr);
+	pthread_attr_setstacksize(&sessThrdAttr, 4096*1024);
+	CHKmalloc(pThis->pIOThrds = calloc(pThis->iNumIOThrds, sizeof(tcpsrvIOThrd_t)));
+	for(i = 0 ; i < pThis->iNumIOThrds ; ++i) {
+		pIOThrd = &pThis->pIOThrds[i];
+		pIOThrd->pSrv = pThis;
+		pIOThrd->idx = i;
+		INIT_ATOMIC_HELPER_MUT(pIOThrd->mutNSess);
+		CHKiRet(nspoll.Construct(&pIOThrd->pPoll));
+		if(pThis->pszDrvrName != NULL)
+			CHKiRet(nspoll.SetDrvrName(pIOThrd->pPoll, pThis->pszDrvrName));
+		CHKiRet(nspoll.ConstructFinalize(pIOThrd->pPoll));
+
+		/* support statistics gathering */
+		CHKiRet(statsobj.Construct(&pIOThrd->stats));
+		snprintf((char*)statname, sizeof(statname), "%s(io%d)", pThis->pszInputName, i);
+		statname[sizeof(statname)-1] = '\0'; /* just to be on the save side... */
+		CHKiRet(statsobj.SetName(pIOThrd->stats, statname));
+		CHKiRet(statsobj.SetOrigin(pIOThrd->stats, pThis->pszOrigin));
+		STATSCOUNTER_INIT(pIOThrd->ctrSessOpened, pIOThrd->mutCtrSessOpened);
+		CHKiRet(statsobj.AddCounter(pIOThrd->stats, UCHAR_CONSTANT("sessions.opened"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pIOThrd->ctrSessOpened));
+		CHKiRet(statsobj.AddCounter(pIOThrd->stats, UCHAR_CONSTANT("sessions.active"),
+			ctrType_Int, CTR_FLAG_NONE, &pIOThrd->nSess));
+		STATSCOUNTER_INIT(pIOThrd->ctrBytesRcvd, pIOThrd->mutCtrBytesRcvd);
+		CHKiRet(statsobj.AddCounter(pIOThrd->stats, UCHAR_CONSTANT("bytes.received"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pIOThrd->ctrBytesRcvd));
+		CHKiRet(statsobj.ConstructFinalize(pIOThrd->stats));
+
+		pIOThrd->bActive = 1;
+		if(pthread_create(&pIOThrd->tid, &sessThrdAttr, ioThrdMain, pIOThrd) != 0) {
+			pIOThrd->bActive = 0;
+			errmsg.LogError(errno, RS_RET_ERR, "tcpsrv: error creating I/O thread %d", i);
+			ABORT_FINALIZE(RS_RET_ERR);
+		}
+		pIOThrd->bStarted = 1;
+	}
+	DBGPRINTF("tcpsrv: started %d I/O threads\n", pThis->iNumIOThrds);
+
+finalize_it:
+	pthread_attr_destroy(&sessThrdAttr);
+	RETiRet;
+}
+
+
+/* cancel cleanup handler for the epoll loop in Run(). If the input thread
+ * is cancelled (e.g. on shutdown timeout), the I/O threads must still be
+ * stopped before the tcpsrv object they work on is destructed.
+ */
+static void
+RunEPollCancelCleanup(void *arg)
+{
+	stopIOThrds((tcpsrv_t*) arg);
+}
+
+
+/* accept a new connection in epoll mode and hand it over to the I/O thread
+ * that currently owns the fewest sessions. From then on, only that thread
+ * processes the session.
+ */
+static rsRetVal
+acceptEPoll(tcpsrv_t *pThis, int idx)
+{
+	tcps_sess_t *pNewSess = NULL;
+	tcpsrvIOThrd_t *pIOThrd;
+	int i;
+	DEFiRet;
+
+	DBGPRINTF("New connect on NSD %p.\n", pThis->ppLstn[idx]);
+	CHKiRet(SessAccept(pThis, pThis->ppLstnPort[idx], &pNewSess, pThis->ppLstn[idx]));
+
+	pIOThrd = &pThis->pIOThrds[0];
+	for(i = 1 ; i < pThis->iNumIOThrds ; ++i) {
+		if(ATOMIC_FETCH_32BIT(&pThis->pIOThrds[i].nSess, &pThis->pIOThrds[i].mutNSess)
+		   < ATOMIC_FETCH_32BIT(&pIOThrd->nSess, &pIOThrd->mutNSess))
+			pIOThrd = &pThis->pIOThrds[i];
+	}
+
+	ATOMIC_INC(&pIOThrd->nSess, &pIOThrd->mutNSess);
+	iRet = nspoll.Ctl(pIOThrd->pPoll, pNewSess->pStrm, 0, pNewSess, NSDPOLL_IN, NSDPOLL_ADD);
+	if(iRet != RS_RET_OK) {
+		ATOMIC_DEC(&pIOThrd->nSess, &pIOThrd->mutNSess);
+		tcps_sess.Destruct(&pNewSess);
+		FINALIZE;
+	}
+	STATSCOUNTER_INC(pIOThrd->ctrSessOpened, pIOThrd->mutCtrSessOpened);
+	DBGPRINTF("New session created with NSD %p, assigned to I/O thread %d.\n",
+		  pNewSess, pIOThrd->idx);
+
+finalize_it:
+	if(iRet != RS_RET_OK)
+		DBGPRINTF("tcpsrv: error %d during accept\n", iRet);
+	RETiRet;
+}
+
+
 /* This function is called to gather input. It tries doing that via the epoll()
  * interface. If the driver does not support that, it falls back to calling its
  * select() equivalent.
+ * In epoll mode, this thread only accepts new connections. The sessions are
+ * handed over to the I/O threads, which do all further processing.
  * rgerhards, 2009-11-18
  */
 static rsRetVal
@@ -871,16 +1070,6 @@ Run(tcpsrv_t *pThis)
 
 	ISOBJ_TYPE_assert(pThis, tcpsrv);
 
-	/* check if we need to start the worker pool. Once it is running, all is
-	 * well. Shutdown is done on modExit.
-	 */
-	d_pthread_mutex_lock(&wrkrMut);
-	if(!bWrkrRunning) {
-		bWrkrRunning = 1;
-		startWorkerPool();
-	}
-	d_pthread_mutex_unlock(&wrkrMut);
-
 	/* this is an endless loop - it is terminated by the framework canelling
 	 * this thread. Thus, we also need to instantiate a cancel cleanup handler
 	 * to prevent us from leaking anything. -- rgerhards, 20080-04-24
@@ -890,9 +1079,22 @@ Run(tcpsrv_t *pThis)
 			CHKiRet(nspoll.SetDrvrName(pPoll, pThis->pszDrvrName));
 		localRet = nspoll.ConstructFinalize(pPoll);
 	}
+	if(localRet == RS_RET_OK) {
+		if((localRet = startIOThrds(pThis)) != RS_RET_OK)
+			stopIOThrds(pThis);
+	}
 	if(localRet != RS_RET_OK) {
 		/* fall back to select */
 		DBGPRINTF("tcpsrv could not use epoll() interface, iRet=%d, using select()\n", localRet);
+		/* check if we need to start the worker pool. Once it is running, all is
+		 * well. Shutdown is done on modExit.
+		 */
+		d_pthread_mutex_lock(&wrkrMut);
+		if(!bWrkrRunning) {
+			bWrkrRunning = 1;
+			startWorkerPool();
+		}
+		d_pthread_mutex_unlock(&wrkrMut);
 		iRet = RunSelect(pThis, workset, sizeof(workset)/sizeof(nsd_epworkset_t));
 		FINALIZE;
 	}
@@ -902,14 +1104,19 @@ Run(tcpsrv_t *pThis)
 	/* flag that we are in epoll mode */
 	pThis->bUsingEPoll = RSTRUE;
 
+	/* Note: no CHKiRet() inside the cleanup handler's scope, we must
+	 * always reach pthread_cleanup_pop().
+	 */
+	pthread_cleanup_push(RunEPollCancelCleanup, (void*) pThis);
+
 	/* Add the TCP listen sockets to the list of sockets to monitor */
-	for(i = 0 ; i < pThis->iLstnCurr ; ++i) {
+	for(i = 0 ; iRet == RS_RET_OK && i < pThis->iLstnCurr ; ++i) {
 		DBGPRINTF("Trying to add listener %d, pUsr=%p\n", i, pThis->ppLstn);
-		CHKiRet(nspoll.Ctl(pPoll, pThis->ppLstn[i], i, pThis->ppLstn, NSDPOLL_IN, NSDPOLL_ADD));
-		DBGPRINTF("Added listener %d\n", i);
+		iRet = nspoll.Ctl(pPoll, pThis->ppLstn[i], i, pThis->ppLstn, NSDPOLL_IN, NSDPOLL_ADD);
+		DBGPRINTF("Added listener %d, iRet %d\n", i, iRet);
 	}
 
-	while(1) {
+	while(iRet == RS_RET_OK) {
 		numEntries = sizeof(workset)/sizeof(nsd_epworkset_t);
 		localRet = nspoll.Wait(pPoll, -1, &numEntries, workset);
 		if(glbl.GetGlobalInputTermState() == 1)
@@ -922,15 +1129,21 @@ Run(tcpsrv_t *pThis)
 		if(localRet != RS_RET_OK)
 			continue;
 
-		processWorkset(pThis, pPoll, numEntries, workset);
+		DBGPRINTF("tcpsrv: ready to accept %d connections\n", numEntries);
+		for(i = 0 ; i < numEntries ; ++i) {
+			acceptEPoll(pThis, workset[i].id);
+		}
 	}
 
 	/* remove the tcp listen sockets from the epoll set */
-	for(i = 0 ; i < pThis->iLstnCurr ; ++i) {
-		CHKiRet(nspoll.Ctl(pPoll, pThis->ppLstn[i], i, pThis->ppLstn, NSDPOLL_IN, NSDPOLL_DEL));
+	for(i = 0 ; iRet == RS_RET_OK && i < pThis->iLstnCurr ; ++i) {
+		iRet = nspoll.Ctl(pPoll, pThis->ppLstn[i], i, pThis->ppLstn, NSDPOLL_IN, NSDPOLL_DEL);
 	}
 
+	pthread_cleanup_pop(0); /* the I/O threads are stopped below */
+
 finalize_it:
+	stopIOThrds(pThis);
 	if(pPoll != NULL)
 		nspoll.Destruct(&pPoll);
 	RETiRet;
@@ -950,6 +1163,9 @@ BEGINobjConstruct(tcpsrv) /* be sure to specify the object type also in END macr
 	pThis->ratelimitBurst = 10000;
 	pThis->bUseFlowControl = 1;
 	pThis->pszDrvrName = NULL;
+	pThis->iNumIOThrds = 1;
+	pthread_mutex_init(&pThis->mutIOThrds, NULL);
+	pthread_cond_init(&pThis->condIOThrdTerm, NULL);
 ENDobjConstruct(tcpsrv)
 
 
@@ -990,6 +1206,7 @@ finalize_it:
 /* destructor for the tcpsrv object */
 BEGINobjDestruct(tcpsrv) /* be sure to specify the object type also in END and CODESTART macros! */
 CODESTARTobjDestruct(tcpsrv)
+	stopIOThrds(pThis); /* no-op unless Run() did not stop them */
 	if(pThis->OnDestruct != NULL)
 		pThis->OnDestruct(pThis->pUsr);
 
@@ -1003,6 +1220,8 @@ CODESTARTobjDestruct(tcpsrv)
 	free(pThis->ppLstnPort);
 	free(pThis->pszInputName);
 	free(pThis->pszOrigin);
+	pthread_mutex_destroy(&pThis->mutIOThrds);
+	pthread_cond_destroy(&pThis->condIOThrdTerm);
 ENDobjDestruct(tcpsrv)
 
 
@@ -1327,6 +1546,19 @@ SetUseFlowControl(tcpsrv_t *pThis, int bUseFlowControl)
 }
 
 
+/* set number of I/O threads to use in epoll mode
+ * this must be called before Run, or it will have no effect!
+ */
+static rsRetVal
+SetNumIOThrds(tcpsrv_t *pThis, int iNum)
+{
+	DEFiRet;
+	ISOBJ_TYPE_assert(pThis, tcpsrv);
+	pThis->iNumIOThrds = iNum;
+	RETiRet;
+}
+
+
 /* set max number of sessions
  * this must be called before ConstructFinalize, or it will have no effect!
  * rgerhards, 2009-04-09
@@ -1376,6 +1608,7 @@ CODESTARTobjQueryInterface(tcpsrv)
 	pIf->SetAddtlFrameDelim = SetAddtlFrameDelim;
 	pIf->SetbDisableLFDelim = SetbDisableLFDelim;
 	pIf->SetSessMax = SetSessMax;
+	pIf->SetNumIOThrds = SetNumIOThrds;
 	pIf->SetUseFlowControl = SetUseFlowControl;
 	pIf->SetLstnMax = SetLstnMax;
 	pIf->SetDrvrMode = SetDrvrMode;
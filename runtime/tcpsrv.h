@@ -25,6 +25,8 @@
 #include "prop.h"
 #include "tcps_sess.h"
 #include "statsobj.h"
+#include "nspoll.h"
+#include "atomic.h"
 
 /* support for framing anomalies */
 typedef enum ETCPsyslogFramingAnomaly {
@@ -52,6 +54,25 @@ struct tcpLstnPortList_s {
 
 #define TCPSRV_NO_ADDTL_DELIMITER -1 /* specifies that no additional delimiter is to be used in TCP framing */
 
+/* an I/O thread of the server in epoll mode. Each I/O thread owns the
+ * sessions that were assigned to it on accept and processes them via
+ * its private epoll set, independently of the other I/O threads.
+ */
+typedef struct tcpsrvIOThrd_s {
+	tcpsrv_t *pSrv;		/**< server we belong to */
+	pthread_t tid;		/**< the thread's ID */
+	nspoll_t *pPoll;	/**< epoll set for our sessions */
+	int idx;		/**< our index, for naming */
+	int nSess;		/**< number of sessions we currently own (used for load balancing) */
+	DEF_ATOMIC_HELPER_MUT(mutNSess)
+	sbool bStarted;		/**< thread was created (and must be joined) */
+	sbool bActive;		/**< thread still running? (protected by pSrv->mutIOThrds) */
+	sbool bShallStop;	/**< request thread termination */
+	statsobj_t *stats;
+	STATSCOUNTER_DEF(ctrSessOpened, mutCtrSessOpened)
+	STATSCOUNTER_DEF(ctrBytesRcvd, mutCtrBytesRcvd)
+} tcpsrvIOThrd_t;
+
 /* the tcpsrv object */
 struct tcpsrv_s {
 	BEGINobjInstance;	/**< Data to implement generic object - MUST be the first data element! */
@@ -76,6 +97,10 @@ struct tcpsrv_s {
 	tcpLstnPortList_t **ppLstnPort; /**< pointer to relevant listen port description */
 	int iLstnMax;		/**< max number of listeners supported */
 	int iSessMax;		/**< max number of sessions supported */
+	int iNumIOThrds;	/**< number of I/O threads to use in epoll mode */
+	tcpsrvIOThrd_t *pIOThrds;	/**< I/O threads (epoll mode only) */
+	pthread_mutex_t mutIOThrds;	/**< guards I/O thread startup and termination */
+	pthread_cond_t condIOThrdTerm;	/**< signaled when an I/O thread terminates */
 	uchar dfltTZ[8];	/**< default TZ if none in timestamp; '\0' =No Default */
 	tcpLstnPortList_t *pLstnPorts;	/**< head pointer for listen ports */
 
@@ -168,8 +193,10 @@ BEGINinterface(tcpsrv) /* name must also be changed in ENDinterface macro! */
 	rsRetVal (*SetKeepAliveTime)(tcpsrv_t*, int);
 	/* added v18 */
 	rsRetVal (*SetbSPFramingFix)(tcpsrv_t*, sbool);
+	/* added v19 */
+	rsRetVal (*SetNumIOThrds)(tcpsrv_t*, int);
 ENDinterface(tcpsrv)
-#define tcpsrvCURR_IF_VERSION 18 /* increment whenever you change the interface structure! */
+#define tcpsrvCURR_IF_VERSION 19 /* increment whenever you change the interface structure! */
 /* change for v4:
  * - SetAddtlFrameDelim() added -- rgerhards, 2008-12-10
  * - SetInputName() added -- rgerhards, 2008-12-10
@@ -0,0 +1,388 @@
+/* trace.c
+ * Sampled pipeline tracing. If enabled, one in traceSampleRate messages
+ * gets a trace record when it is submitted. The processing stages append
+ * timestamped events to it (submit, queue enqueue/dequeue, parsing,
+ * ruleset execution, action processing and commit). When the message is
+ * destructed, begin and end events are paired into spans. Spans are
+ * aggregated into per-stage histograms (reported via impstats as the
+ * "pipeline-trace" object) and, if a trace file is configured, written
+ * to it in Chrome trace event format (load it into chrome://tracing or
+ * Perfetto).
+ *
+ * Untraced messages only pay for a pointer check at each stage, so
+ * tracing can be enabled in production with a reasonably large sample
+ * rate.
+ *
+ * Copyright 2026 Adiscon GmbH.
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#if defined(HAVE_SYSCALL) && defined(HAVE_SYS_gettid)
+#	include <sys/syscall.h>
+#endif
+
+#include "rsyslog.h"
+#include "obj.h"
+#include "msg.h"
+#include "atomic.h"
+#include "errmsg.h"
+#include "statsobj.h"
+#include "histogram.h"
+#include "srUtils.h"
+#include "unicode-helper.h"
+#include "trace.h"
+
+/* definitions for objects we access */
+DEFobjStaticHelpers
+DEFobjCurrIf(errmsg)
+DEFobjCurrIf(statsobj)
+
+/* the aggregated spans */
+enum {
+	SPAN_TOTAL = 0,	/* from submit until the last event */
+	SPAN_QUEUE,
+	SPAN_PARSE,
+	SPAN_RULESET,
+	SPAN_ACTION,
+	SPAN_COMMIT,
+	SPAN_NUM
+};
+static const char *spanNames[SPAN_NUM] = { "total", "queuewait", "parse", "ruleset", "action", "commit" };
+
+int traceSampleRate = 0;	/* trace one in traceSampleRate messages, 0 - off */
+static uchar *pszTraceFile = NULL;
+static unsigned iTraceCtr = 0;	/* messages seen by traceStart(), also provides the trace id */
+static sbool bActive = 0;
+static statsobj_t *stats = NULL;
+static histogram_t histSpans[SPAN_NUM];
+static intctr_t ctrTraced;
+static intctr_t ctrEvtsDropped;
+#ifndef HAVE_ATOMIC_BUILTINS
+static DEF_ATOMIC_HELPER_MUT(mutTraceCtr);
+static DEF_ATOMIC_HELPER_MUT(mutTraceEvts);
+static DEF_ATOMIC_HELPER_MUT(mutTraceRefs);
+#endif
+#ifndef HAVE_ATOMIC_BUILTINS64
+static DEF_ATOMIC_HELPER_MUT64(mutCtrTraced);
+static DEF_ATOMIC_HELPER_MUT64(mutCtrEvtsDropped);
+#endif
+static FILE *fpTrace = NULL;	/* trace file, Chrome trace event format */
+static pthread_mutex_t mutTraceFile = PTHREAD_MUTEX_INITIALIZER;
+static sbool bFirstFileEvt = 1;
+
+
+static unsigned
+traceGetTid(void)
+{
+#	if defined(HAVE_SYSCALL) && defined(HAVE_SYS_gettid)
+	return (unsigned) syscall(SYS_gettid);
+#	else
+	return (unsigned) (uintptr_t) pthread_self();
+#	endif
+}
+
+
+/* called for each submitted message; decides if it is to be traced */
+void
+traceStart(msg_t *pMsg)
+{
+	unsigned ctr;
+
+	if(traceSampleRate == 0 || !bActive || pMsg->pTrace != NULL)
+		return;
+	ctr = ATOMIC_FETCH_AND_INC_unsigned(&iTraceCtr, &mutTraceCtr);
+	if(ctr % traceSampleRate != 0)
+		return;
+	if((pMsg->pTrace = calloc(1, sizeof(msgtrace_t))) == NULL)
+		return; /* we do not trace, but that's no reason to abort */
+	pMsg->pTrace->id = ctr / traceSampleRate;
+	pMsg->pTrace->nRefs = 1;
+	traceAddEvt(pMsg->pTrace, TRACE_SUBMIT, NULL, 0, 0);
+}
+
+
+/* a copy of a traced message (MsgDup()) continues the trace of the
+ * original, e.g. through the queue of a called ruleset. The trace is
+ * completed when the last of them is destructed.
+ */
+msgtrace_t *
+traceAddRef(msgtrace_t *pThis)
+{
+	ATOMIC_INC(&pThis->nRefs, &mutTraceRefs);
+	return pThis;
+}
+
+
+/* add an event to a trace. This may be called concurrently for the same
+ * message, e.g. by multiple action queue workers. If lenName is -1, name
+ * is a C string. If tt is 0, the current time is used.
+ */
+void
+traceAddEvt(msgtrace_t *pThis, traceEvtType_t type, const uchar *name, int lenName, long long tt)
+{
+	traceEvt_t *pEvt;
+	unsigned idx;
+
+	/* the index is the value before the increment */
+	idx = ATOMIC_FETCH_AND_INC_unsigned(&pThis->nEvts, &mutTraceEvts);
+	if(idx >= TRACE_MAX_EVTS)
+		return;
+	pEvt = &pThis->evts[idx];
+	pEvt->tt = (tt == 0) ? currentMonotonicUsecs() : tt;
+	pEvt->tid = traceGetTid();
+	pEvt->type = type;
+	if(name == NULL)
+		name = UCHAR_CONSTANT("");
+	if(lenName < 0)
+		lenName = strlen((const char*) name);
+	if(lenName >= TRACE_MAX_NAMELEN)
+		lenName = TRACE_MAX_NAMELEN - 1;
+	memcpy(pEvt->name, name, lenName);
+	pEvt->name[lenName] = '\0';
+}
+
+
+/* write a span to the trace file. Queue wait spans cross threads, so they
+ * are written as async event pairs, all others as complete events.
+ * Must be called with mutTraceFile locked.
+ */
+static void
+traceWriteSpan(msgtrace_t *pThis, int span, traceEvt_t *pBegin, traceEvt_t *pEnd)
+{
+	const char *sep = bFirstFileEvt ? "" : ",\n";
+	const int pid = (int) getpid();
+
+	bFirstFileEvt = 0;
+	if(span == SPAN_QUEUE) {
+		fprintf(fpTrace, "%s{\"name\":\"queue:%s\",\"cat\":\"queue\",\"ph\":\"b\",\"id\":%u,"
+			"\"ts\":%lld,\"pid\":%d,\"tid\":%u},\n"
+			"{\"name\":\"queue:%s\",\"cat\":\"queue\",\"ph\":\"e\",\"id\":%u,"
+			"\"ts\":%lld,\"pid\":%d,\"tid\":%u}",
+			sep, pBegin->name, pThis->id, pBegin->tt, pid, pBegin->tid,
+			pBegin->name, pThis->id, pEnd->tt, pid, pEnd->tid);
+	} else {
+		fprintf(fpTrace, "%s{\"name\":\"%s%s%s\",\"cat\":\"%s\",\"ph\":\"X\","
+			"\"ts\":%lld,\"dur\":%lld,\"pid\":%d,\"tid\":%u,\"args\":{\"trace\":%u}}",
+			sep, spanNames[span], pBegin->name[0] == '\0' ? "" : ":", pBegin->name,
+			spanNames[span], pBegin->tt, pEnd->tt - pBegin->tt, pid, pBegin->tid, pThis->id);
+	}
+}
+
+
+/* find the begin event for the end event at idxEnd. Spans of the same
+ * kind may nest (ruleset call) or interleave (actions on different
+ * threads), so we search for the latest unmatched begin event for the
+ * same object, on the same thread except for queues.
+ */
+static int
+traceFindBegin(msgtrace_t *pThis, int idxEnd, traceEvtType_t typeBegin, sbool *matched)
+{
+	traceEvt_t *const pEnd = &pThis->evts[idxEnd];
+	int i;
+
+	for(i = idxEnd - 1 ; i >= 0 ; --i) {
+		if(matched[i] || pThis->evts[i].type != typeBegin)
+			continue;
+		if(strcmp(pThis->evts[i].name, pEnd->name))
+			continue;
+		if(typeBegin != TRACE_ENQ && pThis->evts[i].tid != pEnd->tid)
+			continue;
+		return i;
+	}
+	return -1;
+}
+
+
+/* called when a traced message is destructed. When the last message
+ * sharing the trace is gone, no events can be added any longer, so we
+ * record the spans and free the trace.
+ */
+void
+traceFinish(msgtrace_t *pThis)
+{
+	sbool matched[TRACE_MAX_EVTS];
+	traceEvtType_t typeBegin;
+	unsigned nEvts;
+	long long ttLast;
+	int span;
+	int idxBegin;
+	int i;
+
+	if(ATOMIC_DEC_AND_FETCH(&pThis->nRefs, &mutTraceRefs) > 0)
+		return;
+	nEvts = pThis->nEvts;
+	if(nEvts > TRACE_MAX_EVTS) {
+		STATSCOUNTER_ADD(ctrEvtsDropped, mutCtrEvtsDropped, nEvts - TRACE_MAX_EVTS);
+		nEvts = TRACE_MAX_EVTS;
+	}
+	STATSCOUNTER_INC(ctrTraced, mutCtrTraced);
+	memset(matched, 0, sizeof(matched));
+	if(fpTrace != NULL)
+		pthread_mutex_lock(&mutTraceFile);
+
+	ttLast = pThis->evts[0].tt;
+	for(i = 1 ; i < (int) nEvts ; ++i) {
+		if(pThis->evts[i].tt > ttLast)
+			ttLast = pThis->evts[i].tt;
+		switch(pThis->evts[i].type) {
+		case TRACE_DEQ:		typeBegin = TRACE_ENQ;		span = SPAN_QUEUE;	break;
+		case TRACE_PARSE_END:	typeBegin = TRACE_PARSE_BEGIN;	span = SPAN_PARSE;	break;
+		case TRACE_RULESET_END:	typeBegin = TRACE_RULESET_BEGIN; span = SPAN_RULESET;	break;
+		case TRACE_ACTION_END:	typeBegin = TRACE_ACTION_BEGIN;	span = SPAN_ACTION;	break;
+		case TRACE_COMMIT_END:	typeBegin = TRACE_COMMIT_BEGIN;	span = SPAN_COMMIT;	break;
+		default:		continue; /* not an end event */
+		}
+		idxBegin = traceFindBegin(pThis, i, typeBegin, matched);
+		if(idxBegin == -1)
+			continue; /* begin event was dropped */
+		matched[idxBegin] = 1;
+		histogramRecord(&histSpans[span], pThis->evts[i].tt - pThis->evts[idxBegin].tt);
+		if(fpTrace != NULL)
+			traceWriteSpan(pThis, span, &pThis->evts[idxBegin], &pThis->evts[i]);
+	}
+
+	if(pThis->evts[0].type == TRACE_SUBMIT) {
+		histogramRecord(&histSpans[SPAN_TOTAL], ttLast - pThis->evts[0].tt);
+		if(fpTrace != NULL) {
+			traceEvt_t evtLast = pThis->evts[0];
+			evtLast.tt = ttLast;
+			traceWriteSpan(pThis, SPAN_TOTAL, &pThis->evts[0], &evtLast);
+		}
+	}
+
+	if(fpTrace != NULL)
+		pthread_mutex_unlock(&mutTraceFile);
+	free(pThis);
+}
+
+
+/* called before the stats are read */
+static void
+traceStatsPreRead(statsobj_t __attribute__((unused)) *pStats, void __attribute__((unused)) *ctx)
+{
+	int i;
+	for(i = 0 ; i < SPAN_NUM ; ++i)
+		histogramUpdateCounters(&histSpans[i]);
+}
+
+
+/* set the configuration (from global() parameters) */
+void
+traceSetCnf(int sampleRate, uchar *pszFile)
+{
+	traceSampleRate = sampleRate;
+	if(pszFile != NULL) {
+		free(pszTraceFile);
+		pszTraceFile = pszFile;
+	}
+}
+
+
+/* start tracing if configured; done once the config is activated */
+rsRetVal
+traceActivate(void)
+{
+	int i;
+	DEFiRet;
+
+	if(traceSampleRate == 0 || bActive)
+		FINALIZE;
+
+	for(i = 0 ; i < SPAN_NUM ; ++i)
+		histogramInit(&histSpans[i]);
+	ctrTraced = 0;
+	ctrEvtsDropped = 0;
+	CHKiRet(statsobj.Construct(&stats));
+	CHKiRet(statsobj.SetName(stats, UCHAR_CONSTANT("pipeline-trace")));
+	CHKiRet(statsobj.SetOrigin(stats, UCHAR_CONSTANT("core.trace")));
+	CHKiRet(statsobj.AddCounter(stats, UCHAR_CONSTANT("traced"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrTraced));
+	CHKiRet(statsobj.AddCounter(stats, UCHAR_CONSTANT("events.dropped"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrEvtsDropped));
+	for(i = 0 ; i < SPAN_NUM ; ++i)
+		CHKiRet(histogramAddCounters(&histSpans[i], &statsobj, stats, spanNames[i]));
+	CHKiRet(statsobj.SetPreReadNotifier(stats, traceStatsPreRead, NULL));
+	CHKiRet(statsobj.ConstructFinalize(stats));
+
+	if(pszTraceFile != NULL) {
+		if((fpTrace = fopen((char*) pszTraceFile, "w")) == NULL) {
+			errmsg.LogError(errno, RS_RET_FILE_OPEN_ERROR, "trace: could not open "
+				"trace file '%s', spans are only reported via stats", pszTraceFile);
+		} else {
+			fputs("[\n", fpTrace);
+			bFirstFileEvt = 1;
+		}
+	}
+	bActive = 1;
+	DBGPRINTF("trace: tracing one in %d messages, trace file '%s'\n", traceSampleRate,
+		pszTraceFile == NULL ? "(none)" : (char*) pszTraceFile);
+
+finalize_it:
+	if(iRet != RS_RET_OK) {
+		errmsg.LogError(0, iRet, "trace: could not set up tracing, it is disabled");
+		if(stats != NULL)
+			statsobj.Destruct(&stats);
+	}
+	RETiRet;
+}
+
+
+/* end tracing; all traced messages must be gone at this point */
+void
+traceExit(void)
+{
+	int i;
+
+	if(bActive) {
+		bActive = 0;
+		statsobj.Destruct(&stats);
+		for(i = 0 ; i < SPAN_NUM ; ++i)
+			histogramExit(&histSpans[i]);
+	}
+	if(fpTrace != NULL) {
+		fputs("\n]\n", fpTrace);
+		fclose(fpTrace);
+		fpTrace = NULL;
+	}
+	free(pszTraceFile);
+	pszTraceFile = NULL;
+}
+
+
+rsRetVal
+traceClassInit(void)
+{
+	DEFiRet;
+	CHKiRet(objGetObjInterface(&obj));
+	CHKiRet(objUse(errmsg, CORE_COMPONENT));
+	CHKiRet(objUse(statsobj, CORE_COMPONENT));
+	INIT_ATOMIC_HELPER_MUT(mutTraceCtr);
+	INIT_ATOMIC_HELPER_MUT(mutTraceEvts);
+	INIT_ATOMIC_HELPER_MUT(mutTraceRefs);
+	INIT_ATOMIC_HELPER_MUT64(mutCtrTraced);
+	INIT_ATOMIC_HELPER_MUT64(mutCtrEvtsDropped);
+finalize_it:
+	RETiRet;
+}
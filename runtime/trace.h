@@ -0,0 +1,73 @@
+/* Definitions for sampled pipeline tracing.
+ *
+ * Copyright 2026 Adiscon GmbH.
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef INCLUDED_TRACE_H
+#define INCLUDED_TRACE_H
+
+/* processing stages */
+typedef enum traceEvtType_e {
+	TRACE_SUBMIT = 0,
+	TRACE_ENQ,
+	TRACE_DEQ,
+	TRACE_PARSE_BEGIN,
+	TRACE_PARSE_END,
+	TRACE_RULESET_BEGIN,
+	TRACE_RULESET_END,
+	TRACE_ACTION_BEGIN,
+	TRACE_ACTION_END,
+	TRACE_COMMIT_BEGIN,
+	TRACE_COMMIT_END
+} traceEvtType_t;
+
+#define TRACE_MAX_EVTS 48	/* events beyond that are dropped (and counted) */
+#define TRACE_MAX_NAMELEN 32	/* longer object names are truncated */
+#define TRACE_MAX_PENDING 16	/* traced messages per transaction; more are not traced */
+
+typedef struct traceEvt_s {
+	long long tt;		/* monotonic time, usecs */
+	unsigned tid;		/* thread the event happened on */
+	traceEvtType_t type;
+	char name[TRACE_MAX_NAMELEN]; /* a copy, as the object may be gone when the trace completes */
+} traceEvt_t;
+
+struct msgtrace_s {
+	unsigned id;
+	int nRefs;		/* messages sharing this trace (see MsgDup()), changed atomically */
+	unsigned nEvts;		/* incremented atomically, may be larger than TRACE_MAX_EVTS */
+	traceEvt_t evts[TRACE_MAX_EVTS];
+};
+
+extern int traceSampleRate;
+
+/* record an event if the message is traced; this is all the cost for untraced ones */
+#define TRACE_EVT(pMsg, type, name) \
+	if((pMsg)->pTrace != NULL) traceAddEvt((pMsg)->pTrace, (type), (name), -1, 0)
+
+/* prototypes */
+void traceStart(msg_t *pMsg);
+void traceAddEvt(msgtrace_t *pThis, traceEvtType_t type, const uchar *name, int lenName, long long tt);
+msgtrace_t *traceAddRef(msgtrace_t *pThis);
+void traceFinish(msgtrace_t *pThis);
+void traceSetCnf(int sampleRate, uchar *pszFile);
+rsRetVal traceActivate(void);
+void traceExit(void);
+rsRetVal traceClassInit(void);
+
+#endif /* #ifndef INCLUDED_TRACE_H */
@@ -46,6 +46,7 @@
 #include "glbl.h"
 #include "action.h"
 #include "atomic.h"
+#include "msg.h"
 
 /* static data */
 DEFobjStaticHelpers
@@ -200,8 +201,15 @@ finalize_it:
 
 /* Destructor */
 BEGINobjDestruct(wti) /* be sure to specify the object type also in END and CODESTART macros! */
+	int i, j;
 CODESTARTobjDestruct(wti)
 	/* actual destruction */
+	if(pThis->actWrkrInfo != NULL) {
+		/* traced messages of transactions that were never committed */
+		for(i = 0 ; i < iActionNbr ; ++i)
+			for(j = 0 ; j < pThis->actWrkrInfo[i].nTracedMsgs ; ++j)
+				msgDestruct(&pThis->actWrkrInfo[i].tracedMsgs[j]);
+	}
 	batchFree(&pThis->batch);
 	free(pThis->actWrkrInfo);
 	pthread_cond_destroy(&pThis->pcondBusy);
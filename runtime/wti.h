@@ -28,6 +28,7 @@
 #include "obj.h"
 #include "batch.h"
 #include "action.h"
+#include "trace.h"
 
 
 #define ACT_STATE_RDY  0	/* action ready, waiting for new transaction */
@@ -57,6 +58,8 @@ typedef struct actWrkrInfo {
 			actWrkrIParams_t actParams[CONF_OMOD_NUMSTRINGS_MAXSIZE];
 		} nontx;
 	} p; /* short name for "parameters" */
+	msg_t *tracedMsgs[TRACE_MAX_PENDING]; /* traced messages in the current transaction */
+	int nTracedMsgs;
 } actWrkrInfo_t;
 
 /* the worker thread instance class */
@@ -0,0 +1,68 @@
+/* Counts memory allocations, for the imdiag core benchmark. This library
+ * is meant to be preloaded (LD_PRELOAD) into rsyslogd. It forwards all
+ * calls to the glibc allocator, but counts calls to malloc(), calloc()
+ * and realloc() per thread. imdiag looks up allocCountGet() at runtime
+ * and reports the number of allocations per message if it finds it.
+ * On non-glibc platforms, the library is empty and thus does nothing.
+ *
+ * Part of the testbench for rsyslog.
+ *
+ * Copyright 2026 Adiscon GmbH.
+ *
+ * This file is part of rsyslog.
+ *
+ * Rsyslog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Rsyslog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Rsyslog.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * A copy of the GPL can be found in the file "COPYING" in this distribution.
+ */
+#include "config.h"
+#include <stdlib.h>
+
+#ifdef __GLIBC__
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t nmemb, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+/* initial-exec, so that accessing the counter never calls into the
+ * allocator itself.
+ */
+static __thread unsigned long long nAllocs __attribute__((tls_model("initial-exec")));
+
+void *
+malloc(size_t size)
+{
+	++nAllocs;
+	return __libc_malloc(size);
+}
+
+void *
+calloc(size_t nmemb, size_t size)
+{
+	++nAllocs;
+	return __libc_calloc(nmemb, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+	++nAllocs;
+	return __libc_realloc(ptr, size);
+}
+
+unsigned long long
+allocCountGet(void)
+{
+	return nAllocs;
+}
+#endif /* #ifdef __GLIBC__ */
@@ -0,0 +1,21 @@
+#!/bin/bash
+# Writes to 20 dynafiles via async writing, with only two writer threads
+# in the async writer pool. As the files are kept open and the last
+# buffer of each one is only partially filled, the data must be written
+# by the flush interval timeout of the pool, BEFORE rsyslogd is shut down.
+# The conf file has a 2 second flush interval, so we wait 4 seconds to be
+# on the save side.
+# This file is part of the rsyslog project, released  under GPLv3
+echo ===============================================================================
+echo TEST: \[asynwr_pool.sh\]: test async writer pool with many files
+. $srcdir/diag.sh init
+. $srcdir/diag.sh startup asynwr_pool.conf
+. $srcdir/diag.sh tcpflood -m 20000 -f20
+sleep 4 # wait for writer pool flush timeouts
+cat rsyslog.out.*.log > rsyslog.out.log
+. $srcdir/diag.sh seq-check 0 19999
+. $srcdir/diag.sh shutdown-when-empty # shut down rsyslogd when done processing messages
+. $srcdir/diag.sh wait-shutdown       # and wait for it to terminate
+cat rsyslog.out.*.log > rsyslog.out.log
+. $srcdir/diag.sh seq-check 0 19999
+. $srcdir/diag.sh exit
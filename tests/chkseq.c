@@ -13,6 +13,11 @@
  *    message is permitted to be lost.
  * -T anticipate truncation (which means specified payload length may be
  *    more than actual payload (which may have been truncated)
+ * -l latency mode: each line is "number,sent,received", with the two
+ *    timestamps in microseconds since the epoch (as written by tcpflood -k
+ *    and the $now-unixtimestamp-us property). In addition to the sequence
+ *    check, latency statistics are printed as a single JSON line.
+ *    Cannot be combined with -E.
  *
  * Part of the testbench for rsyslog.
  *
@@ -41,6 +46,44 @@
 #include <string.h>
 #include <getopt.h>
 
+static int
+cmpLatency(const void *a, const void *b)
+{
+	const long long la = *(const long long*) a;
+	const long long lb = *(const long long*) b;
+	return la < lb ? -1 : (la > lb ? 1 : 0);
+}
+
+/* nearest-rank percentile of the sorted latencies */
+static long long
+percentile(long long *lat, int nLat, int pctTimes10)
+{
+	int idx = (int) (((long long) nLat * pctTimes10 + 999) / 1000) - 1;
+	if(idx < 0)
+		idx = 0;
+	return lat[idx];
+}
+
+static void
+printLatency(long long *lat, int nLat)
+{
+	long long sum = 0;
+	int i;
+
+	if(nLat == 0) {
+		printf("{\"lat_count\": 0}\n");
+		return;
+	}
+	qsort(lat, nLat, sizeof(long long), cmpLatency);
+	for(i = 0 ; i < nLat ; ++i)
+		sum += lat[i];
+	printf("{\"lat_count\": %d, \"lat_min_us\": %lld, \"lat_avg_us\": %lld, "
+		"\"lat_p50_us\": %lld, \"lat_p90_us\": %lld, \"lat_p99_us\": %lld, "
+		"\"lat_p999_us\": %lld, \"lat_max_us\": %lld}\n",
+		nLat, lat[0], sum / nLat, percentile(lat, nLat, 500), percentile(lat, nLat, 900),
+		percentile(lat, nLat, 990), percentile(lat, nLat, 999), lat[nLat-1]);
+}
+
 int main(int argc, char *argv[])
 {
 	FILE *fp;
@@ -51,6 +94,10 @@ int main(int argc, char *argv[])
 	int verbose = 0;
 	int bHaveExtraData = 0;
 	int bAnticipateTruncation = 0;
+	int bLatency = 0;
+	long long tSent, tRcvd;
+	long long *lat = NULL;
+	int nLat = 0, maxLat = 0;
 	int dupsPermitted = 0;
 	int start = 0, end = 0;
 	int opt;
@@ -62,7 +109,7 @@ int main(int argc, char *argv[])
 	static char ioBuf[sizeof(edBuf)+1024];
 	char *file = NULL;
 
-	while((opt = getopt(argc, argv, "e:f:ds:vm:ET")) != EOF) {
+	while((opt = getopt(argc, argv, "e:f:ds:vm:ETl")) != EOF) {
 		switch((char)opt) {
 		case 'f':
 			file = optarg;
@@ -88,8 +135,11 @@ int main(int argc, char *argv[])
 		case 'T':
 			bAnticipateTruncation = 1;
 			break;
+		case 'l':
+			bLatency = 1;
+			break;
 		default:printf("Invalid call of chkseq, optchar='%c'\n", opt);
-			printf("Usage: chkseq file -sstart -eend -d -E\n");
+			printf("Usage: chkseq file -sstart -eend -d -E -l\n");
 			exit(1);
 		}
 	}
@@ -104,6 +154,11 @@ int main(int argc, char *argv[])
 		exit(1);
 	}
 
+	if(bLatency && bHaveExtraData) {
+		printf("-l and -E cannot be combined!\n");
+		exit(1);
+	}
+
 	if(verbose) {
 		printf("chkseq: start %d, end %d\n", start, end);
 	}
@@ -137,6 +192,22 @@ int main(int argc, char *argv[])
 					exit(1);
 				}
 			}
+		} else if(bLatency) {
+			if(fgets(ioBuf, sizeof(ioBuf), fp) == NULL) {
+				scanfOK = 0;
+			} else {
+				scanfOK = sscanf(ioBuf, "%d,%lld,%lld\n", &val, &tSent, &tRcvd) == 3 ? 1 : 0;
+			}
+			if(scanfOK) {
+				if(nLat == maxLat) {
+					maxLat = maxLat ? 2 * maxLat : end - start + 1;
+					if((lat = realloc(lat, sizeof(long long) * maxLat)) == NULL) {
+						perror("chkseq");
+						exit(1);
+					}
+				}
+				lat[nLat++] = tRcvd - tSent;
+			}
 		} else {
 			if(fgets(ioBuf, sizeof(ioBuf), fp) == NULL) {
 				scanfOK = 0;
@@ -204,7 +275,8 @@ int main(int argc, char *argv[])
 					if(fgets(ioBuf, sizeof(ioBuf), fp) == NULL) {
 						scanfOK = 0;
 					} else {
-						scanfOK = sscanf(ioBuf, "%d\n", &val) == 1 ? 1 : 0;
+						/* in latency mode, this only reads the number */
+						scanfOK = sscanf(ioBuf, "%d", &val) == 1 ? 1 : 0;
 					}
 				}
 
@@ -231,5 +303,10 @@ breakIF:
 		exit(1);
 	}
 
+	if(bLatency) {
+		printLatency(lat, nLat);
+		free(lat);
+	}
+
 	exit(ret);
 }
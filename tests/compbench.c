@@ -0,0 +1,291 @@
+/* Benchmark for the stream compression codecs used by omfwd and
+ * imptcp. A set of syslog-like messages is compressed with each
+ * codec that is compiled in, in the same way omfwd does it (flush at
+ * end of each batch). The result is then decompressed with codec
+ * auto-detection, as imptcp does it, and compared to the original.
+ * For each codec, the compression ratio and the CPU time for
+ * compression and decompression are reported.
+ *
+ * Params
+ * -n<number of messages> default 100000
+ * -b<messages per batch> messages between flushes, default 1024
+ * -f<filename> use lines from this file instead of generated messages
+ * -c<codec> only benchmark this codec (zlib, zstd, lz4)
+ * -l<level> compression level (default: codec default)
+ * -D<dictionary file> zstd dictionary to use
+ *
+ * Exits with non-zero status if a roundtrip does not reproduce the
+ * input, so it can also be used as a testbench tool.
+ *
+ * Part of the testbench for rsyslog.
+ *
+ * Copyright 2026 Adiscon GmbH.
+ *
+ * This file is part of rsyslog.
+ *
+ * Rsyslog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Rsyslog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Rsyslog.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * A copy of the GPL can be found in the file "COPYING" in this distribution.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rsyslog.h"
+#include "strmcomp.h"
+
+/* the codec helper is part of the runtime and may emit debug
+ * messages - we do not link the runtime, so provide what it needs.
+ */
+int Debug = 0;
+void
+dbgprintf(const char __attribute__((unused)) *fmt, ...)
+{
+}
+
+typedef struct {
+	uchar *buf;
+	size_t len;
+	size_t size;
+} outbuf_t;
+
+static rsRetVal
+appendOut(void *usrptr, uchar *buf, size_t len)
+{
+	outbuf_t *out = (outbuf_t*) usrptr;
+	uchar *newbuf;
+	size_t newsize;
+
+	if(out->len + len > out->size) {
+		newsize = (out->size == 0) ? 64*1024 : out->size;
+		while(newsize < out->len + len)
+			newsize *= 2;
+		if((newbuf = realloc(out->buf, newsize)) == NULL)
+			return RS_RET_OUT_OF_MEMORY;
+		out->buf = newbuf;
+		out->size = newsize;
+	}
+	memcpy(out->buf + out->len, buf, len);
+	out->len += len;
+	return RS_RET_OK;
+}
+
+static double
+cpuTime(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+/* build test data, one LF-terminated message per line. Messages are
+ * modelled after what we typically see in real traffic, with some
+ * variable fields so that the data is not trivially compressible.
+ */
+static void
+genMsgs(outbuf_t *data, int nMsgs)
+{
+	static const char *hosts[] = { "web01", "web02", "db-master", "lb-east", "mailgw" };
+	static const char *tags[] = { "sshd[%d]:", "postfix/smtpd[%d]:", "kernel:", "nginx[%d]:" };
+	char msg[1024];
+	char tag[64];
+	int len;
+	int i;
+
+	srand(42);
+	for(i = 0 ; i < nMsgs ; ++i) {
+		snprintf(tag, sizeof(tag), tags[i % 4], 1000 + rand() % 30000);
+		len = snprintf(msg, sizeof(msg), "<%d>Oct 11 22:%2.2d:%2.2d %s %s "
+			"msgnum:%8.8d: connection from 10.%d.%d.%d port %d, user=u%d "
+			"status=%s bytes=%d\n", 8 + rand() % 160, (i / 60) % 60, i % 60,
+			hosts[rand() % 5], tag, i, rand() % 256, rand() % 256, rand() % 256,
+			1024 + rand() % 60000, rand() % 500, (rand() % 10) ? "ok" : "failed",
+			rand() % 100000);
+		appendOut(data, (uchar*) msg, len);
+	}
+}
+
+static int
+readFile(outbuf_t *data, const char *fn)
+{
+	FILE *fp;
+	uchar buf[64*1024];
+	size_t nRead;
+
+	if((fp = fopen(fn, "r")) == NULL) {
+		perror(fn);
+		return 1;
+	}
+	while((nRead = fread(buf, 1, sizeof(buf), fp)) > 0)
+		appendOut(data, buf, nRead);
+	fclose(fp);
+	return 0;
+}
+
+/* compress data in batches of lines, then decompress and check the
+ * result. Returns 0 on success.
+ */
+static int
+benchCodec(int codec, int level, int batchSize, outbuf_t *data, uchar *dict, size_t lenDict)
+{
+	strmcomp_t *comp = NULL;
+	strmcomp_t *decomp = NULL;
+	outbuf_t zipped = { NULL, 0, 0 };
+	outbuf_t unzipped = { NULL, 0, 0 };
+	size_t offs, end;
+	int nLines;
+	double tStart, tComp, tDecomp;
+	int ret = 1;
+
+	if(level == -1)
+		level = strmcompDfltLevel(codec);
+	if(strmcompConstruct(&comp, codec, 0, level, dict, lenDict) != RS_RET_OK
+	   || strmcompConstruct(&decomp, STRMCOMP_AUTO, 1, 0, dict, lenDict) != RS_RET_OK) {
+		fprintf(stderr, "%s: could not initialize codec\n", strmcompCodecName(codec));
+		goto done;
+	}
+
+	tStart = cpuTime();
+	for(offs = 0 ; offs < data->len ; offs = end) {
+		for(end = offs, nLines = 0 ; end < data->len && nLines < batchSize ; ++end) {
+			if(data->buf[end] == '\n')
+				++nLines;
+		}
+		if(strmcompProcess(comp, data->buf + offs, end - offs, STRMCOMP_FLUSH,
+			appendOut, &zipped) != RS_RET_OK) {
+			fprintf(stderr, "%s: compression failed\n", strmcompCodecName(codec));
+			goto done;
+		}
+	}
+	if(strmcompProcess(comp, NULL, 0, STRMCOMP_FINISH, appendOut, &zipped) != RS_RET_OK) {
+		fprintf(stderr, "%s: finishing stream failed\n", strmcompCodecName(codec));
+		goto done;
+	}
+	tComp = cpuTime() - tStart;
+
+	/* decompress in chunks of typical network read size */
+	tStart = cpuTime();
+	for(offs = 0 ; offs < zipped.len ; offs = end) {
+		end = offs + 64*1024;
+		if(end > zipped.len)
+			end = zipped.len;
+		if(strmcompProcess(decomp, zipped.buf + offs, end - offs, STRMCOMP_NOFLUSH,
+			appendOut, &unzipped) != RS_RET_OK) {
+			fprintf(stderr, "%s: decompression failed\n", strmcompCodecName(codec));
+			goto done;
+		}
+	}
+	tDecomp = cpuTime() - tStart;
+
+	if(unzipped.len != data->len || memcmp(unzipped.buf, data->buf, data->len)) {
+		fprintf(stderr, "%s: roundtrip mismatch, in %zu bytes, out %zu bytes\n",
+			strmcompCodecName(codec), data->len, unzipped.len);
+		goto done;
+	}
+
+	printf("%-5s %5d %12zu %12zu %7.2f %10.1f %9.1f %10.1f %9.1f\n",
+		strmcompCodecName(codec), level, data->len, zipped.len,
+		(double) data->len / (zipped.len ? zipped.len : 1),
+		tComp * 1000, data->len / (tComp ? tComp : 1e-9) / (1024*1024),
+		tDecomp * 1000, data->len / (tDecomp ? tDecomp : 1e-9) / (1024*1024));
+	ret = 0;
+
+done:
+	if(comp != NULL)
+		strmcompDestruct(&comp);
+	if(decomp != NULL)
+		strmcompDestruct(&decomp);
+	free(zipped.buf);
+	free(unzipped.buf);
+	return ret;
+}
+
+int
+main(int argc, char *argv[])
+{
+	int opt;
+	int nMsgs = 100000;
+	int batchSize = 1024;
+	int level = -1;
+	int codec = -1;
+	char *fn = NULL;
+	char *dictFn = NULL;
+	uchar *dict = NULL;
+	size_t lenDict = 0;
+	outbuf_t data = { NULL, 0, 0 };
+	int ret = 0;
+	int i;
+
+	while((opt = getopt(argc, argv, "n:b:f:c:l:D:")) != -1) {
+		switch (opt) {
+		case 'n':	nMsgs = atoi(optarg);
+				break;
+		case 'b':	batchSize = atoi(optarg);
+				break;
+		case 'f':	fn = optarg;
+				break;
+		case 'c':	codec = strmcompCodecFromName(optarg);
+				if(codec == -1 || codec == STRMCOMP_AUTO) {
+					fprintf(stderr, "invalid codec '%s'\n", optarg);
+					exit(1);
+				}
+				break;
+		case 'l':	level = atoi(optarg);
+				break;
+		case 'D':	dictFn = optarg;
+				break;
+		default:	printf("Invalid call of compbench, optchar='%c'\n", opt);
+				printf("Usage: compbench [-n msgs] [-b batchsize] [-f file] "
+				       "[-c codec] [-l level] [-D dictfile]\n");
+				exit(1);
+		}
+	}
+
+	if(fn == NULL) {
+		genMsgs(&data, nMsgs);
+	} else if(readFile(&data, fn) != 0) {
+		exit(1);
+	}
+	if(dictFn != NULL && strmcompLoadDict(dictFn, &dict, &lenDict) != RS_RET_OK) {
+		fprintf(stderr, "could not load dictionary '%s'\n", dictFn);
+		exit(1);
+	}
+
+	printf("codec level     in-bytes    out-bytes   ratio  comp-cpu-ms  comp-MB/s "
+	       "dcmp-cpu-ms dcmp-MB/s\n");
+	for(i = STRMCOMP_ZLIB ; i <= STRMCOMP_LZ4 ; ++i) {
+		if(codec != -1 && codec != i)
+			continue;
+		if(!strmcompCodecAvailable(i)) {
+			if(codec != -1) {
+				fprintf(stderr, "codec %s not supported by this build\n",
+					strmcompCodecName(i));
+				ret = 77; /* "skip" for the testbench */
+			}
+			continue;
+		}
+		/* dictionary only applies to zstd */
+		if(benchCodec(i, level, batchSize, &data, (i == STRMCOMP_ZSTD) ? dict : NULL,
+			(i == STRMCOMP_ZSTD) ? lenDict : 0) != 0)
+			ret = 1;
+	}
+
+	free(dict);
+	free(data.buf);
+	return ret;
+}
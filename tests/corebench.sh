@@ -0,0 +1,35 @@
+#!/bin/bash
+# run the in-process core benchmark (imdiag "benchmark" command) for
+# all stages. The results are written to corebench.out.json, one JSON
+# object per stage, so that they can be compared between builds. The
+# number of messages per stage can be set via RSYSLOG_COREBENCH_MSGS.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[corebench.sh\]: in-process benchmark of core processing stages
+. $srcdir/diag.sh init
+NMSGS=${RSYSLOG_COREBENCH_MSGS:-100000}
+rm -f corebench.out.json
+cp $srcdir/testsuites/corebench.lkp_tbl $srcdir/corebench.lkp_tbl
+# if available, count allocations (preload only affects rsyslogd)
+ALLOCCOUNT=""
+if [ -f .libs/liballoccount.so ]; then
+	ALLOCCOUNT="$(pwd)/.libs/liballoccount.so"
+fi
+LD_PRELOAD=$ALLOCCOUNT . $srcdir/diag.sh startup corebench.conf
+. $srcdir/diag.sh corebench parse-rfc3164 $NMSGS
+. $srcdir/diag.sh corebench parse-rfc5424 $NMSGS
+. $srcdir/diag.sh corebench template $NMSGS bench_string
+. $srcdir/diag.sh corebench template $NMSGS bench_list
+. $srcdir/diag.sh corebench template $NMSGS RSYSLOG_ForwardFormat
+. $srcdir/diag.sh corebench expr $NMSGS bench_filter
+. $srcdir/diag.sh corebench lookup $NMSGS bench_hosts
+. $srcdir/diag.sh corebench serialize $NMSGS
+. $srcdir/diag.sh shutdown-immediate
+. $srcdir/diag.sh wait-shutdown
+rm -f $srcdir/corebench.lkp_tbl
+if [ $(grep -c '"ns_per_msg"' corebench.out.json) -ne 8 ]; then
+	echo "FAIL: expected 8 benchmark results, corebench.out.json is:"
+	cat corebench.out.json
+	. $srcdir/diag.sh error-exit 1
+fi
+. $srcdir/diag.sh exit
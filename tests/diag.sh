@@ -66,9 +66,10 @@ case $1 in
 		echo "------------------------------------------------------------"
 		cp $srcdir/testsuites/diag-common.conf diag-common.conf
 		cp $srcdir/testsuites/diag-common2.conf diag-common2.conf
+		cp $srcdir/testsuites/diag-common3.conf diag-common3.conf
 		rm -f rsyslogd.started work-*.conf rsyslog.random.data
-		rm -f rsyslogd2.started work-*.conf
-		rm -f work rsyslog.out.log rsyslog2.out.log rsyslog.out.log.save # common work files
+		rm -f rsyslogd2.started rsyslogd3.started work-*.conf
+		rm -f work rsyslog.out.log rsyslog2.out.log rsyslog3.out.log rsyslog.out.log.save # common work files
 		rm -rf test-spool test-logdir stat-file1
 		rm -f rsyslog.out.*.log work-presort rsyslog.pipe
 		rm -f rsyslog.input rsyslog.empty
@@ -113,7 +114,8 @@ case $1 in
 		# now real cleanup
 		rm -f rsyslogd.started work-*.conf diag-common.conf
    		rm -f rsyslogd2.started diag-common2.conf rsyslog.action.*.include
-		rm -f work rsyslog.out.log rsyslog2.out.log rsyslog.out.log.save # common work files
+		rm -f rsyslogd3.started diag-common3.conf
+		rm -f work rsyslog.out.log rsyslog2.out.log rsyslog3.out.log rsyslog.out.log.save # common work files
 		rm -rf test-spool test-logdir stat-file1
 		rm -f rsyslog.out.*.log rsyslog.random.data work-presort rsyslog.pipe
 		rm -f rsyslog.input rsyslog.conf.tlscert stat-file1 rsyslog.empty
@@ -282,6 +284,9 @@ case $1 in
 		if [ "$2" == "2" ]
 		then
 			echo WaitMainQueueEmpty | ./diagtalker -p13501 || . $srcdir/diag.sh error-exit  $?
+		elif [ "$2" == "3" ]
+		then
+			echo WaitMainQueueEmpty | ./diagtalker -p13502 || . $srcdir/diag.sh error-exit  $?
 		else
 			echo WaitMainQueueEmpty | ./diagtalker || . $srcdir/diag.sh error-exit  $?
 		fi
@@ -332,6 +337,18 @@ case $1 in
 		echo injectmsg $2 $3 $4 $5 | ./diagtalker || . $srcdir/diag.sh error-exit  $?
 		# TODO: some return state checking? (does it really make sense here?)
 		;;
+   'corebench') # run a core benchmark stage via imdiag: $2 stage, $3 number of messages,
+		# $4 (optional) name of template, ruleset or lookup table to use. The result
+		# (one JSON object per line) is appended to corebench.out.json
+		echo benchmark $2 $3 $4 | ./diagtalker > corebench.tmp || . $srcdir/diag.sh error-exit  $?
+		if grep -q "imdiag::error" corebench.tmp; then
+		  echo "core benchmark stage $2 failed:"
+		  cat corebench.tmp
+		  . $srcdir/diag.sh error-exit 1
+		fi
+		sed -e 's/^imdiag\[[0-9]*\]: //' corebench.tmp | tee -a corebench.out.json
+		rm -f corebench.tmp
+		;;
     'injectmsg-litteral') # inject litteral-payload  via our inject interface (imdiag)
 		echo injecting msg payload from: $2
     cat $2 | sed -e 's/^/injectmsg litteral /g' | ./diagtalker || . $srcdir/diag.sh error-exit  $?
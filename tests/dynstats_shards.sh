@@ -0,0 +1,37 @@
+#!/bin/bash
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[dynstats_shards.sh\]: test for metrics spread over the shards of a bucket
+. $srcdir/diag.sh init
+. $srcdir/diag.sh startup dynstats_shards.conf
+. $srcdir/diag.sh wait-for-stats-flush 'rsyslog.out.stats.log'
+. $srcdir/diag.sh block-stats-flush
+. $srcdir/diag.sh injectmsg 0 6400
+. $srcdir/diag.sh wait-queueempty
+. $srcdir/diag.sh allow-single-stats-flush-after-block-and-wait-for-it
+
+# the metrics hash to different shards, but each one must be counted
+# exactly, and maxCardinality applies to the bucket as a whole
+. $srcdir/diag.sh content-check "k100 0"
+. $srcdir/diag.sh content-check "k163 -6"
+for k in 100 101 117 128 142 159; do
+	. $srcdir/diag.sh first-column-sum-check "s/.*k$k=\([0-9]\+\)/\1/g" "k$k=" 'rsyslog.out.stats.log' 100
+done
+for k in 160 161 162 163; do
+	. $srcdir/diag.sh custom-assert-content-missing "k$k=" 'rsyslog.out.stats.log'
+done
+. $srcdir/diag.sh first-column-sum-check 's/.*new_metric_add=\([0-9]\+\)/\1/g' 'new_metric_add=' 'rsyslog.out.stats.log' 60
+. $srcdir/diag.sh first-column-sum-check 's/.*ops_overflow=\([0-9]\+\)/\1/g' 'ops_overflow=' 'rsyslog.out.stats.log' 400
+. $srcdir/diag.sh first-column-sum-check 's/.*ops_ignored=\([0-9]\+\)/\1/g' 'ops_ignored=' 'rsyslog.out.stats.log' 0
+
+# the reset goes shard by shard, all metrics must be purged in the end
+. $srcdir/diag.sh allow-single-stats-flush-after-block-and-wait-for-it
+. $srcdir/diag.sh await-stats-flush-after-block
+. $srcdir/diag.sh wait-for-stats-flush 'rsyslog.out.stats.log'
+. $srcdir/diag.sh first-column-sum-check 's/.*metrics_purged=\([0-9]\+\)/\1/g' 'metrics_purged=' 'rsyslog.out.stats.log' 60
+
+echo doing shutdown
+. $srcdir/diag.sh shutdown-when-empty
+echo wait on shutdown
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh exit
@@ -0,0 +1,36 @@
+#!/bin/bash
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[dynstats_topk.sh\]: test for reporting only the heavy hitters of a bucket
+. $srcdir/diag.sh init
+. $srcdir/diag.sh startup dynstats_topk.conf
+. $srcdir/diag.sh wait-for-stats-flush 'rsyslog.out.stats.log'
+. $srcdir/diag.sh block-stats-flush
+. $srcdir/diag.sh injectmsg-litteral $srcdir/testsuites/dynstats_input_more_0
+. $srcdir/diag.sh injectmsg-litteral $srcdir/testsuites/dynstats_input_more_1
+. $srcdir/diag.sh injectmsg 0 4000
+. $srcdir/diag.sh wait-queueempty
+. $srcdir/diag.sh allow-single-stats-flush-after-block-and-wait-for-it
+
+. $srcdir/diag.sh content-check "foo 001 0"
+. $srcdir/diag.sh content-check "grault 012 0"
+
+. $srcdir/diag.sh first-column-sum-check 's/.*foo=\([0-9]\+\)/\1/g' 'foo=' 'rsyslog.out.stats.log' 5
+. $srcdir/diag.sh first-column-sum-check 's/.*msg_stats.new_metric_add=\([0-9]\+\)/\1/g' 'msg_stats.new_metric_add=' 'rsyslog.out.stats.log' 6
+. $srcdir/diag.sh custom-assert-content-missing 'bar=' 'rsyslog.out.stats.log'
+. $srcdir/diag.sh custom-assert-content-missing 'baz=' 'rsyslog.out.stats.log'
+. $srcdir/diag.sh custom-assert-content-missing 'quux=' 'rsyslog.out.stats.log'
+. $srcdir/diag.sh custom-assert-content-missing 'corge=' 'rsyslog.out.stats.log'
+
+# evict_stats sees far more distinct metrics than it can track (7 per
+# shard), so entries are evicted, but the heavy hitter must survive with
+# its exact count
+. $srcdir/diag.sh first-column-sum-check 's/.*hot=\([0-9]\+\)/\1/g' 'hot=' 'rsyslog.out.stats.log' 1000
+. $srcdir/diag.sh assert-first-column-sum-greater-than 's/.*evict_stats.metrics_purged=\([0-9]\+\)/\1/g' 'evict_stats.metrics_purged=' 'rsyslog.out.stats.log' 2000
+. $srcdir/diag.sh first-column-sum-check 's/.*evict_stats.ops_overflow=\([0-9]\+\)/\1/g' 'evict_stats.ops_overflow=' 'rsyslog.out.stats.log' 0
+
+echo doing shutdown
+. $srcdir/diag.sh shutdown-when-empty
+echo wait on shutdown
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh exit
@@ -0,0 +1,40 @@
+#!/bin/bash
+# Test concurrent bulk requests in omelasticsearch. We use a mock ES
+# server which delays each reply, so requests can only overlap if
+# multiple of them are in flight.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[es-bulk-inflight.sh\]: test concurrent bulk requests with mock server
+. $srcdir/diag.sh init
+rm -f es_mock.stats
+python $srcdir/es_mock_server.py 19200 rsyslog.out.log es_mock.stats 50 &
+MOCK_PID=$!
+# the mock creates the stats file as soon as it listens
+i=0
+while [ ! -f es_mock.stats ]; do
+	./msleep 100
+	let "i++"
+	if test $i -gt $TB_TIMEOUT_STARTSTOP; then
+		echo "ABORT! Timeout waiting for mock ES server"
+		kill $MOCK_PID
+		. $srcdir/diag.sh error-exit 1
+	fi
+done
+. $srcdir/diag.sh startup es-bulk-inflight.conf
+. $srcdir/diag.sh injectmsg  0 20000
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+kill $MOCK_PID
+cat es_mock.stats
+. $srcdir/diag.sh seq-check  0 19999
+# 20000 messages do not fit into a single 16k bulk request
+if [ $(sed -n 's/^requests=//p' es_mock.stats) -lt 10 ]; then
+	echo "FAIL: too few bulk requests, maxbytes not honored"
+	. $srcdir/diag.sh error-exit 1
+fi
+if [ $(sed -n 's/^maxactive=//p' es_mock.stats) -lt 2 ]; then
+	echo "FAIL: bulk requests were not sent concurrently"
+	. $srcdir/diag.sh error-exit 1
+fi
+rm -f es_mock.stats
+. $srcdir/diag.sh exit
@@ -0,0 +1,87 @@
+# A minimal mock of the Elasticsearch _bulk API for the testbench.
+# It records the "msgnum" field of each indexed document, one per line,
+# and replies like ES does when no errors occured. Replies can be
+# delayed to simulate ES round-trip latency. Some statistics (number
+# of bulk requests and max number of concurrent requests) are written
+# to the stats file once the server listens and after each request.
+#
+# usage: es_mock_server.py port outfile statsfile [delay-ms]
+#
+# This file is part of the rsyslog project, released under ASL 2.0
+import json
+import sys
+import threading
+import time
+try:
+    from BaseHTTPServer import BaseHTTPRequestHandler, HTTPServer
+    from SocketServer import ThreadingMixIn
+except ImportError:
+    from http.server import BaseHTTPRequestHandler, HTTPServer
+    from socketserver import ThreadingMixIn
+
+port = int(sys.argv[1])
+outfile = open(sys.argv[2], "a")
+statsfile = sys.argv[3]
+delay = (int(sys.argv[4]) if len(sys.argv) > 4 else 0) / 1000.0
+
+lock = threading.Lock()
+stats = {"requests": 0, "active": 0, "maxactive": 0}
+
+
+class ThreadingHTTPServer(ThreadingMixIn, HTTPServer):
+    daemon_threads = True
+
+
+def write_stats():
+    with open(statsfile, "w") as f:
+        f.write("requests=%d\nmaxactive=%d\n"
+                % (stats["requests"], stats["maxactive"]))
+
+
+class BulkHandler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def log_message(self, format, *args):
+        pass
+
+    def reply(self, body):
+        self.send_response(200)
+        self.send_header("Content-Type", "application/json; charset=UTF-8")
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        if self.command != "HEAD":
+            self.wfile.write(body)
+
+    def do_HEAD(self):
+        self.reply(b"{}")
+
+    def do_GET(self):
+        self.reply(b"{}")
+
+    def do_POST(self):
+        with lock:
+            stats["active"] += 1
+            stats["maxactive"] = max(stats["maxactive"], stats["active"])
+        data = self.rfile.read(int(self.headers["Content-Length"]))
+        lines = data.decode("utf-8").splitlines()
+        msgnums = []
+        # bulk format: action line followed by document line
+        for doc in lines[1::2]:
+            msgnums.append(json.loads(doc)["msgnum"])
+        if delay > 0:
+            time.sleep(delay)
+        items = ",".join(['{"index":{"status":201}}'] * len(msgnums))
+        body = '{"took":1,"errors":false,"items":[' + items + ']}'
+        with lock:
+            for msgnum in msgnums:
+                outfile.write(msgnum + "\n")
+            outfile.flush()
+            stats["requests"] += 1
+            stats["active"] -= 1
+            write_stats()
+        self.reply(body.encode("utf-8"))
+
+
+server = ThreadingHTTPServer(("127.0.0.1", port), BulkHandler)
+write_stats()  # tells the testbench we are ready
+server.serve_forever()
@@ -0,0 +1,20 @@
+#!/bin/bash
+# Test imtcp in TLS mode with multiple I/O threads. This requires the
+# epoll() driver for gtls, the per-thread stats are only present if
+# it is used (otherwise imtcp falls back to select()).
+# added 2026-10-18, released under ASL 2.0
+echo ===============================================================================
+echo \[imtcp-tls-workerthreads.sh\]: test imtcp in TLS mode with multiple I/O threads
+. $srcdir/diag.sh init
+echo \$DefaultNetstreamDriverCAFile $srcdir/tls-certs/ca.pem     >rsyslog.conf.tlscert
+echo \$DefaultNetstreamDriverCertFile $srcdir/tls-certs/cert.pem >>rsyslog.conf.tlscert
+echo \$DefaultNetstreamDriverKeyFile $srcdir/tls-certs/key.pem   >>rsyslog.conf.tlscert
+. $srcdir/diag.sh startup imtcp-tls-workerthreads.conf
+. $srcdir/diag.sh tcpflood -p13514 -c20 -m50000 -Ttls -Z$srcdir/tls-certs/cert.pem -z$srcdir/tls-certs/key.pem
+. $srcdir/diag.sh wait-for-stats-flush 'rsyslog.out.stats.log'
+. $srcdir/diag.sh shutdown-when-empty # shut down rsyslogd when done processing messages
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh seq-check 0 49999
+. $srcdir/diag.sh custom-content-check 'imtcp(io2)' 'rsyslog.out.stats.log'
+. $srcdir/diag.sh first-column-sum-check 's/.*sessions.opened=\([0-9]\+\).*/\1/g' 'imtcp(io' 'rsyslog.out.stats.log' 20
+. $srcdir/diag.sh exit
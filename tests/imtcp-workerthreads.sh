@@ -0,0 +1,28 @@
+#!/bin/bash
+# Test imtcp with multiple I/O threads. The connections must be spread
+# over all threads and each thread must report its own counters.
+# added 2026-10-18, released under ASL 2.0
+echo ===============================================================================
+echo \[imtcp-workerthreads.sh\]: test imtcp with multiple I/O threads
+. $srcdir/diag.sh init
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+ruleset(name="stats") {
+	action(type="omfile" file="./rsyslog.out.stats.log")
+}
+module(load="../plugins/impstats/.libs/impstats" interval="1" severity="7" resetCounters="on" ruleset="stats")
+module(load="../plugins/imtcp/.libs/imtcp" workerthreads="3")
+input(type="imtcp" port="13514")
+
+template(name="outfmt" type="string" string="%msg:F,58:2%\n")
+:msg, contains, "msgnum:" action(type="omfile" template="outfmt" file="rsyslog.out.log")
+'
+. $srcdir/diag.sh startup
+. $srcdir/diag.sh tcpflood -c30 -m30000
+. $srcdir/diag.sh wait-for-stats-flush 'rsyslog.out.stats.log'
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh seq-check 0 29999
+. $srcdir/diag.sh custom-content-check 'imtcp(io2)' 'rsyslog.out.stats.log'
+. $srcdir/diag.sh first-column-sum-check 's/.*sessions.opened=\([0-9]\+\).*/\1/g' 'imtcp(io' 'rsyslog.out.stats.log' 30
+. $srcdir/diag.sh exit
@@ -0,0 +1,296 @@
+/* a very simplistic http receiver for the rsyslog testbench. It
+ * understands just enough HTTP/1.1 to stand in for an Elasticsearch
+ * server when omelasticsearch is benchmarked: every request is answered
+ * with "200 OK" and a bulk reply without errors. For POST requests, the
+ * body lines are written to the output file, except for the bulk action
+ * lines ({"index":...}), so the file contains one line per document.
+ * Multiple (keep-alive) connections are served; the program runs until
+ * it is terminated.
+ *
+ * Copyright 2026 Adiscon GmbH.
+ *
+ * This file is part of the rsyslog project.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#if defined(__FreeBSD__)
+#include <netinet/in.h>
+#endif
+
+#define MAX_CONNS 64
+
+/* the reply omelasticsearch expects for a successful bulk request */
+static const char replyBody[] = "{\"took\":1,\"errors\":false,\"items\":[]}";
+
+typedef struct {
+	int fd;
+	char *buf;
+	size_t lenBuf;
+	size_t maxBuf;
+	int bContinueSent;	/* did we already send "100 Continue" for the current request? */
+} conn_t;
+
+static conn_t conns[MAX_CONNS];
+static int fdf = -1;
+
+static void
+errout(char *reason)
+{
+	perror(reason);
+	exit(1);
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: minihttpsrvr -t ip-addr -p port -f outfile\n");
+	exit (1);
+}
+
+static void
+sendAll(int fd, const char *buf, size_t len)
+{
+	ssize_t nWritten;
+
+	while(len > 0) {
+		nWritten = send(fd, buf, len, 0);
+		if(nWritten <= 0)
+			return; /* peer gone, the next read will notice */
+		buf += nWritten;
+		len -= nWritten;
+	}
+}
+
+/* find a header in the header block, returns pointer to its value or NULL */
+static char *
+findHeader(char *hdrs, size_t lenHdrs, const char *name)
+{
+	const size_t lenName = strlen(name);
+	char *p = hdrs;
+	char *end = hdrs + lenHdrs;
+
+	while(p < end) {
+		if(!strncasecmp(p, name, lenName) && p[lenName] == ':') {
+			p += lenName + 1;
+			while(*p == ' ')
+				++p;
+			return p;
+		}
+		while(p < end && *p != '\n')
+			++p;
+		++p;
+	}
+	return NULL;
+}
+
+/* write the documents contained in a bulk request body */
+static void
+writeBody(const char *body, size_t lenBody)
+{
+	const char *line = body;
+	const char *end = body + lenBody;
+	const char *eol;
+
+	while(line < end) {
+		eol = memchr(line, '\n', end - line);
+		if(eol == NULL)
+			eol = end;
+		if(eol > line && strncmp(line, "{\"index\"", sizeof("{\"index\"") - 1)) {
+			if(write(fdf, line, eol - line) != eol - line || write(fdf, "\n", 1) != 1)
+				errout("write");
+		}
+		line = eol + 1;
+	}
+}
+
+/* process all complete requests in the connection buffer.
+ * Returns -1 if the connection must be closed.
+ */
+static int
+processRequests(conn_t *conn)
+{
+	char *hdrEnd;
+	char *val;
+	size_t lenHdrs;
+	size_t lenBody;
+	size_t lenReq;
+	int bIsHead;
+	char reply[256];
+	int lenReply;
+
+	while(1) {
+		hdrEnd = memmem(conn->buf, conn->lenBuf, "\r\n\r\n", 4);
+		if(hdrEnd == NULL)
+			return 0;
+		lenHdrs = hdrEnd - conn->buf + 4;
+		*hdrEnd = '\0'; /* temporarily, for the header functions */
+		if(findHeader(conn->buf, lenHdrs, "Transfer-Encoding") != NULL) {
+			fprintf(stderr, "minihttpsrvr: chunked requests are not supported\n");
+			return -1;
+		}
+		val = findHeader(conn->buf, lenHdrs, "Content-Length");
+		lenBody = (val == NULL) ? 0 : strtoul(val, NULL, 10);
+		bIsHead = !strncmp(conn->buf, "HEAD ", 5);
+		if(conn->lenBuf < lenHdrs + lenBody) {
+			val = findHeader(conn->buf, lenHdrs, "Expect");
+			*hdrEnd = '\r';
+			if(val != NULL && !conn->bContinueSent) {
+				sendAll(conn->fd, "HTTP/1.1 100 Continue\r\n\r\n", 25);
+				conn->bContinueSent = 1;
+			}
+			return 0;
+		}
+
+		if(!strncmp(conn->buf, "POST ", 5) || !strncmp(conn->buf, "PUT ", 4))
+			writeBody(conn->buf + lenHdrs, lenBody);
+		lenReply = snprintf(reply, sizeof(reply), "HTTP/1.1 200 OK\r\n"
+			"Content-Type: application/json; charset=UTF-8\r\n"
+			"Content-Length: %d\r\n\r\n", (int) sizeof(replyBody) - 1);
+		sendAll(conn->fd, reply, lenReply);
+		if(!bIsHead)
+			sendAll(conn->fd, replyBody, sizeof(replyBody) - 1);
+
+		lenReq = lenHdrs + lenBody;
+		memmove(conn->buf, conn->buf + lenReq, conn->lenBuf - lenReq);
+		conn->lenBuf -= lenReq;
+		conn->bContinueSent = 0;
+	}
+}
+
+static int
+readConn(conn_t *conn)
+{
+	ssize_t nRead;
+
+	if(conn->maxBuf - conn->lenBuf < 4096) {
+		conn->maxBuf = conn->maxBuf ? 2 * conn->maxBuf : 65536;
+		if((conn->buf = realloc(conn->buf, conn->maxBuf + 1)) == NULL)
+			errout("realloc");
+	}
+	nRead = recv(conn->fd, conn->buf + conn->lenBuf, conn->maxBuf - conn->lenBuf, 0);
+	if(nRead <= 0)
+		return -1;
+	conn->lenBuf += nRead;
+	return processRequests(conn);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int fds;
+	int fdc;
+	struct sockaddr_in srvAddr;
+	unsigned int srvAddrLen;
+	struct pollfd pfd[MAX_CONNS + 1];
+	int nConns = 0;
+	int opt;
+	int on = 1;
+	int i;
+	char *targetIP = NULL;
+	int targetPort = -1;
+
+	while((opt = getopt(argc, argv, "t:p:f:")) != -1) {
+		switch (opt) {
+		case 't':
+			targetIP = optarg;
+			break;
+		case 'p':
+			targetPort = atoi(optarg);
+			break;
+		case 'f':
+			if(!strcmp(optarg, "-")) {
+				fdf = 1;
+			} else {
+				fdf = open(optarg, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR|S_IWUSR);
+				if(fdf == -1) errout(optarg);
+			}
+			break;
+		default:
+			fprintf(stderr, "invalid option '%c' or value missing - terminating...\n", opt);
+			usage();
+			break;
+		}
+	}
+
+	if(targetIP == NULL) {
+		fprintf(stderr, "-t parameter missing -- terminating\n");
+		usage();
+	}
+	if(targetPort == -1) {
+		fprintf(stderr, "-p parameter missing -- terminating\n");
+		usage();
+	}
+	if(fdf == -1) {
+		fprintf(stderr, "-f parameter missing -- terminating\n");
+		usage();
+	}
+
+	fds = socket(AF_INET, SOCK_STREAM, 0);
+	setsockopt(fds, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	srvAddr.sin_family = AF_INET;
+	srvAddr.sin_addr.s_addr = inet_addr(targetIP);
+	srvAddr.sin_port = htons(targetPort);
+	srvAddrLen = sizeof(srvAddr);
+	if(bind(fds, (struct sockaddr *)&srvAddr, srvAddrLen) != 0)
+		errout("bind");
+	if(listen(fds, 20) != 0) errout("listen");
+
+	while(1) {
+		pfd[0].fd = fds;
+		pfd[0].events = POLLIN;
+		for(i = 0 ; i < nConns ; ++i) {
+			pfd[i+1].fd = conns[i].fd;
+			pfd[i+1].events = POLLIN;
+		}
+		if(poll(pfd, nConns + 1, -1) < 0)
+			errout("poll");
+		/* check clients from the end, so that a closed one can be replaced by the last */
+		for(i = nConns - 1 ; i >= 0 ; --i) {
+			if(!(pfd[i+1].revents & (POLLIN | POLLHUP | POLLERR)))
+				continue;
+			if(readConn(&conns[i]) != 0) {
+				close(conns[i].fd);
+				free(conns[i].buf);
+				conns[i] = conns[--nConns];
+			}
+		}
+		if(pfd[0].revents & POLLIN) {
+			fdc = accept(fds, NULL, NULL);
+			if(fdc < 0)
+				errout("accept");
+			if(nConns == MAX_CONNS) {
+				close(fdc);
+			} else {
+				memset(&conns[nConns], 0, sizeof(conn_t));
+				conns[nConns++].fd = fdc;
+			}
+		}
+	}
+	/* NOTREACHED */
+	return 0;
+}
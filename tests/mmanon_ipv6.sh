@@ -0,0 +1,43 @@
+#!/bin/bash
+# test IPv4 and IPv6 anonymization in mmanon, including embedded
+# IPv4 addresses and things that only look like addresses
+# This file is part of the rsyslog project, released under ASL 2.0
+. $srcdir/diag.sh init
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+module(load="../plugins/mmanon/.libs/mmanon")
+module(load="../plugins/imtcp/.libs/imtcp")
+input(type="imtcp" port="13514")
+
+template(name="outfmt" type="string" string="%msg%\n")
+
+action(type="mmanon" ipv4.bits="16" ipv6.enable="on" ipv6.bits="64")
+:msg, contains, "msgnum:" action(type="omfile" template="outfmt"
+			         file="rsyslog.out.log")
+'
+. $srcdir/diag.sh startup
+cat >tmp.in <<'END'
+<129>Mar 10 01:00:00 172.20.245.8 tag: msgnum:1 from 192.168.1.100 to 10.0.0.1:80
+<129>Mar 10 01:00:00 172.20.245.8 tag: msgnum:2 src=2001:db8:85a3:8d3:1319:8a2e:370:7348 dst=::1
+<129>Mar 10 01:00:00 172.20.245.8 tag: msgnum:3 mapped ::ffff:192.168.10.20 and fe80::1%eth0
+<129>Mar 10 01:00:00 172.20.245.8 tag: msgnum:4 at 12:34:56.789 mac 00:1a:2b:3c:4d:5e std::vector
+END
+. $srcdir/diag.sh tcpflood -I tmp.in
+rm tmp.in
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+cat >tmp.expected <<'END'
+ msgnum:1 from 192.168.0.0 to 10.0.0.0:80
+ msgnum:2 src=2001:db8:85a3:8d3:: dst=::
+ msgnum:3 mapped ::0.0.0.0 and fe80::%eth0
+ msgnum:4 at 12:34:56.789 mac 00:1a:2b:3c:4d:5e std::vector
+END
+cmp tmp.expected rsyslog.out.log
+if [ ! $? -eq 0 ]; then
+  echo "invalid anonymization, rsyslog.out.log is:"
+  cat rsyslog.out.log
+  exit 1
+fi;
+rm tmp.expected
+
+. $srcdir/diag.sh exit
@@ -0,0 +1,27 @@
+#!/bin/bash
+# check that the JSON output does not depend on mmjsonparse lazy mode,
+# even if the input is not formatted the way json-c does it
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[mmjsonparse-lazy-canonical.sh\]: test lazy and regular mode give same output
+. $srcdir/diag.sh init
+rm -f rsyslog2.out.log
+. $srcdir/diag.sh startup mmjsonparse-lazy-canonical.conf
+. $srcdir/diag.sh injectmsg-litteral $srcdir/testsuites/mmjsonparse_lazy_input
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+if [ $(wc -l < rsyslog2.out.log) -ne 6 ]; then
+	echo "FAIL: expected 6 lines of regular mode output, have:"
+	cat rsyslog2.out.log
+	. $srcdir/diag.sh error-exit 1
+fi
+if ! cmp rsyslog.out.log rsyslog2.out.log; then
+	echo "FAIL: output differs between lazy and regular mode"
+	echo "lazy:"
+	cat rsyslog.out.log
+	echo "regular:"
+	cat rsyslog2.out.log
+	. $srcdir/diag.sh error-exit 1
+fi
+rm -f rsyslog2.out.log
+. $srcdir/diag.sh exit
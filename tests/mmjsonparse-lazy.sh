@@ -0,0 +1,15 @@
+#!/bin/bash
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[mmjsonparse-lazy.sh\]: test for mmjsonparse lazy mode
+. $srcdir/diag.sh init
+. $srcdir/diag.sh startup mmjsonparse-lazy.conf
+. $srcdir/diag.sh tcpflood -m 1 -M "\"<167>Nov  6 12:34:56 172.0.0.1 test: @cee: {\\\"msgnum\\\":\\\"1\\\", \\\"sub\\\": {\\\"b\\\": \\\"x\\\"}, \\\"arr\\\": [\\\"a\\\", \\\"b\\\"], \\\"n\\\": null}\""
+echo doing shutdown
+. $srcdir/diag.sh shutdown-when-empty
+echo wait on shutdown
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh content-check "fields: 1 x b n= m="
+. $srcdir/diag.sh content-check "all:{ \"msgnum\": \"1\", \"sub\": { \"b\": \"x\" }, \"arr\": [ \"a\", \"b\" ], \"n\": null }"
+. $srcdir/diag.sh content-check "\"n\": null, \"new\": \"added\" }"
+. $srcdir/diag.sh exit
@@ -0,0 +1,37 @@
+#!/bin/bash
+# check that original and MsgDup() copy do not see each other's
+# modifications of the (shared) JSON tree
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[msgdup-json-cow.sh\]: test copy-on-write of JSON tree in message copies
+. $srcdir/diag.sh init
+rm -f rsyslog2.out.log
+. $srcdir/diag.sh startup msgdup-json-cow.conf
+. $srcdir/diag.sh injectmsg 0 1000
+# the copies are processed by the ruleset queue, which shutdown-when-empty
+# does not cover, so we wait until all of them are written
+i=0
+while [ ! -f rsyslog2.out.log ] || [ $(wc -l < rsyslog2.out.log) -lt 1000 ]; do
+	./msleep 100
+	let "i++"
+	if test $i -gt $TB_TIMEOUT_STARTSTOP; then
+		echo "ABORT! Timeout waiting for copied messages"
+		. $srcdir/diag.sh error-exit 1
+	fi
+done
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+if [ "$(sort -u rsyslog.out.log)" != "orig,changed,here" ] || [ $(wc -l < rsyslog.out.log) -ne 1000 ]; then
+	echo "original messages invalid, unique lines:"
+	sort -u rsyslog.out.log
+	wc -l < rsyslog.out.log
+	. $srcdir/diag.sh error-exit 1
+fi
+if [ "$(sort -u rsyslog2.out.log)" != "copy,shared," ] || [ $(wc -l < rsyslog2.out.log) -ne 1000 ]; then
+	echo "copied messages invalid, unique lines:"
+	sort -u rsyslog2.out.log
+	wc -l < rsyslog2.out.log
+	. $srcdir/diag.sh error-exit 1
+fi
+rm -f rsyslog2.out.log
+. $srcdir/diag.sh exit
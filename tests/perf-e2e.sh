@@ -0,0 +1,234 @@
+#!/bin/bash
+# End-to-end throughput and latency suite. For each scenario, rsyslogd is
+# started with a scenario-specific config, tcpflood sends messages that
+# carry their send time (-k), and the outputs write the message number,
+# the send time and the time the message was formatted for output
+# ($now-unixtimestamp-us). Throughput is measured from the start of
+# sending until all messages arrived at the output; latency statistics are
+# computed by chkseq -l. Results are written to perf-e2e.out.csv and
+# perf-e2e.out.json (one line per scenario).
+# This suite is not part of "make check", run it via "make perf".
+#
+# Environment:
+# RSYSLOG_PERF_MSGS      number of messages per scenario (default 10000,
+#                        use much more for real measurements)
+# RSYSLOG_PERF_SCENARIOS scenarios to run (default: all), out of
+#                        udp tcp tls dynafile diskqueue elasticsearch
+# Scenarios whose modules are not built are skipped. UDP may lose
+# messages, this is reported but not considered an error.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[perf-e2e.sh\]: end-to-end throughput and latency suite
+NMSGS=${RSYSLOG_PERF_MSGS:-10000}
+SCENARIOS=${RSYSLOG_PERF_SCENARIOS:-"udp tcp tls dynafile diskqueue elasticsearch"}
+RESULT_CSV=perf-e2e.out.csv
+RESULT_JSON=perf-e2e.out.json
+HTTP_PORT=19200
+OUTFMT='template(name="outfmt" type="string"
+	 string="%msg:F,58:2%,%msg:F,58:3%,%$now-unixtimestamp-us%\n")'
+
+rm -f $RESULT_CSV $RESULT_JSON
+echo "scenario,status,msgs,received,seconds,msgs_per_sec,lat_count,lat_min_us,lat_avg_us,lat_p50_us,lat_p90_us,lat_p99_us,lat_p999_us,lat_max_us" > $RESULT_CSV
+nfailed=0
+
+# now in nanoseconds
+now_ns() {
+	date +%s%N
+}
+
+# wait until the output files ($2...) contain $1 lines or no more lines
+# arrive for 10 seconds. Sets nreceived.
+wait_lines() {
+	local expected=$1
+	local last=0
+	local idle=0
+	shift
+	while true; do
+		nreceived=$(cat "$@" 2>/dev/null | wc -l)
+		if [ $nreceived -ge $expected ]; then
+			return
+		fi
+		if [ $nreceived -eq $last ]; then
+			let "idle++"
+			if [ $idle -ge 1000 ]; then
+				echo "no new output for 10 seconds, received $nreceived of $expected"
+				return
+			fi
+		else
+			idle=0
+			last=$nreceived
+		fi
+		./msleep 10
+	done
+}
+
+# run one scenario: $1 name, $2 tcpflood options, $3 allowed loss (0 or 1),
+# $4 output file(s), may be a pattern. The config must already be generated.
+run_scenario() {
+	local name=$1
+	local floodopts=$2
+	local lossok=$3
+	local status=ok
+	local lat
+	local nlost
+	local last
+	local tstart tend
+	local outfiles=$4
+	. $srcdir/diag.sh startup
+	tstart=$(now_ns)
+	. $srcdir/diag.sh tcpflood -m$NMSGS -k $floodopts
+	wait_lines $NMSGS $outfiles
+	tend=$(now_ns)
+	. $srcdir/diag.sh shutdown-when-empty
+	. $srcdir/diag.sh wait-shutdown
+	cat $outfiles | $RS_SORTCMD -g > work
+	nlost=$((NMSGS - $(cat work | wc -l)))
+	if [ $nlost -gt 0 ] && [ $lossok -eq 0 ]; then
+		echo "scenario $name: $nlost messages lost"
+		status=failed
+	fi
+	if [ $nlost -gt 0 ]; then
+		# lost messages at the tail would otherwise be reported as error
+		last=$(tail -n1 work | cut -d, -f1 | sed -e 's/^0*\([0-9]\)/\1/')
+		seqout=$(./chkseq -fwork -s0 -e${last:-0} -m$nlost -l)
+	else
+		seqout=$(./chkseq -fwork -s0 -e$((NMSGS - 1)) -l)
+	fi
+	seqrc=$?
+	lat=$(echo "$seqout" | grep '^{')
+	if [ "$seqrc" -ne "0" ] || [ "x$lat" == "x" ]; then
+		echo "scenario $name: sequence error detected"
+		./chkseq -fwork -s0 -e$((NMSGS - 1)) -l -m$nlost | head -n 10
+		status=failed
+		lat='{"lat_count": 0}'
+	fi
+	if [ $status != ok ]; then
+		let "nfailed++"
+	fi
+	awk -v name=$name -v msgs=$NMSGS -v rcvd=$nreceived -v ns=$((tend - tstart)) \
+	    -v status=$status -v lat="$lat" 'BEGIN {
+		secs = ns > 0 ? ns / 1000000000 : 1e-9;
+		printf("{\"scenario\": \"%s\", \"status\": \"%s\", \"msgs\": %d, \"received\": %d, "\
+		       "\"seconds\": %.3f, \"msgs_per_sec\": %.0f, \"latency\": %s}\n",
+		       name, status, msgs, rcvd, secs, rcvd / secs, lat);
+	}' | tee -a $RESULT_JSON
+	# the CSV is generated from the JSON record, fields are in the same order
+	tail -n1 $RESULT_JSON | sed -e 's/"[a-z0-9_]*": //g' -e 's/[{}" ]//g' >> $RESULT_CSV
+}
+
+# checks if all given modules are built, else reports scenario as skipped
+have_modules() {
+	for mod in "$@"; do
+		if [ ! -f ../$mod ]; then
+			echo "scenario $scenario: ../$mod not found, skipped"
+			return 1
+		fi
+	done
+	return 0
+}
+
+for scenario in $SCENARIOS; do
+	. $srcdir/diag.sh init
+	. $srcdir/diag.sh generate-conf
+	case $scenario in
+	udp)
+		have_modules plugins/imudp/.libs/imudp.so || continue
+		. $srcdir/diag.sh add-conf '
+module(load="../plugins/imudp/.libs/imudp")
+input(type="imudp" address="127.0.0.1" port="13514")
+'"$OUTFMT"'
+:msg, contains, "msgnum:" action(type="omfile" template="outfmt" file="rsyslog.out.log")
+'
+		# limit rate a bit, so that the socket buffer is not overrun
+		run_scenario udp "-Tudp -b100 -W1000" 1 rsyslog.out.log
+		;;
+	tcp)
+		have_modules plugins/imtcp/.libs/imtcp.so || continue
+		. $srcdir/diag.sh add-conf '
+module(load="../plugins/imtcp/.libs/imtcp")
+input(type="imtcp" port="13514")
+'"$OUTFMT"'
+:msg, contains, "msgnum:" action(type="omfile" template="outfmt" file="rsyslog.out.log")
+'
+		run_scenario tcp "-c4" 0 rsyslog.out.log
+		;;
+	tls)
+		have_modules plugins/imtcp/.libs/imtcp.so runtime/.libs/lmnsd_gtls.so || continue
+		if grep -q "define ENABLE_GNUTLS 1" ../config.h; then
+			. $srcdir/diag.sh add-conf '
+global(defaultNetstreamDriverCAFile="'$srcdir'/tls-certs/ca.pem"
+       defaultNetstreamDriverCertFile="'$srcdir'/tls-certs/cert.pem"
+       defaultNetstreamDriverKeyFile="'$srcdir'/tls-certs/key.pem")
+module(load="../plugins/imtcp/.libs/imtcp" streamDriver.name="gtls"
+       streamDriver.mode="1" streamDriver.authMode="anon")
+input(type="imtcp" port="13514")
+'"$OUTFMT"'
+:msg, contains, "msgnum:" action(type="omfile" template="outfmt" file="rsyslog.out.log")
+'
+			run_scenario tls "-c4 -Ttls -Z$srcdir/tls-certs/cert.pem -z$srcdir/tls-certs/key.pem" 0 rsyslog.out.log
+		else
+			echo "scenario tls: tcpflood has no TLS support, skipped"
+		fi
+		;;
+	dynafile)
+		have_modules plugins/imtcp/.libs/imtcp.so || continue
+		# tcpflood -f adds the file number as first field, so all fields move by one
+		. $srcdir/diag.sh add-conf '
+module(load="../plugins/imtcp/.libs/imtcp")
+input(type="imtcp" port="13514")
+template(name="outfmt" type="string"
+	 string="%msg:F,58:3%,%msg:F,58:4%,%$now-unixtimestamp-us%\n")
+template(name="dynfile" type="string" string="rsyslog.out.%msg:F,58:2%.log")
+:msg, contains, "msgnum:" action(type="omfile" template="outfmt" dynaFile="dynfile"
+				 dynaFileCacheSize="10")
+'
+		run_scenario dynafile "-c4 -f10" 0 'rsyslog.out.[0-9].log'
+		;;
+	diskqueue)
+		have_modules plugins/imtcp/.libs/imtcp.so || continue
+		. $srcdir/diag.sh add-conf '
+module(load="../plugins/imtcp/.libs/imtcp")
+input(type="imtcp" port="13514")
+'"$OUTFMT"'
+:msg, contains, "msgnum:" action(type="omfile" template="outfmt" file="rsyslog.out.log"
+				 queue.type="disk" queue.filename="perfq"
+				 queue.spoolDirectory="test-spool")
+'
+		run_scenario diskqueue "-c4" 0 rsyslog.out.log
+		;;
+	elasticsearch)
+		have_modules plugins/imtcp/.libs/imtcp.so \
+			plugins/omelasticsearch/.libs/omelasticsearch.so || continue
+		# the document is the output line, the mock server writes one line per document
+		. $srcdir/diag.sh add-conf '
+module(load="../plugins/imtcp/.libs/imtcp")
+module(load="../plugins/omelasticsearch/.libs/omelasticsearch")
+input(type="imtcp" port="13514")
+template(name="outfmt" type="string"
+	 string="%msg:F,58:2%,%msg:F,58:3%,%$now-unixtimestamp-us%")
+:msg, contains, "msgnum:" action(type="omelasticsearch" template="outfmt"
+				 server="127.0.0.1" serverport="'$HTTP_PORT'"
+				 searchIndex="perf" searchType="events" bulkmode="on")
+'
+		./minihttpsrv -t127.0.0.1 -p$HTTP_PORT -frsyslog.out.log &
+		HTTP_PID=$!
+		./msleep 500
+		run_scenario elasticsearch "-c4" 0 rsyslog.out.log
+		kill $HTTP_PID
+		wait $HTTP_PID 2>/dev/null
+		;;
+	*)
+		echo "unknown scenario '$scenario'"
+		. $srcdir/diag.sh error-exit 1
+		;;
+	esac
+done
+
+echo "results (also in $RESULT_CSV and $RESULT_JSON):"
+cat $RESULT_CSV
+rm -f work
+if [ $nfailed -ne 0 ]; then
+	echo "$nfailed scenario(s) failed"
+	. $srcdir/diag.sh error-exit 1
+fi
+. $srcdir/diag.sh exit
@@ -0,0 +1,103 @@
+#!/bin/bash
+# check that sampled pipeline tracing records spans for all stages and
+# writes a complete Chrome trace file, without affecting processing. Also
+# checks the span histograms reported via impstats, and that the copies
+# of messages passed to a queued ruleset continue the trace.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[pipeline-trace.sh\]: test sampled pipeline tracing
+. $srcdir/diag.sh init
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+global(trace.sampleRate="10" trace.file="rsyslog.trace.json")
+module(load="../plugins/imtcp/.libs/imtcp")
+input(type="imtcp" port="13514")
+
+ruleset(name="stats") {
+	action(type="omfile" file="rsyslog.out.stats.log")
+}
+module(load="../plugins/impstats/.libs/impstats" interval="1" severity="7" Ruleset="stats" bracketing="on")
+
+template(name="outfmt" type="string" string="%msg:F,58:2%\n")
+ruleset(name="out") {
+	action(type="omfile" template="outfmt" file="rsyslog.out.log")
+}
+ruleset(name="async" queue.type="LinkedList") {
+	action(type="omfile" template="outfmt" file="rsyslog2.out.log")
+}
+if $msg contains "msgnum:" then {
+	call out
+	call async
+}
+'
+rm -f rsyslog.trace.json
+. $srcdir/diag.sh startup
+. $srcdir/diag.sh wait-for-stats-flush 'rsyslog.out.stats.log'
+. $srcdir/diag.sh block-stats-flush
+. $srcdir/diag.sh tcpflood -m1000
+. $srcdir/diag.sh wait-queueempty
+# the traces complete only when the copies in the async ruleset are done
+i=0
+while [ "$(cat rsyslog2.out.log 2>/dev/null | wc -l)" -lt 1000 ]; do
+	if [ $i -gt 300 ]; then
+		echo "async ruleset did not process all messages"
+		. $srcdir/diag.sh error-exit 1
+	fi
+	./msleep 100
+	let "i++"
+done
+. $srcdir/diag.sh allow-single-stats-flush-after-block-and-wait-for-it
+
+# check the "pipeline-trace" stats counters. The stats messages are traced,
+# too, so we see a few more than the about 100 sampled test messages. Spans
+# are recorded in microseconds, so only the end-to-end span is sure to be
+# non-zero; parse and ruleset spans may well round down to 0.
+statsline=$(grep -F 'pipeline-trace: origin=core.trace' rsyslog.out.stats.log | tail -1)
+get_counter() {
+	echo "$statsline" | sed -n "s/.* $1=\([0-9]*\).*/\1/p"
+}
+traced=$(get_counter traced)
+if [ "0$traced" -lt 90 ] || [ "0$traced" -gt 130 ] || [ "x$(get_counter events.dropped)" != "x0" ]; then
+	echo "FAIL: unexpected traced/events.dropped counters"
+	echo "stats line: $statsline"
+	. $srcdir/diag.sh error-exit 1
+fi
+for span in total queuewait parse ruleset action; do
+	count=$(get_counter $span.count)
+	p99=$(get_counter $span.p99)
+	max=$(get_counter $span.max)
+	if [ "0$count" -lt 90 ] || [ -z "$p99" ] || [ "0$max" -lt "0$p99" ]; then
+		echo "FAIL: unexpected $span span stats: count=$count p99=$p99 max=$max"
+		echo "stats line: $statsline"
+		. $srcdir/diag.sh error-exit 1
+	fi
+done
+if [ "0$(get_counter total.p99)" -le 0 ]; then
+	echo "FAIL: end-to-end span p99 is 0"
+	echo "stats line: $statsline"
+	. $srcdir/diag.sh error-exit 1
+fi
+
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh seq-check 0 999
+for span in '"name":"queue:main Q"' '"name":"parse"' '"name":"ruleset:RSYSLOG_DefaultRuleset"' \
+	    '"name":"ruleset:out"' '"name":"queue:async"' '"cat":"action"' '"name":"total"'; do
+	if ! grep -q "$span" rsyslog.trace.json; then
+		echo "span $span missing in trace file, content:"
+		head -n 20 rsyslog.trace.json
+		. $srcdir/diag.sh error-exit 1
+	fi
+done
+if [ "$(head -n1 rsyslog.trace.json)" != "[" ] || [ "$(tail -n1 rsyslog.trace.json)" != "]" ]; then
+	echo "trace file is not a complete JSON array"
+	. $srcdir/diag.sh error-exit 1
+fi
+# we sampled about 100 messages, one "total" span each
+ntraced=$(grep -c '"name":"total"' rsyslog.trace.json)
+if [ $ntraced -lt 90 ] || [ $ntraced -gt 110 ]; then
+	echo "expected about 100 traced messages, got $ntraced"
+	. $srcdir/diag.sh error-exit 1
+fi
+rm -f rsyslog.trace.json
+. $srcdir/diag.sh exit
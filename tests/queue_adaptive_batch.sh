@@ -0,0 +1,47 @@
+#!/bin/bash
+# check that the adaptive dequeue batch size grows while there is a
+# backlog, is halved when the action is suspended and grows back later.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[queue_adaptive_batch.sh\]: test for adaptive dequeue batch size
+. $srcdir/diag.sh init
+. $srcdir/diag.sh startup queue_adaptive_batch.conf
+. $srcdir/diag.sh wait-for-stats-flush 'rsyslog.out.stats.log'
+. $srcdir/diag.sh block-stats-flush
+
+# check the batch size reported by the last stats report
+check_batchsize() {
+	line=$(grep -F 'adaptive: origin=core.queue' rsyslog.out.stats.log | tail -1)
+	size=$(echo "$line" | sed -n 's/.* dequeuebatchsize=\([0-9]*\).*/\1/p')
+	if [ "x$size" != "x$1" ]; then
+		echo "FAIL: $2: expected dequeue batch size $1, have '$size'"
+		echo "stats line: $line"
+		. $srcdir/diag.sh error-exit 1
+	fi
+}
+
+# the first message suspends the action, the others build a backlog. The
+# batch size starts at the minimum (4) and grows to the maximum (64).
+. $srcdir/diag.sh injectmsg 0 10000
+. $srcdir/diag.sh wait-queueempty
+. $srcdir/diag.sh allow-single-stats-flush-after-block-and-wait-for-it
+check_batchsize 64 "backlog"
+
+# message 10000 suspends the action again, the batch size is halved
+. $srcdir/diag.sh injectmsg 10000 1
+. $srcdir/diag.sh wait-queueempty
+. $srcdir/diag.sh allow-single-stats-flush-after-block-and-wait-for-it
+check_batchsize 32 "suspension"
+
+# with a backlog and no further trouble, it grows back
+. $srcdir/diag.sh injectmsg 10001 9999
+. $srcdir/diag.sh wait-queueempty
+. $srcdir/diag.sh allow-single-stats-flush-after-block-and-wait-for-it
+check_batchsize 64 "recovery"
+
+echo doing shutdown
+. $srcdir/diag.sh shutdown-when-empty
+echo wait on shutdown
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh seq-check 0 19999
+. $srcdir/diag.sh exit
@@ -0,0 +1,15 @@
+#!/bin/bash
+# check that fair queueing mode neither loses nor duplicates messages,
+# including when the number of keys exceeds queue.fairness.maxKeys
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[queue_fairness.sh\]: test for fair queueing mode
+. $srcdir/diag.sh init
+. $srcdir/diag.sh startup queue_fairness.conf
+. $srcdir/diag.sh injectmsg  0 10000
+echo doing shutdown
+. $srcdir/diag.sh shutdown-when-empty
+echo wait on shutdown
+. $srcdir/diag.sh wait-shutdown 
+. $srcdir/diag.sh seq-check  0 9999
+. $srcdir/diag.sh exit
@@ -0,0 +1,34 @@
+#!/bin/bash
+# check the dequeue order and the per-key limits of fair queueing mode.
+# The queue worker is kept busy while a skewed key mix is enqueued, so
+# the output order is exactly the deficit round robin order.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[queue_fairness_order.sh\]: test for fair queueing mode dequeue order
+. $srcdir/diag.sh init
+. $srcdir/diag.sh startup queue_fairness_order.conf
+. $srcdir/diag.sh wait-for-stats-flush 'rsyslog.out.stats.log'
+# the blocker message keeps the single worker of the fair queue busy for
+# 3 seconds, all other messages are enqueued during that time
+echo '<167>Mar  1 01:00:00 blocker tag: msgnum:blocker' > rsyslog.input
+. $srcdir/diag.sh injectmsg-litteral rsyslog.input
+./msleep 500
+. $srcdir/diag.sh injectmsg-litteral $srcdir/testsuites/queue_fairness_order_input
+. $srcdir/diag.sh wait-queueempty
+. $srcdir/diag.sh wait-for-stats-flush 'rsyslog.out.stats.log'
+echo doing shutdown
+. $srcdir/diag.sh shutdown-when-empty
+echo wait on shutdown
+. $srcdir/diag.sh wait-shutdown
+# hostA (weight 2) may dequeue 4 messages per round, all others 2. Only 6
+# messages per key are queued, so A07-A10 are discarded. hostD and hostE
+# share the overflow sub-queue, which also holds 6 messages at most, so
+# E03 and E04 are discarded, too.
+printf 'A01\nA02\nA03\nA04\nB01\nB02\nC01\nC02\nD01\nD02\nA05\nA06\nB03\nB04\nC03\nD03\nD04\nB05\nE01\nE02\n' | cmp - rsyslog.out.log
+if [ ! $? -eq 0 ]; then
+  echo "FAIL: unexpected dequeue order, rsyslog.out.log is:"
+  cat rsyslog.out.log
+  . $srcdir/diag.sh error-exit 1
+fi;
+. $srcdir/diag.sh custom-content-check 'discarded.fairness=6 ' 'rsyslog.out.stats.log'
+. $srcdir/diag.sh exit
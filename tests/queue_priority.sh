@@ -0,0 +1,14 @@
+#!/bin/bash
+# check that priority lane mode neither loses nor duplicates messages
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[queue_priority.sh\]: test for priority lanes in queues
+. $srcdir/diag.sh init
+. $srcdir/diag.sh startup queue_priority.conf
+. $srcdir/diag.sh injectmsg  0 10000
+echo doing shutdown
+. $srcdir/diag.sh shutdown-when-empty
+echo wait on shutdown
+. $srcdir/diag.sh wait-shutdown 
+. $srcdir/diag.sh seq-check  0 9999
+. $srcdir/diag.sh exit
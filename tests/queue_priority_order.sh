@@ -0,0 +1,45 @@
+#!/bin/bash
+# check the dequeue order and the lane limits of priority lane mode.
+# The queue workers are kept busy while messages of mixed severity are
+# enqueued, so the output order is exactly the dequeue order.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[queue_priority_order.sh\]: test for priority lanes dequeue order
+. $srcdir/diag.sh init
+rm -f rsyslog2.out.log
+. $srcdir/diag.sh startup queue_priority_order.conf
+. $srcdir/diag.sh wait-for-stats-flush 'rsyslog.out.stats.log'
+# the blocker message keeps the single worker of each queue busy for 3
+# seconds, all other messages are enqueued during that time. It is a
+# debug message, so the lowest priority lane has no credit left when
+# the other messages are dequeued.
+echo '<167>Mar  1 01:00:00 blocker tag: msgnum:blocker' > rsyslog.input
+. $srcdir/diag.sh injectmsg-litteral rsyslog.input
+./msleep 500
+. $srcdir/diag.sh injectmsg-litteral $srcdir/testsuites/queue_priority_order_input
+. $srcdir/diag.sh wait-queueempty
+. $srcdir/diag.sh wait-for-stats-flush 'rsyslog.out.stats.log'
+echo doing shutdown
+. $srcdir/diag.sh shutdown-when-empty
+echo wait on shutdown
+. $srcdir/diag.sh wait-shutdown
+# strict: higher lanes always first. Lane 1 holds 3 messages at most, so
+# w3 is discarded. Lane 2 discards debug messages (d4, d5) once it holds
+# 4 messages, but still accepts informational ones (i2).
+printf 'c1\na1\nc2\nc3\nc4\nc5\nw1\nw2\ne1\nd1\nd2\ni1\nd3\ni2\n' | cmp - rsyslog.out.log
+if [ ! $? -eq 0 ]; then
+  echo "FAIL: unexpected strict priority dequeue order, rsyslog.out.log is:"
+  cat rsyslog.out.log
+  . $srcdir/diag.sh error-exit 1
+fi;
+# weighted: per round, lane 0 dequeues 3 messages, lane 1 2 and lane 2 1
+printf 'c1\na1\nc2\nw1\nw2\nd1\nc3\nc4\nc5\ne1\nw3\nd2\ni1\nd3\nd4\ni2\nd5\n' | cmp - rsyslog2.out.log
+if [ ! $? -eq 0 ]; then
+  echo "FAIL: unexpected weighted dequeue order, rsyslog2.out.log is:"
+  cat rsyslog2.out.log
+  . $srcdir/diag.sh error-exit 1
+fi;
+. $srcdir/diag.sh custom-content-check 'lane1.enqueued=4 lane1.discarded=1 lane1.maxqsize=3 ' 'rsyslog.out.stats.log'
+. $srcdir/diag.sh custom-content-check 'lane2.enqueued=8 lane2.discarded=2 lane2.maxqsize=5 ' 'rsyslog.out.stats.log'
+rm -f rsyslog2.out.log
+. $srcdir/diag.sh exit
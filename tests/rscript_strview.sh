@@ -0,0 +1,13 @@
+#!/bin/bash
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[rscript_strview.sh\]: test for string operations on message properties
+. $srcdir/diag.sh init
+. $srcdir/diag.sh startup rscript_strview.conf
+. $srcdir/diag.sh injectmsg  0 5000
+echo doing shutdown
+. $srcdir/diag.sh shutdown-when-empty
+echo wait on shutdown
+. $srcdir/diag.sh wait-shutdown 
+. $srcdir/diag.sh seq-check  0 4999
+. $srcdir/diag.sh exit
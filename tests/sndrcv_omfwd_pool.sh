@@ -0,0 +1,70 @@
+#!/bin/bash
+# This tests an omfwd target pool in hash mode. Instance TWO sends data
+# via a pool of two targets: instance ONE (port 13515) and instance
+# THREE (port 13516). The first half of the messages must be spread
+# over both receivers. Then instance THREE is shut down, and the second
+# half must fully arrive at instance ONE. In total, each message must
+# have been received exactly once.
+# This file is part of the rsyslog project, released  under GPLv3
+echo ===============================================================================
+echo \[sndrcv_omfwd_pool.sh\]: testing sending via an omfwd target pool
+
+# wait until the receivers wrote $1 lines in total
+wait_received() {
+	i=0
+	while [ $(cat rsyslog.out.log rsyslog3.out.log 2>/dev/null | wc -l) -lt $1 ]; do
+		./msleep 100
+		let "i++"
+		if test $i -gt $TB_TIMEOUT_STARTSTOP; then
+			echo "ABORT! timeout waiting for $1 messages, got" \
+				$(cat rsyslog.out.log rsyslog3.out.log 2>/dev/null | wc -l)
+			. $srcdir/diag.sh error-exit 1
+		fi
+	done
+}
+
+. $srcdir/diag.sh init
+. $srcdir/diag.sh startup sndrcv_omfwd_pool_rcvr.conf
+. $srcdir/diag.sh startup sndrcv_omfwd_pool_rcvr3.conf 3
+. $srcdir/diag.sh startup sndrcv_omfwd_pool_sender.conf 2
+
+# first half: both receivers are up, keys must be spread over them
+. $srcdir/diag.sh tcpflood -m5000 -i0
+wait_received 5000
+NRCVD1=$(wc -l < rsyslog.out.log)
+NRCVD3=$(wc -l < rsyslog3.out.log)
+echo "first half: receiver ONE got $NRCVD1, receiver THREE got $NRCVD3 messages"
+if [ $NRCVD1 -lt 1000 ] || [ $NRCVD3 -lt 1000 ]; then
+	echo "messages are not distributed over the pool"
+	. $srcdir/diag.sh error-exit 1
+fi
+
+# second half: receiver THREE is gone, ONE must take over its keys
+. $srcdir/diag.sh shutdown-when-empty 3
+. $srcdir/diag.sh wait-shutdown 3
+. $srcdir/diag.sh tcpflood -m5000 -i5000
+wait_received 10000
+if [ $(wc -l < rsyslog3.out.log) -ne $NRCVD3 ]; then
+	echo "receiver THREE got messages after it was shut down"
+	. $srcdir/diag.sh error-exit 1
+fi
+if [ $(wc -l < rsyslog.out.log) -ne $((NRCVD1 + 5000)) ]; then
+	echo "receiver ONE did not get all messages of the second half, got" \
+		$(($(wc -l < rsyslog.out.log) - NRCVD1))
+	. $srcdir/diag.sh error-exit 1
+fi
+
+. $srcdir/diag.sh shutdown-when-empty 2
+. $srcdir/diag.sh wait-shutdown 2
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+
+# each message must have been received exactly once (chkseq fails on duplicates)
+cat rsyslog.out.log rsyslog3.out.log | $RS_SORTCMD -g > work
+./chkseq -fwork -s0 -e9999
+if [ "$?" -ne "0" ]; then
+	echo "sequence error detected"
+	. $srcdir/diag.sh error-exit 1
+fi
+rm -f rsyslog3.out.log
+. $srcdir/diag.sh exit
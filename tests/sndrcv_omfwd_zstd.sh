@@ -0,0 +1,12 @@
+#!/bin/bash
+# This tests zstd stream compression between omfwd and imptcp. The
+# receiver detects the codec from the stream, so it just needs to be
+# configured for stream compression.
+# This file is part of the rsyslog project, released  under GPLv3
+echo ===============================================================================
+echo \[sndrcv_omfwd_zstd.sh\]: testing sending and receiving via zstd compressed stream
+./compbench -c zstd -n 10 > /dev/null
+if [ $? -eq 77 ]; then
+	exit 77 # no zstd support, skip this test
+fi
+. $srcdir/sndrcv_drvr.sh sndrcv_omfwd_zstd 50000
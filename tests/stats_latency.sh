@@ -0,0 +1,37 @@
+#!/bin/bash
+# check the queue wait time and action processing time histograms. Each
+# message is delayed by a known time, so we can check the reported values.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[stats_latency.sh\]: test for queue wait time and action processing time histograms
+. $srcdir/diag.sh init
+. $srcdir/diag.sh startup stats_latency.conf
+. $srcdir/diag.sh wait-for-stats-flush 'rsyslog.out.stats.log'
+. $srcdir/diag.sh block-stats-flush
+. $srcdir/diag.sh injectmsg 0 20
+. $srcdir/diag.sh wait-queueempty
+. $srcdir/diag.sh allow-single-stats-flush-after-block-and-wait-for-it
+
+# check the histogram $2 of stats object $1 in the last report. All 20
+# messages must be counted, and p99 must be at least the 100ms delay.
+# Values are reported as bucket upper bounds, so max can not be below p99.
+check_latency() {
+	line=$(grep -F "$1: origin=" rsyslog.out.stats.log | tail -1)
+	count=$(echo "$line" | sed -n "s/.* $2\.count=\([0-9]*\).*/\1/p")
+	p99=$(echo "$line" | sed -n "s/.* $2\.p99=\([0-9]*\).*/\1/p")
+	max=$(echo "$line" | sed -n "s/.* $2\.max=\([0-9]*\).*/\1/p")
+	if [ "x$count" != "x20" ] || [ "0$p99" -lt 100000 ] || [ "0$max" -lt "0$p99" ]; then
+		echo "FAIL: unexpected $2 histogram for '$1': count=$count p99=$p99 max=$max"
+		echo "stats line: $line"
+		. $srcdir/diag.sh error-exit 1
+	fi
+}
+check_latency 'sleeper queue' waittime
+check_latency 'sleeper' proctime
+
+echo doing shutdown
+. $srcdir/diag.sh shutdown-when-empty
+echo wait on shutdown
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh seq-check 0 19
+. $srcdir/diag.sh exit
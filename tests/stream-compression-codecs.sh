@@ -0,0 +1,17 @@
+#!/bin/bash
+# Check that data compressed with each supported stream codec is
+# decompressed to the original, with and without flushing after
+# each message. Also prints the codec benchmark results.
+# This file is part of the rsyslog project, released  under GPLv3
+echo ===============================================================================
+echo \[stream-compression-codecs.sh\]: roundtrip all stream compression codecs
+./compbench -n 20000
+if [ $? -ne 0 ]; then
+	echo "FAIL: stream compression roundtrip with batches failed"
+	exit 1
+fi
+./compbench -n 5000 -b 1
+if [ $? -ne 0 ]; then
+	echo "FAIL: stream compression roundtrip with per-message flush failed"
+	exit 1
+fi
@@ -59,6 +59,10 @@
  * -L	loglevel to use for GnuTLS troubleshooting (0-off to 10-all, 0 default)
  * -j	format message in json, parameter is JSON cookie
  * -O	Use octate-count framing
+ * -k	add the send time (microseconds since the epoch) as additional field
+ *      after the message number, for latency measurement (see chkseq -l).
+ *      The time is taken when the message is generated. Cannot be used
+ *      together with -d.
  * -v   verbose output, possibly useful for troubleshooting. Most importantly,
  *      this gives insight into librelp actions (if relp is selected as protocol).
  *
@@ -174,6 +178,7 @@ static char *tlsKeyFile = NULL;
 static int tlsLogLevel = 0;
 static char *jsonCookie = NULL; /* if non-NULL, use JSON format with this cookie */
 static int octateCountFramed = 0;
+static int bSendTimestamp = 0; /* add send timestamp to message? */
 
 #ifdef ENABLE_GNUTLS
 static gnutls_session_t *sessArray;	/* array of TLS sessions to use */
@@ -440,6 +445,16 @@ void closeConnections(void)
 }
 
 
+/* current time in microseconds since the epoch, used for latency measurement */
+static long long
+currTimeUsecs(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (long long) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
 /* generate the message to be sent according to program command line parameters.
  * this has been moved to its own function as we now have various different ways
  * of constructing test messages. -- rgerhards, 2010-03-31
@@ -482,7 +497,16 @@ genMsg(char *buf, size_t maxBuf, int *pLenBuf, struct instdata *inst)
 		if(dynFileIDs > 0) {
 			snprintf(dynFileIDBuf, sizeof(dynFileIDBuf), "%d:", rand() % dynFileIDs);
 		}
-		if(extraDataLen == 0) {
+		if(bSendTimestamp) {
+			if(useRFC5424Format) {
+				*pLenBuf = snprintf(buf, maxBuf, "<%s>1 2003-03-01T01:00:00.000Z mymachine.example.com tcpflood "
+						     "- tag [tcpflood@32473 MSGNUM=\"%8.8d\"] msgnum:%s%8.8d:%lld:%c",
+						       msgPRI, msgNum, dynFileIDBuf, msgNum, currTimeUsecs(), frameDelim);
+			} else {
+				*pLenBuf = snprintf(buf, maxBuf, "<%s>Mar  1 01:00:00 172.20.245.8 tag msgnum:%s%8.8d:%lld:%c",
+						       msgPRI, dynFileIDBuf, msgNum, currTimeUsecs(), frameDelim);
+			}
+		} else if(extraDataLen == 0) {
 			if(useRFC5424Format) {
 				*pLenBuf = snprintf(buf, maxBuf, "<%s>1 2003-03-01T01:00:00.000Z mymachine.example.com tcpflood "
 						     "- tag [tcpflood@32473 MSGNUM=\"%8.8d\"] msgnum:%s%8.8d:%c",
@@ -1020,7 +1044,7 @@ int main(int argc, char *argv[])
 
 	setvbuf(stdout, buf, _IONBF, 48);
 	
-	while((opt = getopt(argc, argv, "b:ef:F:t:p:c:C:m:i:I:P:d:Dn:l:L:M:rsBR:S:T:XW:yYz:Z:j:Ov")) != -1) {
+	while((opt = getopt(argc, argv, "b:ef:F:t:p:c:C:m:i:I:P:d:Dn:kl:L:M:rsBR:S:T:XW:yYz:Z:j:Ov")) != -1) {
 		switch (opt) {
 		case 'b':	batchsize = atoll(optarg);
 				break;
@@ -1124,6 +1148,8 @@ int main(int argc, char *argv[])
 				break;
 		case 'O':	octateCountFramed = 1;
 				break;				
+		case 'k':	bSendTimestamp = 1;
+				break;
 		case 'v':	verbose = 1;
 				break;
 		default:	printf("invalid option '%c' or value missing - terminating...\n", opt);
@@ -1137,6 +1163,11 @@ int main(int argc, char *argv[])
 				"is somewhat contradictory!\n");
 	}
 
+	if(bSendTimestamp && extraDataLen) {
+		fprintf(stderr, "-k and -d cannot be used together\n");
+		exit(1);
+	}
+
 	if(!isatty(1) || bSilent)
 		bShowProgress = 0;
 
@@ -0,0 +1,252 @@
+/* Benchmark for the mmutf8fix checking and repair routines. A set of
+ * syslog-like messages is processed by the portable code and by the
+ * vectorized fast path (if the CPU supports it), in both modes of the
+ * module. The results of both are compared, so this also works as a
+ * testbench tool. For each run, the throughput is reported; on x86 also
+ * in bytes per TSC cycle.
+ *
+ * Params
+ * -n<number of messages> default 100000
+ * -i<invalid messages in percent> messages with invalid UTF-8, default 1
+ * -u<UTF-8 messages in percent> messages with (valid) multibyte
+ *    characters, default 10
+ * -r<rounds> how often each message set is processed, default 20
+ *
+ * Exits with non-zero status if the vectorized and portable code do not
+ * produce the same result.
+ *
+ * Part of the testbench for rsyslog.
+ *
+ * Copyright 2026 Adiscon GmbH.
+ *
+ * This file is part of rsyslog.
+ *
+ * Rsyslog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Rsyslog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Rsyslog.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * A copy of the GPL can be found in the file "COPYING" in this distribution.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#	include <x86intrin.h>
+#	define HAVE_TSC 1
+#endif
+
+#include "rsyslog.h"
+#include "utf8fix.h"
+
+#define MAX_MSG_LEN 1024
+
+typedef struct {
+	uchar *buf;	/* all messages, back to back */
+	int *offs;	/* start of message i, offs[nMsgs] is the end */
+	int nMsgs;
+} msgset_t;
+
+static double
+wallTime(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+/* append a random multibyte character, valid or not */
+static int
+genMBChar(uchar *p, int bValid)
+{
+	static const uchar invld[][4] = {
+		{ 0xc0, 0x80 }, { 0xe2, 0x28, 0xa1 }, { 0xf8, 0x88, 0x80, 0x80 },
+		{ 0xbf }, { 0xf4, 0x90, 0x80, 0x80 }, { 0xe0, 0x80, 0xaf }, { 0xed, 0xa0, 0x80 },
+		{ 0xc3 }, { 0xf0, 0x9f, 0x98 }, { 0xfe }
+	};
+	static const int lenInvld[] = { 2, 3, 4, 1, 4, 3, 3, 1, 3, 1 };
+	int cp;
+	int i;
+
+	if(!bValid) {
+		i = rand() % (sizeof(lenInvld) / sizeof(int));
+		memcpy(p, invld[i], lenInvld[i]);
+		return lenInvld[i];
+	}
+	switch(rand() % 3) {
+	case 0:	cp = 0x80 + rand() % (0x800 - 0x80);
+		p[0] = 0xc0 | (cp >> 6);
+		p[1] = 0x80 | (cp & 0x3f);
+		return 2;
+	case 1:	cp = 0x800 + rand() % (0xd800 - 0x800);
+		p[0] = 0xe0 | (cp >> 12);
+		p[1] = 0x80 | ((cp >> 6) & 0x3f);
+		p[2] = 0x80 | (cp & 0x3f);
+		return 3;
+	default:cp = 0x10000 + rand() % (0x110000 - 0x10000);
+		p[0] = 0xf0 | (cp >> 18);
+		p[1] = 0x80 | ((cp >> 12) & 0x3f);
+		p[2] = 0x80 | ((cp >> 6) & 0x3f);
+		p[3] = 0x80 | (cp & 0x3f);
+		return 4;
+	}
+}
+
+/* messages are modelled after typical traffic, with a configurable share
+ * of multibyte and invalid content (which may also end up truncated at
+ * the message end).
+ */
+static void
+genMsgs(msgset_t *set, int nMsgs, int pctInvld, int pctUTF8)
+{
+	uchar msg[MAX_MSG_LEN + 8];
+	int len, lenMax;
+	int i, j, type;
+
+	set->buf = malloc((size_t) nMsgs * MAX_MSG_LEN);
+	set->offs = malloc(sizeof(int) * (nMsgs + 1));
+	set->nMsgs = nMsgs;
+	srand(42);
+	set->offs[0] = 0;
+	for(i = 0 ; i < nMsgs ; ++i) {
+		len = snprintf((char*) msg, sizeof(msg), "Oct 11 22:14:15 web%2.2d sshd[%d]: "
+			"msgnum:%8.8d: Accepted publickey for user%d from 10.%d.%d.%d port %d ssh2",
+			rand() % 10, rand() % 30000, i, rand() % 500, rand() % 256,
+			rand() % 256, rand() % 256, 1024 + rand() % 60000);
+		type = rand() % 100;
+		lenMax = 64 + rand() % (MAX_MSG_LEN - 64);
+		while(len < lenMax) {
+			if(type < pctInvld && rand() % 8 == 0) {
+				len += genMBChar(msg + len, 0);
+			} else if(type < pctInvld + pctUTF8 && rand() % 4 == 0) {
+				len += genMBChar(msg + len, 1);
+			} else {
+				msg[len++] = 'a' + rand() % 26;
+			}
+		}
+		if(len > MAX_MSG_LEN)
+			len = MAX_MSG_LEN;
+		/* some control characters for the cc mode */
+		if(type < pctInvld)
+			msg[rand() % len] = rand() % 32;
+		for(j = 0 ; j < len ; ++j)
+			set->buf[set->offs[i] + j] = msg[j];
+		set->offs[i+1] = set->offs[i] + len;
+	}
+}
+
+/* process all messages rounds times, result is in work */
+static void
+runBench(msgset_t *set, uchar *work, int bCC, int bNoSIMD, int rounds)
+{
+	const int lenTotal = set->offs[set->nMsgs];
+	double tStart, tElapsed;
+#	ifdef HAVE_TSC
+	unsigned long long cycles = 0;
+	unsigned long long cStart;
+#	endif
+	int r, i;
+
+	utf8fixInit(bNoSIMD);
+	tElapsed = 0;
+	for(r = 0 ; r < rounds ; ++r) {
+		memcpy(work, set->buf, lenTotal);
+		tStart = wallTime();
+#		ifdef HAVE_TSC
+		cStart = __rdtsc();
+#		endif
+		for(i = 0 ; i < set->nMsgs ; ++i) {
+			if(bCC)
+				utf8fixCC(work + set->offs[i], set->offs[i+1] - set->offs[i], ' ');
+			else
+				utf8fixUTF8(work + set->offs[i], set->offs[i+1] - set->offs[i], ' ');
+		}
+#		ifdef HAVE_TSC
+		cycles += __rdtsc() - cStart;
+#		endif
+		tElapsed += wallTime() - tStart;
+	}
+	printf("%-5s %-6s %12d %10.1f", bCC ? "cc" : "utf-8", utf8fixImplName(),
+		lenTotal, (double) lenTotal * rounds / (tElapsed ? tElapsed : 1e-9) / (1024*1024));
+#	ifdef HAVE_TSC
+	printf(" %11.3f", (double) lenTotal * rounds / (cycles ? cycles : 1));
+#	endif
+	printf("\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	int opt;
+	int nMsgs = 100000;
+	int pctInvld = 1;
+	int pctUTF8 = 10;
+	int rounds = 20;
+	msgset_t set;
+	uchar *workRef, *workSIMD;
+	int lenTotal;
+	int bCC;
+	int i;
+	int ret = 0;
+
+	while((opt = getopt(argc, argv, "n:i:u:r:")) != -1) {
+		switch (opt) {
+		case 'n':	nMsgs = atoi(optarg);
+				break;
+		case 'i':	pctInvld = atoi(optarg);
+				break;
+		case 'u':	pctUTF8 = atoi(optarg);
+				break;
+		case 'r':	rounds = atoi(optarg);
+				break;
+		default:	printf("Invalid call of utf8bench, optchar='%c'\n", opt);
+				printf("Usage: utf8bench [-n msgs] [-i pct-invalid] [-u pct-utf8] "
+				       "[-r rounds]\n");
+				exit(1);
+		}
+	}
+	if(nMsgs < 1 || rounds < 1) {
+		fprintf(stderr, "number of messages and rounds must be at least 1\n");
+		exit(1);
+	}
+
+	genMsgs(&set, nMsgs, pctInvld, pctUTF8);
+	lenTotal = set.offs[nMsgs];
+	workRef = malloc(lenTotal);
+	workSIMD = malloc(lenTotal);
+
+	printf("mode  impl         in-bytes       MB/s");
+#	ifdef HAVE_TSC
+	printf(" bytes/cycle");
+#	endif
+	printf("\n");
+	for(bCC = 0 ; bCC < 2 ; ++bCC) {
+		runBench(&set, workRef, bCC, 1, rounds);
+		runBench(&set, workSIMD, bCC, 0, rounds);
+		if(memcmp(workRef, workSIMD, lenTotal)) {
+			for(i = 0 ; i < nMsgs && !memcmp(workRef + set.offs[i], workSIMD + set.offs[i],
+				set.offs[i+1] - set.offs[i]) ; ++i)
+				/* just search */;
+			fprintf(stderr, "%s: result of %s code differs from portable code, "
+				"first at message %d\n", bCC ? "cc" : "utf-8", utf8fixImplName(), i);
+			ret = 1;
+		}
+	}
+
+	free(workRef);
+	free(workSIMD);
+	free(set.buf);
+	free(set.offs);
+	return ret;
+}
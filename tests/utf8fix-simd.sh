@@ -0,0 +1,17 @@
+#!/bin/bash
+# Check that the vectorized mmutf8fix fast path produces the same result
+# as the portable code, for mostly valid and for heavily broken input.
+# Also prints the benchmark results.
+# This file is part of the rsyslog project, released  under GPLv3
+echo ===============================================================================
+echo \[utf8fix-simd.sh\]: compare vectorized and portable mmutf8fix code
+./utf8bench -n 20000 -r 2
+if [ $? -ne 0 ]; then
+	echo "FAIL: mmutf8fix fast path differs on typical input"
+	exit 1
+fi
+./utf8bench -n 20000 -r 1 -i 60 -u 30
+if [ $? -ne 0 ]; then
+	echo "FAIL: mmutf8fix fast path differs on invalid input"
+	exit 1
+fi
@@ -39,6 +39,10 @@
 #include <stdint.h>
 #include <zlib.h>
 #include <pthread.h>
+#ifdef HAVE_SENDMMSG
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
 #include "syslogd.h"
 #include "conf.h"
 #include "syslogd-types.h"
@@ -55,6 +59,8 @@
 #include "glbl.h"
 #include "errmsg.h"
 #include "unicode-helper.h"
+#include "statsobj.h"
+#include "strmcomp.h"
 
 MODULE_TYPE_OUTPUT
 MODULE_TYPE_NOKEEP
@@ -69,19 +75,47 @@ DEFobjCurrIf(net)
 DEFobjCurrIf(netstrms)
 DEFobjCurrIf(netstrm)
 DEFobjCurrIf(tcpclt)
+DEFobjCurrIf(statsobj)
 
 
 /* some local constants (just) for better readybility */
 #define IS_FLUSH 1
 #define NO_FLUSH 0
 
+#define POOL_DFLT_RESUME_INTERVAL 30	/* seconds a failed pool target stays out of rotation */
+#define POOL_RING_VNODES 160		/* points per target on the consistent hashing ring */
+
+/* per-target data that is shared between all workers of an instance.
+ * This is only set up if a pool (more than one target) is configured.
+ * The suspension state is kept here (and not with the per-worker
+ * connection), so that a failed target is avoided by all workers.
+ */
+typedef struct poolTarget_s {
+	char *port;		/* port given with the target, NULL to use the action's port */
+	statsobj_t *stats;
+	STATSCOUNTER_DEF(ctrMsgsSent, mutCtrMsgsSent)
+	STATSCOUNTER_DEF(ctrBytesSent, mutCtrBytesSent)
+	STATSCOUNTER_DEF(ctrFail, mutCtrFail)
+	STATSCOUNTER_DEF(ctrSuspended, mutCtrSuspended)
+	sbool bIsSuspended;	/* taken out of the pool due to errors? */
+	time_t ttResume;	/* when to try a suspended target again */
+	pthread_mutex_t mutSusp; /* guards bIsSuspended and ttResume */
+} poolTarget_t;
+
+/* a point on the consistent hashing ring */
+typedef struct ringPoint_s {
+	unsigned hash;
+	int iTarget;
+} ringPoint_t;
+
 typedef struct _instanceData {
 	uchar 	*tplName;	/* name of assigned template */
 	uchar *pszStrmDrvr;
 	uchar *pszStrmDrvrAuthMode;
 	permittedPeers_t *pPermPeers;
 	int iStrmDrvrMode;
-	char	*target;
+	char	**target;	/* target hosts - more than one means we have a pool */
+	int nTargets;
 	int compressionLevel;	/* 0 - no compression, else level for zlib */
 	char *port;
 	int protocol;
@@ -106,10 +140,34 @@ typedef struct _instanceData {
 	uint8_t compressionMode;
 	int errsToReport;	/* max number of errors to report (per instance) */
 	sbool strmCompFlushOnTxEnd; /* flush stream compression on transaction end? */
+	int strmCompCodec;	/* codec to use for stream compression (STRMCOMP_*) */
+	int strmCompLevel;	/* level for stream compression, -1 means codec default */
+	uchar *strmCompDictFile; /* zstd dictionary file name */
+	uchar *strmCompDict;	/* zstd dictionary, loaded at config time */
+	size_t lenStrmCompDict;
+	/* following fields for target pools (load balancing) */
+#	define POOL_ROUNDROBIN 0
+#	define POOL_HASH 1
+	uint8_t poolMode;
+	int poolResumeInterval;	/* seconds before a failed target is tried again */
+	uchar *poolHashTplName;	/* template to obtain the key for POOL_HASH */
+	int nTpls;		/* number of templates we requested */
+	poolTarget_t *poolTarget;	/* one entry per target, only if pool */
+	ringPoint_t *ring;	/* consistent hashing ring, only for POOL_HASH */
+	unsigned nRingPoints;
 } instanceData;
 
-typedef struct wrkrInstanceData {
+typedef struct wrkrInstanceData wrkrInstanceData_t;
+
+/* connection to a single target. Each worker has its own connection
+ * to each of the configured targets.
+ */
+typedef struct targetData_s {
+	wrkrInstanceData_t *pWrkrData;
 	instanceData *pData;
+	int iTarget;		/* index into pData->target[] */
+	char *target;		/* name of this target (from pData->target[]) */
+	char *port;		/* port of this target */
 	netstrms_t *pNS; /* netstream subsystem */
 	netstrm_t *pNetstrm; /* our output netstream */
 	struct addrinfo *f_addr;
@@ -117,12 +175,42 @@ typedef struct wrkrInstanceData {
 	int bIsConnected;  /* are we connected to remote host? 0 - no, 1 - yes, UDP means addr resolved */
 	int nXmit;		/* number of transmissions since last (re-)bind */
 	tcpclt_t *pTCPClt;	/* our tcpclt object */
-	sbool bzInitDone; /* did we do an init of zstrm already? */
-	z_stream zstrm;	/* zip stream to use for tcp compression */
+	strmcomp_t *pComp;	/* stream compressor, created on first use */
 	uchar sndBuf[16*1024];	/* this is intensionally fixed -- see no good reason to make configurable */
 	unsigned offsSndBuf;	/* next free spot in send buffer */
+} targetData_t;
+
+struct wrkrInstanceData {
+	instanceData *pData;
+	targetData_t *target;	/* one entry for each pData->target[] */
+	unsigned nextTarget;	/* next target to use in POOL_ROUNDROBIN mode */
+	sbool *bUsable;		/* per target: may currently be used (snapshot, see poolSnapshot) */
 	int errsToReport;	/* (remaining) number of errors to report */
-} wrkrInstanceData_t;
+	/* the following members are used to distribute a transaction to the
+	 * targets. They are sized on demand and kept for the lifetime of the
+	 * worker, so there is no per-batch malloc().
+	 */
+	unsigned maxBatch;	/* number of entries currently allocated */
+	unsigned *pendIdx;	/* messages still to be sent */
+	unsigned *grpIdx;	/* messages to be sent to the current target */
+	unsigned *failIdx;	/* messages whose target failed */
+	int *msgTarget;		/* message index -> target index */
+	/* progress of the current transaction. If a commit fails, the core
+	 * retries the same batch, and messages already delivered to a target
+	 * must not be sent again (see abortTransaction).
+	 */
+	sbool *bTxDone;		/* per message: delivered to a target */
+	unsigned nTxParams;	/* size of the failed transaction */
+	sbool bTxRetry;		/* next commit is a retry of the failed one */
+#	ifdef HAVE_SENDMMSG
+	/* used to send a whole UDP transaction via sendmmsg() */
+	struct mmsghdr *mmh;	/* message headers handed to sendmmsg() */
+	struct iovec *iov;	/* one payload buffer per message */
+	unsigned *mmhIdx;	/* mmh entry -> message index in batch */
+	sbool *bSent;		/* was message i sent to at least one target? */
+	Bytef **compBuf;	/* per-message compression buffers (or NULL) */
+#	endif
+};
 
 /* config data */
 typedef struct configSettings_s {
@@ -154,13 +242,16 @@ static struct cnfparamblk modpblk =
 
 /* action (instance) parameters */
 static struct cnfparamdescr actpdescr[] = {
-	{ "target", eCmdHdlrGetWord, 0 },
+	{ "target", eCmdHdlrArray, 0 },
 	{ "port", eCmdHdlrGetWord, 0 },
 	{ "protocol", eCmdHdlrGetWord, 0 },
 	{ "tcp_framing", eCmdHdlrGetWord, 0 },
 	{ "ziplevel", eCmdHdlrInt, 0 },
 	{ "compression.mode", eCmdHdlrGetWord, 0 },
 	{ "compression.stream.flushontxend", eCmdHdlrBinary, 0 },
+	{ "compression.stream.codec", eCmdHdlrGetWord, 0 },
+	{ "compression.stream.level", eCmdHdlrInt, 0 },
+	{ "compression.stream.dictionary", eCmdHdlrString, 0 },
 	{ "maxerrormessages", eCmdHdlrInt, 0 },
 	{ "rebindinterval", eCmdHdlrInt, 0 },
 	{ "keepalive", eCmdHdlrBinary, 0 },
@@ -174,6 +265,9 @@ static struct cnfparamdescr actpdescr[] = {
 	{ "resendlastmsgonreconnect", eCmdHdlrBinary, 0 },
 	{ "udp.sendtoall", eCmdHdlrBinary, 0 },
 	{ "udp.senddelay", eCmdHdlrInt, 0 },
+	{ "pool.mode", eCmdHdlrGetWord, 0 },
+	{ "pool.resumeinterval", eCmdHdlrPositiveInt, 0 },
+	{ "pool.hashtemplate", eCmdHdlrGetWord, 0 },
 	{ "template", eCmdHdlrGetWord, 0 }
 };
 static struct cnfparamblk actpblk =
@@ -191,7 +285,7 @@ static modConfData_t *loadModConf = NULL;/* modConf ptr to use for the current l
 static modConfData_t *runModConf = NULL;/* modConf ptr to use for the current exec process */
 
 
-static rsRetVal initTCP(wrkrInstanceData_t *pWrkrData);
+static rsRetVal initTCP(targetData_t *pTarget);
 
 
 BEGINinitConfVars		/* (re)set config variables to default values */
@@ -208,7 +302,8 @@ ENDinitConfVars
 
 
 static rsRetVal doTryResume(wrkrInstanceData_t *);
-static rsRetVal doZipFinish(wrkrInstanceData_t *);
+static rsRetVal doTryResumeTarget(targetData_t *);
+static rsRetVal doZipFinish(targetData_t *);
 
 /* this function gets the default template. It coordinates action between
  * old-style and new-style configuration parts.
@@ -252,16 +347,16 @@ finalize_it:
  * rgerhards, 2009-05-29
  */
 static rsRetVal
-closeUDPSockets(wrkrInstanceData_t *pWrkrData)
+closeUDPSockets(targetData_t *pTarget)
 {
 	DEFiRet;
-	if(pWrkrData->pSockArray != NULL) {
-		net.closeUDPListenSockets(pWrkrData->pSockArray);
-		pWrkrData->pSockArray = NULL;
-		freeaddrinfo(pWrkrData->f_addr);
-		pWrkrData->f_addr = NULL;
+	if(pTarget->pSockArray != NULL) {
+		net.closeUDPListenSockets(pTarget->pSockArray);
+		pTarget->pSockArray = NULL;
+		freeaddrinfo(pTarget->f_addr);
+		pTarget->f_addr = NULL;
 	}
-pWrkrData->bIsConnected = 0; // TODO: remove this variable altogether
+pTarget->bIsConnected = 0; // TODO: remove this variable altogether
 	RETiRet;
 }
 
@@ -276,13 +371,13 @@ pWrkrData->bIsConnected = 0; // TODO: remove this variable altogether
  * loose data.
  */
 static inline void
-DestructTCPInstanceData(wrkrInstanceData_t *pWrkrData)
+DestructTCPInstanceData(targetData_t *pTarget)
 {
-	doZipFinish(pWrkrData);
-	if(pWrkrData->pNetstrm != NULL)
-		netstrm.Destruct(&pWrkrData->pNetstrm);
-	if(pWrkrData->pNS != NULL)
-		netstrms.Destruct(&pWrkrData->pNS);
+	doZipFinish(pTarget);
+	if(pTarget->pNetstrm != NULL)
+		netstrm.Destruct(&pTarget->pNetstrm);
+	if(pTarget->pNS != NULL)
+		netstrms.Destruct(&pTarget->pNS);
 }
 
 
@@ -351,6 +446,9 @@ ENDfreeCnf
 BEGINcreateInstance
 CODESTARTcreateInstance
 	pData->errsToReport = 5;
+	pData->nTpls = 1;
+	pData->poolMode = POOL_ROUNDROBIN;
+	pData->poolResumeInterval = POOL_DFLT_RESUME_INTERVAL;
 	if(cs.pszStrmDrvr != NULL)
 		CHKmalloc(pData->pszStrmDrvr = (uchar*)strdup((char*)cs.pszStrmDrvr));
 	if(cs.pszStrmDrvrAuthMode != NULL)
@@ -361,11 +459,25 @@ ENDcreateInstance
 
 
 BEGINcreateWrkrInstance
+	int i;
 CODESTARTcreateWrkrInstance
 	dbgprintf("DDDD: createWrkrInstance: pWrkrData %p\n", pWrkrData);
-	pWrkrData->offsSndBuf = 0;
 	pWrkrData->errsToReport = pData->errsToReport;
-	iRet = initTCP(pWrkrData);
+	CHKmalloc(pWrkrData->target = calloc(pData->nTargets, sizeof(targetData_t)));
+	CHKmalloc(pWrkrData->bUsable = calloc(pData->nTargets, sizeof(sbool)));
+	for(i = 0 ; i < pData->nTargets ; ++i) {
+		pWrkrData->target[i].pWrkrData = pWrkrData;
+		pWrkrData->target[i].pData = pData;
+		pWrkrData->target[i].iTarget = i;
+		pWrkrData->target[i].target = pData->target[i];
+		if(pData->poolTarget != NULL && pData->poolTarget[i].port != NULL)
+			pWrkrData->target[i].port = pData->poolTarget[i].port;
+		else
+			pWrkrData->target[i].port = pData->port;
+		pWrkrData->target[i].offsSndBuf = 0;
+		CHKiRet(initTCP(&pWrkrData->target[i]));
+	}
+finalize_it:
 ENDcreateWrkrInstance
 
 
@@ -377,36 +489,97 @@ ENDisCompatibleWithFeature
 
 
 BEGINfreeInstance
+	int i;
 CODESTARTfreeInstance
 	free(pData->pszStrmDrvr);
 	free(pData->pszStrmDrvrAuthMode);
 	free(pData->port);
-	free(pData->target);
+	if(pData->target != NULL) {
+		for(i = 0 ; i < pData->nTargets ; ++i)
+			free(pData->target[i]);
+		free(pData->target);
+	}
+	if(pData->poolTarget != NULL) {
+		for(i = 0 ; i < pData->nTargets ; ++i) {
+			if(pData->poolTarget[i].stats != NULL)
+				statsobj.Destruct(&pData->poolTarget[i].stats);
+			pthread_mutex_destroy(&pData->poolTarget[i].mutSusp);
+			free(pData->poolTarget[i].port);
+		}
+		free(pData->poolTarget);
+	}
+	free(pData->ring);
+	free(pData->poolHashTplName);
+	free(pData->strmCompDictFile);
+	free(pData->strmCompDict);
 	net.DestructPermittedPeers(&pData->pPermPeers);
 ENDfreeInstance
 
 
 BEGINfreeWrkrInstance
+	int i;
 CODESTARTfreeWrkrInstance
-	DestructTCPInstanceData(pWrkrData);
-	closeUDPSockets(pWrkrData);
-
-	if(pWrkrData->pData->protocol == FORW_TCP) {
-		tcpclt.Destruct(&pWrkrData->pTCPClt);
+	if(pWrkrData->target != NULL) {
+		for(i = 0 ; i < pWrkrData->pData->nTargets ; ++i) {
+			targetData_t *const pTarget = &pWrkrData->target[i];
+			DestructTCPInstanceData(pTarget);
+			closeUDPSockets(pTarget);
+			if(pTarget->pTCPClt != NULL) {
+				tcpclt.Destruct(&pTarget->pTCPClt);
+			}
+		}
+		free(pWrkrData->target);
 	}
+	free(pWrkrData->bUsable);
+	free(pWrkrData->pendIdx);
+	free(pWrkrData->grpIdx);
+	free(pWrkrData->failIdx);
+	free(pWrkrData->msgTarget);
+	free(pWrkrData->bTxDone);
+#	ifdef HAVE_SENDMMSG
+	free(pWrkrData->mmh);
+	free(pWrkrData->iov);
+	free(pWrkrData->mmhIdx);
+	free(pWrkrData->bSent);
+	free(pWrkrData->compBuf);
+#	endif
 ENDfreeWrkrInstance
 
 
 BEGINdbgPrintInstInfo
 CODESTARTdbgPrintInstInfo
-	dbgprintf("%s", pData->target);
+	dbgprintf("%s", pData->target[0]);
+	if(pData->nTargets > 1)
+		dbgprintf(" (+%d more pool targets)", pData->nTargets - 1);
 ENDdbgPrintInstInfo
 
 
+/* report a failed UDP send, honoring the max number of error
+ * messages permitted for this worker.
+ */
+static void
+reportUDPSendErr(wrkrInstanceData_t *__restrict__ const pWrkrData, const int lasterrno)
+{
+	dbgprintf("error forwarding via udp, suspending\n");
+	if(pWrkrData->errsToReport > 0) {
+		errmsg.LogError(lasterrno, RS_RET_ERR_UDPSEND,
+				"omfwd: error %d sending "
+				"via udp", lasterrno);
+		if(pWrkrData->errsToReport == 1) {
+			errmsg.LogMsg(0, RS_RET_LAST_ERRREPORT, LOG_WARNING, "omfwd: "
+					"max number of error message emitted "
+					"- further messages will be "
+					"suppressed");
+		}
+		--pWrkrData->errsToReport;
+	}
+}
+
+
 /* Send a message via UDP
  * rgehards, 2007-12-20
  */
-static rsRetVal UDPSend(wrkrInstanceData_t *__restrict__ const pWrkrData,
+static rsRetVal UDPSend(targetData_t *__restrict__ const pTarget,
 	uchar *__restrict__ const msg,
 	const size_t len)
 {
@@ -418,17 +591,17 @@ static rsRetVal UDPSend(wrkrInstanceData_t *__restrict__ const pWrkrData,
 	int lasterrno = ENOENT;
 	char errStr[1024];
 
-	if(pWrkrData->pData->iRebindInterval && (pWrkrData->nXmit++ % pWrkrData->pData->iRebindInterval == 0)) {
+	if(pTarget->pData->iRebindInterval && (pTarget->nXmit++ % pTarget->pData->iRebindInterval == 0)) {
 		dbgprintf("omfwd dropping UDP 'connection' (as configured)\n");
-		pWrkrData->nXmit = 1;	/* else we have an addtl wrap at 2^31-1 */
-		CHKiRet(closeUDPSockets(pWrkrData));
+		pTarget->nXmit = 1;	/* else we have an addtl wrap at 2^31-1 */
+		CHKiRet(closeUDPSockets(pTarget));
 	}
 
-	if(pWrkrData->pSockArray == NULL) {
-		CHKiRet(doTryResume(pWrkrData));
+	if(pTarget->pSockArray == NULL) {
+		CHKiRet(doTryResumeTarget(pTarget));
 	}
 
-	if(pWrkrData->pSockArray != NULL) {
+	if(pTarget->pSockArray != NULL) {
 		/* we need to track if we have success sending to the remote
 		 * peer. Success is indicated by at least one sendto() call
 		 * succeeding. We track this be bSendSuccess. We can not simply
@@ -437,9 +610,9 @@ static rsRetVal UDPSend(wrkrInstanceData_t *__restrict__ const pWrkrData,
 		 * the sendto() succeeded. -- rgerhards, 2007-06-22
 		 */
 		bSendSuccess = RSFALSE;
-		for (r = pWrkrData->f_addr; r; r = r->ai_next) {
-			for (i = 0; i < *pWrkrData->pSockArray; i++) {
-			       lsent = sendto(pWrkrData->pSockArray[i+1], msg, len, 0, r->ai_addr, r->ai_addrlen);
+		for (r = pTarget->f_addr; r; r = r->ai_next) {
+			for (i = 0; i < *pTarget->pSockArray; i++) {
+			       lsent = sendto(pTarget->pSockArray[i+1], msg, len, 0, r->ai_addr, r->ai_addrlen);
 				if (lsent == len) {
 					bSendSuccess = RSTRUE;
 					break;
@@ -450,29 +623,17 @@ static rsRetVal UDPSend(wrkrInstanceData_t *__restrict__ const pWrkrData,
 						rs_strerror_r(lasterrno, errStr, sizeof(errStr)));
 				}
 			}
-			if (lsent == len && !pWrkrData->pData->bSendToAll)
+			if (lsent == len && !pTarget->pData->bSendToAll)
 			       break;
 		}
 		/* finished looping */
 		if(bSendSuccess == RSTRUE) {
-			if(pWrkrData->pData->iUDPSendDelay > 0) {
-				srSleep(pWrkrData->pData->iUDPSendDelay / 1000000,
-				        pWrkrData->pData->iUDPSendDelay % 1000000);
+			if(pTarget->pData->iUDPSendDelay > 0) {
+				srSleep(pTarget->pData->iUDPSendDelay / 1000000,
+				        pTarget->pData->iUDPSendDelay % 1000000);
 				}
 		} else {
-			dbgprintf("error forwarding via udp, suspending\n");
-			if(pWrkrData->errsToReport > 0) {
-				errmsg.LogError(lasterrno, RS_RET_ERR_UDPSEND,
-						"omfwd: error %d sending "
-						"via udp", lasterrno);
-				if(pWrkrData->errsToReport == 1) {
-					errmsg.LogMsg(0, RS_RET_LAST_ERRREPORT, LOG_WARNING, "omfwd: "
-							"max number of error message emitted "
-							"- further messages will be "
-							"suppressed");
-				}
-				--pWrkrData->errsToReport;
-			}
+			reportUDPSendErr(pTarget->pWrkrData, lasterrno);
 			iRet = RS_RET_SUSPENDED;
 		}
 	}
@@ -499,18 +660,18 @@ finalize_it:
 /* CODE FOR SENDING TCP MESSAGES */
 
 static rsRetVal
-TCPSendBufUncompressed(wrkrInstanceData_t *pWrkrData, uchar *buf, unsigned len)
+TCPSendBufUncompressed(targetData_t *pTarget, uchar *buf, unsigned len)
 {
 	DEFiRet;
 	unsigned alreadySent;
 	ssize_t lenSend;
 
 	alreadySent = 0;
-	CHKiRet(netstrm.CheckConnection(pWrkrData->pNetstrm)); /* hack for plain tcp syslog - see ptcp driver for details */
+	CHKiRet(netstrm.CheckConnection(pTarget->pNetstrm)); /* hack for plain tcp syslog - see ptcp driver for details */
 
 	while(alreadySent != len) {
 		lenSend = len - alreadySent;
-		CHKiRet(netstrm.Send(pWrkrData->pNetstrm, buf+alreadySent, &lenSend));
+		CHKiRet(netstrm.Send(pTarget->pNetstrm, buf+alreadySent, &lenSend));
 		DBGPRINTF("omfwd: TCP sent %ld bytes, requested %u\n", (long) lenSend, len - alreadySent);
 		alreadySent += lenSend;
 	}
@@ -519,106 +680,77 @@ finalize_it:
 	if(iRet != RS_RET_OK) {
 		/* error! */
 		dbgprintf("TCPSendBuf error %d, destruct TCP Connection!\n", iRet);
-		DestructTCPInstanceData(pWrkrData);
+		DestructTCPInstanceData(pTarget);
 		iRet = RS_RET_SUSPENDED;
 	}
 	RETiRet;
 }
 
+/* output function for the stream compressor */
 static rsRetVal
-TCPSendBufCompressed(wrkrInstanceData_t *pWrkrData, uchar *buf, unsigned len, sbool bIsFlush)
+sendCompressedData(void *usrptr, uchar *buf, size_t len)
 {
-	int zRet;	/* zlib return state */
-	unsigned outavail;
-	uchar zipBuf[32*1024];
+	return TCPSendBufUncompressed((targetData_t*) usrptr, buf, len);
+}
+
+static rsRetVal
+TCPSendBufCompressed(targetData_t *pTarget, uchar *buf, unsigned len, sbool bIsFlush)
+{
+	instanceData *pData = pTarget->pData;
 	int op;
 	DEFiRet;
 
-	if(!pWrkrData->bzInitDone) {
-		/* allocate deflate state */
-		pWrkrData->zstrm.zalloc = Z_NULL;
-		pWrkrData->zstrm.zfree = Z_NULL;
-		pWrkrData->zstrm.opaque = Z_NULL;
-		/* see note in file header for the params we use with deflateInit2() */
-		zRet = deflateInit(&pWrkrData->zstrm, 9);
-		if(zRet != Z_OK) {
-			DBGPRINTF("error %d returned from zlib/deflateInit()\n", zRet);
-			ABORT_FINALIZE(RS_RET_ZLIB_ERR);
-		}
-		pWrkrData->bzInitDone = RSTRUE;
+	if(pTarget->pComp == NULL) {
+		CHKiRet(strmcompConstruct(&pTarget->pComp, pData->strmCompCodec, 0,
+			pData->strmCompLevel, pData->strmCompDict, pData->lenStrmCompDict));
 	}
 
-	/* now doing the compression */
-	pWrkrData->zstrm.next_in = (Bytef*) buf;
-	pWrkrData->zstrm.avail_in = len;
-	if(pWrkrData->pData->strmCompFlushOnTxEnd && bIsFlush)
-		op = Z_SYNC_FLUSH;
+	if(pData->strmCompFlushOnTxEnd && bIsFlush)
+		op = STRMCOMP_FLUSH;
 	else
-		op = Z_NO_FLUSH;
-	/* run deflate() on buffer until everything has been compressed */
-	do {
-		DBGPRINTF("omfwd: in deflate() loop, avail_in %d, total_in %ld, isFlush %d\n", pWrkrData->zstrm.avail_in, pWrkrData->zstrm.total_in, bIsFlush);
-		pWrkrData->zstrm.avail_out = sizeof(zipBuf);
-		pWrkrData->zstrm.next_out = zipBuf;
-		zRet = deflate(&pWrkrData->zstrm, op);    /* no bad return value */
-		DBGPRINTF("after deflate, ret %d, avail_out %d\n", zRet, pWrkrData->zstrm.avail_out);
-		outavail = sizeof(zipBuf) - pWrkrData->zstrm.avail_out;
-		if(outavail != 0) {
-			CHKiRet(TCPSendBufUncompressed(pWrkrData, zipBuf, outavail));
-		}
-	} while (pWrkrData->zstrm.avail_out == 0);
+		op = STRMCOMP_NOFLUSH;
+	DBGPRINTF("omfwd: compressing %u bytes with %s, isFlush %d\n", len,
+		strmcompCodecName(pData->strmCompCodec), bIsFlush);
+	CHKiRet(strmcompProcess(pTarget->pComp, buf, len, op, sendCompressedData, pTarget));
 
 finalize_it:
 	RETiRet;
 }
 
 static rsRetVal
-TCPSendBuf(wrkrInstanceData_t *pWrkrData, uchar *buf, unsigned len, sbool bIsFlush)
+TCPSendBuf(targetData_t *pTarget, uchar *buf, unsigned len, sbool bIsFlush)
 {
 	DEFiRet;
-	if(pWrkrData->pData->compressionMode >= COMPRESS_STREAM_ALWAYS)
-		iRet = TCPSendBufCompressed(pWrkrData, buf, len, bIsFlush);
+	if(pTarget->pData->compressionMode >= COMPRESS_STREAM_ALWAYS)
+		iRet = TCPSendBufCompressed(pTarget, buf, len, bIsFlush);
 	else
-		iRet = TCPSendBufUncompressed(pWrkrData, buf, len);
+		iRet = TCPSendBufUncompressed(pTarget, buf, len);
 	RETiRet;
 }
 
-/* finish zlib buffer, to be called before closing the ZIP file (if
- * running in stream mode).
+/* finish compressed stream, to be called before closing the connection
+ * (if running in stream mode).
  */
 static rsRetVal
-doZipFinish(wrkrInstanceData_t *pWrkrData)
+doZipFinish(targetData_t *pTarget)
 {
-	int zRet;	/* zlib return state */
+	strmcomp_t *pComp;
 	DEFiRet;
-	unsigned outavail;
-	uchar zipBuf[32*1024];
 
-	if(!pWrkrData->bzInitDone)
+	if(pTarget->pComp == NULL)
 		goto done;
 
-	// TODO: can we get this into a single common function?
-	pWrkrData->zstrm.avail_in = 0;
-	/* run deflate() on buffer until everything has been compressed */
-	do {
-		DBGPRINTF("in deflate() loop, avail_in %d, total_in %ld\n", pWrkrData->zstrm.avail_in, pWrkrData->zstrm.total_in);
-		pWrkrData->zstrm.avail_out = sizeof(zipBuf);
-		pWrkrData->zstrm.next_out = zipBuf;
-		zRet = deflate(&pWrkrData->zstrm, Z_FINISH);    /* no bad return value */
-		DBGPRINTF("after deflate, ret %d, avail_out %d\n", zRet, pWrkrData->zstrm.avail_out);
-		outavail = sizeof(zipBuf) - pWrkrData->zstrm.avail_out;
-		if(outavail != 0) {
-			CHKiRet(TCPSendBufUncompressed(pWrkrData, zipBuf, outavail));
-		}
-	} while (pWrkrData->zstrm.avail_out == 0);
-
-finalize_it:
-	zRet = deflateEnd(&pWrkrData->zstrm);
-	if(zRet != Z_OK) {
-		DBGPRINTF("error %d returned from zlib/deflateEnd()\n", zRet);
+	/* detach first: a send error in here destructs the connection,
+	 * which calls us again.
+	 */
+	pComp = pTarget->pComp;
+	pTarget->pComp = NULL;
+	iRet = strmcompProcess(pComp, NULL, 0, STRMCOMP_FINISH, sendCompressedData, pTarget);
+	if(iRet != RS_RET_OK) {
+		DBGPRINTF("omfwd: error %d finishing compressed stream\n", iRet);
 	}
+	strmcompDestruct(&pComp);
 
-	pWrkrData->bzInitDone = 0;
 done:	RETiRet;
 }
 
@@ -628,11 +760,11 @@ done:	RETiRet;
 static rsRetVal TCPSendFrame(void *pvData, char *msg, size_t len)
 {
 	DEFiRet;
-	wrkrInstanceData_t *pWrkrData = (wrkrInstanceData_t *) pvData;
+	targetData_t *pTarget = (targetData_t *) pvData;
 
 	DBGPRINTF("omfwd: add %u bytes to send buffer (curr offs %u)\n",
-		(unsigned) len, pWrkrData->offsSndBuf);
-	if(pWrkrData->offsSndBuf != 0 && pWrkrData->offsSndBuf + len >= sizeof(pWrkrData->sndBuf)) {
+		(unsigned) len, pTarget->offsSndBuf);
+	if(pTarget->offsSndBuf != 0 && pTarget->offsSndBuf + len >= sizeof(pTarget->sndBuf)) {
 		/* no buffer space left, need to commit previous records. With the
 		 * current API, there unfortunately is no way to signal this
 		 * state transition to the upper layer.
@@ -640,19 +772,19 @@ static rsRetVal TCPSendFrame(void *pvData, char *msg, size_t len)
 		DBGPRINTF("omfwd: we need to do a tcp send due to buffer "
 			  "out of space. If the transaction fails, this will "
 			  "lead to duplication of messages");
-		CHKiRet(TCPSendBuf(pWrkrData, pWrkrData->sndBuf, pWrkrData->offsSndBuf, NO_FLUSH));
-		pWrkrData->offsSndBuf = 0;
+		CHKiRet(TCPSendBuf(pTarget, pTarget->sndBuf, pTarget->offsSndBuf, NO_FLUSH));
+		pTarget->offsSndBuf = 0;
 	}
 
 	/* check if the message is too large to fit into buffer */
-	if(len > sizeof(pWrkrData->sndBuf)) {
-		CHKiRet(TCPSendBuf(pWrkrData, (uchar*)msg, len, NO_FLUSH));
+	if(len > sizeof(pTarget->sndBuf)) {
+		CHKiRet(TCPSendBuf(pTarget, (uchar*)msg, len, NO_FLUSH));
 		ABORT_FINALIZE(RS_RET_OK);	/* committed everything so far */
 	}
 
 	/* we now know the buffer has enough free space */
-	memcpy(pWrkrData->sndBuf + pWrkrData->offsSndBuf, msg, len);
-	pWrkrData->offsSndBuf += len;
+	memcpy(pTarget->sndBuf + pTarget->offsSndBuf, msg, len);
+	pTarget->offsSndBuf += len;
 	iRet = RS_RET_DEFER_COMMIT;
 
 finalize_it:
@@ -667,10 +799,10 @@ finalize_it:
 static rsRetVal TCPSendPrepRetry(void *pvData)
 {
 	DEFiRet;
-	wrkrInstanceData_t *pWrkrData = (wrkrInstanceData_t *) pvData;
+	targetData_t *pTarget = (targetData_t *) pvData;
 
-	assert(pWrkrData != NULL);
-	DestructTCPInstanceData(pWrkrData);
+	assert(pTarget != NULL);
+	DestructTCPInstanceData(pTarget);
 	RETiRet;
 }
 
@@ -681,47 +813,47 @@ static rsRetVal TCPSendPrepRetry(void *pvData)
 static rsRetVal TCPSendInit(void *pvData)
 {
 	DEFiRet;
-	wrkrInstanceData_t *pWrkrData = (wrkrInstanceData_t *) pvData;
+	targetData_t *pTarget = (targetData_t *) pvData;
 	instanceData *pData;
 
-	assert(pWrkrData != NULL);
-	pData = pWrkrData->pData;
+	assert(pTarget != NULL);
+	pData = pTarget->pData;
 
-	if(pWrkrData->pNetstrm == NULL) {
+	if(pTarget->pNetstrm == NULL) {
 		dbgprintf("TCPSendInit CREATE\n");
-		CHKiRet(netstrms.Construct(&pWrkrData->pNS));
+		CHKiRet(netstrms.Construct(&pTarget->pNS));
 		/* the stream driver must be set before the object is finalized! */
-		CHKiRet(netstrms.SetDrvrName(pWrkrData->pNS, pData->pszStrmDrvr));
-		CHKiRet(netstrms.ConstructFinalize(pWrkrData->pNS));
+		CHKiRet(netstrms.SetDrvrName(pTarget->pNS, pData->pszStrmDrvr));
+		CHKiRet(netstrms.ConstructFinalize(pTarget->pNS));
 
 		/* now create the actual stream and connect to the server */
-		CHKiRet(netstrms.CreateStrm(pWrkrData->pNS, &pWrkrData->pNetstrm));
-		CHKiRet(netstrm.ConstructFinalize(pWrkrData->pNetstrm));
-		CHKiRet(netstrm.SetDrvrMode(pWrkrData->pNetstrm, pData->iStrmDrvrMode));
+		CHKiRet(netstrms.CreateStrm(pTarget->pNS, &pTarget->pNetstrm));
+		CHKiRet(netstrm.ConstructFinalize(pTarget->pNetstrm));
+		CHKiRet(netstrm.SetDrvrMode(pTarget->pNetstrm, pData->iStrmDrvrMode));
 		/* now set optional params, but only if they were actually configured */
 		if(pData->pszStrmDrvrAuthMode != NULL) {
-			CHKiRet(netstrm.SetDrvrAuthMode(pWrkrData->pNetstrm, pData->pszStrmDrvrAuthMode));
+			CHKiRet(netstrm.SetDrvrAuthMode(pTarget->pNetstrm, pData->pszStrmDrvrAuthMode));
 		}
 		if(pData->pPermPeers != NULL) {
-			CHKiRet(netstrm.SetDrvrPermPeers(pWrkrData->pNetstrm, pData->pPermPeers));
+			CHKiRet(netstrm.SetDrvrPermPeers(pTarget->pNetstrm, pData->pPermPeers));
 		}
 		/* params set, now connect */
-		CHKiRet(netstrm.Connect(pWrkrData->pNetstrm, glbl.GetDefPFFamily(),
-			(uchar*)pData->port, (uchar*)pData->target));
+		CHKiRet(netstrm.Connect(pTarget->pNetstrm, glbl.GetDefPFFamily(),
+			(uchar*)pTarget->port, (uchar*)pTarget->target));
 
 		/* set keep-alive if enabled */
 		if(pData->bKeepAlive) {
-			CHKiRet(netstrm.SetKeepAliveProbes(pWrkrData->pNetstrm, pData->iKeepAliveProbes));
-			CHKiRet(netstrm.SetKeepAliveIntvl(pWrkrData->pNetstrm, pData->iKeepAliveIntvl));
-			CHKiRet(netstrm.SetKeepAliveTime(pWrkrData->pNetstrm, pData->iKeepAliveTime));
-			CHKiRet(netstrm.EnableKeepAlive(pWrkrData->pNetstrm));
+			CHKiRet(netstrm.SetKeepAliveProbes(pTarget->pNetstrm, pData->iKeepAliveProbes));
+			CHKiRet(netstrm.SetKeepAliveIntvl(pTarget->pNetstrm, pData->iKeepAliveIntvl));
+			CHKiRet(netstrm.SetKeepAliveTime(pTarget->pNetstrm, pData->iKeepAliveTime));
+			CHKiRet(netstrm.EnableKeepAlive(pTarget->pNetstrm));
 		}
 	}
 
 finalize_it:
 	if(iRet != RS_RET_OK) {
 		dbgprintf("TCPSendInit FAILED with %d.\n", iRet);
-		DestructTCPInstanceData(pWrkrData);
+		DestructTCPInstanceData(pTarget);
 	}
 
 	RETiRet;
@@ -731,7 +863,7 @@ finalize_it:
 /* try to resume connection if it is not ready
  * rgerhards, 2007-08-02
  */
-static rsRetVal doTryResume(wrkrInstanceData_t *pWrkrData)
+static rsRetVal doTryResumeTarget(targetData_t *pTarget)
 {
 	int iErr;
 	struct addrinfo *res;
@@ -739,9 +871,9 @@ static rsRetVal doTryResume(wrkrInstanceData_t *pWrkrData)
 	instanceData *pData;
 	DEFiRet;
 
-	if(pWrkrData->bIsConnected)
+	if(pTarget->bIsConnected)
 		FINALIZE;
-	pData = pWrkrData->pData;
+	pData = pTarget->pData;
 
 	/* The remote address is not yet known and needs to be obtained */
 	if(pData->protocol == FORW_UDP) {
@@ -750,35 +882,271 @@ static rsRetVal doTryResume(wrkrInstanceData_t *pWrkrData)
 		hints.ai_flags = AI_NUMERICSERV;
 		hints.ai_family = glbl.GetDefPFFamily();
 		hints.ai_socktype = SOCK_DGRAM;
-		if((iErr = (getaddrinfo(pData->target, pData->port, &hints, &res))) != 0) {
+		if((iErr = (getaddrinfo(pTarget->target, pTarget->port, &hints, &res))) != 0) {
 			dbgprintf("could not get addrinfo for hostname '%s':'%s': %d%s\n",
-				  pData->target, pData->port, iErr, gai_strerror(iErr));
+				  pTarget->target, pTarget->port, iErr, gai_strerror(iErr));
 			ABORT_FINALIZE(RS_RET_SUSPENDED);
 		}
-		dbgprintf("%s found, resuming.\n", pData->target);
-		pWrkrData->f_addr = res;
-		pWrkrData->bIsConnected = 1;
-		if(pWrkrData->pSockArray == NULL) {
-			pWrkrData->pSockArray = net.create_udp_socket((uchar*)pData->target, NULL, 0, 0, 0);
+		dbgprintf("%s found, resuming.\n", pTarget->target);
+		pTarget->f_addr = res;
+		pTarget->bIsConnected = 1;
+		if(pTarget->pSockArray == NULL) {
+			pTarget->pSockArray = net.create_udp_socket((uchar*)pTarget->target, NULL, 0, 0, 0);
 		}
 	} else {
-		CHKiRet(TCPSendInit((void*)pWrkrData));
+		CHKiRet(TCPSendInit((void*)pTarget));
 	}
 
 finalize_it:
-	DBGPRINTF("omfwd: doTryResume %s iRet %d\n", pWrkrData->pData->target, iRet);
+	DBGPRINTF("omfwd: doTryResume %s iRet %d\n", pTarget->target, iRet);
 	if(iRet != RS_RET_OK) {
-		if(pWrkrData->f_addr != NULL) {
-			freeaddrinfo(pWrkrData->f_addr);
-			pWrkrData->f_addr = NULL;
+		if(pTarget->f_addr != NULL) {
+			freeaddrinfo(pTarget->f_addr);
+			pTarget->f_addr = NULL;
+		}
+		iRet = RS_RET_SUSPENDED;
+	}
+
+	RETiRet;
+}
+
+
+/* take a failed target out of the pool, for all workers. It will be
+ * retried once the pool resume interval has expired.
+ */
+static void
+suspendTarget(targetData_t *__restrict__ const pTarget, const time_t ttNow)
+{
+	instanceData *__restrict__ const pData = pTarget->pData;
+	poolTarget_t *__restrict__ const pPool = &pData->poolTarget[pTarget->iTarget];
+
+	pthread_mutex_lock(&pPool->mutSusp);
+	if(!pPool->bIsSuspended) {
+		DBGPRINTF("omfwd: suspending pool target %s for %d seconds\n",
+			  pTarget->target, pData->poolResumeInterval);
+		STATSCOUNTER_INC(pPool->ctrSuspended, pPool->mutCtrSuspended);
+	}
+	pPool->bIsSuspended = RSTRUE;
+	pPool->ttResume = ttNow + pData->poolResumeInterval;
+	pthread_mutex_unlock(&pPool->mutSusp);
+	pTarget->pWrkrData->bUsable[pTarget->iTarget] = RSFALSE;
+}
+
+
+/* put a target that works again back into the pool */
+static void
+resumeTarget(targetData_t *__restrict__ const pTarget)
+{
+	poolTarget_t *__restrict__ const pPool = &pTarget->pData->poolTarget[pTarget->iTarget];
+
+	pthread_mutex_lock(&pPool->mutSusp);
+	if(pPool->bIsSuspended) {
+		DBGPRINTF("omfwd: pool target %s works again\n", pTarget->target);
+		pPool->bIsSuspended = RSFALSE;
+	}
+	pthread_mutex_unlock(&pPool->mutSusp);
+}
+
+
+/* take a snapshot of which pool targets may currently be used, so that
+ * we do not need to lock the shared state for each message. Targets with
+ * expired resume interval are given a new chance; if they still fail,
+ * the send will take them out of the pool again. Returns the number of
+ * usable targets.
+ */
+static int
+poolSnapshot(wrkrInstanceData_t *__restrict__ const pWrkrData, const time_t ttNow)
+{
+	instanceData *__restrict__ const pData = pWrkrData->pData;
+	poolTarget_t *pPool;
+	int nUsable = 0;
+	int i;
+
+	for(i = 0 ; i < pData->nTargets ; ++i) {
+		pPool = &pData->poolTarget[i];
+		pthread_mutex_lock(&pPool->mutSusp);
+		pWrkrData->bUsable[i] = !pPool->bIsSuspended || ttNow >= pPool->ttResume;
+		pthread_mutex_unlock(&pPool->mutSusp);
+		if(pWrkrData->bUsable[i])
+			++nUsable;
+	}
+	return nUsable;
+}
+
+
+/* try to resume the connections to our targets. If we have a pool,
+ * it is sufficient that one of its targets works - the others are
+ * taken out of rotation until their resume interval expires. Only
+ * if no target at all is usable the action is suspended. If that
+ * happened, all targets are tried on resume, no matter what their
+ * resume interval says (the action engine does its own retry timing).
+ */
+static rsRetVal
+doTryResume(wrkrInstanceData_t *pWrkrData)
+{
+	instanceData *__restrict__ const pData = pWrkrData->pData;
+	targetData_t *pTarget;
+	time_t ttNow;
+	sbool bAllSuspended;
+	int nUsable = 0;
+	int i;
+	DEFiRet;
+
+	if(pData->nTargets == 1) {
+		iRet = doTryResumeTarget(&pWrkrData->target[0]);
+		FINALIZE;
+	}
+
+	ttNow = time(NULL);
+	bAllSuspended = (poolSnapshot(pWrkrData, ttNow) == 0);
+	for(i = 0 ; i < pData->nTargets ; ++i) {
+		pTarget = &pWrkrData->target[i];
+		if(!pWrkrData->bUsable[i] && !bAllSuspended)
+			continue;
+		if(doTryResumeTarget(pTarget) == RS_RET_OK) {
+			resumeTarget(pTarget);
+			++nUsable;
+		} else {
+			suspendTarget(pTarget, ttNow);
 		}
+	}
+
+	if(nUsable == 0) {
+		DBGPRINTF("omfwd: no pool target usable, suspending action\n");
 		iRet = RS_RET_SUSPENDED;
 	}
 
+finalize_it:
 	RETiRet;
 }
 
 
+/* a simple string hash for the consistent hashing ring. This is FNV-1a
+ * with a final avalanche step, as we need keys that differ only in their
+ * last character (like "host#1", "host#2") to spread well over the ring.
+ */
+static unsigned
+poolHash(const uchar *__restrict__ buf, const size_t len)
+{
+	unsigned h = 2166136261u;
+	size_t i;
+
+	for(i = 0 ; i < len ; ++i) {
+		h ^= buf[i];
+		h *= 16777619u;
+	}
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+	return h;
+}
+
+
+static int
+ringPointCmp(const void *v1, const void *v2)
+{
+	const ringPoint_t *const p1 = (const ringPoint_t*) v1;
+	const ringPoint_t *const p2 = (const ringPoint_t*) v2;
+	if(p1->hash < p2->hash)
+		return -1;
+	else if(p1->hash > p2->hash)
+		return 1;
+	return p1->iTarget - p2->iTarget;
+}
+
+
+/* build the consistent hashing ring. Each target is placed on the ring
+ * POOL_RING_VNODES times, so that the keys of a failed target are spread
+ * evenly across the remaining ones.
+ */
+static rsRetVal
+buildHashRing(instanceData *__restrict__ const pData)
+{
+	char vnode[1024];
+	int len;
+	int i, j;
+	unsigned n = 0;
+	DEFiRet;
+
+	pData->nRingPoints = pData->nTargets * POOL_RING_VNODES;
+	CHKmalloc(pData->ring = malloc(pData->nRingPoints * sizeof(ringPoint_t)));
+	for(i = 0 ; i < pData->nTargets ; ++i) {
+		for(j = 0 ; j < POOL_RING_VNODES ; ++j) {
+			len = snprintf(vnode, sizeof(vnode), "%s:%s#%d", pData->target[i],
+				(pData->poolTarget[i].port == NULL) ? "" : pData->poolTarget[i].port, j);
+			if(len >= (int) sizeof(vnode))
+				len = sizeof(vnode) - 1;
+			pData->ring[n].hash = poolHash((uchar*) vnode, len);
+			pData->ring[n].iTarget = i;
+			++n;
+		}
+	}
+	qsort(pData->ring, pData->nRingPoints, sizeof(ringPoint_t), ringPointCmp);
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* select the target for a message in POOL_HASH mode. We find the first
+ * ring point at or after the key's hash and walk clockwise until we
+ * find a usable target (as of the last poolSnapshot()). Returns NULL if
+ * no target is usable.
+ */
+static targetData_t *
+selectHashTarget(wrkrInstanceData_t *__restrict__ const pWrkrData,
+	const uchar *__restrict__ const key, const size_t lenKey)
+{
+	instanceData *__restrict__ const pData = pWrkrData->pData;
+	const unsigned h = poolHash(key, lenKey);
+	unsigned lo = 0, hi = pData->nRingPoints;
+	unsigned mid;
+	unsigned n;
+	targetData_t *pTarget;
+
+	while(lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if(pData->ring[mid].hash < h)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for(n = 0 ; n < pData->nRingPoints ; ++n) {
+		pTarget = &pWrkrData->target[pData->ring[(lo + n) % pData->nRingPoints].iTarget];
+		if(pWrkrData->bUsable[pTarget->iTarget])
+			return pTarget;
+	}
+	return NULL;
+}
+
+
+/* select the target for a whole batch in POOL_ROUNDROBIN mode, that is
+ * the next usable one (as of the last poolSnapshot()). Returns NULL if no
+ * target is usable.
+ */
+static targetData_t *
+selectBatchTarget(wrkrInstanceData_t *__restrict__ const pWrkrData)
+{
+	instanceData *__restrict__ const pData = pWrkrData->pData;
+	targetData_t *pTarget;
+	int i;
+
+	if(pData->nTargets == 1)
+		return &pWrkrData->target[0];
+
+	for(i = 0 ; i < pData->nTargets ; ++i) {
+		pTarget = &pWrkrData->target[(pWrkrData->nextTarget + i) % pData->nTargets];
+		if(pWrkrData->bUsable[pTarget->iTarget]) {
+			pWrkrData->nextTarget = (pTarget->iTarget + 1) % pData->nTargets;
+			return pTarget;
+		}
+	}
+	return NULL;
+}
+
+
 BEGINtryResume
 CODESTARTtryResume
 	dbgprintf("omfwd: tryResume: pWrkrData %p\n", pWrkrData);
@@ -793,40 +1161,38 @@ CODESTARTbeginTransaction
 ENDbeginTransaction
 
 
+/* Check if we should compress and, if so, do it. We also
+ * check if the message is large enough to justify compression.
+ * The smaller the message, the less likely is a gain in compression.
+ * To save CPU cycles, we do not try to compress very small messages.
+ * What "very small" means needs to be configured. Currently, it is
+ * hard-coded but this may be changed to a config parameter.
+ * On return, *ppsz and *pl describe the data to be sent. If a
+ * compression buffer was allocated, it is returned in *ppOut and must
+ * be freed by the caller after the data has been sent.
+ * rgerhards, 2006-11-30
+ */
 static rsRetVal
-processMsg(wrkrInstanceData_t *__restrict__ const pWrkrData,
-	actWrkrIParams_t *__restrict__ const iparam)
+compressMsg(instanceData *__restrict__ const pData,
+	uchar **__restrict__ const ppsz,
+	unsigned *__restrict__ const pl,
+	Bytef **__restrict__ const ppOut)
 {
-	uchar *psz; /* temporary buffering */
-	register unsigned l;
-	int iMaxLine;
-	Bytef *out = NULL; /* for compression */
-	instanceData *__restrict__ const pData = pWrkrData->pData;
+	Bytef *out = NULL;
+	const unsigned l = *pl;
 	DEFiRet;
 
-	iMaxLine = glbl.GetMaxLine();
-
-	psz = iparam->param;
-	l = iparam->lenStr;
-	if((int) l > iMaxLine)
-		l = iMaxLine;
-
-	/* Check if we should compress and, if so, do it. We also
-	 * check if the message is large enough to justify compression.
-	 * The smaller the message, the less likely is a gain in compression.
-	 * To save CPU cycles, we do not try to compress very small messages.
-	 * What "very small" means needs to be configured. Currently, it is
-	 * hard-coded but this may be changed to a config parameter.
-	 * rgerhards, 2006-11-30
-	 */
+	*ppOut = NULL;
 	if(pData->compressionMode == COMPRESS_SINGLE_MSG && (l > CONF_MIN_SIZE_FOR_COMPRESS)) {
+		const int iMaxLine = glbl.GetMaxLine();
 		uLongf destLen = iMaxLine + iMaxLine/100 +12; /* recommended value from zlib doc */
 		uLong srcLen = l;
 		int ret;
 		CHKmalloc(out = (Bytef*) MALLOC(destLen));
+		*ppOut = out;
 		out[0] = 'z';
 		out[1] = '\0';
-		ret = compress2((Bytef*) out+1, &destLen, (Bytef*) psz,
+		ret = compress2((Bytef*) out+1, &destLen, (Bytef*) *ppsz,
 				srcLen, pData->compressionLevel);
 		dbgprintf("Compressing message, length was %d now %d, return state  %d.\n",
 			l, (int) destLen, ret);
@@ -842,22 +1208,46 @@ processMsg(wrkrInstanceData_t *__restrict__ const pWrkrData,
 		} else if(destLen+1 < l) {
 			/* only use compression if there is a gain in using it! */
 			dbgprintf("there is gain in compression, so we do it\n");
-			psz = out;
-			l = destLen + 1; /* take care for the "z" at message start! */
+			*ppsz = out;
+			*pl = destLen + 1; /* take care for the "z" at message start! */
 		}
-		++destLen;
 	}
 
+finalize_it:
+	RETiRet;
+}
+
+
+static rsRetVal
+processMsg(targetData_t *__restrict__ const pTarget,
+	actWrkrIParams_t *__restrict__ const iparam)
+{
+	uchar *psz; /* temporary buffering */
+	unsigned l;
+	int iMaxLine;
+	Bytef *out = NULL; /* for compression */
+	instanceData *__restrict__ const pData = pTarget->pData;
+	DEFiRet;
+
+	iMaxLine = glbl.GetMaxLine();
+
+	psz = iparam->param;
+	l = iparam->lenStr;
+	if((int) l > iMaxLine)
+		l = iMaxLine;
+
+	CHKiRet(compressMsg(pData, &psz, &l, &out));
+
 	if(pData->protocol == FORW_UDP) {
 		/* forward via UDP */
-		CHKiRet(UDPSend(pWrkrData, psz, l));
+		CHKiRet(UDPSend(pTarget, psz, l));
 	} else {
 		/* forward via TCP */
-		iRet = tcpclt.Send(pWrkrData->pTCPClt, pWrkrData, (char *)psz, l);
+		iRet = tcpclt.Send(pTarget->pTCPClt, pTarget, (char *)psz, l);
 		if(iRet != RS_RET_OK && iRet != RS_RET_DEFER_COMMIT && iRet != RS_RET_PREVIOUS_COMMITTED) {
 			/* error! */
 			dbgprintf("error forwarding via tcp, suspending\n");
-			DestructTCPInstanceData(pWrkrData);
+			DestructTCPInstanceData(pTarget);
 			iRet = RS_RET_SUSPENDED;
 		}
 	}
@@ -866,28 +1256,403 @@ finalize_it:
 	RETiRet;
 }
 
+
+/* make sure the batch work arrays can hold at least nMsgs entries.
+ * Arrays only grow, so after the first few transactions this is a no-op.
+ */
+static rsRetVal
+growBatchArrays(wrkrInstanceData_t *__restrict__ const pWrkrData, const unsigned nMsgs)
+{
+	unsigned *newIdx;
+	int *newTarget;
+	sbool *newDone;
+#	ifdef HAVE_SENDMMSG
+	struct mmsghdr *newmmh;
+	struct iovec *newiov;
+	sbool *newSent;
+	Bytef **newCompBuf;
+#	endif
+	DEFiRet;
+
+	if(nMsgs <= pWrkrData->maxBatch)
+		FINALIZE;
+
+	CHKmalloc(newIdx = realloc(pWrkrData->pendIdx, nMsgs * sizeof(unsigned)));
+	pWrkrData->pendIdx = newIdx;
+	CHKmalloc(newIdx = realloc(pWrkrData->grpIdx, nMsgs * sizeof(unsigned)));
+	pWrkrData->grpIdx = newIdx;
+	CHKmalloc(newIdx = realloc(pWrkrData->failIdx, nMsgs * sizeof(unsigned)));
+	pWrkrData->failIdx = newIdx;
+	CHKmalloc(newTarget = realloc(pWrkrData->msgTarget, nMsgs * sizeof(int)));
+	pWrkrData->msgTarget = newTarget;
+	CHKmalloc(newDone = realloc(pWrkrData->bTxDone, nMsgs * sizeof(sbool)));
+	pWrkrData->bTxDone = newDone;
+#	ifdef HAVE_SENDMMSG
+	CHKmalloc(newmmh = realloc(pWrkrData->mmh, nMsgs * sizeof(struct mmsghdr)));
+	pWrkrData->mmh = newmmh;
+	CHKmalloc(newiov = realloc(pWrkrData->iov, nMsgs * sizeof(struct iovec)));
+	pWrkrData->iov = newiov;
+	CHKmalloc(newIdx = realloc(pWrkrData->mmhIdx, nMsgs * sizeof(unsigned)));
+	pWrkrData->mmhIdx = newIdx;
+	CHKmalloc(newSent = realloc(pWrkrData->bSent, nMsgs * sizeof(sbool)));
+	pWrkrData->bSent = newSent;
+	CHKmalloc(newCompBuf = realloc(pWrkrData->compBuf, nMsgs * sizeof(Bytef*)));
+	pWrkrData->compBuf = newCompBuf;
+#	endif
+	pWrkrData->maxBatch = nMsgs;
+
+finalize_it:
+	RETiRet;
+}
+
+
+#ifdef HAVE_SENDMMSG
+/* send the first nPending entries of mmh[] to a single target address.
+ * Just like UDPSend() does for a single message, each message is tried on
+ * our sockets in order until one accepts it (there is one socket per address
+ * family, so usually only one of them works for a given target). sendmmsg()
+ * may send only part of the vector; in that case we continue with the
+ * remaining messages. A message the first socket did not accept is tried
+ * alone on the other sockets, so that the messages after it again start
+ * with the first socket. Messages that were sent completely are flagged
+ * in bSent[].
+ */
+static void
+UDPSendBatchToAddr(targetData_t *__restrict__ const pTarget,
+	struct addrinfo *__restrict__ const r,
+	const unsigned nPending,
+	int *__restrict__ const pLasterrno)
+{
+	wrkrInstanceData_t *__restrict__ const pWrkrData = pTarget->pWrkrData;
+	unsigned done = 0; /* number of mmh[] entries already handled */
+	int iSock = 0;
+	int nSent;
+	int j;
+	char errStr[1024];
+
+	for(j = 0 ; j < (int) nPending ; ++j) {
+		pWrkrData->mmh[j].msg_hdr.msg_name = r->ai_addr;
+		pWrkrData->mmh[j].msg_hdr.msg_namelen = r->ai_addrlen;
+	}
+
+	while(done < nPending) {
+		nSent = sendmmsg(pTarget->pSockArray[iSock+1], pWrkrData->mmh + done,
+				 (iSock == 0) ? nPending - done : 1, 0);
+		if(nSent < 0) {
+			if(errno == EINTR)
+				continue;
+			*pLasterrno = errno;
+			DBGPRINTF("sendmmsg() error: %d = %s.\n", *pLasterrno,
+				rs_strerror_r(*pLasterrno, errStr, sizeof(errStr)));
+		}
+		for(j = 0 ; j < nSent ; ++j) {
+			if(pWrkrData->mmh[done].msg_len != pWrkrData->mmh[done].msg_hdr.msg_iov->iov_len)
+				break; /* partially sent, treated as failure like in UDPSend() */
+			pWrkrData->bSent[pWrkrData->mmhIdx[done]] = RSTRUE;
+			++done;
+		}
+		if(nSent > 0 && j == nSent) {
+			iSock = 0;
+		} else if(++iSock >= *pTarget->pSockArray) {
+			/* no socket accepted this message, so give up on it
+			 * (for this address) and continue with the next one.
+			 */
+			++done;
+			iSock = 0;
+		}
+	}
+}
+
+
+/* Send the messages listed in msgIdx[] via UDP, using as few sendmmsg()
+ * calls as possible. This is semantically equivalent to calling UDPSend()
+ * for each message (except for the send delay, which inherently is
+ * per-message and thus not supported here): the rebind interval is honored
+ * by splitting the batch into chunks, and without udp.sendtoall each message
+ * is sent to the first target address that accepts it. If any message could
+ * not be sent to any of the addresses, the target is suspended. The messages
+ * that were sent are flagged in bTxDone[], so that they are not sent again.
+ */
+static rsRetVal
+UDPSendBatch(targetData_t *__restrict__ const pTarget,
+	actWrkrIParams_t *__restrict__ const pParams,
+	const int nTpls,
+	const unsigned *__restrict__ const msgIdx,
+	const unsigned nMsgs)
+{
+	instanceData *__restrict__ const pData = pTarget->pData;
+	wrkrInstanceData_t *__restrict__ const pWrkrData = pTarget->pWrkrData;
+	struct addrinfo *r;
+	uchar *psz;
+	unsigned l;
+	unsigned i, j;
+	unsigned first, nChunk;
+	unsigned nPending;
+	unsigned nFailed = 0;
+	int iMaxLine;
+	int lasterrno = ENOENT;
+	DEFiRet;
+
+	memset(pWrkrData->compBuf, 0, nMsgs * sizeof(Bytef*));
+	memset(pWrkrData->bSent, 0, nMsgs * sizeof(sbool));
+
+	iMaxLine = glbl.GetMaxLine();
+	for(i = 0 ; i < nMsgs ; ++i) {
+		psz = actParam(pParams, nTpls, msgIdx[i], 0).param;
+		l = actParam(pParams, nTpls, msgIdx[i], 0).lenStr;
+		if((int) l > iMaxLine)
+			l = iMaxLine;
+		CHKiRet(compressMsg(pData, &psz, &l, &pWrkrData->compBuf[i]));
+		pWrkrData->iov[i].iov_base = psz;
+		pWrkrData->iov[i].iov_len = l;
+	}
+
+	for(first = 0 ; first < nMsgs ; first += nChunk) {
+		nChunk = nMsgs - first;
+		if(pData->iRebindInterval) {
+			/* count exactly like UDPSend() does for each message: the
+			 * first message of the chunk may trigger the rebind, the
+			 * others must stay below the next one.
+			 */
+			if(pTarget->nXmit++ % pData->iRebindInterval == 0) {
+				dbgprintf("omfwd dropping UDP 'connection' (as configured)\n");
+				pTarget->nXmit = 1;
+				CHKiRet(closeUDPSockets(pTarget));
+			}
+			if(nChunk > (unsigned) (pData->iRebindInterval - pTarget->nXmit + 1))
+				nChunk = pData->iRebindInterval - pTarget->nXmit + 1;
+			pTarget->nXmit += nChunk - 1;
+		}
+
+		if(pTarget->pSockArray == NULL) {
+			CHKiRet(doTryResumeTarget(pTarget));
+		}
+		if(pTarget->pSockArray == NULL) {
+			/* same as UDPSend(): no socket, the messages are dropped */
+			for(j = first ; j < first + nChunk ; ++j)
+				pWrkrData->bSent[j] = RSTRUE;
+			continue;
+		}
+
+		for(r = pTarget->f_addr; r; r = r->ai_next) {
+			nPending = 0;
+			for(j = first ; j < first + nChunk ; ++j) {
+				if(pData->bSendToAll || !pWrkrData->bSent[j]) {
+					memset(&pWrkrData->mmh[nPending], 0, sizeof(struct mmsghdr));
+					pWrkrData->mmh[nPending].msg_hdr.msg_iov = &pWrkrData->iov[j];
+					pWrkrData->mmh[nPending].msg_hdr.msg_iovlen = 1;
+					pWrkrData->mmhIdx[nPending] = j;
+					++nPending;
+				}
+			}
+			if(nPending == 0)
+				break; /* everything delivered, no need to try further addresses */
+			UDPSendBatchToAddr(pTarget, r, nPending, &lasterrno);
+		}
+
+		for(j = first ; j < first + nChunk ; ++j) {
+			if(!pWrkrData->bSent[j])
+				++nFailed;
+		}
+	}
+
+	if(nFailed > 0) {
+		DBGPRINTF("omfwd: %u of %u messages could not be sent via udp\n", nFailed, nMsgs);
+		reportUDPSendErr(pWrkrData, lasterrno);
+		iRet = RS_RET_SUSPENDED;
+	}
+
+finalize_it:
+	for(i = 0 ; i < nMsgs ; ++i) {
+		free(pWrkrData->compBuf[i]);
+		if(pWrkrData->bSent[i])
+			pWrkrData->bTxDone[msgIdx[i]] = RSTRUE;
+	}
+	RETiRet;
+}
+#endif /* #ifdef HAVE_SENDMMSG */
+
+
+/* send the messages listed in msgIdx[] to a single target and flush
+ * the target's send buffer. Messages that were delivered are flagged in
+ * bTxDone[]. For UDP, this is known for each message. For TCP, we only know
+ * that all messages arrived if the send buffer could be flushed.
+ */
+static rsRetVal
+sendToTarget(targetData_t *__restrict__ const pTarget,
+	actWrkrIParams_t *__restrict__ const pParams,
+	const int nTpls,
+	const unsigned *__restrict__ const msgIdx,
+	const unsigned nMsgs)
+{
+	instanceData *__restrict__ const pData = pTarget->pData;
+	wrkrInstanceData_t *__restrict__ const pWrkrData = pTarget->pWrkrData;
+	poolTarget_t *const pPool = (pData->poolTarget == NULL) ? NULL
+					: &pData->poolTarget[pTarget->iTarget];
+	unsigned i;
+	unsigned nSent = 0;
+	uint64 nBytes = 0;
+	DEFiRet;
+
+	dbgprintf(" %s:%s/%s\n", pTarget->target, pTarget->port,
+		 pData->protocol == FORW_UDP ? "udp" : "tcp");
+
+	CHKiRet(doTryResumeTarget(pTarget));
+
+#	ifdef HAVE_SENDMMSG
+	if(pData->protocol == FORW_UDP && pData->iUDPSendDelay == 0) {
+		CHKiRet(UDPSendBatch(pTarget, pParams, nTpls, msgIdx, nMsgs));
+	} else {
+#	endif
+		for(i = 0 ; i < nMsgs ; ++i) {
+			iRet = processMsg(pTarget, &actParam(pParams, nTpls, msgIdx[i], 0));
+			if(iRet != RS_RET_OK && iRet != RS_RET_DEFER_COMMIT && iRet != RS_RET_PREVIOUS_COMMITTED)
+				FINALIZE;
+			if(pData->protocol == FORW_UDP)
+				pWrkrData->bTxDone[msgIdx[i]] = RSTRUE;
+		}
+
+		if(pTarget->offsSndBuf != 0) {
+			iRet = TCPSendBuf(pTarget, pTarget->sndBuf, pTarget->offsSndBuf, IS_FLUSH);
+			pTarget->offsSndBuf = 0;
+		}
+		if(pData->protocol != FORW_UDP
+		   && (iRet == RS_RET_OK || iRet == RS_RET_DEFER_COMMIT || iRet == RS_RET_PREVIOUS_COMMITTED)) {
+			for(i = 0 ; i < nMsgs ; ++i)
+				pWrkrData->bTxDone[msgIdx[i]] = RSTRUE;
+		}
+#	ifdef HAVE_SENDMMSG
+	}
+#	endif
+
+finalize_it:
+	if(pPool != NULL) {
+		for(i = 0 ; i < nMsgs ; ++i) {
+			if(pWrkrData->bTxDone[msgIdx[i]]) {
+				++nSent;
+				nBytes += actParam(pParams, nTpls, msgIdx[i], 0).lenStr;
+			}
+		}
+		STATSCOUNTER_ADD(pPool->ctrMsgsSent, pPool->mutCtrMsgsSent, nSent);
+		STATSCOUNTER_ADD(pPool->ctrBytesSent, pPool->mutCtrBytesSent, nBytes);
+		if(iRet == RS_RET_OK || iRet == RS_RET_DEFER_COMMIT || iRet == RS_RET_PREVIOUS_COMMITTED) {
+			resumeTarget(pTarget); /* a formerly failed target works again */
+		} else {
+			/* The messages will be sent to another target. Whatever is
+			 * left in the send buffer must not go to this target once it
+			 * is reconnected, as that would duplicate these messages.
+			 */
+			pTarget->offsSndBuf = 0;
+			STATSCOUNTER_INC(pPool->ctrFail, pPool->mutCtrFail);
+		}
+	}
+	RETiRet;
+}
+
+
+/* In a transaction, each message is assigned to a target: in POOL_HASH
+ * mode based on its key, otherwise the whole batch goes to a single
+ * target. If a target fails, it is taken out of the pool (for all
+ * workers) and its messages are re-assigned to the remaining targets.
+ * Only if no target is left, the action is suspended. Messages that were
+ * delivered are tracked by their index in the batch (bTxDone[]): they are
+ * neither re-assigned nor sent again when the core retries the batch. For
+ * UDP this is exact; for TCP, a message the failed target had received
+ * before the connection broke may still be duplicated.
+ */
 BEGINcommitTransaction
+	instanceData *__restrict__ const pData = pWrkrData->pData;
+	const int nTpls = pData->nTpls;
+	targetData_t *pTarget;
+	time_t ttNow;
 	unsigned i;
+	unsigned nPending;
+	unsigned nGrp;
+	unsigned nFailed;
+	int t;
+	int nRounds;
+	rsRetVal localRet;
 CODESTARTcommitTransaction
+	CHKiRet(growBatchArrays(pWrkrData, nParams));
+	if(!pWrkrData->bTxRetry || pWrkrData->nTxParams != nParams)
+		memset(pWrkrData->bTxDone, 0, nParams * sizeof(sbool));
+	pWrkrData->bTxRetry = 1;
+	pWrkrData->nTxParams = nParams;
 	CHKiRet(doTryResume(pWrkrData));
 
-	dbgprintf(" %s:%s/%s\n", pWrkrData->pData->target, pWrkrData->pData->port,
-		 pWrkrData->pData->protocol == FORW_UDP ? "udp" : "tcp");
-
+	nPending = 0;
 	for(i = 0 ; i < nParams ; ++i) {
-		iRet = processMsg(pWrkrData, &actParam(pParams, 1, i, 0));
-		if(iRet != RS_RET_OK && iRet != RS_RET_DEFER_COMMIT && iRet != RS_RET_PREVIOUS_COMMITTED)
-			FINALIZE;
+		if(!pWrkrData->bTxDone[i])
+			pWrkrData->pendIdx[nPending++] = i;
 	}
+	if(nPending < nParams)
+		DBGPRINTF("omfwd: retried transaction, %u of %u messages already sent\n",
+			  nParams - nPending, nParams);
+
+	/* each round takes at least one failed target out of the pool */
+	for(nRounds = 0 ; nPending > 0 ; ++nRounds) {
+		if(nRounds >= pData->nTargets) {
+			DBGPRINTF("omfwd: all pool targets failed, suspending action\n");
+			ABORT_FINALIZE(RS_RET_SUSPENDED);
+		}
+		ttNow = 0;
+		if(pData->nTargets > 1) {
+			ttNow = time(NULL);
+			poolSnapshot(pWrkrData, ttNow);
+		}
+		if(pData->poolMode == POOL_HASH && pData->nTargets > 1) {
+			for(i = 0 ; i < nPending ; ++i) {
+				pTarget = selectHashTarget(pWrkrData,
+					actParam(pParams, nTpls, pWrkrData->pendIdx[i], 1).param,
+					actParam(pParams, nTpls, pWrkrData->pendIdx[i], 1).lenStr);
+				if(pTarget == NULL)
+					ABORT_FINALIZE(RS_RET_SUSPENDED);
+				pWrkrData->msgTarget[pWrkrData->pendIdx[i]] = pTarget->iTarget;
+			}
+		} else {
+			pTarget = selectBatchTarget(pWrkrData);
+			if(pTarget == NULL)
+				ABORT_FINALIZE(RS_RET_SUSPENDED);
+			for(i = 0 ; i < nPending ; ++i)
+				pWrkrData->msgTarget[pWrkrData->pendIdx[i]] = pTarget->iTarget;
+		}
 
-	if(pWrkrData->offsSndBuf != 0) {
-		iRet = TCPSendBuf(pWrkrData, pWrkrData->sndBuf, pWrkrData->offsSndBuf, IS_FLUSH);
-		pWrkrData->offsSndBuf = 0;
+		nFailed = 0;
+		for(t = 0 ; t < pData->nTargets ; ++t) {
+			nGrp = 0;
+			for(i = 0 ; i < nPending ; ++i) {
+				if(pWrkrData->msgTarget[pWrkrData->pendIdx[i]] == t)
+					pWrkrData->grpIdx[nGrp++] = pWrkrData->pendIdx[i];
+			}
+			if(nGrp == 0)
+				continue;
+			localRet = sendToTarget(&pWrkrData->target[t], pParams, nTpls, pWrkrData->grpIdx, nGrp);
+			if(   localRet == RS_RET_OK
+			   || localRet == RS_RET_DEFER_COMMIT
+			   || localRet == RS_RET_PREVIOUS_COMMITTED)
+				continue;
+			if(pData->nTargets == 1)
+				ABORT_FINALIZE(localRet);
+			suspendTarget(&pWrkrData->target[t], ttNow);
+			for(i = 0 ; i < nGrp ; ++i) {
+				if(!pWrkrData->bTxDone[pWrkrData->grpIdx[i]])
+					pWrkrData->failIdx[nFailed++] = pWrkrData->grpIdx[i];
+			}
+		}
+		memcpy(pWrkrData->pendIdx, pWrkrData->failIdx, nFailed * sizeof(unsigned));
+		nPending = nFailed;
 	}
+	pWrkrData->bTxRetry = 0;
 finalize_it:
 ENDcommitTransaction
 
 
+BEGINabortTransaction
+CODESTARTabortTransaction
+	pWrkrData->bTxRetry = 0;
+ENDabortTransaction
+
+
 /* This function loads TCP support, if not already loaded. It will be called
  * during config processing. To server ressources, TCP support will only
  * be loaded if it actually is used. -- rgerhard, 2008-04-17
@@ -909,28 +1674,117 @@ finalize_it:
  * created.
  */
 static rsRetVal
-initTCP(wrkrInstanceData_t *pWrkrData)
+initTCP(targetData_t *pTarget)
 {
 	instanceData *pData;
 	DEFiRet;
 
-	pData = pWrkrData->pData;
+	pData = pTarget->pData;
 	if(pData->protocol == FORW_TCP) {
 		/* create our tcpclt */
-		CHKiRet(tcpclt.Construct(&pWrkrData->pTCPClt));
-		CHKiRet(tcpclt.SetResendLastOnRecon(pWrkrData->pTCPClt, pData->bResendLastOnRecon));
+		CHKiRet(tcpclt.Construct(&pTarget->pTCPClt));
+		/* in a pool, the last message was re-sent to another target */
+		CHKiRet(tcpclt.SetResendLastOnRecon(pTarget->pTCPClt,
+			pData->nTargets == 1 && pData->bResendLastOnRecon));
 		/* and set callbacks */
-		CHKiRet(tcpclt.SetSendInit(pWrkrData->pTCPClt, TCPSendInit));
-		CHKiRet(tcpclt.SetSendFrame(pWrkrData->pTCPClt, TCPSendFrame));
-		CHKiRet(tcpclt.SetSendPrepRetry(pWrkrData->pTCPClt, TCPSendPrepRetry));
-		CHKiRet(tcpclt.SetFraming(pWrkrData->pTCPClt, pData->tcp_framing));
-		CHKiRet(tcpclt.SetRebindInterval(pWrkrData->pTCPClt, pData->iRebindInterval));
+		CHKiRet(tcpclt.SetSendInit(pTarget->pTCPClt, TCPSendInit));
+		CHKiRet(tcpclt.SetSendFrame(pTarget->pTCPClt, TCPSendFrame));
+		CHKiRet(tcpclt.SetSendPrepRetry(pTarget->pTCPClt, TCPSendPrepRetry));
+		CHKiRet(tcpclt.SetFraming(pTarget->pTCPClt, pData->tcp_framing));
+		CHKiRet(tcpclt.SetRebindInterval(pTarget->pTCPClt, pData->iRebindInterval));
 	}
 finalize_it:
 	RETiRet;
 }
 
 
+/* split a pool target given as "host:port" or "[ipv6-addr]:port". The
+ * host part is modified in place, the port is returned as a new string
+ * (or NULL if the target has no port). A plain IPv6 address (more than
+ * one colon) is taken as host name.
+ */
+static rsRetVal
+splitPoolTarget(char *__restrict__ const target, char **__restrict__ const pPort)
+{
+	char *colon;
+	char *host = target;
+	DEFiRet;
+
+	*pPort = NULL;
+	if(target[0] == '[') {
+		colon = strstr(target, "]:");
+		if(colon == NULL)
+			FINALIZE;
+		*colon++ = '\0';
+		++host;
+	} else {
+		colon = strchr(target, ':');
+		if(colon == NULL || strchr(colon + 1, ':') != NULL)
+			FINALIZE;
+	}
+	*colon = '\0';
+	CHKmalloc(*pPort = strdup(colon + 1));
+	if(host != target)
+		memmove(target, host, strlen(host) + 1);
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* set up the instance-wide data needed for a target pool: the
+ * per-target ports, suspension state and statistics and, for hash
+ * mode, the hashing ring.
+ */
+static rsRetVal
+setupPool(instanceData *__restrict__ const pData)
+{
+	poolTarget_t *pPool;
+	uchar ctrName[512];
+	int i;
+	DEFiRet;
+
+	CHKmalloc(pData->poolTarget = calloc(pData->nTargets, sizeof(poolTarget_t)));
+	for(i = 0 ; i < pData->nTargets ; ++i) {
+		pPool = &pData->poolTarget[i];
+		pthread_mutex_init(&pPool->mutSusp, NULL);
+		CHKiRet(splitPoolTarget(pData->target[i], &pPool->port));
+		if(pPool->port != NULL && *pPool->port == '\0') {
+			errmsg.LogError(0, RS_RET_INVALID_PARAMS, "omfwd: pool target '%s' "
+					"has an empty port", pData->target[i]);
+			ABORT_FINALIZE(RS_RET_INVALID_PARAMS);
+		}
+		snprintf((char*)ctrName, sizeof(ctrName), "omfwd pool %s:%s", pData->target[i],
+			(pPool->port != NULL) ? pPool->port
+					      : ((pData->port == NULL) ? "514" : pData->port));
+		ctrName[sizeof(ctrName)-1] = '\0'; /* be on the save side */
+		CHKiRet(statsobj.Construct(&pPool->stats));
+		CHKiRet(statsobj.SetName(pPool->stats, ctrName));
+		CHKiRet(statsobj.SetOrigin(pPool->stats, (uchar*)"omfwd"));
+		STATSCOUNTER_INIT(pPool->ctrMsgsSent, pPool->mutCtrMsgsSent);
+		CHKiRet(statsobj.AddCounter(pPool->stats, UCHAR_CONSTANT("messages.sent"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pPool->ctrMsgsSent));
+		STATSCOUNTER_INIT(pPool->ctrBytesSent, pPool->mutCtrBytesSent);
+		CHKiRet(statsobj.AddCounter(pPool->stats, UCHAR_CONSTANT("bytes.sent"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pPool->ctrBytesSent));
+		STATSCOUNTER_INIT(pPool->ctrFail, pPool->mutCtrFail);
+		CHKiRet(statsobj.AddCounter(pPool->stats, UCHAR_CONSTANT("failed"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pPool->ctrFail));
+		STATSCOUNTER_INIT(pPool->ctrSuspended, pPool->mutCtrSuspended);
+		CHKiRet(statsobj.AddCounter(pPool->stats, UCHAR_CONSTANT("suspended"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pPool->ctrSuspended));
+		CHKiRet(statsobj.ConstructFinalize(pPool->stats));
+	}
+
+	if(pData->poolMode == POOL_HASH) {
+		CHKiRet(buildHashRing(pData));
+	}
+
+finalize_it:
+	RETiRet;
+}
+
+
 static inline void
 setInstParamDefaults(instanceData *pData)
 {
@@ -951,6 +1805,8 @@ setInstParamDefaults(instanceData *pData)
 	pData->pPermPeers = NULL;
 	pData->compressionLevel = 9;
 	pData->strmCompFlushOnTxEnd = 1;
+	pData->strmCompCodec = STRMCOMP_ZLIB;
+	pData->strmCompLevel = -1;
 	pData->compressionMode = COMPRESS_NEVER;
 	pData->errsToReport = 5;
 }
@@ -959,7 +1815,7 @@ BEGINnewActInst
 	struct cnfparamvals *pvals;
 	uchar *tplToUse;
 	char *cstr;
-	int i;
+	int i, j;
 	rsRetVal localRet;
 	int complevel = -1;
 CODESTARTnewActInst
@@ -984,7 +1840,11 @@ CODESTARTnewActInst
 		if(!pvals[i].bUsed)
 			continue;
 		if(!strcmp(actpblk.descr[i].name, "target")) {
-			pData->target = es_str2cstr(pvals[i].val.d.estr, NULL);
+			pData->nTargets = pvals[i].val.d.ar->nmemb;
+			CHKmalloc(pData->target = calloc(pData->nTargets, sizeof(char*)));
+			for(j = 0 ; j < pData->nTargets ; ++j) {
+				CHKmalloc(pData->target[j] = es_str2cstr(pvals[i].val.d.ar->arr[j], NULL));
+			}
 		} else if(!strcmp(actpblk.descr[i].name, "port")) {
 			pData->port = es_str2cstr(pvals[i].val.d.estr, NULL);
 		} else if(!strcmp(actpblk.descr[i].name, "protocol")) {
@@ -1084,8 +1944,45 @@ CODESTARTnewActInst
 			pData->iUDPSendDelay = (int) pvals[i].val.d.n;
 		} else if(!strcmp(actpblk.descr[i].name, "template")) {
 			pData->tplName = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
+		} else if(!strcmp(actpblk.descr[i].name, "pool.mode")) {
+			cstr = es_str2cstr(pvals[i].val.d.estr, NULL);
+			if(!strcasecmp(cstr, "roundrobin")) {
+				pData->poolMode = POOL_ROUNDROBIN;
+			} else if(!strcasecmp(cstr, "hash")) {
+				pData->poolMode = POOL_HASH;
+			} else {
+				errmsg.LogError(0, RS_RET_PARAM_ERROR, "omfwd: invalid value for 'pool.mode' "
+					 "parameter (given is '%s')", cstr);
+				free(cstr);
+				ABORT_FINALIZE(RS_RET_PARAM_ERROR);
+			}
+			free(cstr);
+		} else if(!strcmp(actpblk.descr[i].name, "pool.resumeinterval")) {
+			pData->poolResumeInterval = (int) pvals[i].val.d.n;
+		} else if(!strcmp(actpblk.descr[i].name, "pool.hashtemplate")) {
+			pData->poolHashTplName = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
 		} else if(!strcmp(actpblk.descr[i].name, "compression.stream.flushontxend")) {
 			pData->strmCompFlushOnTxEnd = (sbool) pvals[i].val.d.n;
+		} else if(!strcmp(actpblk.descr[i].name, "compression.stream.codec")) {
+			cstr = es_str2cstr(pvals[i].val.d.estr, NULL);
+			pData->strmCompCodec = strmcompCodecFromName(cstr);
+			if(pData->strmCompCodec == -1 || pData->strmCompCodec == STRMCOMP_AUTO) {
+				errmsg.LogError(0, RS_RET_PARAM_ERROR, "omfwd: invalid value for "
+					 "'compression.stream.codec' parameter (given is '%s')", cstr);
+				free(cstr);
+				ABORT_FINALIZE(RS_RET_PARAM_ERROR);
+			}
+			if(!strmcompCodecAvailable(pData->strmCompCodec)) {
+				errmsg.LogError(0, RS_RET_CODEC_NOT_AVAILABLE, "omfwd: compression "
+					 "codec '%s' is not supported by this build of rsyslog", cstr);
+				free(cstr);
+				ABORT_FINALIZE(RS_RET_CODEC_NOT_AVAILABLE);
+			}
+			free(cstr);
+		} else if(!strcmp(actpblk.descr[i].name, "compression.stream.level")) {
+			pData->strmCompLevel = (int) pvals[i].val.d.n;
+		} else if(!strcmp(actpblk.descr[i].name, "compression.stream.dictionary")) {
+			pData->strmCompDictFile = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
 		} else if(!strcmp(actpblk.descr[i].name, "compression.mode")) {
 			cstr = es_str2cstr(pvals[i].val.d.estr, NULL);
 			if(!strcasecmp(cstr, "stream:always")) {
@@ -1118,10 +2015,70 @@ CODESTARTnewActInst
 		}
 	}
 
-	CODE_STD_STRING_REQUESTnewActInst(1)
+	if(pData->strmCompLevel == -1)
+		pData->strmCompLevel = strmcompDfltLevel(pData->strmCompCodec);
+	if(pData->strmCompDictFile != NULL) {
+		if(pData->strmCompCodec != STRMCOMP_ZSTD) {
+			errmsg.LogError(0, RS_RET_PARAM_ERROR, "omfwd: compression.stream.dictionary "
+					"is only supported with codec \"zstd\"");
+			ABORT_FINALIZE(RS_RET_PARAM_ERROR);
+		}
+		localRet = strmcompLoadDict((char*) pData->strmCompDictFile, &pData->strmCompDict,
+				&pData->lenStrmCompDict);
+		if(localRet != RS_RET_OK) {
+			errmsg.LogError(0, localRet, "omfwd: could not load compression "
+					"dictionary '%s'", pData->strmCompDictFile);
+			ABORT_FINALIZE(localRet);
+		}
+	}
+	if(pData->compressionMode == COMPRESS_STREAM_ALWAYS) {
+		/* catch invalid levels now, not on each connection attempt */
+		strmcomp_t *pComp;
+		localRet = strmcompConstruct(&pComp, pData->strmCompCodec, 0,
+				pData->strmCompLevel, pData->strmCompDict, pData->lenStrmCompDict);
+		if(localRet != RS_RET_OK) {
+			errmsg.LogError(0, localRet, "omfwd: could not initialize %s stream "
+					"compression with level %d", strmcompCodecName(pData->strmCompCodec),
+					pData->strmCompLevel);
+			ABORT_FINALIZE(localRet);
+		}
+		strmcompDestruct(&pComp);
+	}
+
+	if(pData->nTargets == 0) {
+		errmsg.LogError(0, RS_RET_PARAM_ERROR, "omfwd: parameter 'target' is "
+				"missing or empty");
+		ABORT_FINALIZE(RS_RET_PARAM_ERROR);
+	}
+	if(pData->poolMode == POOL_HASH) {
+		if(pData->poolHashTplName == NULL) {
+			errmsg.LogError(0, RS_RET_INVALID_PARAMS, "omfwd: pool.mode \"hash\" "
+					"requires the pool.hashtemplate parameter");
+			ABORT_FINALIZE(RS_RET_INVALID_PARAMS);
+		}
+		pData->nTpls = 2;
+	} else if(pData->poolHashTplName != NULL) {
+		errmsg.LogError(0, RS_RET_INVALID_PARAMS, "omfwd: pool.hashtemplate can "
+				"only be used with pool.mode \"hash\"");
+		ABORT_FINALIZE(RS_RET_INVALID_PARAMS);
+	}
+	if(pData->nTargets > 1 && pData->bResendLastOnRecon) {
+		errmsg.LogError(0, RS_RET_PARAM_ERROR, "omfwd: resendLastMSGOnReconnect "
+				"is not used with a target pool, as the messages of a failed "
+				"target are sent to the other targets -- ignored");
+	}
+
+	CODE_STD_STRING_REQUESTnewActInst(pData->nTpls)
 
 	tplToUse = ustrdup((pData->tplName == NULL) ? getDfltTpl() : pData->tplName);
 	CHKiRet(OMSRsetEntry(*ppOMSR, 0, tplToUse, OMSR_NO_RQD_TPL_OPTS));
+	if(pData->nTpls == 2) {
+		CHKiRet(OMSRsetEntry(*ppOMSR, 1, ustrdup(pData->poolHashTplName), OMSR_NO_RQD_TPL_OPTS));
+	}
+
+	if(pData->nTargets > 1) {
+		CHKiRet(setupPool(pData));
+	}
 
 	if(pData->bSendToAll == -1) {
 		pData->bSendToAll = send_to_all;
@@ -1265,13 +2222,15 @@ CODE_STD_STRING_REQUESTparseSelectorAct(1)
 	while(*p && *p != ';'  && *p != '#' && !isspace((int) *p))
 		++p; /*JUST SKIP*/
 
+	CHKmalloc(pData->target = calloc(1, sizeof(char*)));
+	pData->nTargets = 1;
 	if(*p == ';' || *p == '#' || isspace(*p)) {
 		uchar cTmp = *p;
 		*p = '\0'; /* trick to obtain hostname (later)! */
-		CHKmalloc(pData->target = strdup((char*) q));
+		CHKmalloc(pData->target[0] = strdup((char*) q));
 		*p = cTmp;
 	} else {
-		CHKmalloc(pData->target = strdup((char*) q));
+		CHKmalloc(pData->target[0] = strdup((char*) q));
 	}
 
 	/* copy over config data as needed */
@@ -1322,6 +2281,7 @@ CODESTARTmodExit
 	objRelease(netstrm, LM_NETSTRMS_FILENAME);
 	objRelease(netstrms, LM_NETSTRMS_FILENAME);
 	objRelease(tcpclt, LM_TCPCLT_FILENAME);
+	objRelease(statsobj, CORE_COMPONENT);
 	freeConfigVars();
 ENDmodExit
 
@@ -1333,6 +2293,7 @@ CODEqueryEtryPt_STD_OMOD8_QUERIES
 CODEqueryEtryPt_STD_CONF2_QUERIES
 CODEqueryEtryPt_STD_CONF2_setModCnf_QUERIES
 CODEqueryEtryPt_STD_CONF2_OMOD_QUERIES
+CODEqueryEtryPt_abortTransaction
 ENDqueryEtryPt
 
 
@@ -1365,6 +2326,7 @@ CODEmodInit_QueryRegCFSLineHdlr
 	CHKiRet(objUse(glbl, CORE_COMPONENT));
 	CHKiRet(objUse(errmsg, CORE_COMPONENT));
 	CHKiRet(objUse(net,LM_NET_FILENAME));
+	CHKiRet(objUse(statsobj, CORE_COMPONENT));
 
 	CHKiRet(regCfSysLineHdlr((uchar *)"actionforwarddefaulttemplate", 0, eCmdHdlrGetWord, setLegacyDfltTpl, NULL, NULL));
 	CHKiRet(regCfSysLineHdlr((uchar *)"actionsendtcprebindinterval", 0, eCmdHdlrInt, NULL, &cs.iTCPRebindInterval, NULL));
@@ -61,6 +61,7 @@
 #include "datetime.h"
 #include "dirty.h"
 #include "janitor.h"
+#include "trace.h"
 
 DEFobjCurrIf(obj)
 DEFobjCurrIf(prop)
@@ -847,6 +848,8 @@ submitMsg2(msg_t *pMsg)
 		FINALIZE;
 	}
 
+	if(traceSampleRate)
+		traceStart(pMsg);
 	qqueueEnqMsg(pQueue, pMsg->flowCtlType, pMsg);
 
 finalize_it:
@@ -862,6 +865,7 @@ multiSubmitMsg2(multi_submit_t *pMultiSub)
 {
 	qqueue_t *pQueue;
 	ruleset_t *pRuleset;
+	int i;
 	DEFiRet;
 	assert(pMultiSub != NULL);
 
@@ -878,6 +882,10 @@ multiSubmitMsg2(multi_submit_t *pMultiSub)
 		FINALIZE;
 	}
 
+	if(traceSampleRate) {
+		for(i = 0 ; i < pMultiSub->nElem ; ++i)
+			traceStart(pMultiSub->ppMsgs[i]);
+	}
 	iRet = pQueue->MultiEnq(pQueue, pMultiSub);
 	pMultiSub->nElem = 0;
 